@@ -0,0 +1,22 @@
+#!/bin/sh
+# headless layer2 tools for linux, built with the generic (software) GL.
+# run the tools from the repository root so that assets/ is found.
+#
+#   linux/layer2.sh                  build all tools
+#   linux/layer2.sh lsystems_batch   build one of them
+cd "$(dirname "$0")" || exit 1
+CXX=${CXX:-g++}
+CXXFLAGS=${CXXFLAGS:-"-O2 -w"}
+TOOLS=${*:-"lsystems_benchmark lsystems_batch load_benchmark"}
+for tool in $TOOLS; do
+  case $tool in
+    lsystems_benchmark) define=OCTET_LSYSTEMS_BENCHMARK ;;
+    lsystems_batch) define=OCTET_LSYSTEMS_BATCH ;;
+    lsystems_export) define=OCTET_LSYSTEMS_EXPORT ;;
+    load_benchmark) define=OCTET_LOAD_BENCHMARK ;;
+    containers_benchmark) define=OCTET_CONTAINERS_BENCHMARK ;;
+    *) echo "unknown tool $tool"; exit 1 ;;
+  esac
+  echo "building $tool"
+  $CXX -std=gnu++11 $CXXFLAGS -D __GENERIC__ -D $define -I ../src/physics ../src/examples/layer2/main.cpp -o $tool -lpthread || exit 1
+done
@@ -662,7 +662,7 @@ namespace octet
         curScope = saveScope;
 
         if( !expect( tok_rparen ) ) {
-          return false;
+          return NULL;
         }
         getNext();
       }
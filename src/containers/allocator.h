@@ -6,20 +6,192 @@
 //
 // game-style memory allocator
 //
-// this is a placeholder for a game-style memory allocator
-// using malloc and free is frowned upon in grown-up circles.
+// free() is told the size of the block, so there are no block headers.
 //
-// these functions are poor for the following reasons:
+// Blocks of up to max_small_size bytes come from pools, one per size class.
+// Each thread keeps its own free list for every class, so most calls take no
+// locks. A thread with too many free blocks of a class hands half of them to
+// a shared list, which is where other threads look before carving a new chunk.
+// Pool chunks are kept for the life of the program.
 //
-// 1) free() has to compute the size of the block to free
-// 2) these functions use heavy weight locks to guard the heap.
-// 3) implementations are quite variable
+// A thread that ends should call flush_thread() to hand its free blocks to
+// the shared lists (thread_pool workers do). Otherwise they are lost to the
+// other threads. Its cache and counters are kept for the totals.
+//
+// Bigger blocks go to the system heap.
+//
+// Build with OCTET_POOL_ALLOCATOR 0 to send everything to the system heap
+// (for memory checkers) and with OCTET_ALLOCATOR_CHECK 1 to check that every
+// free() and realloc() is given the size the block was allocated with.
+//
+// Heap statistics
+//
+// Every allocation has a tag, the one of the innermost allocator_tag_scope
+// on the thread or the one given to tagged_allocator<tag> by a container.
+// With OCTET_HEAP_STATS 1 (the default in _DEBUG builds) each block gets a
+// header with its size and tag, so that live bytes, peak bytes, counts and
+// size histograms are kept per tag, and every live block is on a list.
+// print_stats() and write_json() report on demand and the report is printed
+// at exit along with the blocks still allocated.
+//
+// Without heap stats, only the totals are kept, per thread without locks.
+//
+
+#ifndef OCTET_POOL_ALLOCATOR
+  #define OCTET_POOL_ALLOCATOR 1
+#endif
+
+#ifndef OCTET_ALLOCATOR_CHECK
+  #define OCTET_ALLOCATOR_CHECK 0
+#endif
+
+#ifndef OCTET_HEAP_STATS
+  #ifdef _DEBUG
+    #define OCTET_HEAP_STATS 1
+  #else
+    #define OCTET_HEAP_STATS 0
+  #endif
+#endif
+
+#ifndef OCTET_THREAD_LOCAL
+  #if defined(_MSC_VER)
+    #define OCTET_THREAD_LOCAL __declspec(thread)
+  #else
+    #define OCTET_THREAD_LOCAL __thread
+  #endif
+#endif
+
+#if defined(_MSC_VER)
+  #include <intrin.h>
+#endif
 
 namespace octet {
   class allocator {
+  public:
+    enum {
+      alignment = 16,
+      max_small_size = 2048,
+      chunk_size = 65536,
+      num_classes = 24,
+      num_histogram_buckets = 32,
+    };
+
+    // what the memory is for
+    enum tag_t {
+      tag_general,
+      tag_load,
+      tag_rewrite,
+      tag_geometry,
+      tag_texture,
+      tag_scene,
+      tag_xml,
+      tag_arena,
+      num_tags,
+    };
+
+    // heap statistics of one tag
+    struct tag_stats_t {
+      int64_t live_bytes;
+      int64_t peak_bytes;
+      uint64_t num_allocs;
+      uint64_t live_blocks;
+      uint64_t histogram[num_histogram_buckets];  // allocations of 2^n to 2^(n+1)-1 bytes
+    };
+
+  private:
+    struct block_t {
+      block_t *next;
+    };
+
+    // free blocks of one size class
+    struct free_list_t {
+      block_t *head;
+      unsigned count;
+    };
+
+    // pools and counters of the calling thread
+    struct thread_cache_t {
+      free_list_t lists[num_classes];
+
+      // unused end of the last chunk of each class
+      char *carve_pos[num_classes];
+      char *carve_end[num_classes];
+
+      // totals are summed over the threads when asked for
+      int64_t num_bytes;
+      int64_t peak_bytes;   // highest num_bytes since reset_peak_bytes()
+      uint64_t num_allocs;
+      uint64_t bytes_allocated;
+
+      unsigned tag;
+      thread_cache_t *next_cache;
+    };
+
+    #if OCTET_ALLOCATOR_CHECK || OCTET_HEAP_STATS
+      // in front of every block. header_size is rounded up to the alignment
+      // so that the block after it stays aligned (the header is 24 bytes on Win32).
+      struct header_t {
+        header_t *prev;
+        header_t *next;
+        uint32_t size;
+        uint32_t tag;
+        uint32_t serial;
+        uint32_t magic;
+      };
+      enum {
+        header_size = (sizeof(header_t) + alignment - 1) & ~(alignment - 1),
+        header_magic = 0x0c7e7a11
+      };
+      typedef char header_size_check[header_size % alignment == 0 ? 1 : -1];
+    #endif
+
     // singleton state, a bit like an old-world global variable
     struct state_t {
-      int num_bytes;
+      uint64_t pool_bytes;
+      thread_cache_t *caches;
+
+      #if OCTET_HEAP_STATS
+        // guarded by lock
+        tag_stats_t tags[num_tags];
+        int64_t live_bytes;
+        int64_t peak_bytes;
+        uint32_t serial;
+        header_t live;
+      #endif
+
+      // size class for each multiple of 16 bytes, and the block size of each class
+      unsigned char size_to_class[max_small_size / alignment + 1];
+      unsigned class_size[num_classes];
+
+      // blocks handed back by threads, guarded by lock
+      free_list_t shared[num_classes];
+      volatile long lock;
+
+      state_t() {
+        // 16 byte steps up to 128, then four classes for each power of two.
+        unsigned size = 0, step = alignment;
+        for (unsigned i = 0; i != num_classes; ++i) {
+          if (size >= 128 && (size & (size - 1)) == 0) step = size >> 2;
+          size += step;
+          class_size[i] = size;
+        }
+        unsigned cls = 0;
+        for (unsigned i = 0; i <= max_small_size / alignment; ++i) {
+          if (i * alignment > class_size[cls]) cls++;
+          size_to_class[i] = (unsigned char)cls;
+        }
+        memset(shared, 0, sizeof(shared));
+        lock = 0;
+        pool_bytes = 0;
+        caches = 0;
+        #if OCTET_HEAP_STATS
+          memset(tags, 0, sizeof(tags));
+          live_bytes = peak_bytes = 0;
+          serial = 0;
+          live.prev = live.next = &live;
+          atexit(report_at_exit);
+        #endif
+      }
     };
 
     static state_t &state() {
@@ -27,37 +199,519 @@ namespace octet {
       return instance;
     }
 
+    static void lock() {
+      #if defined(_MSC_VER)
+        while (_InterlockedExchange(&state().lock, 1)) {}
+      #else
+        while (__sync_lock_test_and_set(&state().lock, 1)) {}
+      #endif
+    }
+
+    static void unlock() {
+      #if defined(_MSC_VER)
+        _InterlockedExchange(&state().lock, 0);
+      #else
+        __sync_lock_release(&state().lock);
+      #endif
+    }
+
+    // _aligned_malloc is MSVC only, posix_memalign stands in on other platforms
+    static void *system_malloc(size_t size) {
+      #if defined(OCTET_SSE) && defined(_MSC_VER)
+        return ::_aligned_malloc(size, alignment);
+      #elif defined(OCTET_SSE)
+        void *ptr = 0;
+        return ::posix_memalign(&ptr, alignment, size) == 0 ? ptr : 0;
+      #else
+        return ::malloc(size);
+      #endif
+    }
+
+    static void system_free(void *ptr) {
+      #if defined(OCTET_SSE) && defined(_MSC_VER)
+        ::_aligned_free(ptr);
+      #else
+        ::free(ptr);
+      #endif
+    }
+
+    static void *system_realloc(void *ptr, size_t old_size, size_t size) {
+      #if defined(OCTET_SSE) && defined(_MSC_VER)
+        return ::_aligned_realloc(ptr, size, alignment);
+      #elif defined(OCTET_SSE)
+        // realloc does not keep the alignment, so copy to a new block
+        void *res = system_malloc(size);
+        if (res) {
+          if (ptr) memcpy(res, ptr, old_size < size ? old_size : size);
+          system_free(ptr);
+        }
+        return res;
+      #else
+        return ::realloc(ptr, size);
+      #endif
+    }
+
+    static thread_cache_t *get_cache() {
+      static OCTET_THREAD_LOCAL thread_cache_t *cache;
+      if (!cache) {
+        // kept after the thread ends, flush_thread() gives back its blocks
+        cache = (thread_cache_t*)system_malloc(sizeof(thread_cache_t));
+        memset(cache, 0, sizeof(thread_cache_t));
+        lock();
+        cache->next_cache = state().caches;
+        state().caches = cache;
+        unlock();
+      }
+      return cache;
+    }
+
+    // most free blocks a thread keeps of a class before sharing them
+    static unsigned get_cache_limit(unsigned cls) {
+      unsigned limit = chunk_size / state().class_size[cls];
+      return limit < 16 ? 16 : limit;
+    }
+
+    // move up to max_blocks blocks from the head of one list to another
+    static void move_blocks(free_list_t &dest, free_list_t &src, unsigned max_blocks) {
+      while (src.head && max_blocks--) {
+        block_t *b = src.head;
+        src.head = b->next;
+        src.count--;
+        b->next = dest.head;
+        dest.head = b;
+        dest.count++;
+      }
+    }
+
+    static void *pool_malloc(unsigned cls) {
+      thread_cache_t *cache = get_cache();
+      free_list_t &list = cache->lists[cls];
+      if (!list.head) {
+        unsigned size = state().class_size[cls];
+        if (cache->carve_pos[cls] && cache->carve_pos[cls] + size <= cache->carve_end[cls]) {
+          void *res = cache->carve_pos[cls];
+          cache->carve_pos[cls] += size;
+          return res;
+        }
+
+        free_list_t &shared = state().shared[cls];
+        if (shared.head) {
+          lock();
+          move_blocks(list, shared, get_cache_limit(cls) / 2);
+          unlock();
+        }
+
+        if (!list.head) {
+          char *chunk = (char*)system_malloc(chunk_size);
+          if (!chunk) return 0;
+          lock();
+          state().pool_bytes += chunk_size;
+          unlock();
+          cache->carve_pos[cls] = chunk + size;
+          cache->carve_end[cls] = chunk + chunk_size;
+          return chunk;
+        }
+      }
+
+      block_t *b = list.head;
+      list.head = b->next;
+      list.count--;
+      return b;
+    }
+
+    static void pool_free(void *ptr, unsigned cls) {
+      free_list_t &list = get_cache()->lists[cls];
+      block_t *b = (block_t*)ptr;
+      b->next = list.head;
+      list.head = b;
+      if (++list.count > get_cache_limit(cls)) {
+        lock();
+        move_blocks(state().shared[cls], list, list.count / 2);
+        unlock();
+      }
+    }
+
+    static unsigned get_class(size_t size) {
+      return state().size_to_class[(size + alignment - 1) / alignment];
+    }
+
+    static void *raw_malloc(size_t size) {
+      #if OCTET_POOL_ALLOCATOR
+        if (size <= max_small_size) {
+          return pool_malloc(get_class(size));
+        }
+      #endif
+      return system_malloc(size);
+    }
+
+    static void raw_free(void *ptr, size_t size) {
+      #if OCTET_POOL_ALLOCATOR
+        if (size <= max_small_size) {
+          return pool_free(ptr, get_class(size));
+        }
+      #endif
+      system_free(ptr);
+    }
+
+    static void *raw_realloc(void *ptr, size_t old_size, size_t size) {
+      #if OCTET_POOL_ALLOCATOR
+        bool old_small = old_size <= max_small_size;
+        bool new_small = size <= max_small_size;
+        if (old_small && new_small && get_class(old_size) == get_class(size)) {
+          return ptr;
+        } else if (old_small || new_small) {
+          void *res = raw_malloc(size);
+          if (res) {
+            memcpy(res, ptr, old_size < size ? old_size : size);
+            raw_free(ptr, old_size);
+          }
+          return res;
+        }
+      #endif
+      return system_realloc(ptr, old_size, size);
+    }
+
+    #if OCTET_ALLOCATOR_CHECK || OCTET_HEAP_STATS
+      static header_t *get_header(void *ptr) {
+        return (header_t*)((char*)ptr - header_size);
+      }
+
+      static void *get_block(header_t *h) {
+        return (char*)h + header_size;
+      }
+
+      static void check_size(header_t *h, size_t size, const char *where) {
+        if (h->magic != header_magic) {
+          printf("warning: allocator::%s: block %p was not allocated here\n", where, get_block(h));
+        } else if (h->size != size) {
+          printf("warning: allocator::%s: block %p has %d bytes, not %d\n", where, get_block(h), (int)h->size, (int)size);
+        }
+      }
+
+      static void *add_header(void *block, size_t size, unsigned tag) {
+        header_t *h = (header_t*)block;
+        h->size = (uint32_t)size;
+        h->tag = tag;
+        h->magic = header_magic;
+        h->prev = h->next = 0;
+        #if OCTET_HEAP_STATS
+          lock();
+          state_t &s = state();
+          h->serial = ++s.serial;
+          h->next = s.live.next;
+          h->prev = &s.live;
+          h->next->prev = h;
+          s.live.next = h;
+          tag_stats_t &t = s.tags[tag];
+          t.live_bytes += size;
+          if (t.live_bytes > t.peak_bytes) t.peak_bytes = t.live_bytes;
+          t.num_allocs++;
+          t.live_blocks++;
+          t.histogram[get_bucket(size)]++;
+          s.live_bytes += size;
+          if (s.live_bytes > s.peak_bytes) s.peak_bytes = s.live_bytes;
+          unlock();
+        #endif
+        return get_block(h);
+      }
+
+      static void remove_header(header_t *h) {
+        #if OCTET_HEAP_STATS
+          lock();
+          h->prev->next = h->next;
+          h->next->prev = h->prev;
+          tag_stats_t &t = state().tags[h->tag];
+          t.live_bytes -= h->size;
+          t.live_blocks--;
+          state().live_bytes -= h->size;
+          unlock();
+        #endif
+      }
+
+      static unsigned get_bucket(size_t size) {
+        unsigned bucket = 0;
+        while (size > 1 && bucket != num_histogram_buckets - 1) {
+          size >>= 1;
+          bucket++;
+        }
+        return bucket;
+      }
+    #endif
+
+    #if OCTET_HEAP_STATS
+      static void report_at_exit() {
+        print_stats();
+        print_leaks();
+      }
+    #endif
+
   public:
-    // todo: implement this from scratch using a pool allocator
     static void *malloc(size_t size) {
-      state().num_bytes += size;
-      #ifdef OCTET_SSE
-        void *res = ::_aligned_malloc(size, 16);
+      return malloc(size, get_cache()->tag);
+    }
+
+    static void *malloc(size_t size, unsigned tag) {
+      #if OCTET_ALLOCATOR_CHECK || OCTET_HEAP_STATS
+        void *block = raw_malloc(size + header_size);
+        if (!block) return 0;
+        void *res = add_header(block, size, tag);
       #else
-        void *res = ::malloc(size);
+        void *res = raw_malloc(size);
+        if (!res) return 0;
       #endif
-      //printf("malloc %p[%d] -> %d\n", res, size, state().num_bytes);
+      thread_cache_t *cache = get_cache();
+      cache->num_bytes += size;
+      if (cache->num_bytes > cache->peak_bytes) cache->peak_bytes = cache->num_bytes;
+      cache->num_allocs++;
+      cache->bytes_allocated += size;
       return res;
     }
 
     static void free(void *ptr, size_t size) {
-      state().num_bytes -= size;
-      //printf("free %p[%d] -> %d\n", ptr, size, state().num_bytes);
-      #ifdef OCTET_SSE
-        return ::_aligned_free(ptr);
+      if (!ptr) return;
+      get_cache()->num_bytes -= size;
+      #if OCTET_ALLOCATOR_CHECK || OCTET_HEAP_STATS
+        header_t *h = get_header(ptr);
+        check_size(h, size, "free");
+        remove_header(h);
+        h->magic = 0;
+        raw_free(h, size + header_size);
       #else
-        return ::free(ptr);
+        raw_free(ptr, size);
       #endif
     }
 
     static void *realloc(void *ptr, size_t old_size, size_t size) {
-      state().num_bytes += size - old_size;
-      #ifdef OCTET_SSE
-        void *res = ::_aligned_realloc(ptr, size, 16);
+      return realloc(ptr, old_size, size, get_cache()->tag);
+    }
+
+    // a block keeps the tag it was first allocated with.
+    // if there is not enough memory, returns null and ptr is left as it was.
+    static void *realloc(void *ptr, size_t old_size, size_t size, unsigned tag) {
+      if (!ptr) return malloc(size, tag);
+      #if OCTET_ALLOCATOR_CHECK || OCTET_HEAP_STATS
+        // the header is on the live list, so copy to a new block rather than
+        // move it, and only let go of the old block once we have the new one.
+        header_t *h = get_header(ptr);
+        check_size(h, old_size, "realloc");
+        unsigned old_tag = h->tag < num_tags ? h->tag : tag;
+        void *block = raw_malloc(size + header_size);
+        if (!block) return 0;
+        memcpy((char*)block + header_size, ptr, old_size < size ? old_size : size);
+        remove_header(h);
+        h->magic = 0;
+        raw_free(h, old_size + header_size);
+        void *res = add_header(block, size, old_tag);
+      #else
+        void *res = raw_realloc(ptr, old_size, size);
+        if (!res) return 0;
+      #endif
+      thread_cache_t *cache = get_cache();
+      cache->num_bytes += (int64_t)size - (int64_t)old_size;
+      if (cache->num_bytes > cache->peak_bytes) cache->peak_bytes = cache->num_bytes;
+      cache->num_allocs++;
+      cache->bytes_allocated += size;
+      return res;
+    }
+
+    // tag of allocations on this thread that are not given one
+    static unsigned get_tag() {
+      return get_cache()->tag;
+    }
+
+    static unsigned set_tag(unsigned tag) {
+      thread_cache_t *cache = get_cache();
+      unsigned old = cache->tag;
+      cache->tag = tag < num_tags ? tag : tag_general;
+      return old;
+    }
+
+    static const char *get_tag_name(unsigned tag) {
+      static const char *names[] = {
+        "general", "load", "rewrite", "geometry",
+        "texture", "scene", "xml", "arena",
+      };
+      return tag < num_tags ? names[tag] : "";
+    }
+
+    // give the free blocks of the calling thread to the other threads.
+    // call this before a thread ends.
+    static void flush_thread() {
+      #if OCTET_POOL_ALLOCATOR
+        thread_cache_t *cache = get_cache();
+        lock();
+        for (unsigned cls = 0; cls != num_classes; ++cls) {
+          free_list_t &shared = state().shared[cls];
+          move_blocks(shared, cache->lists[cls], ~0u);
+
+          // the unused end of the last chunk becomes free blocks too
+          unsigned size = state().class_size[cls];
+          while (cache->carve_pos[cls] && cache->carve_pos[cls] + size <= cache->carve_end[cls]) {
+            block_t *b = (block_t*)cache->carve_pos[cls];
+            b->next = shared.head;
+            shared.head = b;
+            shared.count++;
+            cache->carve_pos[cls] += size;
+          }
+          cache->carve_pos[cls] = cache->carve_end[cls] = 0;
+        }
+        unlock();
+      #endif
+    }
+
+    // bytes allocated and not yet freed.
+    // the counters of other threads may be a little behind.
+    static int64_t get_bytes_in_use() {
+      int64_t total = 0;
+      lock();
+      for (thread_cache_t *c = state().caches; c; c = c->next_cache) total += c->num_bytes;
+      unlock();
+      return total;
+    }
+
+    // calls to malloc() and realloc() so far, by all threads
+    static uint64_t get_num_allocs() {
+      uint64_t total = 0;
+      lock();
+      for (thread_cache_t *c = state().caches; c; c = c->next_cache) total += c->num_allocs;
+      unlock();
+      return total;
+    }
+
+    // total bytes asked for by malloc() and realloc() so far
+    static uint64_t get_bytes_allocated() {
+      uint64_t total = 0;
+      lock();
+      for (thread_cache_t *c = state().caches; c; c = c->next_cache) total += c->bytes_allocated;
+      unlock();
+      return total;
+    }
+
+    // true if the per tag statistics are kept
+    static bool has_stats() {
+      return OCTET_HEAP_STATS != 0;
+    }
+
+    // statistics of one tag, all zero without OCTET_HEAP_STATS
+    static tag_stats_t get_stats(unsigned tag) {
+      tag_stats_t res;
+      memset(&res, 0, sizeof(res));
+      #if OCTET_HEAP_STATS
+        if (tag < num_tags) {
+          lock();
+          res = state().tags[tag];
+          unlock();
+        }
+      #endif
+      return res;
+    }
+
+    // highest number of bytes in use at once since reset_peak_bytes().
+    // without OCTET_HEAP_STATS this is the sum of the peaks of each thread,
+    // which can be a little high when blocks are freed by other threads.
+    static int64_t get_peak_bytes() {
+      int64_t total = 0;
+      lock();
+      #if OCTET_HEAP_STATS
+        total = state().peak_bytes;
       #else
-        void *res = ::realloc(ptr, size);
+        for (thread_cache_t *c = state().caches; c; c = c->next_cache) total += c->peak_bytes;
+      #endif
+      unlock();
+      return total;
+    }
+
+    // start a new high-water mark from the bytes in use now
+    static void reset_peak_bytes() {
+      lock();
+      #if OCTET_HEAP_STATS
+        state().peak_bytes = state().live_bytes;
       #endif
-      //printf("realloc %p[%d] -> %p[%d] %d\n", ptr, old_size, res, size, state().num_bytes);
+      for (thread_cache_t *c = state().caches; c; c = c->next_cache) c->peak_bytes = c->num_bytes;
+      unlock();
+    }
+
+    // table of the tags with live, peak and total allocations
+    static void print_stats() {
+      printf("heap: %lld bytes in use, %llu allocations, %llu bytes allocated, %llu bytes of pools\n",
+        (long long)get_bytes_in_use(), (unsigned long long)get_num_allocs(), (unsigned long long)get_bytes_allocated(), (unsigned long long)get_pool_bytes()
+      );
+      #if OCTET_HEAP_STATS
+        printf("heap: peak %lld bytes\n", (long long)get_peak_bytes());
+        printf("  %-10s %12s %12s %10s %10s  %s\n", "tag", "live", "peak", "blocks", "allocs", "commonest size");
+        for (unsigned i = 0; i != num_tags; ++i) {
+          tag_stats_t t = get_stats(i);
+          if (!t.num_allocs) continue;
+          unsigned top = 0;
+          for (unsigned b = 1; b != num_histogram_buckets; ++b) {
+            if (t.histogram[b] > t.histogram[top]) top = b;
+          }
+          printf("  %-10s %12lld %12lld %10llu %10llu  %u-%u\n", get_tag_name(i),
+            (long long)t.live_bytes, (long long)t.peak_bytes, (unsigned long long)t.live_blocks,
+            (unsigned long long)t.num_allocs, top ? 1u << top : 0, (2u << top) - 1
+          );
+        }
+      #endif
+    }
+
+    // list the blocks still allocated, max_blocks of them at most
+    static void print_leaks(unsigned max_blocks = 20) {
+      #if OCTET_HEAP_STATS
+        lock();
+        state_t &s = state();
+        unsigned num_blocks = 0;
+        int64_t num_bytes = 0;
+        for (header_t *h = s.live.next; h != &s.live; h = h->next) {
+          if (num_blocks < max_blocks) {
+            printf("heap: leaked %p %u bytes tag %s allocation %u\n", get_block(h), h->size, get_tag_name(h->tag), h->serial);
+          }
+          num_blocks++;
+          num_bytes += h->size;
+        }
+        unlock();
+        if (num_blocks) {
+          printf("heap: %u blocks, %lld bytes still allocated\n", num_blocks, (long long)num_bytes);
+        }
+      #endif
+    }
+
+    // write the statistics as JSON
+    static bool write_json(const char *url) {
+      FILE *file = fopen(url, "wb");
+      if (!file) {
+        printf("warning: can't write %s\n", url);
+        return false;
+      }
+      fprintf(file, "{\n");
+      fprintf(file, "  \"bytes_in_use\": %lld,\n", (long long)get_bytes_in_use());
+      fprintf(file, "  \"num_allocs\": %llu,\n", (unsigned long long)get_num_allocs());
+      fprintf(file, "  \"bytes_allocated\": %llu,\n", (unsigned long long)get_bytes_allocated());
+      fprintf(file, "  \"pool_bytes\": %llu,\n", (unsigned long long)get_pool_bytes());
+      fprintf(file, "  \"peak_bytes\": %lld,\n", (long long)get_peak_bytes());
+      fprintf(file, "  \"tags\": [");
+      const char *sep = "\n";
+      for (unsigned i = 0; has_stats() && i != num_tags; ++i) {
+        tag_stats_t t = get_stats(i);
+        fprintf(file, "%s    { \"tag\": \"%s\", \"live_bytes\": %lld, \"peak_bytes\": %lld, \"live_blocks\": %llu, \"num_allocs\": %llu, \"histogram\": [",
+          sep, get_tag_name(i), (long long)t.live_bytes, (long long)t.peak_bytes,
+          (unsigned long long)t.live_blocks, (unsigned long long)t.num_allocs
+        );
+        for (unsigned b = 0; b != num_histogram_buckets; ++b) {
+          fprintf(file, b ? ", %llu" : "%llu", (unsigned long long)t.histogram[b]);
+        }
+        fprintf(file, "] }");
+        sep = ",\n";
+      }
+      fprintf(file, "\n  ]\n}\n");
+      fclose(file);
+      return true;
+    }
+
+    // bytes of pool chunks taken from the system
+    static uint64_t get_pool_bytes() {
+      lock();
+      uint64_t res = state().pool_bytes;
+      unlock();
       return res;
     }
 
@@ -68,5 +722,34 @@ namespace octet {
       ::free(::malloc(32));
     }
   };
+
+  // tags the allocations of this thread until the end of the block
+  class allocator_tag_scope {
+    unsigned prev;
+  public:
+    allocator_tag_scope(unsigned tag) {
+      prev = allocator::set_tag(tag);
+    }
+
+    ~allocator_tag_scope() {
+      allocator::set_tag(prev);
+    }
+  };
+
+  // allocator for containers whose memory always has the same tag
+  template <unsigned tag> class tagged_allocator {
+  public:
+    static void *malloc(size_t size) {
+      return allocator::malloc(size, tag);
+    }
+
+    static void free(void *ptr, size_t size) {
+      allocator::free(ptr, size);
+    }
+
+    static void *realloc(void *ptr, size_t old_size, size_t size) {
+      return allocator::realloc(ptr, old_size, size, tag);
+    }
+  };
 }
 
@@ -0,0 +1,240 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Andy Thomason 2012, 2013
+//
+// Modular Framework for OpenGLES2 rendering on multiple platforms.
+//
+// Linear memory arena for short lived allocations
+//
+// malloc() bumps a pointer and free() does nothing, reset() throws away
+// everything at once and keeps the chunks for next time. Good for work that
+// lives for a frame or an iteration.
+//
+// example:
+//
+//   arena scratch;
+//   for (each frame) {
+//     arena_scope scope(scratch);
+//     dynarray<vec3, arena_allocator> points;   // memory comes from scratch
+//     ...
+//   }                                           // and all goes back here
+//
+// arena::get_thread_scratch() is a scratch arena for each thread.
+//
+
+namespace octet {
+  class arena {
+    struct chunk_t {
+      chunk_t *next;
+      size_t size;
+    };
+
+    enum { header_size = 16 };
+
+    chunk_t *chunks;    // in order of use
+    chunk_t *current;
+    char *pos;
+    char *end;
+    size_t chunk_size;
+    size_t max_chunk_size;
+
+    static arena *&current_arena() {
+      static OCTET_THREAD_LOCAL arena *value;
+      return value;
+    }
+
+    char *get_data(chunk_t *c) const {
+      return (char*)c + header_size;
+    }
+
+    void use_chunk(chunk_t *c) {
+      current = c;
+      pos = get_data(c);
+      end = pos + c->size;
+    }
+
+    // move on to the next chunk with room for size bytes, adding one if needed
+    void next_chunk(size_t size) {
+      chunk_t *prev = current;
+      chunk_t *c = current ? current->next : chunks;
+      while (c && c->size < size) {
+        prev = c;
+        c = c->next;
+      }
+      if (!c) {
+        size_t bytes = size > chunk_size ? size : chunk_size;
+        c = (chunk_t*)allocator::malloc(bytes + header_size, allocator::tag_arena);
+        c->size = bytes;
+        c->next = 0;
+        if (prev) prev->next = c; else chunks = c;
+        if (chunk_size < max_chunk_size) chunk_size *= 2;
+      }
+      use_chunk(c);
+    }
+
+  public:
+    // where to go back to with rewind()
+    struct mark_t {
+      chunk_t *chunk;
+      char *pos;
+    };
+
+    // with max_chunk_size, each new chunk is twice the last up to that size,
+    // so small arenas stay small.
+    arena(size_t chunk_size = 65536, size_t max_chunk_size = 0) {
+      chunks = current = 0;
+      pos = end = 0;
+      this->chunk_size = chunk_size;
+      this->max_chunk_size = max_chunk_size;
+    }
+
+    ~arena() {
+      release();
+    }
+
+    void *malloc(size_t size, size_t align = allocator::alignment) {
+      char *res = (char*)(((size_t)pos + align - 1) & ~(align - 1));
+      if (!pos || res + size > end) {
+        next_chunk(size + align);
+        res = (char*)(((size_t)pos + align - 1) & ~(align - 1));
+      }
+      pos = res + size;
+      return res;
+    }
+
+    // the last block can shrink and grow in place
+    void *realloc(void *ptr, size_t old_size, size_t size) {
+      if (ptr && (char*)ptr + old_size == pos && (char*)ptr + size <= end) {
+        pos = (char*)ptr + size;
+        return ptr;
+      }
+      void *res = malloc(size);
+      if (ptr) memcpy(res, ptr, old_size < size ? old_size : size);
+      return res;
+    }
+
+    // only the last block is given back
+    void free(void *ptr, size_t size) {
+      if ((char*)ptr + size == pos) {
+        pos = (char*)ptr;
+      }
+    }
+
+    // true if ptr is in one of the chunks
+    bool owns(const void *ptr) const {
+      for (chunk_t *c = chunks; c; c = c->next) {
+        if ((const char*)ptr >= get_data(c) && (const char*)ptr < get_data(c) + c->size) return true;
+      }
+      return false;
+    }
+
+    mark_t get_mark() const {
+      mark_t mark = { current, pos };
+      return mark;
+    }
+
+    // free everything allocated since the mark was taken
+    void rewind(const mark_t &mark) {
+      if (mark.chunk) {
+        current = mark.chunk;
+        pos = mark.pos;
+        end = get_data(current) + current->size;
+      } else {
+        reset();
+      }
+    }
+
+    // free everything, keeping the chunks
+    void reset() {
+      current = 0;
+      pos = end = 0;
+    }
+
+    // give the chunks back to the allocator
+    void release() {
+      while (chunks) {
+        chunk_t *next = chunks->next;
+        allocator::free(chunks, chunks->size + header_size);
+        chunks = next;
+      }
+      reset();
+    }
+
+    // bytes of chunks held
+    size_t get_capacity() const {
+      size_t total = 0;
+      for (chunk_t *c = chunks; c; c = c->next) total += c->size;
+      return total;
+    }
+
+    // scratch arena of the calling thread, kept for the life of the program
+    static arena &get_thread_scratch() {
+      static OCTET_THREAD_LOCAL arena *scratch;
+      if (!scratch) {
+        scratch = new (allocator::malloc(sizeof(arena)), dynarray_dummy_t()) arena();
+      }
+      return *scratch;
+    }
+
+    // the arena of the innermost arena_scope on this thread, or null
+    static arena *get_current() {
+      return current_arena();
+    }
+
+    static arena *set_current(arena *a) {
+      arena *old = current_arena();
+      current_arena() = a;
+      return old;
+    }
+  };
+
+  // makes an arena current on this thread and rewinds it at the end of the block
+  class arena_scope {
+    arena &a;
+    arena *prev;
+    arena::mark_t mark;
+
+    arena_scope &operator=(const arena_scope &);
+  public:
+    arena_scope(arena &a_) : a(a_) {
+      mark = a.get_mark();
+      prev = arena::set_current(&a);
+    }
+
+    ~arena_scope() {
+      arena::set_current(prev);
+      a.rewind(mark);
+    }
+  };
+
+  // allocator for containers that uses the current arena.
+  // the container must not outlive the arena_scope it was filled in.
+  // outside any scope it falls back to the octet allocator.
+  class arena_allocator {
+  public:
+    static void *malloc(size_t size) {
+      arena *a = arena::get_current();
+      return a ? a->malloc(size) : allocator::malloc(size);
+    }
+
+    static void free(void *ptr, size_t size) {
+      arena *a = arena::get_current();
+      if (a && a->owns(ptr)) {
+        a->free(ptr, size);
+      } else if (ptr) {
+        allocator::free(ptr, size);
+      }
+    }
+
+    static void *realloc(void *ptr, size_t old_size, size_t size) {
+      arena *a = arena::get_current();
+      if (!a) return allocator::realloc(ptr, old_size, size);
+      if (!ptr || a->owns(ptr)) return a->realloc(ptr, old_size, size);
+      void *res = a->malloc(size);
+      memcpy(res, ptr, old_size < size ? old_size : size);
+      allocator::free(ptr, old_size);
+      return res;
+    }
+  };
+}
+
@@ -19,38 +19,42 @@
 //
 // int annes_age = my_dict["anne"];
 //
+// Keys can also be looked up by pointer and length, so a word in the middle
+// of a buffer needs no copy, and with a hash from calc_hash() so a key used
+// many times is only hashed once:
+//
+// unsigned hash = dictionary<int>::calc_hash("anne", 4);
+// int *age = my_dict.find("anne", 4, hash);   // null if not there
+//
+// bool added;
+// int &count = my_dict.find_or_insert(word, word_len, added);  // one probe
+//
+// Keys live in an arena owned by the dictionary, so they don't move
+// and get_key() pointers stay good until reset().
+//
 namespace octet {
   template <class value_t, class allocator_t=allocator> class dictionary {
-    struct entry_t { const char *key; unsigned hash; value_t value; };
+    struct entry_t { const char *key; unsigned length; unsigned hash; value_t value; };
     entry_t *entries;
     unsigned num_entries;
     unsigned max_entries;
-  
-    // hash is a compromise between fewer collisions and
-    // faster hash calculation.
-    unsigned calc_hash( const char *key ) {
-      unsigned hash = 0;
-      for (int i = 0; key[i]; ++i) {
-        hash = ( hash << 5 ) ^ ( hash << 3 ) ^ (key[i] & 0xff);
-      }
-      return hash;
-    }
-  
+    arena keys;
+
     // internal method to find an entry for a key
-    entry_t *find( const char *key, unsigned hash ) {
+    entry_t *find_entry( const char *key, unsigned length, unsigned hash ) {
       unsigned mask = max_entries - 1;
       for (unsigned i = 0; i != max_entries; ++i) {
         entry_t *entry = &entries[ ( i + hash ) & mask ];
         if (!entry->key) {
           return entry;
         }
-        if (entry->hash == hash && !strcmp(entry->key, key)) {
+        if (entry->hash == hash && entry->length == length && !memcmp(entry->key, key, length)) {
           return entry;
         }
       }
       return 0;
     }
-  
+
     // grow the dictionary when needed
     void expand() {
       entry_t *old_entries = entries;
@@ -61,8 +65,9 @@ namespace octet {
       for (unsigned i = 0; i != old_max_entries; ++i) {
         entry_t *old_entry = &old_entries[i];
         if (old_entry->key) {
-          entry_t *new_entry = find(old_entry->key, old_entry->hash);
-          *new_entry = *old_entry;
+          // move the value with memcpy, it is not destroyed in the old table
+          entry_t *new_entry = find_entry(old_entry->key, old_entry->length, old_entry->hash);
+          memcpy((void*)new_entry, (const void*)old_entry, sizeof(entry_t));
         }
       }
       allocator_t::free(old_entries, sizeof(entry_t) * old_max_entries);
@@ -70,11 +75,9 @@ namespace octet {
 
     void release() {
       for (unsigned i = 0; i != max_entries; ++i) {
-        entry_t *entry = &entries[i];
-        if (entry->key ) {
-          allocator_t::free((void*)entry->key, strlen(entry->key)+1);
-        }
+        if (entries[i].key) entries[i].value.~value_t();
       }
+      keys.release();
       allocator_t::free(entries, sizeof(entry_t) * max_entries);
       entries = 0;
       num_entries = 0;
@@ -89,34 +92,87 @@ namespace octet {
     }
   public:
     // make a new dictionary
-    dictionary() {
+    dictionary() : keys(256, 65536) {
       init();
     }
 
-    // index the dictionary
-    value_t &operator[]( const char *key ) {
-      unsigned hash = calc_hash( key );
-      entry_t *entry = find( key, hash );
-      if (!entry || !entry->key) {
+    // hash is FNV-1a with a final mix so that the low bits,
+    // which pick the slot, depend on every character.
+    static unsigned calc_hash( const char *key, unsigned length ) {
+      unsigned hash = 2166136261u;
+      for (unsigned i = 0; i != length; ++i) {
+        hash = ( hash ^ (key[i] & 0xff) ) * 16777619u;
+      }
+      hash ^= hash >> 16;
+      hash *= 0x85ebca6b;
+      hash ^= hash >> 13;
+      return hash;
+    }
+
+    static unsigned calc_hash( const char *key ) {
+      return calc_hash( key, (unsigned)strlen(key) );
+    }
+
+    // find the value for a key, adding a zero value if it is not there.
+    // added is set if the key is new. Only adding a key can grow the
+    // dictionary, so finding one leaves other value references good.
+    value_t &find_or_insert( const char *key, unsigned length, unsigned hash, bool &added ) {
+      entry_t *entry = find_entry( key, length, hash );
+      added = !entry->key;
+      if (added) {
         // reducing this ratio decreases hot search time at the
         // expense of size (cold search time).
-        if (num_entries > max_entries * 3 / 4) {
+        if (num_entries >= max_entries * 3 / 4) {
           expand();
-          entry = find(key, hash);
+          entry = find_entry( key, length, hash );
         }
         num_entries++;
-        size_t bytes = strlen(key) + 1;
-        entry->key = (char *)allocator_t::malloc(bytes);
+        char *new_key = (char *)keys.malloc(length + 1, 1);
+        memcpy(new_key, key, length);
+        new_key[length] = 0;
+        entry->key = new_key;
+        entry->length = length;
         entry->hash = hash;
-        memcpy((void*)entry->key, key, bytes);
       }
       return entry->value;
     }
 
+    value_t &find_or_insert( const char *key, unsigned length, bool &added ) {
+      return find_or_insert( key, length, calc_hash( key, length ), added );
+    }
+
+    value_t &find_or_insert( const char *key, bool &added ) {
+      unsigned length = (unsigned)strlen(key);
+      return find_or_insert( key, length, calc_hash( key, length ), added );
+    }
+
+    // index the dictionary
+    value_t &operator[]( const char *key ) {
+      bool added;
+      return find_or_insert( key, added );
+    }
+
+    // pointer to the value for a key or null if it is not there
+    value_t *find( const char *key, unsigned length, unsigned hash ) {
+      entry_t *entry = find_entry( key, length, hash );
+      return entry && entry->key ? &entry->value : 0;
+    }
+
+    value_t *find( const char *key, unsigned length ) {
+      return find( key, length, calc_hash( key, length ) );
+    }
+
+    value_t *find( const char *key ) {
+      unsigned length = (unsigned)strlen(key);
+      return find( key, length, calc_hash( key, length ) );
+    }
+
     bool contains(const char *key) {
-      unsigned hash = calc_hash( key );
-      entry_t *entry = find( key, hash );
-      return entry && entry->key;
+      return find( key ) != 0;
+    }
+
+    bool contains(const char *key, unsigned length) {
+      return find( key, length ) != 0;
     }
 
     // how many entries are used?
@@ -135,6 +191,12 @@ namespace octet {
       return entries[index].key;
     }
 
+    // length of a specific key
+    unsigned get_key_length(unsigned index) const {
+      assert(index < max_entries);
+      return entries[index].length;
+    }
+
     // access a specific value
     value_t &get_value(unsigned index) {
       assert(index < max_entries);
@@ -142,8 +204,8 @@ namespace octet {
     }
 
     int get_index(const char *key) {
-      unsigned hash = calc_hash( key );
-      entry_t *entry = find( key, hash );
+      unsigned length = (unsigned)strlen(key);
+      entry_t *entry = find_entry( key, length, calc_hash( key, length ) );
       return entry && entry->key ? (int)(entry - entries) : -1;
     }
 
@@ -152,10 +214,10 @@ namespace octet {
       release();
       init();
     }
-  
+
     // bye bye dictionary. Use the allocator to free up memory.
     ~dictionary() {
-      reset();
+      release();
     }
   };
 }
@@ -15,10 +15,62 @@
 //
 //   // now treat the array like an ordinary array.
 //   printf("%d\n", my_array[1]);
+//
+// Items that are relocatable (see is_relocatable below) are moved with
+// realloc and memmove when the array grows or items are inserted and erased.
+// Other items are move constructed one at a time.
+//
+// An array of plain data can borrow() memory it does not own, such as part of
+// a mapped file. It is read and written in place, copied out the first time
+// the array has to grow and never freed by the array. The owner of the memory
+// is told through dynarray_borrow when the array stops using it.
+
+// rvalue references (move semantics) are in VS2010 and C++11 compilers
+#ifndef OCTET_RVALUE_REFS
+  #if __cplusplus >= 201103L || (defined(_MSC_VER) && _MSC_VER >= 1600)
+    #define OCTET_RVALUE_REFS 1
+  #else
+    #define OCTET_RVALUE_REFS 0
+  #endif
+#endif
 
+// true if a type can be copied with memcpy and needs no destructor
+#if defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 5)
+  #define OCTET_IS_TRIVIALLY_COPYABLE(T) __is_trivially_copyable(T)
+#elif defined(_MSC_VER) || defined(__GNUC__)
+  #define OCTET_IS_TRIVIALLY_COPYABLE(T) (__has_trivial_copy(T) && __has_trivial_destructor(T))
+#else
+  #define OCTET_IS_TRIVIALLY_COPYABLE(T) 0
+#endif
 
 // dynamic array class similar to std::vector
 namespace octet {
+  // An item is relocatable if it can be moved to a new address with memcpy,
+  // forgetting the old copy without running its destructor. Plain data is
+  // always relocatable. Classes that only point to what they own (string,
+  // ref, dynarray) are too but need to say so:
+  //
+  //   template <> struct is_relocatable<my_class> { enum { value = 1 }; };
+  //
+  template <class item_t> struct is_relocatable {
+    enum { value = OCTET_IS_TRIVIALLY_COPYABLE(item_t) };
+  };
+
+  // owners of memory that arrays borrow, such as mapped_file, set on_release()
+  // to count the arrays still using it. It is called once for each borrow().
+  struct dynarray_borrow {
+    typedef void (*release_fn)(const void *data);
+
+    static release_fn &on_release() {
+      static release_fn fn;
+      return fn;
+    }
+
+    static void release(const void *data) {
+      if (on_release()) on_release()(data);
+    }
+  };
+
   template <class item_t, class allocator_t=allocator, bool use_new_delete=true> class dynarray {
     item_t *data_;
     typedef unsigned int_size_t;
@@ -26,8 +78,28 @@ namespace octet {
     int_size_t capacity_;
     enum { min_capacity = 8 };
 
-    dynarray(const dynarray &rhs) {
-      // you can't do this at the moment!
+    // these are functions, not enums, so that item_t can be incomplete
+    // when the dynarray is declared.
+    static bool items_are_trivial() { return !use_new_delete || OCTET_IS_TRIVIALLY_COPYABLE(item_t); }
+    static bool items_are_relocatable() { return !use_new_delete || octet::is_relocatable<item_t>::value; }
+
+    #if OCTET_RVALUE_REFS
+      static item_t &&rvalue(item_t &value) { return static_cast<item_t&&>(value); }
+    #else
+      static item_t &rvalue(item_t &value) { return value; }
+    #endif
+
+    // make room for at least min_size items, doubling so that
+    // push_back and append are amortised O(1)
+    void grow(int_size_t min_size) {
+      int_size_t new_capacity = capacity_ == 0 ? min_capacity : capacity_ * 2;
+      while (new_capacity < min_size) new_capacity *= 2;
+      reserve(new_capacity);
+    }
+
+    // index of ptr if it points into this array, else ~0
+    int_size_t index_of(const item_t *ptr) const {
+      return ptr >= data_ && ptr < data_ + size_ ? (int_size_t)(ptr - data_) : ~(int_size_t)0;
     }
 
   public:
@@ -38,10 +110,48 @@ namespace octet {
     }
 
     dynarray(int_size_t size) {
-      data_ = (item_t*)allocator::malloc(size * sizeof(item_t));
-      size_ = capacity_ = size;
+      data_ = 0;
+      size_ = capacity_ = 0;
+      resize(size);
+    }
+
+    dynarray(const dynarray &rhs) {
+      data_ = 0;
+      size_ = capacity_ = 0;
+      append(rhs.data_, rhs.size_);
+    }
+
+    dynarray &operator=(const dynarray &rhs) {
+      if (this != &rhs) {
+        resize(0);
+        append(rhs.data_, rhs.size_);
+      }
+      return *this;
     }
 
+    #if OCTET_RVALUE_REFS
+      // take the items of rhs, leaving it empty
+      dynarray(dynarray &&rhs) {
+        data_ = rhs.data_;
+        size_ = rhs.size_;
+        capacity_ = rhs.capacity_;
+        rhs.data_ = 0;
+        rhs.size_ = rhs.capacity_ = 0;
+      }
+
+      dynarray &operator=(dynarray &&rhs) {
+        if (this != &rhs) {
+          reset();
+          data_ = rhs.data_;
+          size_ = rhs.size_;
+          capacity_ = rhs.capacity_;
+          rhs.data_ = 0;
+          rhs.size_ = rhs.capacity_ = 0;
+        }
+        return *this;
+      }
+    #endif
+
     ~dynarray() {
       reset();
     }
@@ -68,36 +178,112 @@ namespace octet {
     iterator end() {
       return iterator(this, size_);
     }
-  
+
     iterator insert(iterator it, const item_t &new_item) {
-      int_size_t old_length = size_;
-      resize(size_+1);
-      for (int_size_t i = old_length; i != it.elem; --i) {
-        data_[i] = data_[i-1];
+      // new_item may be one of ours and about to move
+      item_t tmp(new_item);
+      dynarray_dummy_t x;
+      int_size_t pos = it.elem;
+      if (size_ >= capacity_) grow(size_ + 1);
+      if (items_are_relocatable()) {
+        memmove((void*)(data_ + pos + 1), (void*)(data_ + pos), (size_ - pos) * sizeof(item_t));
+        new (data_ + pos, x) item_t(rvalue(tmp));
+      } else {
+        new (data_ + size_, x) item_t;
+        for (int_size_t i = size_; i != pos; --i) {
+          data_[i] = rvalue(data_[i-1]);
+        }
+        data_[pos] = rvalue(tmp);
       }
-      data_[it.elem] = new_item;
+      size_++;
       return it;
     }
 
     iterator erase(iterator it) {
-      for (int_size_t i = it.elem; i < size_-1; ++i) {
-        data_[i] = data_[i+1];
-      }
-      resize(size_-1);
+      erase(it.elem);
       return it;
     }
-  
+
     void erase(unsigned elem) {
-      for (int_size_t i = elem; i < size_-1; ++i) {
-        data_[i] = data_[i+1];
+      if (items_are_relocatable()) {
+        if (use_new_delete) data_[elem].~item_t();
+        memmove((void*)(data_ + elem), (void*)(data_ + elem + 1), (size_ - elem - 1) * sizeof(item_t));
+        size_--;
+      } else {
+        for (int_size_t i = elem; i < size_-1; ++i) {
+          data_[i] = rvalue(data_[i+1]);
+        }
+        resize(size_-1);
       }
-      resize(size_-1);
     }
-  
+
     void push_back(const item_t &new_item) {
-      int_size_t old_length = size_;
-      resize(size_+1);
-      data_[old_length] = new_item;
+      dynarray_dummy_t x;
+      if (size_ >= capacity_) {
+        // new_item may be one of ours, find it again after growing
+        int_size_t index = index_of(&new_item);
+        grow(size_ + 1);
+        new (data_ + size_, x) item_t(index == ~(int_size_t)0 ? new_item : data_[index]);
+      } else {
+        new (data_ + size_, x) item_t(new_item);
+      }
+      size_++;
+    }
+
+    #if OCTET_RVALUE_REFS
+      void push_back(item_t &&new_item) {
+        dynarray_dummy_t x;
+        if (size_ >= capacity_) {
+          int_size_t index = index_of(&new_item);
+          grow(size_ + 1);
+          new (data_ + size_, x) item_t(rvalue(index == ~(int_size_t)0 ? new_item : data_[index]));
+        } else {
+          new (data_ + size_, x) item_t(rvalue(new_item));
+        }
+        size_++;
+      }
+    #endif
+
+    // construct a new item in place at the end and return it.
+    // the arguments must not be items of this array.
+    item_t &emplace_back() {
+      dynarray_dummy_t x;
+      if (size_ >= capacity_) grow(size_ + 1);
+      new (data_ + size_, x) item_t;
+      return data_[size_++];
+    }
+
+    template <class arg0_t> item_t &emplace_back(const arg0_t &arg0) {
+      dynarray_dummy_t x;
+      if (size_ >= capacity_) grow(size_ + 1);
+      new (data_ + size_, x) item_t(arg0);
+      return data_[size_++];
+    }
+
+    template <class arg0_t, class arg1_t> item_t &emplace_back(const arg0_t &arg0, const arg1_t &arg1) {
+      dynarray_dummy_t x;
+      if (size_ >= capacity_) grow(size_ + 1);
+      new (data_ + size_, x) item_t(arg0, arg1);
+      return data_[size_++];
+    }
+
+    // copy num_items items to the end, with memcpy for plain data
+    void append(const item_t *items, int_size_t num_items) {
+      if (num_items == 0) return;
+      if (size_ + num_items > capacity_) {
+        int_size_t index = index_of(items);
+        grow(size_ + num_items);
+        if (index != ~(int_size_t)0) items = data_ + index;
+      }
+      if (items_are_trivial()) {
+        memcpy((void*)(data_ + size_), (const void*)items, num_items * sizeof(item_t));
+      } else {
+        dynarray_dummy_t x;
+        for (int_size_t i = 0; i != num_items; ++i) {
+          new (data_ + size_ + i, x) item_t(items[i]);
+        }
+      }
+      size_ += num_items;
     }
 
     item_t &back() const {
@@ -107,17 +293,17 @@ namespace octet {
     bool is_empty() const {
       return size_ == 0;
     }
-  
+
     item_t &operator[](int_size_t elem) { return data_[elem]; }
     const item_t &operator[](int_size_t elem) const { return data_[elem]; }
-  
+
     int_size_t size() const { return size_; }
 
     int_size_t capacity() const { return capacity_; }
 
     const item_t *data() const { return data_; }
     item_t *data() { return data_; }
-  
+
     void resize(int_size_t new_length) {
       bool trace = false; // hack this for detailed traces
       dynarray_dummy_t x;
@@ -166,25 +352,50 @@ namespace octet {
       }
     }
 
+    // like resize(), but new items of plain data are left uninitialized
+    // for the caller to fill in, eg. with fread() or memcpy().
+    void resize_uninitialized(int_size_t new_length) {
+      if (!items_are_trivial()) {
+        resize(new_length);
+      } else {
+        if (new_length > capacity_) reserve(new_length);
+        size_ = new_length;
+      }
+    }
+
     void reserve(int_size_t new_capacity) {
-      if (new_capacity >= size_) {
-        dynarray_dummy_t x;
-        item_t *new_data = (item_t *)allocator_t::malloc(sizeof(item_t) * new_capacity);
-      
-        if (use_new_delete) {
-          // initialize new data_ elements from old ones
+      if (is_borrowed()) {
+        // copy the items out of memory we do not own
+        if (new_capacity < size_) new_capacity = size_;
+        item_t *new_data = new_capacity ? (item_t *)allocator_t::malloc(sizeof(item_t) * new_capacity) : 0;
+        memcpy((void*)new_data, (const void*)data_, size_ * sizeof(item_t));
+        dynarray_borrow::release(data_);
+        data_ = new_data;
+        capacity_ = new_capacity;
+      } else if (new_capacity >= size_ && new_capacity != capacity_) {
+        if (new_capacity == 0) {
+          allocator_t::free(data_, capacity_ * sizeof(item_t));
+          data_ = 0;
+        } else if (items_are_relocatable()) {
+          // move the items with the block
+          data_ = (item_t *)allocator_t::realloc(data_, capacity_ * sizeof(item_t), new_capacity * sizeof(item_t));
+        } else {
+          dynarray_dummy_t x;
+          item_t *new_data = (item_t *)allocator_t::malloc(sizeof(item_t) * new_capacity);
+
+          // move the items one at a time
           for (int_size_t i = 0; i != size_; ++i) {
-            new (new_data + i, x) item_t(data_[i]);
+            new (new_data + i, x) item_t(rvalue(data_[i]));
             data_[i].~item_t();
           }
-        }
 
-        // free up data_
-        if (data_) {
-          allocator_t::free(data_, capacity_ * sizeof(item_t));
-        }
+          // free up data_
+          if (data_) {
+            allocator_t::free(data_, capacity_ * sizeof(item_t));
+          }
 
-        data_ = new_data;
+          data_ = new_data;
+        }
         capacity_ = new_capacity;
       }
     }
@@ -192,6 +403,7 @@ namespace octet {
     void pop_back() {
       //assert(size_ != 0);
       size_--;
+      if (use_new_delete) data_[size_].~item_t();
     }
 
     void reset() {
@@ -200,13 +412,40 @@ namespace octet {
           data_[i].~item_t();
         }
       }
-      if (data_) {
+      if (data_ && capacity_) {
         allocator_t::free(data_, capacity_ * sizeof(item_t));
+      } else if (data_) {
+        dynarray_borrow::release(data_);
       }
       data_ = 0;
       size_ = 0;
       capacity_ = 0;
     }
+
+    // use size items at data without copying them. data must stay valid
+    // until the array is reset or grows. Only plain data can be borrowed,
+    // other items are copied.
+    void borrow(item_t *data, int_size_t size) {
+      reset();
+      if (items_are_trivial() && size) {
+        data_ = data;
+        size_ = size;
+      } else {
+        append(data, size);
+        if (data) dynarray_borrow::release(data);
+      }
+    }
+
+    // true if the items are in memory the array does not own.
+    // borrowed memory has items but no capacity.
+    bool is_borrowed() const {
+      return capacity_ == 0 && data_ != 0;
+    }
+  };
+
+  template <class item_t, class allocator_t, bool use_new_delete>
+  struct is_relocatable<dynarray<item_t, allocator_t, use_new_delete> > {
+    enum { value = 1 };
   };
 
   // dumbarray:
@@ -214,4 +453,3 @@ namespace octet {
   /*template <class item_t, class allocator_t=allocator> class dumbarray : public dynarray<item_t, allocator_t, false> {
   };*/
 }
-
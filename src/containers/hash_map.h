@@ -6,8 +6,6 @@
 //
 // map key_t to value_t.
 //
-// strings and values are owned by the dictionary.
-//
 // A hash map is like a dictionary in JavaScript or Python, but works with only one type of key and value.
 //
 // example:
@@ -17,143 +15,361 @@
 //   int x = chars_to_int["x"];
 //   int y = chars_to_int["y"];
 //
+// Keys and values are plain data: new values start as zero bytes and
+// no constructors or destructors are run.
+//
+// Each slot has a control byte, 0x80 if the slot is empty or seven bits of
+// the hash if it is used. Lookups try the slot the hash points at first, then
+// scan sixteen control bytes at a time (with SSE2 where there is one) from
+// there, so most keys are found with one compare. Probing is linear, so erase() can move
+// the rest of the run back instead of leaving tombstones.
+//
+// iteration:
+//   for (unsigned i = 0; i != map.size(); ++i) {
+//     if (map.is_used(i)) printf("%d\n", map.value(i));
+//   }
+//
+
+#if !defined(OCTET_HASH_MAP_SSE2)
+  #if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define OCTET_HASH_MAP_SSE2 1
+  #else
+    #define OCTET_HASH_MAP_SSE2 0
+  #endif
+#endif
+
+#if OCTET_HASH_MAP_SSE2
+  #include <emmintrin.h>
+#endif
+#if defined(_MSC_VER)
+  #include <intrin.h>
+#endif
+
 namespace octet {
 
   class hash_map_cmp {
   public:
-    // mix in some bits from higher positions to lower positions
-    static unsigned fuzz_hash(unsigned hash) { return hash ^ (hash >> 3) ^ (hash >> 5); }
+    // mix the bits so that every bit of the key affects every bit of the hash
+    // (the murmur3 finaliser)
+    static unsigned fuzz_hash(unsigned hash) {
+      hash ^= hash >> 16;
+      hash *= 0x85ebca6b;
+      hash ^= hash >> 13;
+      hash *= 0xc2b2ae35;
+      hash ^= hash >> 16;
+      return hash;
+    }
 
-    static unsigned get_hash(void *key) { return fuzz_hash((unsigned)(intptr_t)key); }
+    // 64 bit keys below 2^32 hash the same as the 32 bit ones
+    static unsigned get_hash(uint64_t key) { return fuzz_hash((unsigned)key ^ fuzz_hash((unsigned)(key >> 32))); }
+    static unsigned get_hash(void *key) { return get_hash((uint64_t)(uintptr_t)key); }
     static unsigned get_hash(int key) { return fuzz_hash((unsigned)key); }
     static unsigned get_hash(unsigned key) { return fuzz_hash((unsigned)key); }
-    static unsigned get_hash(uint64_t key) { return fuzz_hash((unsigned)(key ^ (key >> 32))); }
 
+    // the map keeps track of empty slots itself, so zero is a valid key.
+    // these are kept for older cmp classes.
     static bool is_empty(void *key) { return !key; }
     static bool is_empty(int key) { return !key; }
     static bool is_empty(unsigned key) { return !key; }
     static bool is_empty(uint64_t key) { return !key; }
 
-    //template <typename T> static bool equals(const T &lhs, const T &rhs) { return lhs == rhs; }
+    // a map can be searched with any type that has a get_hash() here and
+    // compares with key_t.
+    template <typename lhs_t, typename rhs_t> static bool equals(const lhs_t &lhs, const rhs_t &rhs) { return lhs == rhs; }
+  };
+
+  // sixteen control bytes, compared all at once
+  class hash_map_group {
+    #if OCTET_HASH_MAP_SSE2
+      __m128i ctrl;
+    #else
+      const uint8_t *ctrl;
+    #endif
+  public:
+    enum { size = 16 };
+
+    hash_map_group(const uint8_t *pos) {
+      #if OCTET_HASH_MAP_SSE2
+        ctrl = _mm_loadu_si128((const __m128i*)pos);
+      #else
+        ctrl = pos;
+      #endif
+    }
+
+    // bit i is set if control byte i is h2
+    unsigned match(uint8_t h2) const {
+      #if OCTET_HASH_MAP_SSE2
+        return (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8((char)h2), ctrl));
+      #else
+        unsigned mask = 0;
+        for (unsigned i = 0; i != size; ++i) mask |= (ctrl[i] == h2) << i;
+        return mask;
+      #endif
+    }
+
+    // bit i is set if slot i is empty
+    unsigned match_empty() const {
+      #if OCTET_HASH_MAP_SSE2
+        return (unsigned)_mm_movemask_epi8(ctrl);
+      #else
+        unsigned mask = 0;
+        for (unsigned i = 0; i != size; ++i) mask |= (ctrl[i] >> 7) << i;
+        return mask;
+      #endif
+    }
+
+    // index of the lowest set bit of a non-zero mask
+    static unsigned lowest_bit(unsigned mask) {
+      #if defined(_MSC_VER)
+        unsigned long index;
+        _BitScanForward(&index, mask);
+        return (unsigned)index;
+      #elif defined(__GNUC__)
+        return (unsigned)__builtin_ctz(mask);
+      #else
+        unsigned index = 0;
+        while (!(mask & 1)) { mask >>= 1; index++; }
+        return index;
+      #endif
+    }
   };
 
   template <typename key_t, typename value_t, class cmp_t=hash_map_cmp, class allocator_t=allocator> class hash_map {
     // internal gubbins to implement the hash map
     struct entry_t { key_t key; unsigned hash; value_t value; };
 
+    enum {
+      empty = 0x80,
+      group_size = hash_map_group::size,
+      min_entries = group_size,
+    };
+
     entry_t *entries;
+    uint8_t *ctrl;          // a byte for each slot, then a copy of the first group_size-1
     unsigned num_entries;
-    unsigned max_entries;
+    unsigned max_entries;   // number of slots, a power of two
+    unsigned max_used;      // grow when num_entries reaches this
+    float max_load_factor;
+
+    hash_map(const hash_map &);
+    hash_map &operator=(const hash_map &);
+
+    static uint8_t get_h2(unsigned hash) { return (uint8_t)(hash >> 25); }
+
+    static size_t get_bytes(unsigned max_entries) {
+      return sizeof(entry_t) * max_entries + max_entries + group_size - 1;
+    }
 
-    // internal method to find an existing key in the map
-    entry_t *find( const key_t &key, unsigned hash ) {
+    // the copy at the end lets a group start at any slot
+    void set_ctrl(unsigned slot, uint8_t value) {
+      ctrl[slot] = value;
+      if (slot < group_size - 1) ctrl[max_entries + slot] = value;
+    }
+
+    // slot of an existing key or -1
+    template <typename lookup_t> int find_slot(const lookup_t &key, unsigned hash) const {
       unsigned mask = max_entries - 1;
-      for (unsigned i = 0; i != max_entries; ++i) {
-        entry_t *entry = &entries[ ( i + hash ) & mask ];
-        if (cmp_t::is_empty(entry->key)) {
-          return entry;
-        }
-        if (entry->hash == hash && entry->key == key) {
-          return entry;
+      uint8_t h2 = get_h2(hash);
+      unsigned pos = hash & mask;
+
+      // most keys are in the slot their hash points at. The address of that
+      // entry does not depend on the control bytes, as it does in the group
+      // scan, so its cache miss can overlap theirs.
+      const entry_t &home = entries[pos];
+      if (ctrl[pos] == h2 && home.hash == hash && cmp_t::equals(home.key, key)) {
+        return (int)pos;
+      }
+
+      for (unsigned probed = 0; probed < max_entries; probed += group_size) {
+        hash_map_group group(ctrl + pos);
+        unsigned match = group.match(h2);
+        unsigned empty_mask = group.match_empty();
+        // the key can only be before the first empty slot
+        if (empty_mask) match &= (empty_mask & (0 - empty_mask)) - 1;
+        while (match) {
+          unsigned slot = (pos + hash_map_group::lowest_bit(match)) & mask;
+          const entry_t &entry = entries[slot];
+          if (entry.hash == hash && cmp_t::equals(entry.key, key)) {
+            return (int)slot;
+          }
+          match &= match - 1;
         }
+        if (empty_mask) break;
+        pos = (pos + group_size) & mask;
+      }
+      return -1;
+    }
+
+    // first empty slot at or after where the hash points
+    unsigned find_empty(unsigned hash) const {
+      unsigned mask = max_entries - 1;
+      unsigned pos = hash & mask;
+      for (;;) {
+        unsigned empty_mask = hash_map_group(ctrl + pos).match_empty();
+        if (empty_mask) return (pos + hash_map_group::lowest_bit(empty_mask)) & mask;
+        pos = (pos + group_size) & mask;
+      }
+    }
+
+    entry_t *insert(const key_t &key, unsigned hash) {
+      if (num_entries >= max_used) {
+        rehash(max_entries * 2);
       }
-      assert(0 && "hash_map: all entries are used. expand() did not get called");
-      return 0;
+      unsigned slot = find_empty(hash);
+      set_ctrl(slot, get_h2(hash));
+      entry_t *entry = &entries[slot];
+      entry->key = key;
+      entry->hash = hash;
+      num_entries++;
+      return entry;
     }
-  
-    // increase the size of the map if we have run out of space
-    void expand() {
+
+    void allocate(unsigned new_max_entries) {
+      max_entries = new_max_entries;
+      entries = (entry_t *)allocator_t::malloc(get_bytes(max_entries));
+      memset(entries, 0, sizeof(entry_t) * max_entries);
+      ctrl = (uint8_t *)(entries + max_entries);
+      memset(ctrl, empty, max_entries + group_size - 1);
+      max_used = (unsigned)(max_entries * max_load_factor);
+      if (max_used >= max_entries) max_used = max_entries - 1;
+    }
+
+    // move everything to a table of new_max_entries slots
+    void rehash(unsigned new_max_entries) {
       entry_t *old_entries = entries;
+      uint8_t *old_ctrl = ctrl;
       unsigned old_max_entries = max_entries;
-      entries = (entry_t *)allocator_t::malloc(sizeof(entry_t) * max_entries*2);
-      memset(entries, 0, sizeof(entry_t) * max_entries*2);
-      max_entries *= 2;
+      allocate(new_max_entries);
       for (unsigned i = 0; i != old_max_entries; ++i) {
-        entry_t *old_entry = &old_entries[i];
-        if (!cmp_t::is_empty(old_entry->key)) {
-          entry_t *new_entry = find(old_entry->key, old_entry->hash);
-          *new_entry = *old_entry;
+        if (!(old_ctrl[i] & empty)) {
+          unsigned slot = find_empty(old_entries[i].hash);
+          set_ctrl(slot, old_ctrl[i]);
+          memcpy((void*)&entries[slot], (void*)&old_entries[i], sizeof(entry_t));
         }
       }
-      allocator_t::free(old_entries, sizeof(entry_t) * old_max_entries);
+      allocator_t::free(old_entries, get_bytes(old_max_entries));
     }
 
     void release() {
-      allocator_t::free(entries, sizeof(entry_t) * max_entries);
+      allocator_t::free(entries, get_bytes(max_entries));
       entries = 0;
+      ctrl = 0;
       num_entries = 0;
       max_entries = 0;
     }
 
     void init() {
       num_entries = 0;
-      max_entries = 4;
-      entries = (entry_t*)allocator_t::malloc(sizeof(entry_t) * max_entries);
-      memset(entries, 0, sizeof(entry_t) * max_entries);
+      allocate(min_entries);
     }
   public:
     // allocate a small map for starters that has a small number of elements.
     hash_map() {
+      max_load_factor = 0.75f;
       init();
     }
-  
+
+    // remove all the keys, keeping the memory
     void clear() {
-      release();
-      init();
+      memset(entries, 0, sizeof(entry_t) * max_entries);
+      memset(ctrl, empty, max_entries + group_size - 1);
+      num_entries = 0;
+    }
+
+    // make room for num keys without growing
+    void reserve(unsigned num) {
+      unsigned new_max_entries = max_entries;
+      while ((unsigned)(new_max_entries * max_load_factor) < num + 1) new_max_entries *= 2;
+      if (new_max_entries != max_entries) rehash(new_max_entries);
+    }
+
+    // fraction of the slots that can be used before the map doubles.
+    // lower is faster, higher uses less memory.
+    void set_max_load_factor(float value) {
+      max_load_factor = value < 0.25f ? 0.25f : value > 0.9375f ? 0.9375f : value;
+      max_used = (unsigned)(max_entries * max_load_factor);
+      if (max_used >= max_entries) max_used = max_entries - 1;
+      reserve(num_entries);
     }
-  
-    // access the 
+
+    float get_max_load_factor() const {
+      return max_load_factor;
+    }
+
+    // access the value for a key, adding a zero value if it is not there
     // eg. my_map["fred"]
     value_t &operator[]( const key_t &key ) {
       unsigned hash = cmp_t::get_hash(key);
-      entry_t *entry = find( key, hash );
-      if (cmp_t::is_empty(entry->key)) {
-        // reducing this ratio decreases hot search time at the
-        // expense of size (cold search time).
-        if (num_entries >= max_entries * 3 / 4) {
-          expand();
-          entry = find(key, hash);
-        }
-        num_entries++;
-        entry->key = key;
-        entry->hash = hash;
-      }
-      return entry->value;
+      int slot = find_slot(key, hash);
+      return slot >= 0 ? entries[slot].value : insert(key, hash)->value;
     }
 
-    bool contains(const key_t &key) {
-      unsigned hash = cmp_t::get_hash(key);
-      entry_t *entry = find( key, hash );
-      return !cmp_t::is_empty(entry->key);
+    // pointer to the value for a key or null if it is not there
+    template <typename lookup_t> value_t *find(const lookup_t &key) {
+      int slot = find_slot(key, cmp_t::get_hash(key));
+      return slot >= 0 ? &entries[slot].value : 0;
     }
 
-    int get_index(const key_t &key) {
-      unsigned hash = cmp_t::get_hash(key);
-      entry_t *entry = find( key, hash );
-      return entry ? (int)(entry - entries) : -1;
+    template <typename lookup_t> const value_t *find(const lookup_t &key) const {
+      int slot = find_slot(key, cmp_t::get_hash(key));
+      return slot >= 0 ? &entries[slot].value : 0;
+    }
+
+    template <typename lookup_t> bool contains(const lookup_t &key) const {
+      return find_slot(key, cmp_t::get_hash(key)) >= 0;
+    }
+
+    // remove a key. returns false if it was not there.
+    bool erase(const key_t &key) {
+      int found = find_slot(key, cmp_t::get_hash(key));
+      if (found < 0) return false;
+
+      // move later keys of the run back over the hole if their
+      // home slot is at or before it
+      unsigned mask = max_entries - 1;
+      unsigned hole = (unsigned)found;
+      for (unsigned next = (hole + 1) & mask; !(ctrl[next] & empty); next = (next + 1) & mask) {
+        unsigned home = entries[next].hash & mask;
+        if (((next - home) & mask) >= ((next - hole) & mask)) {
+          memcpy((void*)&entries[hole], (void*)&entries[next], sizeof(entry_t));
+          set_ctrl(hole, ctrl[next]);
+          hole = next;
+        }
+      }
+      set_ctrl(hole, empty);
+      memset((void*)&entries[hole], 0, sizeof(entry_t));
+      num_entries--;
+      return true;
+    }
+
+    // index of a key for get_key() and get_value() or -1 if it is not there
+    template <typename lookup_t> int get_index(const lookup_t &key) const {
+      return find_slot(key, cmp_t::get_hash(key));
     }
 
     const key_t &get_key(int index) const {
-      assert(index >= 0 && index < max_entries);
+      assert(index >= 0 && (unsigned)index < max_entries);
       return entries[index].key;
     }
 
     const value_t &get_value(int index) const {
-      assert(index >= 0 && index < max_entries);
+      assert(index >= 0 && (unsigned)index < max_entries);
       return entries[index].value;
     }
 
     // bye bye hash map
     ~hash_map() {
-      allocator_t::free(entries, sizeof(entry_t) * max_entries);
-      entries = 0;
-      num_entries = 0;
-      max_entries = 0;
+      release();
     }
 
+    // number of keys in the map
+    unsigned get_size() const { return num_entries; }
+
     // stl-style iterators are bloated. This is a simpler iterator scheme
-    unsigned size() { return max_entries; }
-    key_t key(unsigned i) { return entries[i].key; }
-    value_t value(unsigned i) { return entries[i].value; }
+    // size() is the number of slots, some of which are empty.
+    unsigned size() const { return max_entries; }
+    bool is_used(unsigned i) const { return !(ctrl[i] & empty); }
+    key_t key(unsigned i) const { return entries[i].key; }
+    value_t value(unsigned i) const { return entries[i].value; }
   };
 }
@@ -20,7 +20,7 @@ namespace octet {
       item = 0;
     }
 
-    ref(ref &rhs) {
+    ref(const ref &rhs) {
       item = rhs.item;
       if (item) item->add_ref();
     }
@@ -68,4 +68,9 @@ namespace octet {
       item = 0;
     }
   };
+
+  // a ref only holds a pointer, so dynarray can move it with memcpy
+  template <class item_t, class allocator_t> struct is_relocatable<ref<item_t, allocator_t> > {
+    enum { value = 1 };
+  };
 }
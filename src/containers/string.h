@@ -15,14 +15,23 @@
 namespace octet {
   class string {
     char *data_;
+    size_t bytes_;  // allocated, the text may hold a zero before the end
 
     static char *null_string() { static char c; return &c; }
 
+    // containers such as dictionary hand out zero filled strings, treat those as empty
     void release() {
-      if (data_ != null_string()) {
-        allocator::free((void*)data_, size() + 1);
-        data_ = null_string();
+      if (data_ && data_ != null_string()) {
+        allocator::free((void*)data_, bytes_);
       }
+      data_ = null_string();
+      bytes_ = 0;
+    }
+
+    // a new block for size characters and the terminator
+    void allocate(size_t size) {
+      data_ = (char*)allocator::malloc(size + 1);
+      bytes_ = size + 1;
     }
 
     // When dealing with windows or java, we will come across the less popular
@@ -136,30 +145,34 @@ namespace octet {
       return num_bytes;
     }
   public:
-    string() { data_ = null_string(); }
+    string() { data_ = null_string(); bytes_ = 0; }
 
-    string(const char *value) { data_ = null_string(); *this = value; }
-    string(const wchar_t *value) { data_ = null_string(); *this = value; }
-    string(const string& rhs) { data_ = null_string(); *this = rhs.c_str(); }
-    string(const char *value, unsigned size) { data_ = null_string(); set(value, size); }
+    string(const char *value) { data_ = null_string(); bytes_ = 0; *this = value; }
+    string(const wchar_t *value) { data_ = null_string(); bytes_ = 0; *this = value; }
+    string(const string& rhs) { data_ = null_string(); bytes_ = 0; *this = rhs.c_str(); }
+    string(const char *value, unsigned size) { data_ = null_string(); bytes_ = 0; set(value, size); }
 
     ~string() { release(); }
 
+    // the arguments may point into this string
     string &format(const char *fmt, ...) {
-      release();
+      string_builder b;
       va_list v;
       va_start(v, fmt);
-      #ifdef WIN32
-        int len = _vscprintf(fmt, v);
-        if (len) {
-          data_ = (char*)allocator::malloc(len+1);
-          vsprintf_s(data_, len+1, fmt, v);
-        }
-      #else
-        char tmp[1024];
-        vsnprintf(tmp, sizeof(tmp)-1, fmt, v);
-        *this = tmp;
-      #endif
+      b.append_vformat(fmt, v);
+      va_end(v);
+      return take(b);
+    }
+
+    // move the text out of a string_builder, leaving it empty
+    string &take(string_builder &b) {
+      size_t size;
+      char *data = b.detach(size);
+      release();
+      if (data) {
+        data_ = data;
+        bytes_ = size + 1;
+      }
       return *this;
     }
 
@@ -169,7 +182,7 @@ namespace octet {
       if (value) {
         unsigned size = urldecode_impl(0, value);
         if (size) {
-          data_ = (char*)allocator::malloc(size+1);
+          allocate(size);
           urldecode_impl(data_, value);
         }
       }
@@ -182,7 +195,7 @@ namespace octet {
       if (value) {
         unsigned size = urlencode_impl(0, value);
         if (size) {
-          data_ = (char*)allocator::malloc(size+1);
+          allocate(size);
           urlencode_impl(data_, value);
         }
       }
@@ -191,14 +204,16 @@ namespace octet {
 
     // utf8 strings - unix, mac and the web
     string &operator=(const char *value) {
-      release();
-      if (value) {
-        size_t size = strlen(value);
-        if (size) {
-          data_ = (char*)allocator::malloc(size+1);
-          memcpy((char*)data_, value, size+1);
-        }
+      // value may point into this string, so copy before releasing
+      char *data = null_string();
+      size_t size = value ? strlen(value) : 0;
+      if (size) {
+        data = (char*)allocator::malloc(size+1);
+        memcpy(data, value, size+1);
       }
+      release();
+      data_ = data;
+      bytes_ = size ? size + 1 : 0;
       return *this;
     }
 
@@ -208,20 +223,20 @@ namespace octet {
       if (value) {
         unsigned size = utf16_to_utf8(0, value);
         if (size) {
-          data_ = (char*)allocator::malloc(size+1);
+          allocate(size);
           utf16_to_utf8(data_, value);
         }
       }
       return *this;
     }
 
-    string &operator=(const string& rhs) { data_ = null_string(); *this = rhs.c_str(); return *this; }
+    string &operator=(const string& rhs) { return *this = rhs.c_str(); }
 
     string &set(const char *value, unsigned size) {
       release();
       if (value) {
         if (size) {
-          data_ = (char*)allocator::malloc(size+1);
+          allocate(size);
           memcpy((char*)data_, value, size);
           data_[size] = 0;
         }
@@ -232,11 +247,8 @@ namespace octet {
     string &truncate(int new_len) {
       int size = (int)strlen(data_);
       if (new_len < size) {
-        if (data_ == null_string()) {
-          data_ = (char*)allocator::malloc(new_len+1);
-        } else {
-          data_ = (char*)allocator::realloc((void*)data_, size+1, new_len+1);
-        }
+        data_ = (char*)allocator::realloc((void*)data_, bytes_, new_len+1);
+        bytes_ = new_len+1;
         data_[new_len] = 0;
       }
       return *this;
@@ -252,9 +264,10 @@ namespace octet {
         size_t data_size = strlen(data_);
         size_t rhs_size = strlen(rhs);
         if (data_ == null_string()) {
-          data_ = (char*)allocator::malloc(data_size+rhs_size+1);
+          allocate(data_size+rhs_size);
         } else {
-          data_ = (char*)allocator::realloc(data_, data_size + 1, data_size+rhs_size+1);
+          data_ = (char*)allocator::realloc(data_, bytes_, data_size+rhs_size+1);
+          bytes_ = data_size+rhs_size+1;
         }
         memcpy(data_ + data_size, rhs, rhs_size+1);
       }
@@ -271,6 +284,7 @@ namespace octet {
         memcpy(new_data + pos + rhs_size, data_, data_size - pos + 1);
         release();
         data_ = new_data;
+        bytes_ = data_size+rhs_size+1;
       }
       return *this;
     }
@@ -331,4 +345,9 @@ namespace octet {
       result.back() = cur;
     }
   };
+
+  // a string only holds a pointer and a size, so dynarray can move it with memcpy
+  template <> struct is_relocatable<string> {
+    enum { value = 1 };
+  };
 }
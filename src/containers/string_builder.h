@@ -0,0 +1,313 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Andy Thomason 2012, 2013
+//
+// Modular Framework for OpenGLES2 rendering on multiple platforms.
+//
+// Growable text buffers for assembling large strings
+//
+// string_builder keeps its length and capacity and doubles when it runs
+// out, so appending is amortised O(1). string::take() moves the text into a
+// string without copying it.
+//
+// example:
+//
+//   string_builder b;
+//   b.append("hello ").append_format("%d", 42);
+//   string s;
+//   s.take(b);
+//
+// if memory runs out the text stops growing and failed() returns true.
+//
+// string_rope holds the text in fixed size chunks that are never moved, for
+// text too big to sit in one block.
+//
+
+#if defined(_MSC_VER) && !defined(va_copy)
+  // va_list is a plain pointer on msvc
+  #define va_copy(dest, src) ((dest) = (src))
+#endif
+
+namespace octet {
+  class string_builder {
+    char *data_;
+    size_t size_;
+    size_t capacity_;   // bytes allocated, including the terminator
+    bool failed_;
+
+    enum { min_capacity = 32 };
+
+    string_builder(const string_builder &);
+    string_builder &operator=(const string_builder &);
+
+    // room for min_size characters, false if there is not enough memory
+    bool grow(size_t min_size) {
+      if (min_size > max_size()) {
+        failed_ = true;
+        return false;
+      }
+      size_t new_capacity = capacity_ < min_capacity ? min_capacity : capacity_;
+      while (new_capacity < min_size + 1) {
+        new_capacity = new_capacity <= max_size() / 2 ? new_capacity * 2 : min_size + 1;
+      }
+      return reserve(new_capacity - 1);
+    }
+
+  public:
+    string_builder(size_t capacity = 0) {
+      data_ = 0;
+      size_ = capacity_ = 0;
+      failed_ = false;
+      if (capacity) reserve(capacity);
+    }
+
+    ~string_builder() {
+      reset();
+    }
+
+    // largest number of characters the builder will hold
+    static size_t max_size() {
+      return ((size_t)-1) / 2;
+    }
+
+    // make room for size characters without reallocating.
+    // false, leaving the text as it was, if there is not enough memory.
+    bool reserve(size_t size) {
+      if (size > max_size()) {
+        failed_ = true;
+        return false;
+      }
+      if (size + 1 > capacity_) {
+        char *data = (char*)allocator::realloc(data_, capacity_, size + 1);
+        if (!data) {
+          failed_ = true;
+          return false;
+        }
+        data_ = data;
+        capacity_ = size + 1;
+        data_[size_] = 0;
+      }
+      return true;
+    }
+
+    // value may point into the builder
+    string_builder &append(const char *value, size_t len) {
+      if (len > max_size() - size_) {
+        failed_ = true;
+        return *this;
+      }
+      if (size_ + len + 1 > capacity_) {
+        bool inside = data_ && value >= data_ && value < data_ + capacity_;
+        size_t offset = inside ? value - data_ : 0;
+        if (!grow(size_ + len)) return *this;
+        if (inside) value = data_ + offset;
+      }
+      memmove(data_ + size_, value, len);
+      size_ += len;
+      data_[size_] = 0;
+      return *this;
+    }
+
+    string_builder &append(const char *value) {
+      return value ? append(value, strlen(value)) : *this;
+    }
+
+    string_builder &append(char chr) {
+      if (size_ + 2 > capacity_ && !grow(size_ + 1)) return *this;
+      data_[size_++] = chr;
+      data_[size_] = 0;
+      return *this;
+    }
+
+    string_builder &operator+=(const char *value) { return append(value); }
+    string_builder &operator+=(char chr) { return append(chr); }
+
+    // append printf-style formatted text
+    string_builder &append_vformat(const char *fmt, va_list v) {
+      va_list v2;
+      va_copy(v2, v);
+      #ifdef WIN32
+        int len = _vscprintf(fmt, v2);
+      #else
+        int len = vsnprintf(NULL, 0, fmt, v2);
+      #endif
+      va_end(v2);
+      if (len > 0) {
+        if (size_ + len + 1 > capacity_ && !grow(size_ + len)) return *this;
+        #ifdef WIN32
+          vsprintf_s(data_ + size_, len + 1, fmt, v);
+        #else
+          vsnprintf(data_ + size_, len + 1, fmt, v);
+        #endif
+        size_ += len;
+      }
+      return *this;
+    }
+
+    string_builder &append_format(const char *fmt, ...) {
+      va_list v;
+      va_start(v, fmt);
+      append_vformat(fmt, v);
+      va_end(v);
+      return *this;
+    }
+
+    // shorten to len characters
+    void truncate(size_t len) {
+      if (len < size_) {
+        size_ = len;
+        data_[size_] = 0;
+      }
+    }
+
+    // empty the text but keep the memory
+    void clear() {
+      truncate(0);
+    }
+
+    // empty the text and free the memory
+    void reset() {
+      if (data_) allocator::free(data_, capacity_);
+      data_ = 0;
+      size_ = capacity_ = 0;
+      failed_ = false;
+    }
+
+    // hand over the text, cut at the first zero and in a block of exactly
+    // size + 1 bytes, leaving the builder empty. returns null if there is no
+    // text or the block could not be shrunk.
+    char *detach(size_t &size) {
+      if (data_) {
+        const char *zero = (const char*)memchr(data_, 0, size_);
+        if (zero) size_ = (size_t)(zero - data_);
+      }
+      if (size_ == 0) {
+        reset();
+        size = 0;
+        return 0;
+      }
+      // shrinking can still fail, then the text stays in the builder
+      char *res = (char*)allocator::realloc(data_, capacity_, size_ + 1);
+      if (!res) {
+        failed_ = true;
+        size = 0;
+        return 0;
+      }
+      size = size_;
+      data_ = 0;
+      size_ = capacity_ = 0;
+      failed_ = false;
+      return res;
+    }
+
+    size_t size() const { return size_; }
+    size_t capacity() const { return capacity_ ? capacity_ - 1 : 0; }
+    bool is_empty() const { return size_ == 0; }
+
+    // true if some text was dropped because memory ran out
+    bool failed() const { return failed_; }
+
+    const char *c_str() const { return data_ ? data_ : ""; }
+    char *data() { return data_; }
+
+    char &operator[](size_t index) { return data_[index]; }
+    char operator[](size_t index) const { return data_[index]; }
+  };
+
+  class string_rope {
+    dynarray<char*> chunks;
+    uint64_t size_;
+    unsigned chunk_size;
+
+    string_rope(const string_rope &);
+    string_rope &operator=(const string_rope &);
+
+  public:
+    string_rope(unsigned chunk_size = 1 << 20) {
+      size_ = 0;
+      this->chunk_size = chunk_size;
+    }
+
+    ~string_rope() {
+      reset();
+    }
+
+    string_rope &append(const char *value, size_t len) {
+      while (len) {
+        unsigned offset = (unsigned)(size_ % chunk_size);
+        if (offset == 0 && size_ / chunk_size == chunks.size()) {
+          chunks.push_back((char*)allocator::malloc(chunk_size));
+        }
+        size_t bytes = chunk_size - offset < len ? chunk_size - offset : len;
+        memcpy(chunks[(unsigned)(size_ / chunk_size)] + offset, value, bytes);
+        value += bytes;
+        len -= bytes;
+        size_ += bytes;
+      }
+      return *this;
+    }
+
+    string_rope &append(const char *value) {
+      return value ? append(value, strlen(value)) : *this;
+    }
+
+    string_rope &append(const string_builder &value) {
+      return append(value.c_str(), value.size());
+    }
+
+    string_rope &operator+=(const char *value) { return append(value); }
+
+    uint64_t size() const { return size_; }
+
+    char operator[](uint64_t index) const {
+      return chunks[(unsigned)(index / chunk_size)][index % chunk_size];
+    }
+
+    // the chunks with text in order. all but the last are full.
+    // after clear() more chunks may be allocated than are in use.
+    unsigned get_num_chunks() const {
+      return (unsigned)((size_ + chunk_size - 1) / chunk_size);
+    }
+
+    const char *get_chunk(unsigned index, unsigned &len) const {
+      uint64_t start = (uint64_t)index * chunk_size;
+      len = (unsigned)(size_ - start < chunk_size ? size_ - start : chunk_size);
+      return chunks[index];
+    }
+
+    // copy len characters from pos to dest
+    void copy(char *dest, uint64_t pos, size_t len) const {
+      while (len) {
+        unsigned offset = (unsigned)(pos % chunk_size);
+        size_t bytes = chunk_size - offset < len ? chunk_size - offset : len;
+        memcpy(dest, chunks[(unsigned)(pos / chunk_size)] + offset, bytes);
+        dest += bytes;
+        pos += bytes;
+        len -= bytes;
+      }
+    }
+
+    bool write(FILE *file) const {
+      for (unsigned i = 0; i != get_num_chunks(); ++i) {
+        unsigned len;
+        const char *chunk = get_chunk(i, len);
+        if (fwrite(chunk, 1, len, file) != len) return false;
+      }
+      return true;
+    }
+
+    // keep the chunks for more text
+    void clear() {
+      size_ = 0;
+    }
+
+    void reset() {
+      for (unsigned i = 0; i != chunks.size(); ++i) {
+        allocator::free(chunks[i], chunk_size);
+      }
+      chunks.reset();
+      size_ = 0;
+    }
+  };
+}
+
@@ -66,8 +66,7 @@ namespace octet {
       mat4t modelToProjection = mat4t::build_projection_matrix(modelToWorld, cameraToWorld);
 
       // set up opengl to draw textured triangles using sampler 0 (GL_TEXTURE0)
-      glActiveTexture(GL_TEXTURE0);
-      glBindTexture(GL_TEXTURE_2D, texture);
+      gl_state::bind_texture(0, GL_TEXTURE_2D, texture);
 
       shader.render(modelToProjection, 0);
 
@@ -94,8 +93,8 @@ namespace octet {
 
       glVertexAttribPointer(attribute_pos, 2, GL_FLOAT, GL_FALSE, 4*sizeof(float), (void*)vertices );
       glVertexAttribPointer(attribute_uv, 2, GL_FLOAT, GL_FALSE, 4*sizeof(float), (void*)(vertices + 2) );
-      glEnableVertexAttribArray(attribute_pos);
-      glEnableVertexAttribArray(attribute_uv);
+      gl_state::enable_attrib(attribute_pos, true);
+      gl_state::enable_attrib(attribute_uv, true);
    
       // finally, draw the sprite as a fan
       glDrawArrays(GL_TRIANGLE_FAN, 0, count);
@@ -225,11 +224,11 @@ namespace octet {
       glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
       // don't allow Z buffer depth testing (closer objects are always drawn in front of far ones)
-      glDisable(GL_DEPTH_TEST);
+      gl_state::enable(GL_DEPTH_TEST, false);
 
       // allow alpha blend (transparency when alpha channel is 0)
-      glEnable(GL_BLEND);
-      glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+      gl_state::enable(GL_BLEND, true);
+      gl_state::blend_func(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
       // draw all the sprites
       for (int i = 0; i != sprites.size(); ++i) {
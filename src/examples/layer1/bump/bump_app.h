@@ -76,10 +76,10 @@ namespace octet {
       glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
       // allow Z buffer depth testing (closer objects are always drawn in front of far ones)
-      glEnable(GL_DEPTH_TEST);
+      gl_state::enable(GL_DEPTH_TEST, true);
 
       // improve draw speed by culling back faces - and avoid flickering edges
-      glEnable(GL_CULL_FACE);
+      gl_state::enable(GL_CULL_FACE, true);
       glCullFace(GL_BACK);
       glFrontFace(GL_CW);
 
@@ -104,17 +104,12 @@ namespace octet {
       //modelToWorld.rotateY(1.5f);
 
       // set textures 0, 1, 2, 3 to their respective values
-      glActiveTexture(GL_TEXTURE0);
-      glBindTexture(GL_TEXTURE_2D, diffuse);
-      glActiveTexture(GL_TEXTURE1);
-      glBindTexture(GL_TEXTURE_2D, ambient);
-      glActiveTexture(GL_TEXTURE2);
-      glBindTexture(GL_TEXTURE_2D, emission);
-      glActiveTexture(GL_TEXTURE3);
-      glBindTexture(GL_TEXTURE_2D, specular);
-      glActiveTexture(GL_TEXTURE4);
-      glBindTexture(GL_TEXTURE_2D, bump);
-      glActiveTexture(GL_TEXTURE0);
+      gl_state::bind_texture(0, GL_TEXTURE_2D, diffuse);
+      gl_state::bind_texture(1, GL_TEXTURE_2D, ambient);
+      gl_state::bind_texture(2, GL_TEXTURE_2D, emission);
+      gl_state::bind_texture(3, GL_TEXTURE_2D, specular);
+      gl_state::bind_texture(4, GL_TEXTURE_2D, bump);
+      gl_state::active_texture(0);
 
       cube_mesh.render();
       //cube_mesh_normals.render();
@@ -57,8 +57,7 @@ namespace octet {
       mat4t modelToProjection = mat4t::build_projection_matrix(modelToWorld, cameraToWorld);
 
       // set up opengl to draw textured triangles using sampler 0 (GL_TEXTURE0)
-      glActiveTexture(GL_TEXTURE0);
-      glBindTexture(GL_TEXTURE_2D, texture);
+      gl_state::bind_texture(0, GL_TEXTURE_2D, texture);
 
       // use "old skool" rendering
       //glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
@@ -78,7 +77,7 @@ namespace octet {
       // each corner has 3 floats (x, y, z)
       // there is no gap between the 3 floats and hence the stride is 3*sizeof(float)
       glVertexAttribPointer(attribute_pos, 3, GL_FLOAT, GL_FALSE, 3*sizeof(float), (void*)vertices );
-      glEnableVertexAttribArray(attribute_pos);
+      gl_state::enable_attrib(attribute_pos, true);
     
       // this is an array of the positions of the corners of the texture in 2D
       static const float uvs[] = {
@@ -92,7 +91,7 @@ namespace octet {
       // each corner (vertex) has 2 floats (x, y)
       // there is no gap between the 2 floats and hence the stride is 2*sizeof(float)
       glVertexAttribPointer(attribute_uv, 2, GL_FLOAT, GL_FALSE, 2*sizeof(float), (void*)uvs );
-      glEnableVertexAttribArray(attribute_uv);
+      gl_state::enable_attrib(attribute_uv, true);
     
       // finally, draw the sprite (4 vertices)
       glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
@@ -394,15 +393,14 @@ namespace octet {
       aabb bb(vec3(0, 0, 0), vec3(256, 256, 0));
 
       unsigned num_quads = font.build_mesh(bb, vertices, indices, max_quads, text, 0);
-      glActiveTexture(GL_TEXTURE0);
-      glBindTexture(GL_TEXTURE_2D, font_texture);
+      gl_state::bind_texture(0, GL_TEXTURE_2D, font_texture);
 
       shader.render(modelToProjection, 0);
 
       glVertexAttribPointer(attribute_pos, 3, GL_FLOAT, GL_FALSE, sizeof(bitmap_font::vertex), (void*)&vertices[0].x );
-      glEnableVertexAttribArray(attribute_pos);
+      gl_state::enable_attrib(attribute_pos, true);
       glVertexAttribPointer(attribute_uv, 3, GL_FLOAT, GL_FALSE, sizeof(bitmap_font::vertex), (void*)&vertices[0].u );
-      glEnableVertexAttribArray(attribute_uv);
+      gl_state::enable_attrib(attribute_uv, true);
 
       glDrawElements(GL_TRIANGLES, num_quads * 6, GL_UNSIGNED_INT, indices);
     }
@@ -516,11 +514,11 @@ namespace octet {
       glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
       // don't allow Z buffer depth testing (closer objects are always drawn in front of far ones)
-      glDisable(GL_DEPTH_TEST);
+      gl_state::enable(GL_DEPTH_TEST, false);
 
       // allow alpha blend (transparency when alpha channel is 0)
-      glEnable(GL_BLEND);
-      glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+      gl_state::enable(GL_BLEND, true);
+      gl_state::blend_func(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
       // draw all the sprites
       for (int i = 0; i != num_sprites; ++i) {
@@ -138,10 +138,10 @@ namespace octet {
       glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
       // allow Z buffer depth testing (closer objects are always drawn in front of far ones)
-      glEnable(GL_DEPTH_TEST);
+      gl_state::enable(GL_DEPTH_TEST, true);
 
       // improve draw speed by culling back faces - and avoid flickering edges
-      glEnable(GL_CULL_FACE);
+      gl_state::enable(GL_CULL_FACE, true);
       glCullFace(GL_BACK);
       glFrontFace(GL_CW);
 
@@ -61,7 +61,7 @@ namespace octet {
       // each corner has 3 floats (x, y, z)
       // there is no gap between the 3 floats and hence the stride is 3*sizeof(float)
       glVertexAttribPointer(attribute_pos, 3, GL_FLOAT, GL_FALSE, 3*sizeof(float), (void*)vertices );
-      glEnableVertexAttribArray(attribute_pos);
+      gl_state::enable_attrib(attribute_pos, true);
     
       // finally, draw the box (4 vertices)
       glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
@@ -228,7 +228,7 @@ namespace octet {
       glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
       // allow Z buffer depth testing (closer objects are always drawn in front of far ones)
-      glEnable(GL_DEPTH_TEST);
+      gl_state::enable(GL_DEPTH_TEST, true);
 
       // draw the ball
       ball.render(color_shader_, cameraToWorld);
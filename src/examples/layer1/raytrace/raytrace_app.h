@@ -72,10 +72,10 @@ public:
 
     // generate a blank texture
     glGenTextures(1, &texture_handle_);
-    glBindTexture(GL_TEXTURE_2D, texture_handle_);
+    gl_state::bind_texture(0, GL_TEXTURE_2D, texture_handle_);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, image_size, image_size, 0, GL_RGB, GL_UNSIGNED_BYTE, 0);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    gl_state::tex_parameter(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    gl_state::tex_parameter(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     glGenerateMipmap(GL_TEXTURE_2D);
 
     //texture_handle_ = resources::get_texture_handle(GL_RGB, "assets/duckCM.gif");
@@ -137,8 +137,7 @@ public:
     modelToWorld[0].rotateY(1);
 
     // set up opengl to draw textured triangles using sampler 0 (GL_TEXTURE0)
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, texture_handle_);
+    gl_state::bind_texture(0, GL_TEXTURE_2D, texture_handle_);
 
     // build a projection matrix: model -> world -> camera -> projection
     // this matrix is used to map the square to fill the screen
@@ -161,7 +160,7 @@ public:
     // each corner has 3 floats (x, y, z)
     // there is no gap between the 3 floats and hence the stride is 3*sizeof(float)
     glVertexAttribPointer(attribute_pos, 3, GL_FLOAT, GL_FALSE, 3*sizeof(float), (void*)vertices );
-    glEnableVertexAttribArray(attribute_pos);
+    gl_state::enable_attrib(attribute_pos, true);
     
     // this is an array of the positions of the corners of the texture in 2D
     static const float uvs[] = {
@@ -175,7 +174,7 @@ public:
     // each corner (vertex) has 2 floats (x, y)
     // there is no gap between the 2 floats and hence the stride is 2*sizeof(float)
     glVertexAttribPointer(attribute_uv, 2, GL_FLOAT, GL_FALSE, 2*sizeof(float), (void*)uvs );
-    glEnableVertexAttribArray(attribute_uv);
+    gl_state::enable_attrib(attribute_uv, true);
     
     // finally, draw the texture (3 vertices)
     glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
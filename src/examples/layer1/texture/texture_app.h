@@ -52,7 +52,7 @@ namespace octet {
       glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
       // allow Z buffer depth testing (closer objects are always drawn in front of far ones)
-      glEnable(GL_DEPTH_TEST);
+      gl_state::enable(GL_DEPTH_TEST, true);
 
       // build a projection matrix: model -> world -> camera -> projection
       // the projection space is the cube -1 <= x/w, y/w, z/w <= 1
@@ -62,8 +62,7 @@ namespace octet {
       modelToWorld.rotateZ(1);
 
       // set up opengl to draw textured triangles using sampler 0 (GL_TEXTURE0)
-      glActiveTexture(GL_TEXTURE0);
-      glBindTexture(GL_TEXTURE_2D, texture_handle_);
+      gl_state::bind_texture(0, GL_TEXTURE_2D, texture_handle_);
       texture_shader_.render(modelToProjection, 0);
 
       // this is an array of the positions of the corners of the texture in 3D
@@ -77,7 +76,7 @@ namespace octet {
       // each corner has 3 floats (x, y, z)
       // there is no gap between the 3 floats and hence the stride is 3*sizeof(float)
       glVertexAttribPointer(attribute_pos, 3, GL_FLOAT, GL_FALSE, 3*sizeof(float), (void*)vertices );
-      glEnableVertexAttribArray(attribute_pos);
+      gl_state::enable_attrib(attribute_pos, true);
     
       // this is an array of the positions of the corners of the texture in 2D
       static const float uvs[] = {
@@ -90,7 +89,7 @@ namespace octet {
       // each corner (vertex) has 2 floats (x, y)
       // there is no gap between the 2 floats and hence the stride is 2*sizeof(float)
       glVertexAttribPointer(attribute_uv, 2, GL_FLOAT, GL_FALSE, 2*sizeof(float), (void*)uvs );
-      glEnableVertexAttribArray(attribute_uv);
+      gl_state::enable_attrib(attribute_uv, true);
     
       // finally, draw the texture (3 vertices)
       glDrawArrays(GL_TRIANGLES, 0, 3);
@@ -0,0 +1,651 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Andy Thomason 2012, 2013
+//
+// Modular Framework for OpenGLES2 rendering on multiple platforms.
+//
+// Microbenchmarks for the containers.
+//
+// usage: containers_benchmark [-max n] [-max_quadratic n] [-repeat n] [-mesh file.dae]
+//
+// Each test does n operations for n = 1k, 4k, 16k... up to -max (default 4M)
+// and prints the best nanoseconds per operation of -repeat runs (default 5).
+// If the cost stays flat as n grows the operation is amortised O(1), if it
+// grows with n it is O(n). Tests that are known to be quadratic stop at
+// -max_quadratic (default 64k).
+//
+//   string +=        string += "piece"
+//   builder          string_builder::append() and string::take() at the end
+//   rope             string_rope::append()
+//   push string      dynarray<string>::push_back()
+//   push mat4t       dynarray<mat4t>::push_back()
+//   emplace mat4t    dynarray<mat4t>::emplace_back()
+//   push bytes       dynarray<uint8_t>::push_back() of each byte of a 64 byte block
+//   append bytes     dynarray<uint8_t>::append() of a 64 byte block
+//   resize           dynarray<vec4>::resize(n)
+//   resize uninit    dynarray<vec4>::resize_uninitialized(n)
+//   copy string      copy a dynarray<string> of n items
+//   insert string    dynarray<string>::insert() at the front
+//   erase string     dynarray<string>::erase() from the front
+//   map insert       hash_map<uint64_t, unsigned>::operator[] of a new key
+//   map hit          hash_map::find() of a key that is there
+//   map miss         hash_map::find() of a key that is not
+//   map erase        hash_map::erase()
+//   old insert/hit/miss   the same with the hash_map this tree used before
+//   dict insert      dictionary::operator[] of a new name
+//   dict hit         dictionary::find_or_insert() of a name that is there
+//   dict hashed      dictionary::find() with a length and hash worked out before
+//   old dict insert/hit   the dictionary this tree used before, a hit being
+//                    contains() then operator[] as app_utils::get_atom did
+//
+// The map keys are like object addresses, 48 bytes apart.
+// The dictionary keys are names like "node_1234_joint".
+//
+// Then the vertices of each mesh in -mesh (default assets/Laurana50k.dae)
+// are welded as indexer does, and the edges found as mesh::get_edges does,
+// with both maps. The meshes need a GL context, so this part only runs in
+// the generic build (__GENERIC__).
+//
+
+namespace octet {
+  // the hash_map this tree used before, kept to compare against:
+  // linear probing one slot at a time, a xor-shift hash and a zero key for empty.
+  class legacy_hash_map_cmp {
+  public:
+    static unsigned fuzz_hash(unsigned hash) { return hash ^ (hash >> 3) ^ (hash >> 5); }
+    static unsigned get_hash(uint64_t key) { return fuzz_hash((unsigned)(key ^ (key >> 32))); }
+    static bool is_empty(uint64_t key) { return !key; }
+  };
+
+  template <typename key_t, typename value_t, class cmp_t=legacy_hash_map_cmp> class legacy_hash_map {
+    struct entry_t { key_t key; unsigned hash; value_t value; };
+
+    entry_t *entries;
+    unsigned num_entries;
+    unsigned max_entries;
+
+    entry_t *find(const key_t &key, unsigned hash) {
+      unsigned mask = max_entries - 1;
+      for (unsigned i = 0; i != max_entries; ++i) {
+        entry_t *entry = &entries[(i + hash) & mask];
+        if (cmp_t::is_empty(entry->key)) return entry;
+        if (entry->hash == hash && entry->key == key) return entry;
+      }
+      return 0;
+    }
+
+    void expand() {
+      entry_t *old_entries = entries;
+      unsigned old_max_entries = max_entries;
+      entries = (entry_t *)allocator::malloc(sizeof(entry_t) * max_entries * 2);
+      memset(entries, 0, sizeof(entry_t) * max_entries * 2);
+      max_entries *= 2;
+      for (unsigned i = 0; i != old_max_entries; ++i) {
+        if (!cmp_t::is_empty(old_entries[i].key)) {
+          *find(old_entries[i].key, old_entries[i].hash) = old_entries[i];
+        }
+      }
+      allocator::free(old_entries, sizeof(entry_t) * old_max_entries);
+    }
+
+  public:
+    legacy_hash_map() {
+      num_entries = 0;
+      max_entries = 4;
+      entries = (entry_t *)allocator::malloc(sizeof(entry_t) * max_entries);
+      memset(entries, 0, sizeof(entry_t) * max_entries);
+    }
+
+    ~legacy_hash_map() {
+      allocator::free(entries, sizeof(entry_t) * max_entries);
+    }
+
+    value_t &operator[](const key_t &key) {
+      unsigned hash = cmp_t::get_hash(key);
+      entry_t *entry = find(key, hash);
+      if (cmp_t::is_empty(entry->key)) {
+        if (num_entries >= max_entries * 3 / 4) {
+          expand();
+          entry = find(key, hash);
+        }
+        num_entries++;
+        entry->key = key;
+        entry->hash = hash;
+      }
+      return entry->value;
+    }
+
+    value_t *find(const key_t &key) {
+      entry_t *entry = find(key, cmp_t::get_hash(key));
+      return cmp_t::is_empty(entry->key) ? 0 : &entry->value;
+    }
+  };
+
+  // the dictionary this tree used before: a malloc for each key
+  // and a shift-xor hash worked out on every lookup.
+  template <class value_t> class legacy_dictionary {
+    struct entry_t { const char *key; unsigned hash; value_t value; };
+    entry_t *entries;
+    unsigned num_entries;
+    unsigned max_entries;
+
+    unsigned calc_hash(const char *key) {
+      unsigned hash = 0;
+      for (int i = 0; key[i]; ++i) {
+        hash = (hash << 5) ^ (hash << 3) ^ (key[i] & 0xff);
+      }
+      return hash;
+    }
+
+    entry_t *find(const char *key, unsigned hash) {
+      unsigned mask = max_entries - 1;
+      for (unsigned i = 0; i != max_entries; ++i) {
+        entry_t *entry = &entries[(i + hash) & mask];
+        if (!entry->key) return entry;
+        if (entry->hash == hash && !strcmp(entry->key, key)) return entry;
+      }
+      return 0;
+    }
+
+    void expand() {
+      entry_t *old_entries = entries;
+      unsigned old_max_entries = max_entries;
+      entries = (entry_t *)allocator::malloc(sizeof(entry_t) * max_entries * 2);
+      memset(entries, 0, sizeof(entry_t) * max_entries * 2);
+      max_entries *= 2;
+      for (unsigned i = 0; i != old_max_entries; ++i) {
+        if (old_entries[i].key) {
+          *find(old_entries[i].key, old_entries[i].hash) = old_entries[i];
+        }
+      }
+      allocator::free(old_entries, sizeof(entry_t) * old_max_entries);
+    }
+
+  public:
+    legacy_dictionary() {
+      num_entries = 0;
+      max_entries = 4;
+      entries = (entry_t *)allocator::malloc(sizeof(entry_t) * max_entries);
+      memset(entries, 0, sizeof(entry_t) * max_entries);
+    }
+
+    ~legacy_dictionary() {
+      for (unsigned i = 0; i != max_entries; ++i) {
+        if (entries[i].key) allocator::free((void*)entries[i].key, strlen(entries[i].key) + 1);
+      }
+      allocator::free(entries, sizeof(entry_t) * max_entries);
+    }
+
+    value_t &operator[](const char *key) {
+      unsigned hash = calc_hash(key);
+      entry_t *entry = find(key, hash);
+      if (!entry || !entry->key) {
+        if (num_entries > max_entries * 3 / 4) {
+          expand();
+          entry = find(key, hash);
+        }
+        num_entries++;
+        size_t bytes = strlen(key) + 1;
+        entry->key = (char *)allocator::malloc(bytes);
+        entry->hash = hash;
+        memcpy((void*)entry->key, key, bytes);
+      }
+      return entry->value;
+    }
+
+    bool contains(const char *key) {
+      entry_t *entry = find(key, calc_hash(key));
+      return entry && entry->key;
+    }
+  };
+
+  class containers_benchmark {
+  public:
+    enum test_t {
+      test_string,
+      test_builder,
+      test_rope,
+      test_push_string,
+      test_push_mat4t,
+      test_emplace_mat4t,
+      test_push_bytes,
+      test_append_bytes,
+      test_resize,
+      test_resize_uninitialized,
+      test_copy_string,
+      test_insert_string,
+      test_erase_string,
+      test_map_insert,
+      test_legacy_insert,
+      test_map_hit,
+      test_legacy_hit,
+      test_map_miss,
+      test_legacy_miss,
+      test_map_erase,
+      test_dict_insert,
+      test_legacy_dict_insert,
+      test_dict_hit,
+      test_dict_hashed,
+      test_legacy_dict_hit,
+      num_tests,
+    };
+
+    unsigned max_ops;
+    unsigned max_quadratic_ops;
+    unsigned repeat;
+    dynarray<string> meshes;
+
+  private:
+    unsigned checksum;  // stops the compiler throwing away the work
+
+    enum { block_size = 64 };
+    uint8_t block[block_size];
+
+    static const char *get_test_name(unsigned test) {
+      static const char *names[] = {
+        "string +=", "builder", "rope",
+        "push string", "push mat4t", "emplace mat4t",
+        "push bytes", "append bytes", "resize", "resize uninit",
+        "copy string", "insert string", "erase string",
+        "map insert", "old insert", "map hit", "old hit",
+        "map miss", "old miss", "map erase",
+        "dict insert", "old dict insert", "dict hit", "dict hashed", "old dict hit",
+      };
+      return names[test];
+    }
+
+    static bool is_quadratic(unsigned test) {
+      // the old dictionary hash only has the last few characters in its low bits,
+      // so names with the same ending all land in one run of slots
+      return test == test_string || test == test_insert_string || test == test_erase_string ||
+        test == test_legacy_dict_insert || test == test_legacy_dict_hit;
+    }
+
+    static const char *get_piece(unsigned i) {
+      static const char *pieces[] = { "F", "[+F]", "F[-F]F", "ff" };
+      return pieces[i & 3];
+    }
+
+    static uint64_t get_map_key(unsigned i) {
+      return 0x10000000 + (uint64_t)i * 48;
+    }
+
+    static void fill_strings(dynarray<string> &strings, unsigned n) {
+      strings.reserve(n);
+      for (unsigned i = 0; i != n; ++i) {
+        strings.push_back(string(get_piece(i)));
+      }
+    }
+
+    // do n operations and return the time taken in seconds
+    double run_test(unsigned test, unsigned n) {
+      dynarray<string> strings;
+      if (test == test_copy_string || test == test_erase_string) {
+        fill_strings(strings, n);
+      }
+
+      dynarray<string> names;
+      dynarray<unsigned> lengths;
+      dynarray<unsigned> hashes;
+      dictionary<unsigned> dict;
+      legacy_dictionary<unsigned> legacy_dict;
+      if (test >= test_dict_insert) {
+        names.reserve(n);
+        lengths.reserve(n);
+        hashes.reserve(n);
+        for (unsigned i = 0; i != n; ++i) {
+          names.push_back(string());
+          names.back().format("node_%u_joint", i);
+          lengths.push_back((unsigned)names[i].size());
+          hashes.push_back(dictionary<unsigned>::calc_hash(names[i].c_str(), lengths[i]));
+          if (test == test_dict_hit || test == test_dict_hashed) dict[names[i].c_str()] = i;
+          if (test == test_legacy_dict_hit) legacy_dict[names[i].c_str()] = i;
+        }
+      }
+
+      hash_map<uint64_t, unsigned> map;
+      legacy_hash_map<uint64_t, unsigned> legacy;
+      if (test == test_map_hit || test == test_map_miss || test == test_map_erase) {
+        for (unsigned i = 0; i != n; ++i) map[get_map_key(i)] = i;
+      } else if (test == test_legacy_hit || test == test_legacy_miss) {
+        for (unsigned i = 0; i != n; ++i) legacy[get_map_key(i)] = i;
+      }
+
+      double start = app_utils::get_time();
+      switch (test) {
+        case test_string: {
+          string s;
+          for (unsigned i = 0; i != n; ++i) {
+            s += get_piece(i);
+          }
+          checksum += s.size();
+        } break;
+        case test_builder: {
+          string_builder b;
+          for (unsigned i = 0; i != n; ++i) {
+            b.append(get_piece(i));
+          }
+          string s;
+          s.take(b);
+          checksum += s.size();
+        } break;
+        case test_rope: {
+          string_rope r(1 << 16);
+          for (unsigned i = 0; i != n; ++i) {
+            r.append(get_piece(i));
+          }
+          checksum += (unsigned)r.size();
+        } break;
+        case test_push_string: {
+          dynarray<string> a;
+          string s(get_piece(1));
+          for (unsigned i = 0; i != n; ++i) {
+            a.push_back(s);
+          }
+          checksum += a.size();
+        } break;
+        case test_push_mat4t: {
+          dynarray<mat4t> a;
+          mat4t m(1.0f);
+          for (unsigned i = 0; i != n; ++i) {
+            a.push_back(m);
+          }
+          checksum += a.size();
+        } break;
+        case test_emplace_mat4t: {
+          dynarray<mat4t> a;
+          for (unsigned i = 0; i != n; ++i) {
+            a.emplace_back(1.0f);
+          }
+          checksum += a.size();
+        } break;
+        case test_push_bytes: {
+          dynarray<uint8_t> a;
+          for (unsigned i = 0; i != n; ++i) {
+            for (unsigned j = 0; j != block_size; ++j) {
+              a.push_back(block[j]);
+            }
+          }
+          checksum += a.size();
+        } break;
+        case test_append_bytes: {
+          dynarray<uint8_t> a;
+          for (unsigned i = 0; i != n; ++i) {
+            a.append(block, block_size);
+          }
+          checksum += a.size();
+        } break;
+        case test_resize: {
+          dynarray<vec4> a;
+          a.resize(n);
+          checksum += a.size();
+        } break;
+        case test_resize_uninitialized: {
+          dynarray<vec4> a;
+          a.resize_uninitialized(n);
+          checksum += a.size();
+        } break;
+        case test_copy_string: {
+          dynarray<string> a(strings);
+          checksum += a.size();
+        } break;
+        case test_insert_string: {
+          dynarray<string> a;
+          string s(get_piece(2));
+          for (unsigned i = 0; i != n; ++i) {
+            a.insert(a.begin(), s);
+          }
+          checksum += a.size();
+        } break;
+        case test_erase_string: {
+          while (!strings.is_empty()) {
+            strings.erase(0u);
+          }
+          checksum += strings.size();
+        } break;
+        case test_map_insert: {
+          for (unsigned i = 0; i != n; ++i) map[get_map_key(i)] = i;
+          checksum += map.get_size();
+        } break;
+        case test_legacy_insert: {
+          for (unsigned i = 0; i != n; ++i) legacy[get_map_key(i)] = i;
+          checksum += legacy[get_map_key(0)];
+        } break;
+        case test_map_hit: case test_map_miss: {
+          unsigned offset = test == test_map_miss ? 8 : 0;
+          for (unsigned i = 0; i != n; ++i) {
+            unsigned *value = map.find(get_map_key(i) + offset);
+            checksum += value ? *value : 1;
+          }
+        } break;
+        case test_legacy_hit: case test_legacy_miss: {
+          unsigned offset = test == test_legacy_miss ? 8 : 0;
+          for (unsigned i = 0; i != n; ++i) {
+            unsigned *value = legacy.find(get_map_key(i) + offset);
+            checksum += value ? *value : 1;
+          }
+        } break;
+        case test_dict_insert: {
+          for (unsigned i = 0; i != n; ++i) dict[names[i].c_str()] = i;
+          checksum += dict.get_size();
+        } break;
+        case test_legacy_dict_insert: {
+          for (unsigned i = 0; i != n; ++i) legacy_dict[names[i].c_str()] = i;
+          checksum += legacy_dict[names[0].c_str()];
+        } break;
+        case test_dict_hit: {
+          for (unsigned i = 0; i != n; ++i) {
+            bool added;
+            checksum += dict.find_or_insert(names[i].c_str(), added);
+          }
+        } break;
+        case test_dict_hashed: {
+          for (unsigned i = 0; i != n; ++i) {
+            unsigned *value = dict.find(names[i].c_str(), lengths[i], hashes[i]);
+            checksum += value ? *value : 1;
+          }
+        } break;
+        case test_legacy_dict_hit: {
+          for (unsigned i = 0; i != n; ++i) {
+            const char *name = names[i].c_str();
+            checksum += legacy_dict.contains(name) ? legacy_dict[name] : 1;
+          }
+        } break;
+        case test_map_erase: {
+          for (unsigned i = 0; i != n; ++i) {
+            map.erase(get_map_key(i));
+          }
+          checksum += map.get_size();
+        } break;
+      }
+      return app_utils::get_time() - start;
+    }
+
+  public:
+    containers_benchmark() {
+      max_ops = 1 << 22;
+      max_quadratic_ops = 1 << 16;
+      repeat = 5;
+      checksum = 0;
+      for (unsigned i = 0; i != block_size; ++i) {
+        block[i] = (uint8_t)i;
+      }
+    }
+
+    // a vertex is stride bytes of the vertex buffer, as in indexer
+    struct bench_vertex {
+      const uint8_t *bytes;
+      unsigned size;
+
+      bool operator==(const bench_vertex &rhs) const {
+        return size == rhs.size && memcmp(bytes, rhs.bytes, size) == 0;
+      }
+
+      unsigned get_hash() const {
+        unsigned hash = 0;
+        for (unsigned i = 0; i != size; ++i) {
+          hash = (hash * 7) + (hash >> 13) + bytes[i];
+        }
+        return hash;
+      }
+
+      bool is_empty() const { return bytes == 0; }
+    };
+
+    class vertex_cmp : public hash_map_cmp {
+    public:
+      static unsigned get_hash(const bench_vertex &key) { return fuzz_hash(key.get_hash()); }
+    };
+
+    class legacy_vertex_cmp : public legacy_hash_map_cmp {
+    public:
+      static unsigned get_hash(const bench_vertex &key) { return fuzz_hash(key.get_hash()); }
+      static bool is_empty(const bench_vertex &key) { return key.is_empty(); }
+    };
+
+    // weld identical vertices, returns the number left
+    template <class map_t> static unsigned weld(map_t &map, const uint8_t *vp, const uint32_t *ip, unsigned num_indices, unsigned stride) {
+      unsigned num_vertices = 0;
+      for (unsigned i = 0; i != num_indices; ++i) {
+        bench_vertex v = { vp + ip[i] * stride, stride };
+        unsigned &e = map[v];
+        if (e == 0) e = ++num_vertices;
+      }
+      return num_vertices;
+    }
+
+    // find the triangles on each edge, returns the number of edges
+    template <class map_t> static unsigned find_edges(map_t &map, const uint32_t *ip, unsigned num_indices) {
+      unsigned num_edges = 0;
+      for (unsigned i = 0; i + 2 < num_indices; i += 3) {
+        for (unsigned j = 0; j != 3; ++j) {
+          unsigned i0 = ip[i + j], i1 = ip[i + (j == 2 ? 0 : j + 1)];
+          if (i0 > i1) { unsigned t = i0; i0 = i1; i1 = t; }
+          uint64_t &edge = map[((uint64_t)i1 << 32) | i0];
+          if (edge == 0) num_edges++;
+          edge = (edge << 32) | (i / 3 + 1);
+        }
+      }
+      return num_edges;
+    }
+
+    void run_mesh(const char *url) {
+      #if defined(__GENERIC__)
+        if (!gl_ctxt()) gl_ctxt(new gl_context());
+        collada_builder builder;
+        if (!builder.load_xml(url)) {
+          printf("warning: could not load %s\n", url);
+          return;
+        }
+        resources dict;
+        builder.get_resources(dict);
+        scene *s = dict.get_scene(builder.get_default_scene());
+        if (!s) return;
+
+        printf("\n%s\n%-32s %12s %12s\n", url, "ms (best of repeat)", "old", "map");
+        for (int m = 0; m != s->get_num_mesh_instances(); ++m) {
+          mesh *msh = s->get_mesh_instance(m)->get_mesh();
+          if (!msh || msh->get_index_type() != GL_UNSIGNED_INT) continue;
+
+          gl_resource::rolock idx_lock(msh->get_indices());
+          gl_resource::rolock vtx_lock(msh->get_vertices());
+          const uint32_t *ip = idx_lock.u32();
+          const uint8_t *vp = vtx_lock.u8();
+          unsigned num_indices = msh->get_num_indices();
+          unsigned stride = msh->get_stride();
+
+          double best[2][2] = { { 1e30, 1e30 }, { 1e30, 1e30 } };
+          unsigned counts[2][2] = { { 0, 0 }, { 0, 0 } };
+          for (unsigned r = 0; r < repeat; ++r) {
+            for (unsigned work = 0; work != 2; ++work) {
+              for (unsigned which = 0; which != 2; ++which) {
+                double start = app_utils::get_time();
+                if (work == 0 && which == 0) {
+                  legacy_hash_map<bench_vertex, unsigned, legacy_vertex_cmp> map;
+                  counts[work][which] = weld(map, vp, ip, num_indices, stride);
+                } else if (work == 0) {
+                  hash_map<bench_vertex, unsigned, vertex_cmp> map;
+                  counts[work][which] = weld(map, vp, ip, num_indices, stride);
+                } else if (which == 0) {
+                  legacy_hash_map<uint64_t, uint64_t> map;
+                  counts[work][which] = find_edges(map, ip, num_indices);
+                } else {
+                  hash_map<uint64_t, uint64_t> map;
+                  counts[work][which] = find_edges(map, ip, num_indices);
+                }
+                double time = app_utils::get_time() - start;
+                best[work][which] = time < best[work][which] ? time : best[work][which];
+              }
+            }
+          }
+
+          char name[64];
+          snprintf(name, sizeof(name), "weld %d indices to %d", num_indices, counts[0][1]);
+          printf("%-32s %12.3f %12.3f\n", name, best[0][0] * 1000, best[0][1] * 1000);
+          snprintf(name, sizeof(name), "edges %d", counts[1][1]);
+          printf("%-32s %12.3f %12.3f\n", name, best[1][0] * 1000, best[1][1] * 1000);
+          if (counts[0][0] != counts[0][1] || counts[1][0] != counts[1][1]) {
+            printf("warning: the maps disagree\n");
+          }
+        }
+      #else
+        printf("\nthe mesh tests need the generic build (__GENERIC__) for its GL context\n");
+      #endif
+    }
+
+    void run() {
+      printf("%-14s", "ns per op");
+      for (unsigned n = 1024; n <= max_ops; n *= 4) {
+        printf(" %9d", n);
+      }
+      printf("    (best of %d)\n", repeat);
+
+      for (unsigned test = 0; test != num_tests; ++test) {
+        printf("%-14s", get_test_name(test));
+        for (unsigned n = 1024; n <= max_ops; n *= 4) {
+          if (is_quadratic(test) && n > max_quadratic_ops) {
+            printf(" %9s", "-");
+            continue;
+          }
+          double best = 1e30;
+          for (unsigned r = 0; r < repeat; ++r) {
+            double time = run_test(test, n);
+            best = time < best ? time : best;
+          }
+          printf(" %9.2f", best * 1e9 / n);
+        }
+        printf("\n");
+      }
+      printf("checksum %u\n", checksum);
+
+      if (meshes.is_empty()) {
+        meshes.push_back(string("assets/Laurana50k.dae"));
+      }
+      for (unsigned i = 0; i != meshes.size(); ++i) {
+        run_mesh(meshes[i].c_str());
+      }
+    }
+  };
+
+  static int containers_benchmark_main(int argc, char **argv) {
+    containers_benchmark benchmark;
+    for (int i = 1; i < argc; ++i) {
+      const char *arg = argv[i];
+      bool has_value = i + 1 < argc;
+      if (!strcmp(arg, "-max") && has_value) {
+        benchmark.max_ops = (unsigned)atoi(argv[++i]);
+      } else if (!strcmp(arg, "-max_quadratic") && has_value) {
+        benchmark.max_quadratic_ops = (unsigned)atoi(argv[++i]);
+      } else if (!strcmp(arg, "-repeat") && has_value) {
+        benchmark.repeat = (unsigned)atoi(argv[++i]);
+      } else if (!strcmp(arg, "-mesh") && has_value) {
+        benchmark.meshes.push_back(string(argv[++i]));
+      } else {
+        printf("usage: %s [-max n] [-max_quadratic n] [-repeat n] [-mesh file.dae]\n", argv[0]);
+        return 1;
+      }
+    }
+    benchmark.run();
+    return 0;
+  }
+}
@@ -50,10 +50,10 @@ namespace octet {
       char buf[8];
       scene *app_scene = 0;
       if (file && fread(buf, 1, sizeof(buf), file) && !memcmp(buf, "octet", 5)) {
-        fseek(file, 0, SEEK_SET);
-        binary_reader r(file);
-        dict.visit(r);
         fclose(file);
+        allocator_tag_scope tag(allocator::tag_scene);
+        binary_reader r(filename);
+        dict.visit(r);
         app_scene = dict.get_active_scene();
       } else {
         if (file) fclose(file);
@@ -197,15 +197,15 @@ namespace octet {
       glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
       // allow Z buffer depth testing (closer objects are always drawn in front of far ones)
-      glEnable(GL_DEPTH_TEST);
+      gl_state::enable(GL_DEPTH_TEST, true);
 
       GLint param;
       glGetIntegerv(GL_SAMPLE_BUFFERS, &param);
       if (param == 0) {
         // if multisampling is disabled, we can't use GL_SAMPLE_COVERAGE (which I think is mean)
         // Instead, allow alpha blend (transparency when alpha channel is 0)
-        glEnable(GL_BLEND);
-        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        gl_state::enable(GL_BLEND, true);
+        gl_state::blend_func(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
         // this is a rather brutal alpha test that cuts off anything with a small alpha.
         #ifndef SN_TARGET_PSP2
@@ -0,0 +1,285 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Andy Thomason 2012, 2013
+//
+// Modular Framework for OpenGLES2 rendering on multiple platforms.
+//
+// Load times of .oct files.
+//
+// usage: load_benchmark [-repeat n] [file.dae | file.oct | file.zip...]
+//
+// Each .dae (default assets/Laurana50k.dae) is saved as a .oct next to it
+// first. Every .oct is then loaded two ways:
+//
+//   copy   binary_reader(FILE *) reads the whole file and copies each dynarray
+//   map    binary_reader(url) maps the file and borrows the dynarrays in place
+//
+// and timed (best of -repeat runs, default 5) for
+//
+//   load   visiting the resources
+//   touch  reading every byte of the meshes afterwards, as uploading them would
+//
+// with a cold cache, the file's pages dropped from memory first, and a warm one.
+// Each run loads a new copy of the file so that none of it is mapped already.
+// Dropping the pages needs posix_fadvise(), elsewhere the cold runs are left out.
+//
+// Every file in a .zip is extracted one get_url() at a time and then all at once
+// with get_urls(), which inflates them in parallel on the thread_pool.
+//
+// Loading needs a GL context, so build with __GENERIC__.
+//
+
+namespace octet {
+  class load_benchmark {
+    unsigned repeat;
+    dynarray<string> files;
+    unsigned checksum;
+
+    static bool can_drop_cache() {
+      #if OCTET_MMAP && !defined(_WIN32) && defined(POSIX_FADV_DONTNEED)
+        return true;
+      #else
+        return false;
+      #endif
+    }
+
+    // write a copy of src. if cold, put it on the disk and out of memory.
+    static bool copy_file(const char *dest, const char *src, bool cold) {
+      dynarray<uint8_t> buffer;
+      app_utils::get_url(buffer, src);
+      string path = app_utils::get_path(dest);
+      FILE *file = fopen(path, "wb");
+      if (!file || buffer.is_empty()) {
+        if (file) fclose(file);
+        return false;
+      }
+      fwrite(buffer.data(), 1, buffer.size(), file);
+      fflush(file);
+      #if OCTET_MMAP && !defined(_WIN32) && defined(POSIX_FADV_DONTNEED)
+        if (cold) {
+          fsync(fileno(file));
+          posix_fadvise(fileno(file), 0, 0, POSIX_FADV_DONTNEED);
+        }
+      #endif
+      fclose(file);
+      return true;
+    }
+
+    static bool save_oct(const char *oct_url, const char *dae_url) {
+      collada_builder builder;
+      if (!builder.load_xml(dae_url)) {
+        printf("warning: could not load %s\n", dae_url);
+        return false;
+      }
+      resources dict;
+      builder.get_resources(dict);
+      dict.set_active_scene(dict.get_scene(builder.get_default_scene()));
+      FILE *file = fopen(app_utils::get_path(oct_url), "wb");
+      if (!file) {
+        printf("warning: could not write %s\n", oct_url);
+        return false;
+      }
+      binary_writer w(file);
+      dict.visit(w);
+      fclose(file);
+      return true;
+    }
+
+    // read every byte of every mesh
+    static unsigned touch(resources &dict) {
+      dynarray<resource*> meshes;
+      dict.find_all(meshes, atom_mesh);
+      unsigned sum = 0;
+      for (unsigned i = 0; i != meshes.size(); ++i) {
+        mesh *msh = meshes[i]->get_mesh();
+        gl_resource *res[2] = { msh->get_vertices(), msh->get_indices() };
+        for (unsigned j = 0; j != 2; ++j) {
+          if (!res[j] || !res[j]->get_size()) continue;
+          gl_resource::rolock lock(res[j]);
+          const uint8_t *bytes = lock.u8();
+          for (unsigned k = 0; k < res[j]->get_size(); k += 64) {
+            sum += bytes[k];
+          }
+        }
+      }
+      return sum;
+    }
+
+    // load a fresh copy of url, returns false if it fails
+    bool load(double &load_time, double &touch_time, const char *url, bool map, bool cold) {
+      string copy_url;
+      copy_url.format("%s.bench%d", url, map);
+      if (!copy_file(copy_url, url, cold)) return false;
+
+      bool ok = true;
+      {
+        resources dict;
+        double start = app_utils::get_time();
+        if (map) {
+          binary_reader r(copy_url);
+          dict.visit(r);
+          ok = !r.get_error();
+        } else {
+          FILE *file = fopen(app_utils::get_path(copy_url), "rb");
+          binary_reader r(file);
+          dict.visit(r);
+          fclose(file);
+          ok = !r.get_error();
+        }
+        double loaded = app_utils::get_time();
+        checksum += touch(dict);
+        double touched = app_utils::get_time();
+        load_time = loaded - start;
+        touch_time = touched - loaded;
+      }
+      // the copy was unmapped with the resources
+      remove(app_utils::get_path(copy_url));
+      return ok;
+    }
+
+    void run_file(const char *url) {
+      FILE *file = fopen(app_utils::get_path(url), "rb");
+      if (!file) {
+        printf("warning: could not open %s\n", url);
+        return;
+      }
+      fseek(file, 0, SEEK_END);
+      long size = ftell(file);
+      fclose(file);
+
+      printf("\n%s: %ld bytes\n%-12s %10s %10s %10s    (best of %d)\n", url, size, "ms", "load", "touch", "total", repeat);
+      for (unsigned map = 0; map != 2; ++map) {
+        for (unsigned pass = 0; pass != 2; ++pass) {
+          bool cold = pass == 0;
+          char name[32];
+          snprintf(name, sizeof(name), "%s %s", map ? "map" : "copy", cold ? "cold" : "warm");
+          if (cold && !can_drop_cache()) {
+            printf("%-12s %10s %10s %10s\n", name, "-", "-", "-");
+            continue;
+          }
+          double best_load = 1e30, best_touch = 1e30, best_total = 1e30;
+          for (unsigned r = 0; r < repeat; ++r) {
+            double load_time = 0, touch_time = 0;
+            if (!load(load_time, touch_time, url, map != 0, cold)) {
+              printf("warning: could not load %s\n", url);
+              return;
+            }
+            best_load = load_time < best_load ? load_time : best_load;
+            best_touch = touch_time < best_touch ? touch_time : best_touch;
+            best_total = load_time + touch_time < best_total ? load_time + touch_time : best_total;
+          }
+          printf("%-12s %10.3f %10.3f %10.3f\n", name, best_load * 1000, best_touch * 1000, best_total * 1000);
+        }
+      }
+    }
+
+    // extract everything in a zip serially and in parallel
+    void run_zip(const char *url) {
+      dynarray<string> names;
+      app_utils::get_zip_file(url)->get_file_names(names);
+      if (names.is_empty()) {
+        printf("warning: could not open %s\n", url);
+        return;
+      }
+
+      dynarray<string> urls;
+      dynarray<const char *> url_ptrs;
+      for (unsigned i = 0; i != names.size(); ++i) {
+        urls.push_back(string());
+        urls.back().format("zip://%s/%s", url, names[i].c_str());
+      }
+      for (unsigned i = 0; i != urls.size(); ++i) {
+        url_ptrs.push_back(urls[i].c_str());
+      }
+
+      printf("\n%s: %d files\n%-12s %10s    (best of %d)\n", url, names.size(), "ms", "extract", repeat);
+      for (unsigned parallel = 0; parallel != 2; ++parallel) {
+        double best = 1e30;
+        for (unsigned r = 0; r < repeat; ++r) {
+          dynarray<dynarray<uint8_t> > buffers;
+          buffers.resize(urls.size());
+          double start = app_utils::get_time();
+          if (parallel) {
+            app_utils::get_urls(buffers.data(), url_ptrs.data(), url_ptrs.size());
+          } else {
+            for (unsigned i = 0; i != urls.size(); ++i) {
+              app_utils::get_url(buffers[i], urls[i]);
+            }
+          }
+          double time = app_utils::get_time() - start;
+          best = time < best ? time : best;
+          for (unsigned i = 0; i != buffers.size(); ++i) {
+            for (unsigned k = 0; k < buffers[i].size(); k += 64) {
+              checksum += buffers[i][k];
+            }
+          }
+        }
+        printf("%-12s %10.3f\n", parallel ? "get_urls" : "get_url", best * 1000);
+      }
+    }
+
+  public:
+    load_benchmark() {
+      repeat = 5;
+      checksum = 0;
+    }
+
+    void set_repeat(unsigned value) {
+      repeat = value;
+    }
+
+    void add_file(const char *url) {
+      files.push_back(string(url));
+    }
+
+    void run() {
+      #if defined(__GENERIC__)
+        if (!gl_ctxt()) gl_ctxt(new gl_context());
+      #endif
+
+      if (files.is_empty()) {
+        add_file("assets/Laurana50k.dae");
+      }
+
+      for (unsigned i = 0; i != files.size(); ++i) {
+        string url = files[i];
+        const char *ext = strrchr(url, '.');
+        if (ext && !strcmp(ext, ".zip")) {
+          run_zip(url);
+          continue;
+        }
+        if (ext && !strcmp(ext, ".dae")) {
+          string oct_url;
+          oct_url.format("%s.oct", url.c_str());
+          if (!save_oct(oct_url, url)) continue;
+          url = oct_url;
+        }
+        run_file(url);
+      }
+      printf("checksum %u\n", checksum);
+    }
+  };
+
+  static int load_benchmark_main(int argc, char **argv) {
+    #if !defined(__GENERIC__)
+      printf("the benchmark needs the generic build (__GENERIC__) for its GL context\n");
+      return 1;
+    #endif
+
+    load_benchmark benchmark;
+    for (int i = 1; i < argc; ++i) {
+      const char *arg = argv[i];
+      bool has_value = i + 1 < argc;
+      if (!strcmp(arg, "-repeat") && has_value) {
+        benchmark.set_repeat((unsigned)atoi(argv[++i]));
+      } else if (arg[0] == '-') {
+        printf("usage: %s [-repeat n] [file.dae | file.oct | file.zip...]\n", argv[0]);
+        return 1;
+      } else {
+        benchmark.add_file(arg);
+      }
+    }
+    benchmark.run();
+    return 0;
+  }
+}
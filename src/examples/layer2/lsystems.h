@@ -10,7 +10,10 @@
 // Author: Ciro Duran <ciro.duran@gmail.com>
 //
 
+#include "lsystems_turtle.h"
 #include "lsystemsobjs.h"
+#include "lsystems_scene.h"
+#include "lsystems_forest.h"
 
 namespace octet {
   class lsystems : public app {
@@ -19,10 +22,21 @@ namespace octet {
     typedef animation animation;
     typedef scene_node scene_node;
 
-    texture_shader tshader;
+    atlas_shader tshader;
 
     LSystemsModel model;
     Tree2DRenderer model_renderer;
+    Tree3DRenderer tree3d_renderer;
+
+    // Draw the tree with the 3D turtle instead of flat quads
+    bool use_3d;
+
+    // Draw a forest of 3D trees from several grammars in a scene
+    bool use_forest;
+    ref<scene> forest_scene;
+    LSystemsForest forest;
+    bump_shader object_shader;
+    bump_shader skin_shader;
 
     mat4t cameraToWorld;
     mat4t cameraToProjection;
@@ -39,9 +53,15 @@ namespace octet {
     // Display or hide the online help
     bool display_help;
 
-    GLuint leafTex;
-    GLuint woodTex;
-    GLuint helpTex;
+    // all the textures are packed in one atlas, bound once per frame
+    texture_atlas atlas;
+    unsigned leafImage;
+    unsigned woodImage;
+    unsigned helpImage;
+
+    // frame timings drawn over the scene
+    profiler_hud hud;
+    bool display_profile;
 
   public:
     // this is called when we construct the class
@@ -49,10 +69,14 @@ namespace octet {
     : app(argc, argv)
     , model()
     , model_renderer(NULL)
+    , tree3d_renderer(NULL)
+    , use_3d(false)
+    , use_forest(false)
     , cameraToWorld()
     , camera_position(0.0f, 0.0f, 0.0f, 1.0f)
     , just_pressed(false)
     , display_help(true)
+    , display_profile(false)
     {
     }
 
@@ -60,17 +84,29 @@ namespace octet {
     void app_init() {
       // set up the shaders
       tshader.init();
+      object_shader.init(false);
+      skin_shader.init(true);
 
       const char *filename = "assets/lsystems1.xml";
 
       current_iterations = 0;
       model_renderer.tshader = &tshader;
 
-      helpTex = resources::get_texture_handle(GL_RGBA, "assets/help.gif");
-      leafTex = resources::get_texture_handle(GL_RGBA, "assets/leaf.gif");
-      woodTex = resources::get_texture_handle(GL_RGBA, "assets/wood.gif");
-      model_renderer.leafTex = leafTex;
-      model_renderer.woodTex = woodTex;
+      helpImage = atlas.add_image("assets/help.gif");
+      leafImage = atlas.add_image("assets/leaf.gif");
+      woodImage = atlas.add_image("assets/wood.gif", true);
+      atlas.build("assets/lsystems.atlas");
+
+      model_renderer.atlas = &atlas;
+      model_renderer.leafImage = leafImage;
+      model_renderer.woodImage = woodImage;
+
+      tree3d_renderer.tshader = &tshader;
+      tree3d_renderer.atlas = &atlas;
+      tree3d_renderer.leafImage = leafImage;
+      tree3d_renderer.woodImage = woodImage;
+
+      hud.init();
 
       loadModel(filename);
       //printf("Displaying step %d: \"%s\"\n", current_iterations, model.getProduction(current_iterations)->c_str());
@@ -80,16 +116,89 @@ namespace octet {
       cameraToWorld.translate(0, 0, camera_position[2]);
     }
 
+    // plant a grid of trees from the first four grammars
+    void buildForest() {
+      forest_scene = new scene();
+      material *leaf_material = new material("assets/leaf.gif");
+      leaf_material->set_blended(true);
+      forest.init(forest_scene, new material("assets/wood.gif"), leaf_material);
+
+      int grammar[4];
+      for (int i = 0; i != 4; ++i) {
+        char url[64];
+        sprintf(url, "assets/lsystems%d.xml", i + 1);
+        grammar[i] = forest.add_grammar(url);
+      }
+
+      unsigned seed = 1;
+      for (int z = 0; z != 11; ++z) {
+        for (int x = 0; x != 11; ++x) {
+          int g = grammar[seed % 4];
+          if (g >= 0) {
+            int iterations = forest.get_grammar(g)->get_initial_iterations();
+            forest.add_tree(g, iterations, vec3(x * 20.0f - 100.0f, 0, z * -20.0f), seed);
+          }
+          seed++;
+        }
+      }
+
+      forest.update(camera_position.xyz());
+      forest_scene->create_default_camera_and_lights();
+      forest_scene->get_camera_instance(0)->set_perspective(0, 45, 1, 0.1f, 1000.0f);
+    }
+
+    void renderForest(int vx, int vy) {
+      OCTET_PROFILE_SCOPE("forest");
+      if (!forest_scene) buildForest();
+
+      camera_instance *cam = forest_scene->get_camera_instance(0);
+      mat4t &cameraToWorld = cam->get_node()->access_nodeToParent();
+      cameraToWorld.loadIdentity();
+      cameraToWorld.translate(camera_position.x(), camera_position.y() + 10.0f, camera_position.z());
+
+      forest.update(cameraToWorld.w().xyz());
+
+      gl_state::enable(GL_DEPTH_TEST, true);
+      forest_scene->update(1.0f/30);
+      forest_scene->render(object_shader, skin_shader, *cam, (float)vx / vy);
+      gl_state::enable(GL_DEPTH_TEST, false);
+    }
+
+    // bake the current tree into a .oct file that engine::load_file can read
+    void saveTree(const char *url) {
+      resources dict;
+      LSystemsSceneBuilder tree_builder;
+      tree_builder.step_length = model_renderer.branch_separation;
+      tree_builder.make_scene(dict, model, current_iterations, "tree");
+      if (LSystemsSceneBuilder::save(dict, url)) {
+        printf("saved %s\n", url);
+      }
+    }
+
     void loadModel(const char *filename) {
       model.readConfigurationFile(filename);
       model.dump_productions();
       model_renderer.setModel(&model);
+      tree3d_renderer.setModel(&model);
       current_iterations = model.get_initial_iterations();
       just_pressed = true;
     }
 
     // this is called to draw the world
     void draw_world(int x, int y, int w, int h) {
+      draw_frame();
+
+      if (display_profile) {
+        int vx, vy;
+        get_viewport_size(vx, vy);
+        hud.render(object_shader, skin_shader, vx, vy);
+      }
+      profiler::end_frame();
+      gl_trace::get().end_frame();
+    }
+
+    void draw_frame() {
+      OCTET_PROFILE_SCOPE("draw_world");
       int vx, vy;
       get_viewport_size(vx, vy);
       // set a viewport - includes whole window area
@@ -99,14 +208,31 @@ namespace octet {
       glClearColor(0.75f, 0.75f, 0.75f, 1);
       glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-      if (model.is_loaded()) {
+      if (use_forest) {
+        renderForest(vx, vy);
+      }
+
+      // scene materials bind their own textures, so the atlas goes after the forest
+      gl_state::bind_texture(0, GL_TEXTURE_2D, atlas.get_texture());
+      gl_state::tex_parameter(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+      gl_state::tex_parameter(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+      gl_state::tex_parameter(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+      gl_state::tex_parameter(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+      if (model.is_loaded() && !use_forest) {
         int vx = 0, vy = 0;
         get_viewport_size(vx, vy);
 
         cameraToWorld.loadIdentity();
         cameraToWorld.translate(camera_position.x(), camera_position.y(), camera_position.z());
 
-        model_renderer.render(cameraToWorld, cameraToProjection, current_iterations);
+        if (use_3d) {
+          tree3d_renderer.branch_rotate_angle = model_renderer.branch_rotate_angle;
+          tree3d_renderer.branch_length = model_renderer.branch_separation;
+          tree3d_renderer.render(cameraToWorld, cameraToProjection, current_iterations);
+        } else {
+          model_renderer.render(cameraToWorld, cameraToProjection, current_iterations);
+        }
 
       }
 
@@ -135,12 +261,42 @@ namespace octet {
         current_iterations++;
         //printf("Displaying step %d: \"%s\"\n", current_iterations, model.getProduction(current_iterations)->c_str());
         just_pressed = true;
+      } else if (is_key_down('V') && !just_pressed) {
+        use_3d = !use_3d;
+        just_pressed = true;
+      } else if (is_key_down('F') && !just_pressed) {
+        use_forest = !use_forest;
+        just_pressed = true;
+      } else if (is_key_down('O') && !just_pressed) {
+        if (model.is_loaded()) saveTree("assets/lsystems_tree.oct");
+        just_pressed = true;
+      } else if (is_key_down('P') && !just_pressed) {
+        display_profile = !display_profile;
+        profiler::set_enabled(display_profile);
+        just_pressed = true;
+      } else if (is_key_down('G') && !just_pressed) {
+        if (profiler::write_chrome_trace("lsystems_trace.json")) {
+          printf("saved lsystems_trace.json\n");
+        }
+        if (OCTET_GL_TRACE && gl_trace::get().write_json("lsystems_gl_trace.json")) {
+          printf("saved lsystems_gl_trace.json\n");
+        }
+        just_pressed = true;
+      } else if (is_key_down('I') && !just_pressed) {
+        allocator::print_stats();
+        if (allocator::write_json("lsystems_heap.json")) {
+          printf("saved lsystems_heap.json\n");
+        }
+        just_pressed = true;
       } else if (just_pressed &&
         !(is_key_down('1') || is_key_down('2') ||
           is_key_down('3') || is_key_down('4') ||
           is_key_down('5') || is_key_down('6') ||
           is_key_down('7') || is_key_down('8') ||
-          is_key_down('N') || is_key_down('M')
+          is_key_down('N') || is_key_down('M') ||
+          is_key_down('V') || is_key_down('F') ||
+          is_key_down('O') || is_key_down('P') ||
+          is_key_down('G') || is_key_down('I')
          )) {
         just_pressed = false;
       }
@@ -177,6 +333,12 @@ namespace octet {
         model_renderer.branch_rotate_angle += 0.5f;
       }
       
+      if (is_key_down('K')) {
+        tree3d_renderer.yaw -= 2.0f;
+      } else if (is_key_down('L')) {
+        tree3d_renderer.yaw += 2.0f;
+      }
+
       if (is_key_down('W')) {
         camera_position[1] += 0.25f * (camera_position[2]/5.0f);
       } else if (is_key_down('S')) {
@@ -203,6 +365,7 @@ namespace octet {
     void render_help() {
       
       if (!display_help) return;
+      OCTET_PROFILE_SCOPE("help");
 
       mat4t help_text_matrix;
       help_text_matrix.loadIdentity();
@@ -215,18 +378,11 @@ namespace octet {
       // model -> world -> camera -> projection
       mat4t modelToProjection = mat4t::build_projection_matrix(help_text_matrix, help_cam_matrix);
 
-      glEnable(GL_BLEND);
-      glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-
-      glActiveTexture(GL_TEXTURE0);
-      glBindTexture(GL_TEXTURE_2D, helpTex);
-      glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-      glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-      glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
-      glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
+      gl_state::enable(GL_BLEND, true);
+      gl_state::blend_func(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
       // set up the uniforms for the shader
-      tshader.render(modelToProjection, 0);
+      tshader.render(modelToProjection, 0, atlas.get_uv_rect(helpImage), false);
 
       int zoomFactor = 10;
 
@@ -239,11 +395,12 @@ namespace octet {
 
       glVertexAttribPointer(attribute_pos, 2, GL_FLOAT, GL_FALSE, 4*sizeof(float), (void*)vertices );
       glVertexAttribPointer(attribute_uv, 2, GL_FLOAT, GL_FALSE, 4*sizeof(float), (void*)(vertices + 2) );
-      glEnableVertexAttribArray(attribute_pos);
-      glEnableVertexAttribArray(attribute_uv);
+      gl_state::enable_attrib(attribute_pos, true);
+      gl_state::enable_attrib(attribute_uv, true);
 
       // finally, draw the box (4 vertices)
       glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+      OCTET_PROFILE_COUNT("draw calls", 1);
     }
   };
 }
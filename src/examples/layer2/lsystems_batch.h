@@ -0,0 +1,574 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Andy Thomason 2012, 2013
+//
+// Modular Framework for OpenGLES2 rendering on multiple platforms.
+//
+// Command line batch renderer for L-Systems.
+//
+// usage: lsystems_batch [options] jobs.txt
+//
+// Each line of the job list is "grammar.xml iterations angle output...", where
+// angle may be "-" to keep the angle in the grammar and each output is a .tga,
+// .jpg, .oct, .obj, .ply or .svg file. Blank lines and lines starting with #
+// are skipped. A job list of "-" is read from stdin.
+//
+// On POSIX systems every job runs in its own process with its own memory and
+// time limits, so a grammar that explodes only fails its own job. Images need
+// the generic (headless) build, which renders with the software rasteriser.
+//
+
+#include "lsystems_export.h"
+#include "lsystems_scene.h"
+
+#if !defined(_WIN32) && !defined(SN_TARGET_PSP2)
+  #include <unistd.h>
+  #include <signal.h>
+  #include <sys/wait.h>
+  #define OCTET_BATCH_PROCESSES 1
+#else
+  #define OCTET_BATCH_PROCESSES 0
+#endif
+
+namespace octet {
+  // what happened to a job. Fixed size so that a child process can send it
+  // back through a pipe.
+  struct LSystemsBatchResult {
+    enum status_t {
+      status_ok,
+      status_failed,     // could not load the grammar or write an output
+      status_too_large,  // the production went over -max_symbols
+      status_timeout,    // killed after -timeout seconds
+      status_crashed,    // killed by a signal, usually out of memory
+    };
+
+    int status;
+    int signal;
+    unsigned symbols;
+    unsigned triangles;
+    unsigned peak_memory_kb;
+    float load_ms;
+    float expand_ms;
+    float build_ms;
+    float render_ms;
+    float write_ms;
+    float total_ms;
+
+    static const char *get_status_name(int status) {
+      static const char *names[] = { "ok", "failed", "too_large", "timeout", "crashed" };
+      return status >= 0 && status <= status_crashed ? names[status] : "unknown";
+    }
+  };
+
+  // one line of the job list
+  class LSystemsBatchJob {
+  public:
+    string grammar;
+    int iterations;
+    bool has_angle;
+    float angle;
+    dynarray<string> outputs;
+
+    LSystemsBatchResult result;
+    #if OCTET_BATCH_PROCESSES
+      pid_t pid;
+      int pipe_fd;
+    #endif
+
+    LSystemsBatchJob() {
+      iterations = 0;
+      has_angle = false;
+      angle = 0;
+      memset(&result, 0, sizeof(result));
+    }
+  };
+
+  class LSystemsBatch {
+  public:
+    // command line options
+    unsigned max_jobs;         // jobs at once, default one per core
+    unsigned threads_per_job;  // rasteriser threads in each job
+    int width;
+    int height;
+    float step_length;
+    unsigned max_symbols;      // 0 for no limit
+    unsigned max_memory_mb;    // address space of each job, 0 for no limit
+    unsigned timeout;          // seconds per job, 0 for no limit
+    bool quiet;                // discard the output of the jobs
+    const char *summary_url;
+
+  private:
+    dynarray<LSystemsBatchJob*> jobs;
+
+    static bool is_image(const char *url) {
+      const char *ext = strrchr(url, '.');
+      return ext && (!strcmp(ext, ".tga") || !strcmp(ext, ".jpg") || !strcmp(ext, ".jpeg"));
+    }
+
+    static bool is_scene(const char *url) {
+      const char *ext = strrchr(url, '.');
+      return ext && !strcmp(ext, ".oct");
+    }
+
+    // split a line into words, NUL terminating them in place
+    static unsigned split(char *line, char **words, unsigned max_words) {
+      unsigned num_words = 0;
+      for (char *p = line; *p && num_words != max_words; ) {
+        while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') *p++ = 0;
+        if (!*p) break;
+        words[num_words++] = p;
+        while (*p && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n') ++p;
+      }
+      return num_words;
+    }
+
+    // point the camera down -z at the middle of the tree
+    static void frame_camera(scene *scn, float aspect_ratio) {
+      aabb bb = scn->get_world_aabb();
+      vec3 center = bb.get_center();
+      float radius = length(bb.get_half_extent());
+      if (radius < 1.0f) radius = 1.0f;
+
+      // fit the bounding sphere in a 45 degree field of view
+      float distance = radius / sinf(22.5f * (3.14159265f / 180.0f));
+      camera_instance *cam = scn->get_camera_instance(0);
+      mat4t &cameraToWorld = cam->get_node()->access_nodeToParent();
+      cameraToWorld.loadIdentity();
+      cameraToWorld.translate(center.x(), center.y(), center.z() + distance);
+      cam->set_perspective(0, 45, aspect_ratio, distance * 0.01f, distance + radius * 2);
+    }
+
+    static float elapsed_ms(double &t) {
+      double now = app_utils::get_time();
+      float ms = (float)((now - t) * 1000);
+      t = now;
+      return ms;
+    }
+
+    // expand, interpret, render and write one job in this process
+    void run_job(const LSystemsBatchJob &job, LSystemsBatchResult &result) {
+      double start = app_utils::get_time();
+      double t = start;
+      memset(&result, 0, sizeof(result));
+      result.status = LSystemsBatchResult::status_failed;
+
+      LSystemsModel model;
+      if (!model.readConfigurationFile(job.grammar.c_str())) {
+        return;
+      }
+      if (job.has_angle) {
+        model.set_rotation_angle(job.angle);
+      }
+      result.load_ms = elapsed_ms(t);
+
+      // one step at a time so that the symbol limit stops runaway grammars early
+      const string *production = model.getProduction(0);
+      for (int i = 1; i <= job.iterations; ++i) {
+        production = model.getProduction(i);
+        if (!production) {
+          result.expand_ms = elapsed_ms(t);
+          result.total_ms = (float)((t - start) * 1000);
+          return;
+        }
+        result.symbols = (unsigned)strlen(production->c_str());
+        if (max_symbols && result.symbols > max_symbols) {
+          printf("warning: %s has %u symbols at iteration %d\n", job.grammar.c_str(), result.symbols, i);
+          result.status = LSystemsBatchResult::status_too_large;
+          result.expand_ms = elapsed_ms(t);
+          result.total_ms = (float)((t - start) * 1000);
+          return;
+        }
+      }
+      result.symbols = (unsigned)strlen(production->c_str());
+      result.expand_ms = elapsed_ms(t);
+
+      bool needs_scene = false;
+      for (unsigned i = 0; i != job.outputs.size(); ++i) {
+        needs_scene = needs_scene || is_image(job.outputs[i].c_str()) || is_scene(job.outputs[i].c_str());
+      }
+
+      resources dict;
+      scene *scn = 0;
+      LSystemsSceneBuilder builder;
+      builder.step_length = step_length;
+      if (needs_scene) {
+        #if defined(__GENERIC__)
+          // materials make their textures as they are loaded
+          if (!gl_ctxt()) {
+            gl_ctxt(new gl_context());
+          }
+        #endif
+        scn = builder.make_scene(dict, model, job.iterations, "tree");
+        for (int i = 0; i != scn->get_num_mesh_instances(); ++i) {
+          result.triangles += scn->get_mesh_instance(i)->get_mesh()->get_num_indices() / 3;
+        }
+      }
+      result.build_ms = elapsed_ms(t);
+
+      bool rendered = false;
+      bool ok = true;
+      for (unsigned i = 0; i != job.outputs.size(); ++i) {
+        const char *url = job.outputs[i].c_str();
+        if (is_image(url)) {
+          #if defined(__GENERIC__)
+            if (!rendered) {
+              render(scn);
+              rendered = true;
+              result.render_ms = elapsed_ms(t);
+            }
+            ok = app_utils::save_frame(url, 0, 0, width, height) && ok;
+          #else
+            printf("warning: %s needs the generic build to render\n", url);
+            ok = false;
+          #endif
+        } else if (is_scene(url)) {
+          ok = LSystemsSceneBuilder::save(dict, url) && ok;
+        } else {
+          LSystemsTurtle turtle;
+          turtle.angle = model.get_rotation_angle();
+          turtle.step_length = step_length;
+          turtle.initial_width = model.get_initial_width();
+          turtle.tropism = model.get_tropism();
+          turtle.elasticity = model.get_elasticity();
+          ok = lsystems_export_file(turtle, production->c_str(), url) && ok;
+        }
+      }
+      result.write_ms = elapsed_ms(t);
+      result.total_ms = (float)((t - start) * 1000);
+      result.peak_memory_kb = app_utils::get_peak_memory();
+      result.status = ok ? LSystemsBatchResult::status_ok : LSystemsBatchResult::status_failed;
+    }
+
+    #if defined(__GENERIC__)
+      // draw the scene into the software framebuffer
+      void render(scene *scn) {
+        gl_ctxt()->set_framebuffer_size(width, height);
+
+        bump_shader object_shader;
+        bump_shader skin_shader;
+        object_shader.init(false);
+        skin_shader.init(true);
+
+        float aspect_ratio = (float)width / height;
+        frame_camera(scn, aspect_ratio);
+
+        glViewport(0, 0, width, height);
+        glClearColor(0.5f, 0.5f, 0.5f, 1);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        gl_state::enable(GL_DEPTH_TEST, true);
+        gl_state::enable(GL_BLEND, true);
+        gl_state::blend_func(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+        scn->update(0);
+        scn->render(object_shader, skin_shader, *scn->get_camera_instance(0), aspect_ratio);
+        glFinish();
+      }
+    #endif
+
+    #if OCTET_BATCH_PROCESSES
+      // fork a process for a job. It sends its result back through a pipe.
+      bool start_job(LSystemsBatchJob &job) {
+        int fds[2];
+        if (pipe(fds)) {
+          return false;
+        }
+
+        fflush(stdout);
+        pid_t pid = fork();
+        if (pid < 0) {
+          close(fds[0]);
+          close(fds[1]);
+          return false;
+        }
+
+        if (pid == 0) {
+          close(fds[0]);
+          if (quiet) {
+            freopen("/dev/null", "w", stdout);
+          }
+          if (max_memory_mb) {
+            rlimit limit;
+            limit.rlim_cur = limit.rlim_max = (rlim_t)max_memory_mb << 20;
+            setrlimit(RLIMIT_AS, &limit);
+          }
+          if (timeout) {
+            alarm(timeout);
+          }
+
+          // the default thread pool is made on first use, after this
+          char threads[16];
+          sprintf(threads, "%u", threads_per_job);
+          setenv("OCTET_NUM_THREADS", threads, 1);
+
+          LSystemsBatchResult result;
+          run_job(job, result);
+          fflush(stdout);
+          ssize_t written = write(fds[1], &result, sizeof(result));
+          _exit(written == sizeof(result) ? 0 : 1);
+        }
+
+        close(fds[1]);
+        job.pid = pid;
+        job.pipe_fd = fds[0];
+        return true;
+      }
+
+      // collect the result of a finished job
+      void finish_job(LSystemsBatchJob &job, int status, const rusage &usage) {
+        LSystemsBatchResult &result = job.result;
+        ssize_t bytes = read(job.pipe_fd, &result, sizeof(result));
+        close(job.pipe_fd);
+        job.pid = 0;
+
+        if (WIFSIGNALED(status)) {
+          int sig = WTERMSIG(status);
+          if (bytes != sizeof(result)) {
+            memset(&result, 0, sizeof(result));
+          }
+          result.status = sig == SIGALRM ? LSystemsBatchResult::status_timeout : LSystemsBatchResult::status_crashed;
+          result.signal = sig;
+        } else if (bytes != sizeof(result)) {
+          memset(&result, 0, sizeof(result));
+          result.status = LSystemsBatchResult::status_crashed;
+        }
+
+        // the child's own figure misses anything after it was measured
+        #if defined(__APPLE__)
+          result.peak_memory_kb = (unsigned)(usage.ru_maxrss / 1024);
+        #else
+          result.peak_memory_kb = (unsigned)usage.ru_maxrss;
+        #endif
+      }
+
+      void run_jobs() {
+        unsigned next = 0;
+        unsigned running = 0;
+        while (next != jobs.size() || running != 0) {
+          while (running != max_jobs && next != jobs.size()) {
+            LSystemsBatchJob &job = *jobs[next++];
+            if (start_job(job)) {
+              running++;
+            } else {
+              printf("warning: could not start a process for %s\n", job.grammar.c_str());
+              run_job(job, job.result);
+              report(job);
+            }
+          }
+
+          if (running) {
+            int status = 0;
+            rusage usage;
+            pid_t pid = wait4(-1, &status, 0, &usage);
+            if (pid <= 0) break;
+            for (unsigned i = 0; i != next; ++i) {
+              if (jobs[i]->pid == pid) {
+                finish_job(*jobs[i], status, usage);
+                report(*jobs[i]);
+                running--;
+                break;
+              }
+            }
+          }
+        }
+      }
+    #else
+      // no processes: run the jobs one after another in this process
+      void run_jobs() {
+        for (unsigned i = 0; i != jobs.size(); ++i) {
+          run_job(*jobs[i], jobs[i]->result);
+          report(*jobs[i]);
+        }
+      }
+    #endif
+
+    static void report(const LSystemsBatchJob &job) {
+      const LSystemsBatchResult &r = job.result;
+      printf("%s %d: %s, %u symbols, %u triangles, %.1fms, %uKB\n",
+        job.grammar.c_str(), job.iterations, LSystemsBatchResult::get_status_name(r.status),
+        r.symbols, r.triangles, r.total_ms, r.peak_memory_kb
+      );
+    }
+
+    static void write_json_string(FILE *file, const char *str) {
+      fputc('"', file);
+      for (const char *p = str; *p; ++p) {
+        if (*p == '"' || *p == '\\') {
+          fputc('\\', file);
+          fputc(*p, file);
+        } else if ((unsigned char)*p < 0x20) {
+          fprintf(file, "\\u%04x", (unsigned char)*p);
+        } else {
+          fputc(*p, file);
+        }
+      }
+      fputc('"', file);
+    }
+
+    bool write_summary(const char *url, float wall_ms) {
+      FILE *file = !strcmp(url, "-") ? stdout : fopen(url, "w");
+      if (!file) {
+        printf("warning: could not write %s\n", url);
+        return false;
+      }
+
+      unsigned num_failed = 0;
+      unsigned max_peak_memory_kb = 0;
+      fprintf(file, "{\n  \"jobs\": [\n");
+      for (unsigned i = 0; i != jobs.size(); ++i) {
+        const LSystemsBatchJob &job = *jobs[i];
+        const LSystemsBatchResult &r = job.result;
+        if (r.status != LSystemsBatchResult::status_ok) num_failed++;
+        if (r.peak_memory_kb > max_peak_memory_kb) max_peak_memory_kb = r.peak_memory_kb;
+
+        fprintf(file, "    {\"grammar\": ");
+        write_json_string(file, job.grammar.c_str());
+        fprintf(file, ", \"iterations\": %d, ", job.iterations);
+        if (job.has_angle) {
+          fprintf(file, "\"angle\": %g, ", job.angle);
+        }
+        fprintf(file, "\"status\": \"%s\", ", LSystemsBatchResult::get_status_name(r.status));
+        if (r.signal) {
+          fprintf(file, "\"signal\": %d, ", r.signal);
+        }
+        fprintf(file, "\"symbols\": %u, \"triangles\": %u, ", r.symbols, r.triangles);
+        fprintf(file, "\"load_ms\": %.3f, \"expand_ms\": %.3f, \"build_ms\": %.3f, ", r.load_ms, r.expand_ms, r.build_ms);
+        fprintf(file, "\"render_ms\": %.3f, \"write_ms\": %.3f, \"total_ms\": %.3f, ", r.render_ms, r.write_ms, r.total_ms);
+        fprintf(file, "\"peak_memory_kb\": %u, \"outputs\": [", r.peak_memory_kb);
+        for (unsigned j = 0; j != job.outputs.size(); ++j) {
+          if (j) fprintf(file, ", ");
+          write_json_string(file, job.outputs[j].c_str());
+        }
+        fprintf(file, "]}%s\n", i + 1 == jobs.size() ? "" : ",");
+      }
+      fprintf(file, "  ],\n");
+      fprintf(file, "  \"num_jobs\": %u,\n  \"num_failed\": %u,\n", jobs.size(), num_failed);
+      fprintf(file, "  \"max_jobs\": %u,\n  \"wall_ms\": %.3f,\n", max_jobs, wall_ms);
+      fprintf(file, "  \"max_peak_memory_kb\": %u\n}\n", max_peak_memory_kb);
+      if (file != stdout) fclose(file);
+      return true;
+    }
+
+  public:
+    LSystemsBatch() {
+      max_jobs = thread_pool::get_num_cores();
+      threads_per_job = 1;
+      width = 512;
+      height = 512;
+      step_length = 1.0f;
+      max_symbols = 0;
+      max_memory_mb = 0;
+      timeout = 0;
+      quiet = false;
+      summary_url = "batch.json";
+    }
+
+    ~LSystemsBatch() {
+      for (unsigned i = 0; i != jobs.size(); ++i) {
+        delete jobs[i];
+      }
+    }
+
+    // read a job list. returns false if the file can't be read.
+    bool read_jobs(const char *url) {
+      FILE *file = !strcmp(url, "-") ? stdin : fopen(app_utils::get_path(url), "r");
+      if (!file) {
+        printf("warning: could not read %s\n", url);
+        return false;
+      }
+
+      char line[4096];
+      for (int line_number = 1; fgets(line, sizeof(line), file); ++line_number) {
+        char *words[64];
+        unsigned num_words = split(line, words, 64);
+        if (num_words == 0 || words[0][0] == '#') continue;
+        if (num_words < 4) {
+          printf("warning: %s(%d): expected grammar iterations angle output...\n", url, line_number);
+          continue;
+        }
+
+        LSystemsBatchJob *job = new LSystemsBatchJob();
+        job->grammar = words[0];
+        job->iterations = atoi(words[1]);
+        job->has_angle = strcmp(words[2], "-") != 0;
+        job->angle = job->has_angle ? (float)atof(words[2]) : 0;
+        for (unsigned i = 3; i != num_words; ++i) {
+          job->outputs.push_back(string(words[i]));
+        }
+        jobs.push_back(job);
+      }
+
+      if (file != stdin) fclose(file);
+      return true;
+    }
+
+    unsigned get_num_jobs() const {
+      return jobs.size();
+    }
+
+    // run all the jobs and write the summary. returns the number that failed.
+    unsigned run() {
+      if (max_jobs < 1) max_jobs = 1;
+      if (threads_per_job < 1) threads_per_job = 1;
+
+      double start = app_utils::get_time();
+      run_jobs();
+      float wall_ms = (float)((app_utils::get_time() - start) * 1000);
+
+      write_summary(summary_url, wall_ms);
+
+      unsigned num_failed = 0;
+      for (unsigned i = 0; i != jobs.size(); ++i) {
+        if (jobs[i]->result.status != LSystemsBatchResult::status_ok) num_failed++;
+      }
+      printf("%u jobs, %u failed, %.1fms\n", jobs.size(), num_failed, wall_ms);
+      return num_failed;
+    }
+  };
+
+  static int lsystems_batch_main(int argc, char **argv) {
+    LSystemsBatch batch;
+    const char *job_list = 0;
+    for (int i = 1; i < argc; ++i) {
+      const char *arg = argv[i];
+      bool has_value = i + 1 < argc;
+      if (!strcmp(arg, "-j") && has_value) {
+        batch.max_jobs = (unsigned)atoi(argv[++i]);
+      } else if (!strcmp(arg, "-threads") && has_value) {
+        batch.threads_per_job = (unsigned)atoi(argv[++i]);
+      } else if (!strcmp(arg, "-size") && has_value) {
+        ++i;
+        if (sscanf(argv[i], "%dx%d", &batch.width, &batch.height) != 2 || batch.width <= 0 || batch.height <= 0) {
+          printf("warning: bad size %s\n", argv[i]);
+          return 1;
+        }
+      } else if (!strcmp(arg, "-step") && has_value) {
+        batch.step_length = (float)atof(argv[++i]);
+      } else if (!strcmp(arg, "-max_symbols") && has_value) {
+        batch.max_symbols = (unsigned)atoi(argv[++i]);
+      } else if (!strcmp(arg, "-max_memory") && has_value) {
+        batch.max_memory_mb = (unsigned)atoi(argv[++i]);
+      } else if (!strcmp(arg, "-timeout") && has_value) {
+        batch.timeout = (unsigned)atoi(argv[++i]);
+      } else if (!strcmp(arg, "-summary") && has_value) {
+        batch.summary_url = argv[++i];
+      } else if (!strcmp(arg, "-quiet")) {
+        batch.quiet = true;
+      } else if (arg[0] == '-' && arg[1]) {
+        printf("warning: unknown option %s\n", arg);
+        return 1;
+      } else {
+        job_list = arg;
+      }
+    }
+
+    if (!job_list) {
+      printf("usage: %s [-j jobs] [-threads n] [-size WxH] [-step length] [-max_symbols n] [-max_memory MB] [-timeout s] [-summary out.json|-] [-quiet] jobs.txt|-\n", argv[0]);
+      return 1;
+    }
+
+    if (!batch.read_jobs(job_list)) {
+      return 1;
+    }
+    return batch.run() ? 1 : 0;
+  }
+}
@@ -0,0 +1,498 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Andy Thomason 2012, 2013
+//
+// Modular Framework for OpenGLES2 rendering on multiple platforms.
+//
+// Benchmarks for the L-System pipeline.
+//
+// usage: lsystems_benchmark [-max_iterations n] [-max_symbols n] [-repeat n]
+//          [-out results.json] [-baseline old.json] [-threshold percent]
+//          [-min_delta ms] [-max_draw_calls n] [-heap heap.json] [grammar.xml...]
+//
+// Every grammar (by default assets/lsystems1.xml, assets/lsystems2.xml...) is
+// run at 1, 2, 3... iterations until the production gets too big. Each phase
+// is timed (best of -repeat runs), and the octet allocator calls it makes and
+// the most heap it has in use at once are recorded:
+//
+//   load       parse the XML
+//   rewrite    expand the axiom to the production
+//   interpret  walk the production with the turtle and no output
+//   emit       build the wood and leaf meshes
+//   submit     draw with Tree2DRenderer, one draw call per symbol
+//   raster     finish the frame on the software rasteriser
+//
+// Meshes and draws need a GL context, so build with __GENERIC__ to run
+// headless on the software rasteriser. With -baseline, phases that got slower
+// by more than -threshold percent (default 10) and -min_delta ms (default 0.05)
+// or that make more allocations are listed as regressions and the exit code
+// is 1.
+//
+// Built with OCTET_GL_TRACE 1, the submit phase also reports its GL calls,
+// the redundant ones and the client-side bytes drawn. -max_draw_calls makes
+// any grammar that draws more than that a failure. The calls gl_state
+// skipped and made in the submit phase are reported in every build.
+//
+// -heap prints the allocator statistics at the end and writes them as JSON.
+// Build with OCTET_HEAP_STATS 1 for the numbers of each tag.
+//
+
+#include "lsystems_turtle.h"
+#include "lsystemsobjs.h"
+
+namespace octet {
+  // a segment sink that drops everything, to time the turtle on its own
+  class LSystemsNullSink : public LSystemsSegmentSink {
+  public:
+    void addSegment(const LSystemsSegment &seg) {
+    }
+  };
+
+  class LSystemsBenchmark {
+  public:
+    enum phase_t {
+      phase_load,
+      phase_rewrite,
+      phase_interpret,
+      phase_emit,
+      phase_submit,
+      phase_raster,
+      num_phases,
+    };
+
+    static const char *get_phase_name(unsigned phase) {
+      static const char *names[] = { "load", "rewrite", "interpret", "emit", "submit", "raster" };
+      return phase < num_phases ? names[phase] : "unknown";
+    }
+
+    // command line options
+    int max_iterations;
+    unsigned max_symbols;
+    unsigned repeat;
+    float threshold;
+    float min_delta_ms;
+    const char *out_url;
+    const char *baseline_url;
+    unsigned max_draw_calls;  // 0 for no limit
+    const char *heap_url;
+
+  private:
+    struct result_t {
+      unsigned grammar;
+      int iterations;
+      unsigned phase;
+      double time_ms;
+      unsigned symbols;
+      unsigned allocs;
+      uint64_t bytes;
+      unsigned peak_memory_kb;  // most heap in use at once during the phase
+
+      // GL calls made by the phase, with OCTET_GL_TRACE
+      unsigned draw_calls;
+      unsigned gl_calls;
+      unsigned redundant_gl_calls;
+      unsigned client_bytes;
+
+      // gl_state calls skipped and made
+      unsigned state_hits;
+      unsigned state_misses;
+    };
+
+    // allocator counters at the start of a phase
+    struct sample_t {
+      double time;
+      uint64_t allocs;
+      uint64_t bytes;
+
+      void start() {
+        allocs = allocator::get_num_allocs();
+        bytes = allocator::get_bytes_allocated();
+        allocator::reset_peak_bytes();
+        time = app_utils::get_time();
+      }
+    };
+
+    dynarray<string> grammars;
+    dynarray<result_t> results;
+
+    atlas_shader tshader;
+    texture_atlas atlas;
+    unsigned leaf_image;
+    unsigned wood_image;
+    enum { frame_width = 256, frame_height = 256 };
+
+    // keep the best time of the repeats and the counts of the first
+    void add_sample(result_t &r, const sample_t &s, bool first) {
+      double time_ms = (app_utils::get_time() - s.time) * 1000;
+      if (first) {
+        r.allocs = (unsigned)(allocator::get_num_allocs() - s.allocs);
+        r.bytes = allocator::get_bytes_allocated() - s.bytes;
+        r.peak_memory_kb = (unsigned)(allocator::get_peak_bytes() / 1024);
+        r.time_ms = time_ms;
+      } else if (time_ms < r.time_ms) {
+        r.time_ms = time_ms;
+      }
+    }
+
+    static bool file_exists(const char *url) {
+      FILE *file = fopen(app_utils::get_path(url), "rb");
+      if (file) fclose(file);
+      return file != NULL;
+    }
+
+    static void set_turtle(LSystemsTurtle &turtle, LSystemsModel &model) {
+      turtle.angle = model.get_rotation_angle();
+      turtle.step_length = 1.0f;
+      turtle.initial_width = model.get_initial_width();
+      turtle.tropism = model.get_tropism();
+      turtle.elasticity = model.get_elasticity();
+    }
+
+    void init_gl() {
+      #if defined(__GENERIC__)
+        gl_ctxt(new gl_context());
+        gl_ctxt()->set_framebuffer_size(frame_width, frame_height);
+      #endif
+      tshader.init();
+      leaf_image = atlas.add_image("assets/leaf.gif");
+      wood_image = atlas.add_image("assets/wood.gif", true);
+      atlas.build();
+    }
+
+    // run all the phases of one grammar at one iteration count
+    void run_grammar(unsigned grammar, int iterations, unsigned symbols) {
+      const char *url = grammars[grammar].c_str();
+      result_t r[num_phases];
+      memset(r, 0, sizeof(r));
+      for (unsigned phase = 0; phase != num_phases; ++phase) {
+        r[phase].grammar = grammar;
+        r[phase].iterations = iterations;
+        r[phase].phase = phase;
+        r[phase].symbols = symbols;
+      }
+
+      for (unsigned rep = 0; rep != repeat; ++rep) {
+        bool first = rep == 0;
+        sample_t s;
+
+        LSystemsModel model;
+        s.start();
+        model.readConfigurationFile(url, false);
+        add_sample(r[phase_load], s, first);
+
+        s.start();
+        const string *production_string = model.getProduction(iterations);
+        if (!production_string) break;
+        const char *production = production_string->c_str();
+        add_sample(r[phase_rewrite], s, first);
+
+        LSystemsTurtle turtle;
+        set_turtle(turtle, model);
+        LSystemsNullSink null_sink;
+        s.start();
+        turtle.interpret(production, null_sink);
+        add_sample(r[phase_interpret], s, first);
+
+        {
+          LSystemsBranchBuilder builder;
+          ref<mesh> wood(new mesh());
+          ref<mesh> leaves(new mesh());
+          s.start();
+          turtle.interpret(production, builder);
+          builder.get_wood_mesh(*wood);
+          builder.get_leaf_mesh(*leaves);
+          add_sample(r[phase_emit], s, first);
+        }
+
+        Tree2DRenderer renderer(&tshader, &model);
+        renderer.atlas = &atlas;
+        renderer.leafImage = leaf_image;
+        renderer.woodImage = wood_image;
+
+        mat4t cameraToWorld;
+        cameraToWorld.loadIdentity();
+        cameraToWorld.translate(0, 0, 50);
+        mat4t cameraToProjection;
+        cameraToProjection.loadIdentity();
+
+        glViewport(0, 0, frame_width, frame_height);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        gl_state::bind_texture(0, GL_TEXTURE_2D, atlas.get_texture());
+
+        // count the GL calls of the submit on their own
+        gl_trace::get().end_frame();
+        unsigned state_hits = gl_state::get_hits();
+        unsigned state_misses = gl_state::get_misses();
+        s.start();
+        renderer.render(cameraToWorld, cameraToProjection, iterations);
+        add_sample(r[phase_submit], s, first);
+        if (first) {
+          r[phase_submit].state_hits = gl_state::get_hits() - state_hits;
+          r[phase_submit].state_misses = gl_state::get_misses() - state_misses;
+          const gl_trace::frame_t &f = gl_trace::get().get_current();
+          r[phase_submit].draw_calls = f.get_draw_calls();
+          r[phase_submit].gl_calls = f.get_num_calls();
+          r[phase_submit].redundant_gl_calls = f.get_num_redundant();
+          r[phase_submit].client_bytes = f.client_bytes;
+        }
+        gl_trace::get().end_frame();
+
+        s.start();
+        glFinish();
+        add_sample(r[phase_raster], s, first);
+      }
+
+      for (unsigned phase = 0; phase != num_phases; ++phase) {
+        results.push_back(r[phase]);
+        print_result(r[phase]);
+      }
+    }
+
+    static double get_symbols_per_second(const result_t &r) {
+      return r.time_ms > 0 ? r.symbols / (r.time_ms * 0.001) : 0;
+    }
+
+    void print_result(const result_t &r) {
+      printf("%-24s %2d %-9s %10.3fms %9u symbols %12.0f symbols/s %8u allocs %10llu bytes %8uKB\n",
+        grammars[r.grammar].c_str(), r.iterations, get_phase_name(r.phase), r.time_ms, r.symbols,
+        get_symbols_per_second(r), r.allocs, (unsigned long long)r.bytes, r.peak_memory_kb
+      );
+      if (OCTET_GL_TRACE && r.gl_calls) {
+        printf("%-24s %2d %-9s %10u draws %9u gl calls %9u redundant %12u client bytes\n",
+          "", r.iterations, "gl", r.draw_calls, r.gl_calls, r.redundant_gl_calls, r.client_bytes
+        );
+      }
+      if (r.state_hits + r.state_misses) {
+        printf("%-24s %2d %-9s %10u skipped %7u made\n", "", r.iterations, "gl_state", r.state_hits, r.state_misses);
+      }
+    }
+
+    static void write_json_string(FILE *file, const char *str) {
+      fputc('"', file);
+      for (const char *p = str; *p; ++p) {
+        if (*p == '"' || *p == '\\') fputc('\\', file);
+        fputc(*p, file);
+      }
+      fputc('"', file);
+    }
+
+    // one result per line, so that a baseline can be read back line by line
+    bool write_results(const char *url) {
+      FILE *file = !strcmp(url, "-") ? stdout : fopen(url, "w");
+      if (!file) {
+        printf("warning: could not write %s\n", url);
+        return false;
+      }
+      fprintf(file, "{\n  \"max_iterations\": %d,\n  \"max_symbols\": %u,\n  \"repeat\": %u,\n", max_iterations, max_symbols, repeat);
+      fprintf(file, "  \"results\": [\n");
+      for (unsigned i = 0; i != results.size(); ++i) {
+        const result_t &r = results[i];
+        fprintf(file, "    {\"grammar\": ");
+        write_json_string(file, grammars[r.grammar].c_str());
+        fprintf(file, ", \"iterations\": %d, \"phase\": \"%s\", \"time_ms\": %.4f, \"symbols\": %u, \"symbols_per_s\": %.0f, ",
+          r.iterations, get_phase_name(r.phase), r.time_ms, r.symbols, get_symbols_per_second(r)
+        );
+        fprintf(file, "\"allocs\": %u, \"bytes\": %llu, \"peak_memory_kb\": %u, ",
+          r.allocs, (unsigned long long)r.bytes, r.peak_memory_kb
+        );
+        fprintf(file, "\"draw_calls\": %u, \"gl_calls\": %u, \"redundant_gl_calls\": %u, \"client_bytes\": %u, ",
+          r.draw_calls, r.gl_calls, r.redundant_gl_calls, r.client_bytes
+        );
+        fprintf(file, "\"state_hits\": %u, \"state_misses\": %u}%s\n",
+          r.state_hits, r.state_misses, i + 1 == results.size() ? "" : ","
+        );
+      }
+      fprintf(file, "  ]\n}\n");
+      if (file != stdout) fclose(file);
+      return true;
+    }
+
+    // find "key": in a line and return what follows, or NULL
+    static const char *find_value(const char *line, const char *key) {
+      char pattern[64];
+      sprintf(pattern, "\"%s\": ", key);
+      const char *p = strstr(line, pattern);
+      return p ? p + strlen(pattern) : NULL;
+    }
+
+    // compare with a file written by write_results. returns the number of regressions.
+    unsigned compare(const char *url) {
+      FILE *file = fopen(url, "r");
+      if (!file) {
+        printf("warning: could not read baseline %s\n", url);
+        return 0;
+      }
+
+      printf("\ncomparing with %s\n", url);
+      unsigned num_regressions = 0;
+      unsigned num_compared = 0;
+      char line[1024];
+      while (fgets(line, sizeof(line), file)) {
+        const char *grammar = find_value(line, "grammar");
+        const char *iterations = find_value(line, "iterations");
+        const char *phase = find_value(line, "phase");
+        const char *time_ms = find_value(line, "time_ms");
+        const char *allocs = find_value(line, "allocs");
+        if (!grammar || !iterations || !phase || !time_ms || !allocs) continue;
+
+        for (unsigned i = 0; i != results.size(); ++i) {
+          const result_t &r = results[i];
+          const char *name = grammars[r.grammar].c_str();
+          const char *phase_name = get_phase_name(r.phase);
+          size_t name_len = strlen(name), phase_len = strlen(phase_name);
+          if (
+            r.iterations != atoi(iterations) ||
+            strncmp(grammar + 1, name, name_len) || grammar[name_len + 1] != '"' ||
+            strncmp(phase + 1, phase_name, phase_len) || phase[phase_len + 1] != '"'
+          ) {
+            continue;
+          }
+
+          double old_ms = atof(time_ms);
+          unsigned old_allocs = (unsigned)strtoul(allocs, NULL, 10);
+          // small absolute changes are timer noise
+          bool slower = r.time_ms > old_ms * (1 + threshold * 0.01f) && r.time_ms - old_ms > min_delta_ms;
+          bool more_allocs = r.allocs > old_allocs;
+          num_compared++;
+          if (slower || more_allocs) {
+            num_regressions++;
+            printf("REGRESSION %-24s %2d %-9s %10.3fms -> %10.3fms (%+.1f%%) %8u -> %8u allocs\n",
+              name, r.iterations, phase_name, old_ms, r.time_ms,
+              old_ms > 0 ? (r.time_ms / old_ms - 1) * 100 : 0.0, old_allocs, r.allocs
+            );
+          }
+          break;
+        }
+      }
+      fclose(file);
+      printf("%u results compared, %u regressions\n", num_compared, num_regressions);
+      return num_regressions;
+    }
+
+    // returns the number of results that draw more than max_draw_calls
+    unsigned check_draw_calls() {
+      if (!OCTET_GL_TRACE) {
+        printf("warning: -max_draw_calls needs a build with OCTET_GL_TRACE 1\n");
+        return 1;
+      }
+      unsigned num_over = 0;
+      for (unsigned i = 0; i != results.size(); ++i) {
+        const result_t &r = results[i];
+        if (r.draw_calls > max_draw_calls) {
+          num_over++;
+          printf("TOO MANY DRAWS %-24s %2d %10u draws, limit %u\n",
+            grammars[r.grammar].c_str(), r.iterations, r.draw_calls, max_draw_calls
+          );
+        }
+      }
+      return num_over;
+    }
+
+  public:
+    LSystemsBenchmark() {
+      max_iterations = 8;
+      max_symbols = 2000000;
+      repeat = 3;
+      threshold = 10;
+      min_delta_ms = 0.05f;
+      out_url = "benchmark.json";
+      baseline_url = NULL;
+      max_draw_calls = 0;
+      heap_url = NULL;
+      leaf_image = wood_image = 0;
+    }
+
+    void add_grammar(const char *url) {
+      grammars.push_back(string(url));
+    }
+
+    unsigned get_num_grammars() const {
+      return grammars.size();
+    }
+
+    // assets/lsystems1.xml, assets/lsystems2.xml... up to the first missing one
+    void add_default_grammars() {
+      for (int i = 1; ; ++i) {
+        char url[64];
+        sprintf(url, "assets/lsystems%d.xml", i);
+        if (!file_exists(url)) break;
+        add_grammar(url);
+      }
+    }
+
+    // run everything. returns the number of regressions against the baseline.
+    unsigned run() {
+      if (repeat < 1) repeat = 1;
+      init_gl();
+
+      for (unsigned grammar = 0; grammar != grammars.size(); ++grammar) {
+        const char *url = grammars[grammar].c_str();
+        LSystemsModel probe;
+        if (!file_exists(url) || !probe.readConfigurationFile(url, false)) {
+          printf("warning: could not load %s\n", url);
+          continue;
+        }
+
+        // stop before the production gets too big
+        for (int iterations = 1; iterations <= max_iterations; ++iterations) {
+          const string *production = probe.getProduction(iterations);
+          if (!production) break;
+          unsigned symbols = (unsigned)strlen(production->c_str());
+          if (symbols > max_symbols) break;
+          run_grammar(grammar, iterations, symbols);
+        }
+      }
+
+      write_results(out_url);
+      if (heap_url) {
+        allocator::print_stats();
+        allocator::write_json(heap_url);
+      }
+      unsigned num_failures = baseline_url ? compare(baseline_url) : 0;
+      if (max_draw_calls) num_failures += check_draw_calls();
+      return num_failures;
+    }
+  };
+
+  static int lsystems_benchmark_main(int argc, char **argv) {
+    #if !defined(__GENERIC__)
+      printf("the benchmark needs the generic build (__GENERIC__) for its GL context\n");
+      return 1;
+    #endif
+
+    LSystemsBenchmark benchmark;
+    for (int i = 1; i < argc; ++i) {
+      const char *arg = argv[i];
+      bool has_value = i + 1 < argc;
+      if (!strcmp(arg, "-max_iterations") && has_value) {
+        benchmark.max_iterations = atoi(argv[++i]);
+      } else if (!strcmp(arg, "-max_symbols") && has_value) {
+        benchmark.max_symbols = (unsigned)atoi(argv[++i]);
+      } else if (!strcmp(arg, "-repeat") && has_value) {
+        benchmark.repeat = (unsigned)atoi(argv[++i]);
+      } else if (!strcmp(arg, "-out") && has_value) {
+        benchmark.out_url = argv[++i];
+      } else if (!strcmp(arg, "-baseline") && has_value) {
+        benchmark.baseline_url = argv[++i];
+      } else if (!strcmp(arg, "-threshold") && has_value) {
+        benchmark.threshold = (float)atof(argv[++i]);
+      } else if (!strcmp(arg, "-min_delta") && has_value) {
+        benchmark.min_delta_ms = (float)atof(argv[++i]);
+      } else if (!strcmp(arg, "-max_draw_calls") && has_value) {
+        benchmark.max_draw_calls = (unsigned)atoi(argv[++i]);
+      } else if (!strcmp(arg, "-heap") && has_value) {
+        benchmark.heap_url = argv[++i];
+      } else if (arg[0] == '-') {
+        printf("usage: %s [-max_iterations n] [-max_symbols n] [-repeat n] [-out results.json] [-baseline old.json] [-threshold percent] [-min_delta ms] [-max_draw_calls n] [-heap heap.json] [grammar.xml...]\n", argv[0]);
+        return 1;
+      } else {
+        benchmark.add_grammar(arg);
+      }
+    }
+
+    if (benchmark.get_num_grammars() == 0) {
+      benchmark.add_default_grammars();
+    }
+    return benchmark.run() ? 1 : 0;
+  }
+}
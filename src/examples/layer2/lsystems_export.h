@@ -0,0 +1,84 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Andy Thomason 2012, 2013
+//
+// Modular Framework for OpenGLES2 rendering on multiple platforms.
+//
+// Command line exporter for L-Systems. Needs no window or GL context.
+//
+// usage: lsystems_export grammar.xml iterations output.obj|output.ply|output.svg... [-step length]
+//
+
+#include "lsystems_turtle.h"
+#include "lsystemsobjs.h"
+#include "lsystems_exporters.h"
+
+namespace octet {
+  // write a production as .obj, .ply or .svg depending on the extension of url
+  static bool lsystems_export_file(LSystemsTurtle &turtle, const char *production, const char *url) {
+    const char *ext = strrchr(url, '.');
+    bool ok = false;
+    if (ext && !strcmp(ext, ".obj")) {
+      LSystemsObjExporter exporter;
+      ok = exporter.write(turtle, production, url);
+      printf("%s: %d vertices %d triangles\n", url, exporter.get_num_vertices(), exporter.get_num_triangles());
+    } else if (ext && !strcmp(ext, ".ply")) {
+      LSystemsPlyExporter exporter;
+      ok = exporter.write(turtle, production, url);
+      printf("%s: %d vertices %d triangles\n", url, exporter.get_num_vertices(), exporter.get_num_triangles());
+    } else if (ext && !strcmp(ext, ".svg")) {
+      LSystemsSvgExporter exporter;
+      ok = exporter.write(turtle, production, url);
+      printf("%s: %d segments\n", url, turtle.get_num_segments());
+    } else {
+      printf("warning: unknown export format %s\n", url);
+    }
+    return ok;
+  }
+
+  static int lsystems_export_main(int argc, char **argv) {
+    if (argc < 4) {
+      printf("usage: %s grammar.xml iterations output.obj|output.ply|output.svg... [-step length]\n", argv[0]);
+      return 1;
+    }
+
+    LSystemsModel model;
+    if (!model.readConfigurationFile(argv[1])) {
+      return 1;
+    }
+
+    int iterations = atoi(argv[2]);
+
+    LSystemsTurtle turtle;
+    turtle.angle = model.get_rotation_angle();
+    turtle.step_length = 1.0f;
+    turtle.initial_width = model.get_initial_width();
+    turtle.tropism = model.get_tropism();
+    turtle.elasticity = model.get_elasticity();
+
+    for (int i = 3; i < argc - 1; ++i) {
+      if (!strcmp(argv[i], "-step")) {
+        turtle.step_length = (float)atof(argv[i+1]);
+      }
+    }
+
+    const string *production_string = model.getProduction(iterations);
+    if (!production_string) {
+      return 1;
+    }
+    const char *production = production_string->c_str();
+
+    int result = 0;
+    for (int i = 3; i < argc; ++i) {
+      if (!strcmp(argv[i], "-step")) {
+        ++i;
+        continue;
+      }
+
+      if (!lsystems_export_file(turtle, production, argv[i])) {
+        result = 1;
+      }
+    }
+    return result;
+  }
+}
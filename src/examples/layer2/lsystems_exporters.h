@@ -0,0 +1,456 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Andy Thomason 2012, 2013
+//
+// Modular Framework for OpenGLES2 rendering on multiple platforms.
+//
+// Streaming exporters for turtle output: OBJ and binary PLY for 3D, SVG for 2D.
+//
+// The exporters are segment sinks, so geometry goes straight from the turtle
+// to the file and the mesh is never held in memory. The only per-segment
+// state kept is the first vertex of each segment's end ring, so that a
+// branch is written as one tube as in LSystemsBranchBuilder.
+//
+// PLY and SVG need counts or bounds in their headers, so they walk the
+// production more than once. The turtle is much cheaper than the disk.
+// PLY writes its counts last, over fixed width placeholders in the header.
+//
+// Output is buffered in large chunks and floats are formatted with integer
+// arithmetic, so the files are the same on every platform. A failed write,
+// such as to a full disk, makes close() and the exporters' write() fail.
+//
+
+namespace octet {
+  // Buffered file output with fast, deterministic number formatting.
+  class LSystemsFileWriter {
+    enum { buffer_size = 1 << 18 };
+
+    FILE *file;
+    char *buffer;
+    unsigned used;
+    bool failed;
+    string url;
+
+    void write_file(const void *src, size_t bytes) {
+      if (!failed && fwrite(src, 1, bytes, file) != bytes) {
+        failed = true;
+      }
+    }
+
+  public:
+    LSystemsFileWriter()
+    : file(NULL)
+    , buffer(NULL)
+    , used(0)
+    , failed(false)
+    {
+    }
+
+    ~LSystemsFileWriter() {
+      close();
+    }
+
+    bool open(const char *url) {
+      close();
+      file = fopen(app_utils::get_path(url), "wb");
+      if (!file) {
+        printf("warning: could not write %s\n", url);
+        return false;
+      }
+      buffer = (char*)allocator::malloc(buffer_size);
+      used = 0;
+      failed = false;
+      this->url = url;
+      return true;
+    }
+
+    // returns false if any of the file could not be written
+    bool close() {
+      bool ok = true;
+      if (file) {
+        flush();
+        if (fclose(file)) failed = true;
+        allocator::free(buffer, buffer_size);
+        file = NULL;
+        buffer = NULL;
+        if (failed) {
+          printf("warning: could not write all of %s\n", url.c_str());
+        }
+        ok = !failed;
+      }
+      return ok;
+    }
+
+    void flush() {
+      if (used) {
+        write_file(buffer, used);
+        used = 0;
+      }
+    }
+
+    // flush and move to an absolute position, to patch a header
+    void seek(uint64_t offset) {
+      flush();
+      #if defined(_MSC_VER)
+        if (_fseeki64(file, (int64_t)offset, SEEK_SET)) failed = true;
+      #else
+        if (fseeko(file, (off_t)offset, SEEK_SET)) failed = true;
+      #endif
+    }
+
+    // bytes written so far
+    uint64_t tell() {
+      #if defined(_MSC_VER)
+        int64_t pos = _ftelli64(file);
+      #else
+        int64_t pos = (int64_t)ftello(file);
+      #endif
+      return (pos < 0 ? 0 : (uint64_t)pos) + used;
+    }
+
+    void write(const void *src, unsigned bytes) {
+      if (used + bytes > buffer_size) {
+        flush();
+        if (bytes > buffer_size) {
+          write_file(src, bytes);
+          return;
+        }
+      }
+      memcpy(buffer + used, src, bytes);
+      used += bytes;
+    }
+
+    void write(const char *str) {
+      write(str, (unsigned)strlen(str));
+    }
+
+    void write_char(char c) {
+      if (used == buffer_size) flush();
+      buffer[used++] = c;
+    }
+
+    // with leading zeros up to min_digits, at most 10
+    void write_uint(unsigned value, unsigned min_digits = 1) {
+      char tmp[16];
+      char *p = tmp + sizeof(tmp);
+      do {
+        *--p = (char)('0' + value % 10);
+        value /= 10;
+      } while (value || tmp + sizeof(tmp) - p < (int)min_digits);
+      write(p, (unsigned)(tmp + sizeof(tmp) - p));
+    }
+
+    // fixed point with up to 4 decimals and no trailing zeros.
+    void write_float(float value) {
+      if (value != value) value = 0;
+      if (value < 0) {
+        value = -value;
+        // avoid writing -0
+        if (value >= 0.00005f) write_char('-');
+      }
+
+      if (value >= 1e9f) {
+        char tmp[32];
+        sprintf(tmp, "%.6e", value);
+        write(tmp);
+        return;
+      }
+
+      uint64_t fixed = (uint64_t)((double)value * 10000.0 + 0.5);
+      unsigned whole = (unsigned)(fixed / 10000);
+      unsigned frac = (unsigned)(fixed % 10000);
+      write_uint(whole);
+      if (frac) {
+        char tmp[5] = { '.' };
+        unsigned digits = 4;
+        while (frac % 10 == 0) { frac /= 10; digits--; }
+        for (unsigned i = digits; i != 0; --i) {
+          tmp[i] = (char)('0' + frac % 10);
+          frac /= 10;
+        }
+        write(tmp, digits + 1);
+      }
+    }
+
+    // little endian binary values
+    void write_f32(float value) {
+      uint32_t bits;
+      memcpy(&bits, &value, 4);
+      write_u32(bits);
+    }
+
+    void write_u32(uint32_t value) {
+      uint8_t b[4] = { (uint8_t)value, (uint8_t)(value >> 8), (uint8_t)(value >> 16), (uint8_t)(value >> 24) };
+      write(b, 4);
+    }
+
+    void write_u8(uint8_t value) {
+      write_char((char)value);
+    }
+  };
+
+  // Turns segments into tube rings and leaf quads and passes the vertices
+  // and triangles on. Vertices are numbered from zero in the order they are sent.
+  class LSystemsGeometrySink : public LSystemsSegmentSink {
+    dynarray<unsigned> end_rings;
+    unsigned num_vertices;
+    unsigned num_triangles;
+
+    unsigned addRing(const mat4t &frame, float radius, float v) {
+      unsigned first = num_vertices;
+      vec4 pos = frame[3];
+      for (unsigned i = 0; i <= slices; ++i) {
+        float angle = i * (3.1415926536f * 2 / slices);
+        vec4 dir = frame[0] * cosf(angle) - frame[2] * sinf(angle);
+        writeVertex((pos + dir * radius).xyz(), dir.xyz(), (float)i / slices, v * uvscale);
+        num_vertices++;
+      }
+      return first;
+    }
+
+    void addTriangle(unsigned a, unsigned b, unsigned c) {
+      writeTriangle(a, b, c);
+      num_triangles++;
+    }
+
+    void addLeaf(const LSystemsSegment &seg) {
+      const mat4t &m = seg.start_frame;
+      vec4 origin = m[3];
+      vec4 heading = m[1] * (seg.end_frame[3] - origin).length();
+      vec4 sides[2] = { m[0] * (leaf_width * 0.5f), m[2] * (leaf_width * 0.5f) };
+      vec4 normals[2] = { m[2], m[0] };
+
+      for (unsigned i = 0; i != 2; ++i) {
+        unsigned first = num_vertices;
+        writeVertex((origin - sides[i]).xyz(), normals[i].xyz(), 0, 0);
+        writeVertex((origin + sides[i]).xyz(), normals[i].xyz(), 1, 0);
+        writeVertex((origin + sides[i] + heading).xyz(), normals[i].xyz(), 1, 1);
+        writeVertex((origin - sides[i] + heading).xyz(), normals[i].xyz(), 0, 1);
+        num_vertices += 4;
+        addTriangle(first + 0, first + 1, first + 2);
+        addTriangle(first + 0, first + 2, first + 3);
+      }
+    }
+
+  protected:
+    virtual void writeVertex(const vec3 &pos, const vec3 &normal, float u, float v) = 0;
+    virtual void writeTriangle(unsigned a, unsigned b, unsigned c) = 0;
+
+  public:
+    // same meaning as in LSystemsBranchBuilder
+    unsigned slices;
+    float uvscale;
+    float leaf_width;
+
+    LSystemsGeometrySink()
+    : num_vertices(0)
+    , num_triangles(0)
+    , slices(6)
+    , uvscale(1.0f)
+    , leaf_width(0.5f)
+    {
+    }
+
+    void beginSegments(unsigned max_segments, unsigned max_leaves) {
+      num_vertices = num_triangles = 0;
+      end_rings.resize(0);
+      end_rings.reserve(max_segments + max_leaves);
+    }
+
+    void addSegment(const LSystemsSegment &seg) {
+      if (seg.is_leaf) {
+        addLeaf(seg);
+        end_rings.push_back(~0u);
+        return;
+      }
+
+      unsigned start_ring = ~0u;
+      if (seg.parent >= 0) {
+        start_ring = end_rings[seg.parent];
+      }
+      if (start_ring == ~0u) {
+        start_ring = addRing(seg.start_frame, seg.start_radius, seg.start_v);
+      }
+      unsigned end_ring = addRing(seg.end_frame, seg.end_radius, seg.end_v);
+      for (unsigned j = 0; j != slices; ++j) {
+        addTriangle(start_ring + j, end_ring + j, end_ring + j + 1);
+        addTriangle(start_ring + j, end_ring + j + 1, start_ring + j + 1);
+      }
+      end_rings.push_back(end_ring);
+    }
+
+    unsigned get_num_vertices() const {
+      return num_vertices;
+    }
+
+    unsigned get_num_triangles() const {
+      return num_triangles;
+    }
+  };
+
+  // Wavefront OBJ, written in one pass. OBJ allows faces between vertices,
+  // so each segment is written as soon as it arrives.
+  class LSystemsObjExporter : public LSystemsGeometrySink {
+    LSystemsFileWriter out;
+
+    void writeVertex(const vec3 &pos, const vec3 &normal, float u, float v) {
+      out.write("v ", 2);
+      out.write_float(pos.x()); out.write_char(' ');
+      out.write_float(pos.y()); out.write_char(' ');
+      out.write_float(pos.z());
+      out.write("\nvn ", 4);
+      out.write_float(normal.x()); out.write_char(' ');
+      out.write_float(normal.y()); out.write_char(' ');
+      out.write_float(normal.z());
+      out.write("\nvt ", 4);
+      out.write_float(u); out.write_char(' ');
+      out.write_float(v);
+      out.write_char('\n');
+    }
+
+    void writeIndex(unsigned index) {
+      // obj indices start at one and v, vt and vn share the same numbering here
+      out.write_uint(index + 1); out.write_char('/');
+      out.write_uint(index + 1); out.write_char('/');
+      out.write_uint(index + 1);
+    }
+
+    void writeTriangle(unsigned a, unsigned b, unsigned c) {
+      out.write("f ", 2);
+      writeIndex(a); out.write_char(' ');
+      writeIndex(b); out.write_char(' ');
+      writeIndex(c); out.write_char('\n');
+    }
+
+  public:
+    bool write(LSystemsTurtle &turtle, const char *production, const char *url) {
+      if (!out.open(url)) return false;
+      out.write("# octet lsystems\n");
+      turtle.interpret(production, *this);
+      return out.close();
+    }
+  };
+
+  // Binary little endian PLY. All vertices must come before the faces, so the
+  // production is walked twice: vertices, then faces. The element counts in
+  // the header are written as zeros and patched at the end.
+  class LSystemsPlyExporter : public LSystemsGeometrySink {
+    enum pass_t { pass_vertices, pass_faces };
+
+    // enough digits for any unsigned count
+    enum { count_digits = 10 };
+
+    LSystemsFileWriter out;
+    pass_t pass;
+
+    void writeVertex(const vec3 &pos, const vec3 &normal, float u, float v) {
+      if (pass != pass_vertices) return;
+      out.write_f32(pos.x()); out.write_f32(pos.y()); out.write_f32(pos.z());
+      out.write_f32(normal.x()); out.write_f32(normal.y()); out.write_f32(normal.z());
+      out.write_f32(u); out.write_f32(v);
+    }
+
+    void writeTriangle(unsigned a, unsigned b, unsigned c) {
+      if (pass != pass_faces) return;
+      out.write_u8(3);
+      out.write_u32(a); out.write_u32(b); out.write_u32(c);
+    }
+
+  public:
+    LSystemsPlyExporter()
+    : pass(pass_vertices)
+    {
+    }
+
+    bool write(LSystemsTurtle &turtle, const char *production, const char *url) {
+      if (!out.open(url)) return false;
+      out.write("ply\nformat binary_little_endian 1.0\ncomment octet lsystems\n");
+      out.write("element vertex ");
+      uint64_t vertex_count_pos = out.tell();
+      out.write_uint(0, count_digits);
+      out.write("\nproperty float x\nproperty float y\nproperty float z\n");
+      out.write("property float nx\nproperty float ny\nproperty float nz\n");
+      out.write("property float s\nproperty float t\n");
+      out.write("element face ");
+      uint64_t face_count_pos = out.tell();
+      out.write_uint(0, count_digits);
+      out.write("\nproperty list uchar uint vertex_indices\nend_header\n");
+
+      pass = pass_vertices;
+      turtle.interpret(production, *this);
+      pass = pass_faces;
+      turtle.interpret(production, *this);
+
+      out.seek(vertex_count_pos);
+      out.write_uint(get_num_vertices(), count_digits);
+      out.seek(face_count_pos);
+      out.write_uint(get_num_triangles(), count_digits);
+      return out.close();
+    }
+  };
+
+  // SVG of the x-y plane, for 2D grammars. The first walk finds the bounds
+  // for the view box, the second writes a line per segment.
+  class LSystemsSvgExporter : public LSystemsSegmentSink {
+    LSystemsFileWriter out;
+    bool measuring;
+    vec3 bb_min;
+    vec3 bb_max;
+
+    void include(const vec4 &pos) {
+      bb_min = min(bb_min, pos.xyz());
+      bb_max = max(bb_max, pos.xyz());
+    }
+
+  public:
+    // segment widths are scaled by this
+    float width_scale;
+
+    LSystemsSvgExporter()
+    : measuring(false)
+    , width_scale(2.0f)
+    {
+    }
+
+    void addSegment(const LSystemsSegment &seg) {
+      const vec4 &start = seg.start_frame[3];
+      const vec4 &end = seg.end_frame[3];
+      if (measuring) {
+        include(start);
+        include(end);
+        return;
+      }
+
+      // svg y is down
+      out.write(seg.is_leaf ? "<line class=\"l\" x1=\"" : "<line x1=\"");
+      out.write_float(start.x()); out.write("\" y1=\"");
+      out.write_float(-start.y()); out.write("\" x2=\"");
+      out.write_float(end.x()); out.write("\" y2=\"");
+      out.write_float(-end.y()); out.write("\" stroke-width=\"");
+      out.write_float(seg.start_radius * width_scale); out.write("\"/>\n");
+    }
+
+    bool write(LSystemsTurtle &turtle, const char *production, const char *url) {
+      measuring = true;
+      bb_min = vec3(1e30f, 1e30f, 1e30f);
+      bb_max = vec3(-1e30f, -1e30f, -1e30f);
+      turtle.interpret(production, *this);
+      measuring = false;
+      if (bb_min.x() > bb_max.x()) {
+        bb_min = bb_max = vec3(0, 0, 0);
+      }
+
+      if (!out.open(url)) return false;
+      float margin = 1.0f;
+      out.write("<svg xmlns=\"http://www.w3.org/2000/svg\" viewBox=\"");
+      out.write_float(bb_min.x() - margin); out.write_char(' ');
+      out.write_float(-bb_max.y() - margin); out.write_char(' ');
+      out.write_float(bb_max.x() - bb_min.x() + margin * 2); out.write_char(' ');
+      out.write_float(bb_max.y() - bb_min.y() + margin * 2); out.write("\">\n");
+      out.write("<style>line{stroke:#6b4423;stroke-linecap:round}.l{stroke:#3a7d2c}</style>\n");
+      turtle.interpret(production, *this);
+      out.write("</svg>\n");
+      return out.close();
+    }
+  };
+}
@@ -0,0 +1,195 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Andy Thomason 2012, 2013
+//
+// Modular Framework for OpenGLES2 rendering on multiple platforms.
+//
+// Forest of L-System trees in an octet scene.
+//
+// Each tree is a scene_node with a grammar, a seed and a maximum iteration.
+// Grammars are loaded once and keep their productions, and geometry is built
+// once per (grammar, iteration) pair, so memory grows with the number of
+// distinct trees rather than the number of trees placed.
+//
+// update() picks an iteration for each tree from its distance to the camera
+// and gives the tree's mesh instances the geometry of that iteration. The
+// scene sorts the instances for drawing.
+//
+
+namespace octet {
+  class LSystemsForest {
+    struct grammar_t {
+      LSystemsModel *model;
+      string url;
+    };
+
+    struct geometry_t {
+      unsigned grammar;
+      int iterations;
+      ref<mesh> wood;
+      ref<mesh> leaves;
+    };
+
+    struct tree_t {
+      unsigned grammar;
+      int max_iterations;
+      unsigned geometry;  // in use, ~0 before the first update()
+      ref<scene_node> node;
+    };
+
+    ref<scene> forest_scene;
+    ref<material> wood_material;
+    ref<material> leaf_material;
+
+    dynarray<grammar_t> grammars;
+    dictionary<unsigned> grammar_index;
+
+    // geometry index + 1 for each (grammar, iteration) key
+    hash_map<unsigned, unsigned> geometry_index;
+    dynarray<geometry_t> geometries;
+
+    dynarray<tree_t> trees;
+
+    // two mesh instances (wood, leaves) for each tree
+    dynarray<ref<mesh_instance> > slots;
+
+    LSystemsSceneBuilder tree_builder;
+
+    static unsigned make_key(unsigned grammar, int iterations) {
+      return (grammar << 8) | (unsigned)iterations;
+    }
+
+    // find or build the shared geometry for a grammar at an iteration
+    unsigned get_geometry(unsigned grammar, int iterations) {
+      unsigned &index = geometry_index[make_key(grammar, iterations)];
+      if (index == 0) {
+        geometries.push_back(geometry_t());
+        geometry_t &geom = geometries.back();
+        geom.grammar = grammar;
+        geom.iterations = iterations;
+        geom.wood = new mesh();
+        geom.leaves = new mesh();
+        tree_builder.step_length = step_length;
+        tree_builder.build_meshes(*grammars[grammar].model, iterations, geom.wood, geom.leaves);
+        index = geometries.size();
+      }
+      return index - 1;
+    }
+
+    // drop one iteration each time the distance doubles past lod_distance
+    int get_lod_iterations(int max_iterations, float distance) const {
+      int iterations = max_iterations;
+      for (float d = lod_distance; distance > d && iterations > min_iterations; d *= 2) {
+        iterations--;
+      }
+      return iterations < 0 ? 0 : iterations;
+    }
+
+  public:
+    // length of each turtle step
+    float step_length;
+
+    // trees nearer than this use their full iteration
+    float lod_distance;
+
+    // lowest iteration used for distant trees
+    int min_iterations;
+
+    LSystemsForest()
+    : step_length(1.0f)
+    , lod_distance(50.0f)
+    , min_iterations(1)
+    {
+    }
+
+    ~LSystemsForest() {
+      for (unsigned i = 0; i != grammars.size(); ++i) {
+        delete grammars[i].model;
+      }
+    }
+
+    void init(scene *scn, material *wood, material *leaves) {
+      forest_scene = scn;
+      wood_material = wood;
+      leaf_material = leaves;
+    }
+
+    // load a grammar, or return the one already loaded from this url
+    int add_grammar(const char *url) {
+      int index = grammar_index.get_index(url);
+      if (index >= 0) return (int)grammar_index.get_value(index);
+
+      LSystemsModel *model = new LSystemsModel();
+      if (!model->readConfigurationFile(url)) {
+        delete model;
+        return -1;
+      }
+
+      grammars.push_back(grammar_t());
+      grammars.back().model = model;
+      grammars.back().url = url;
+      grammar_index[url] = grammars.size() - 1;
+      return (int)grammars.size() - 1;
+    }
+
+    // place a tree. The seed varies its rotation and size.
+    scene_node *add_tree(unsigned grammar, int max_iterations, const vec3 &position, unsigned seed) {
+      class random rand(seed * 0x9e3779b9 + 0x9bac7615);
+      float yaw = rand.get(0.0f, 360.0f);
+      float scale = rand.get(0.8f, 1.2f);
+
+      scene_node *node = forest_scene->add_scene_node();
+      mat4t &nodeToParent = node->access_nodeToParent();
+      nodeToParent.translate(position.x(), position.y(), position.z());
+      nodeToParent.rotateY(yaw);
+      nodeToParent.scale(scale, scale, scale);
+
+      trees.push_back(tree_t());
+      tree_t &tree = trees.back();
+      tree.grammar = grammar;
+      tree.max_iterations = max_iterations;
+      tree.geometry = ~0u;
+      tree.node = node;
+
+      for (unsigned i = 0; i != 2; ++i) {
+        mesh_instance *mi = new mesh_instance(node, NULL, i ? leaf_material : wood_material);
+        slots.push_back(mi);
+        forest_scene->add_mesh_instance(mi);
+      }
+      return node;
+    }
+
+    // choose the iteration of every tree. only trees whose iteration changed
+    // get new meshes. call before rendering the scene.
+    void update(const vec3 &camera_pos) {
+      for (unsigned i = 0; i != trees.size(); ++i) {
+        tree_t &tree = trees[i];
+        vec3 pos = tree.node->calcModelToWorld().w().xyz();
+        float distance = (pos - camera_pos).length();
+        unsigned geometry = get_geometry(tree.grammar, get_lod_iterations(tree.max_iterations, distance));
+        if (geometry != tree.geometry) {
+          tree.geometry = geometry;
+          slots[i * 2 + 0]->set_mesh(geometries[geometry].wood);
+          slots[i * 2 + 1]->set_mesh(geometries[geometry].leaves);
+        }
+      }
+    }
+
+    unsigned get_num_trees() const {
+      return trees.size();
+    }
+
+    unsigned get_num_grammars() const {
+      return grammars.size();
+    }
+
+    // number of distinct (grammar, iteration) meshes built so far
+    unsigned get_num_geometries() const {
+      return geometries.size();
+    }
+
+    LSystemsModel *get_grammar(unsigned index) {
+      return grammars[index].model;
+    }
+  };
+}
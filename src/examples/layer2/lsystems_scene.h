@@ -0,0 +1,129 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Andy Thomason 2012, 2013
+//
+// Modular Framework for OpenGLES2 rendering on multiple platforms.
+//
+// Turns an L-System production into octet scene resources.
+//
+// The wood and leaves become ordinary meshes on mesh_instances, so a tree can
+// be saved with resources::visit(binary_writer) and loaded again as a .oct
+// file by engine::load_file without running the grammar or the turtle.
+//
+
+namespace octet {
+  class LSystemsSceneBuilder {
+    LSystemsTurtle turtle;
+    LSystemsBranchBuilder builder;
+
+  public:
+    // length of each turtle step
+    float step_length;
+
+    LSystemsSceneBuilder()
+    : step_length(1.0f)
+    {
+    }
+
+    // the branch builder, to change slices or texture scale
+    LSystemsBranchBuilder &get_branch_builder() {
+      return builder;
+    }
+
+    // interpret a production of a model into wood and leaf meshes
+    void build_meshes(LSystemsModel &model, int iterations, mesh *wood, mesh *leaves) {
+      turtle.angle = model.get_rotation_angle();
+      turtle.step_length = step_length;
+      turtle.initial_width = model.get_initial_width();
+      turtle.tropism = model.get_tropism();
+      turtle.elasticity = model.get_elasticity();
+      const string *production = model.getProduction(iterations);
+      turtle.interpret(production ? production->c_str() : "", builder);
+      builder.get_wood_mesh(*wood);
+      builder.get_leaf_mesh(*leaves);
+    }
+
+    // add a tree to a scene as a node with a wood and a leaf mesh_instance.
+    // the meshes and materials are named after the tree in dict.
+    scene_node *add_tree(resources &dict, scene *scn, LSystemsModel &model, int iterations, const char *name, material *wood_material, material *leaf_material) {
+      mesh *wood = new mesh();
+      mesh *leaves = new mesh();
+      build_meshes(model, iterations, wood, leaves);
+
+      scene_node *node = scn->add_scene_node();
+      scn->add_mesh_instance(new mesh_instance(node, wood, wood_material));
+      scn->add_mesh_instance(new mesh_instance(node, leaves, leaf_material));
+
+      string res_name;
+      dict.set_resource(name, node);
+      dict.set_resource(res_name.format("%s-wood", name).c_str(), wood);
+      dict.set_resource(res_name.format("%s-leaves", name).c_str(), leaves);
+      dict.set_resource(res_name.format("%s-wood-material", name).c_str(), wood_material);
+      dict.set_resource(res_name.format("%s-leaf-material", name).c_str(), leaf_material);
+      return node;
+    }
+
+    // make a scene with one tree, a camera and lights and make it the active scene
+    scene *make_scene(resources &dict, LSystemsModel &model, int iterations, const char *name) {
+      scene *scn = new scene();
+      material *leaf_material = new material("assets/leaf.gif");
+      leaf_material->set_blended(true);
+      add_tree(dict, scn, model, iterations, name, new material("assets/wood.gif"), leaf_material);
+      scn->create_default_camera_and_lights();
+
+      string res_name;
+      dict.set_resource(res_name.format("%s-scene", name).c_str(), scn);
+      dict.set_active_scene(scn);
+      return scn;
+    }
+
+    // write the resources as a .oct file.
+    // the old file may be mapped by a reader, so write a new one and rename it.
+    // the old file is only replaced once the new one is complete.
+    // windows can not replace a file that is mapped, so resources loaded from
+    // it must be released first.
+    static bool save(resources &dict, const char *url) {
+      string path = app_utils::get_path(url);
+      if (mapped_file::is_open(path)) {
+        printf("warning: %s is still mapped by resources loaded from it\n", url);
+      }
+      string tmp_path;
+      tmp_path.format("%s.tmp", path.c_str());
+      FILE *file = fopen(tmp_path, "wb");
+      if (!file) {
+        printf("warning: could not write %s\n", url);
+        return false;
+      }
+      bool ok;
+      {
+        binary_writer w(file);
+        dict.visit(w);
+        ok = !w.get_error();
+      }
+      ok = !ferror(file) && ok;
+      ok = !fclose(file) && ok;
+      if (!ok) {
+        printf("warning: could not write %s\n", url);
+        remove(tmp_path);
+        return false;
+      }
+
+      // rename does not replace an existing file on windows, so move the old
+      // one out of the way and put it back if the new one can not go in.
+      if (rename(tmp_path, path)) {
+        string old_path;
+        old_path.format("%s.old", path.c_str());
+        remove(old_path);
+        bool moved = !rename(path, old_path);
+        if (!moved || rename(tmp_path, path)) {
+          if (moved) rename(old_path, path);
+          printf("warning: could not replace %s\n", url);
+          remove(tmp_path);
+          return false;
+        }
+        remove(old_path);
+      }
+      return true;
+    }
+  };
+}
@@ -0,0 +1,356 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Andy Thomason 2012, 2013
+//
+// Modular Framework for OpenGLES2 rendering on multiple platforms.
+//
+// 3D turtle interpretation of an L-System production.
+//
+// The turtle walks a production one symbol at a time and emits a stream of
+// segments. Consumers of the stream (mesh generators, exporters) implement
+// LSystemsSegmentSink so that nothing needs to hold the whole tree.
+//
+// Turtle alphabet:
+//
+//   + -   turn left/right around the up vector
+//   & ^   pitch down/up around the left vector
+//   \ /   roll left/right around the heading
+//   |     turn around
+//   [ ]   push/pop the turtle state
+//   !     decrease the branch width
+//   f     move forward without drawing
+//   X     draw a leaf
+//   any other symbol draws a branch segment, as in the 2D renderer.
+//
+
+namespace octet {
+
+  // One step of the turtle. Frames are model space turtle matrices:
+  // x is the left vector, y the heading, z the up vector and w the position.
+  struct LSystemsSegment {
+    mat4t start_frame;
+    mat4t end_frame;
+    float start_radius;
+    float end_radius;
+
+    // distance along the branch, used as the v texture coordinate
+    float start_v;
+    float end_v;
+
+    // segment whose end this segment starts from, -1 for a new branch
+    int parent;
+
+    bool is_leaf;
+  };
+
+  // Consumer of a segment stream. max_segments is an upper bound known
+  // before the first segment arrives so that buffers can be sized in advance.
+  class LSystemsSegmentSink {
+  public:
+    virtual ~LSystemsSegmentSink() {
+    }
+
+    virtual void beginSegments(unsigned max_segments, unsigned max_leaves) {
+    }
+
+    virtual void addSegment(const LSystemsSegment &seg) = 0;
+
+    virtual void endSegments() {
+    }
+  };
+
+  class LSystemsTurtle {
+    struct state_t {
+      mat4t frame;
+      float width;
+      float v;
+      int segment;
+    };
+
+    state_t cur;
+    dynarray<state_t> stack;
+    unsigned num_segments;
+    LSystemsSegmentSink *sink;
+
+    // bend the heading towards the tropism vector (ABOP 2.2.1)
+    void applyTropism() {
+      if (elasticity == 0) return;
+
+      vec3 heading = cur.frame.y().xyz();
+      vec3 axis = cross(heading, tropism);
+      float axis_len = axis.length();
+      if (axis_len < 1e-6f) return;
+
+      // the rotation axis must be expressed in turtle space
+      axis = axis * (1.0f / axis_len);
+      vec3 local_axis(
+        dot(axis, cur.frame.x().xyz()),
+        dot(axis, cur.frame.y().xyz()),
+        dot(axis, cur.frame.z().xyz())
+      );
+      float angle = elasticity * axis_len * (180.0f / 3.14159265f);
+      cur.frame.rotate(angle, local_axis.x(), local_axis.y(), local_axis.z());
+    }
+
+    void forward(bool is_leaf) {
+      LSystemsSegment seg;
+      seg.start_frame = cur.frame;
+      seg.start_radius = cur.width * 0.5f;
+      seg.start_v = cur.v;
+      seg.parent = cur.segment;
+      seg.is_leaf = is_leaf;
+
+      cur.frame.translate(0, step_length, 0);
+      cur.v += step_length;
+
+      if (!is_leaf) {
+        applyTropism();
+        cur.width *= taper;
+      }
+
+      seg.end_frame = cur.frame;
+      seg.end_radius = cur.width * 0.5f;
+      seg.end_v = cur.v;
+
+      if (sink) sink->addSegment(seg);
+
+      // leaves do not continue a branch
+      cur.segment = is_leaf ? -1 : (int)num_segments;
+      num_segments++;
+    }
+
+  public:
+    // branch angle in degrees
+    float angle;
+
+    // length of each segment
+    float step_length;
+
+    // width of the first segment, each segment is taper times the previous one.
+    float initial_width;
+    float taper;
+
+    // ! multiplies the width by this
+    float width_decay;
+
+    // the heading bends towards tropism by elasticity * |heading x tropism| per step
+    vec3 tropism;
+    float elasticity;
+
+    LSystemsTurtle()
+    : num_segments(0)
+    , sink(NULL)
+    , angle(25.0f)
+    , step_length(5.0f)
+    , initial_width(0.5f)
+    , taper(0.97f)
+    , width_decay(0.7f)
+    , tropism(0.0f, -1.0f, 0.0f)
+    , elasticity(0.0f)
+    {
+      reset();
+    }
+
+    static bool isLeaf(char c) {
+      return c == 'X';
+    }
+
+    // true for symbols that emit a segment
+    static bool isDrawn(char c) {
+      switch (c) {
+        case '+': case '-': case '&': case '^': case '\\': case '/':
+        case '|': case '[': case ']': case '!': case 'f':
+        case ' ': case '\t': case '\r': case '\n':
+          return false;
+        default:
+          return true;
+      }
+    }
+
+    // count the segments and leaves a production will make
+    static void countSegments(const char *production, unsigned &num_branches, unsigned &num_leaves) {
+      num_branches = num_leaves = 0;
+      for (const char *p = production; *p; ++p) {
+        if (isDrawn(*p)) {
+          if (isLeaf(*p)) num_leaves++; else num_branches++;
+        }
+      }
+    }
+
+    void reset() {
+      stack.resize(0);
+      cur.frame.loadIdentity();
+      cur.width = initial_width;
+      cur.v = 0;
+      cur.segment = -1;
+      num_segments = 0;
+    }
+
+    void processChar(char c) {
+      switch (c) {
+        case '+': cur.frame.rotateZ(angle); break;
+        case '-': cur.frame.rotateZ(-angle); break;
+        case '&': cur.frame.rotateX(-angle); break;
+        case '^': cur.frame.rotateX(angle); break;
+        case '\\': cur.frame.rotateY(-angle); break;
+        case '/': cur.frame.rotateY(angle); break;
+        case '|': cur.frame.rotateZ180(); break;
+        case '!': cur.width *= width_decay; break;
+        case '[': stack.push_back(cur); break;
+        case ']': {
+          if (stack.size() == 0) {
+            printf("LSystemsTurtle: trying to pop root node\n");
+          } else {
+            cur = stack.back();
+            stack.pop_back();
+          }
+        } break;
+        case 'f': {
+          cur.frame.translate(0, step_length, 0);
+          cur.segment = -1;
+        } break;
+        case ' ': case '\t': case '\r': case '\n': break;
+        default: forward(isLeaf(c)); break;
+      }
+    }
+
+    // walk the whole production, sending segments to the sink
+    void interpret(const char *production, LSystemsSegmentSink &sink_) {
+      OCTET_PROFILE_SCOPE("interpret");
+      unsigned num_branches, num_leaves;
+      countSegments(production, num_branches, num_leaves);
+
+      reset();
+      sink = &sink_;
+      sink->beginSegments(num_branches, num_leaves);
+      for (const char *p = production; *p; ++p) {
+        processChar(*p);
+      }
+      sink->endSegments();
+      sink = NULL;
+      OCTET_PROFILE_COUNT("symbols interpreted", strlen(production));
+      OCTET_PROFILE_COUNT("segments", num_segments);
+    }
+
+    unsigned get_num_segments() const {
+      return num_segments;
+    }
+  };
+
+  // Builds a generalised cylinder mesh for the branches and crossed quads for
+  // the leaves. Consecutive segments share a ring, so a branch is one
+  // continuous tube rather than a string of closed cylinders.
+  class LSystemsBranchBuilder : public LSystemsSegmentSink {
+    mesh_builder wood;
+    mesh_builder leaves;
+
+    // first vertex of the end ring of each segment, ~0 for leaves
+    dynarray<unsigned> end_rings;
+
+    // bounds of the segment end points, grown by the widest radius
+    vec3 bb_min;
+    vec3 bb_max;
+    float max_radius;
+
+    unsigned addRing(const mat4t &frame, float radius, float v) {
+      // rings are made in the x-y plane, so point z along the heading.
+      mat4t ring_frame = frame;
+      ring_frame.rotateX(-90);
+      wood.set_matrix(ring_frame);
+      return wood.add_ring(radius, vec4(1, 0, 0, 0), slices, v * uvscale, 1);
+    }
+
+    void addLeaf(const LSystemsSegment &seg) {
+      const mat4t &m = seg.start_frame;
+      vec4 origin = m[3];
+      vec4 heading = m[1] * (seg.end_frame[3] - origin).length();
+      vec4 sides[2] = { m[0] * (leaf_width * 0.5f), m[2] * (leaf_width * 0.5f) };
+      vec4 normals[2] = { m[2], m[0] };
+
+      leaves.set_matrix(mat4t(1.0f));
+      for (unsigned i = 0; i != 2; ++i) {
+        unsigned first = leaves.get_num_vertices();
+        leaves.add_vertex(origin - sides[i], normals[i], 0, 0);
+        leaves.add_vertex(origin + sides[i], normals[i], 1, 0);
+        leaves.add_vertex(origin + sides[i] + heading, normals[i], 1, 1);
+        leaves.add_vertex(origin - sides[i] + heading, normals[i], 0, 1);
+        leaves.add_index(first + 0);
+        leaves.add_index(first + 1);
+        leaves.add_index(first + 2);
+        leaves.add_index(first + 0);
+        leaves.add_index(first + 2);
+        leaves.add_index(first + 3);
+      }
+    }
+
+  public:
+    // number of vertices around a branch
+    unsigned slices;
+
+    // texture repeats per unit length
+    float uvscale;
+
+    float leaf_width;
+
+    LSystemsBranchBuilder()
+    : slices(6)
+    , uvscale(1.0f)
+    , leaf_width(0.5f)
+    {
+    }
+
+    void beginSegments(unsigned max_segments, unsigned max_leaves) {
+      // worst case every branch needs two rings
+      unsigned ring_size = slices + 1;
+      wood.init(max_segments * ring_size * 2, max_segments * slices * 6);
+      leaves.init(max_leaves * 8, max_leaves * 12);
+      end_rings.resize(0);
+      end_rings.reserve(max_segments + max_leaves);
+      bb_min = vec3(1e30f, 1e30f, 1e30f);
+      bb_max = vec3(-1e30f, -1e30f, -1e30f);
+      max_radius = leaf_width;
+    }
+
+    void addSegment(const LSystemsSegment &seg) {
+      bb_min = min(bb_min, min(seg.start_frame[3].xyz(), seg.end_frame[3].xyz()));
+      bb_max = max(bb_max, max(seg.start_frame[3].xyz(), seg.end_frame[3].xyz()));
+      max_radius = seg.start_radius > max_radius ? seg.start_radius : max_radius;
+
+      if (seg.is_leaf) {
+        addLeaf(seg);
+        end_rings.push_back(~0u);
+        return;
+      }
+
+      unsigned start_ring = ~0u;
+      if (seg.parent >= 0 && end_rings[seg.parent] != ~0u) {
+        start_ring = end_rings[seg.parent];
+      }
+      if (start_ring == ~0u) {
+        start_ring = addRing(seg.start_frame, seg.start_radius, seg.start_v);
+      }
+      unsigned end_ring = addRing(seg.end_frame, seg.end_radius, seg.end_v);
+      wood.add_ring_strip(start_ring, end_ring, slices);
+      end_rings.push_back(end_ring);
+    }
+
+    // bounds of everything built since beginSegments()
+    aabb get_aabb() const {
+      if (bb_min.x() > bb_max.x()) {
+        return aabb(vec3(0, 0, 0), vec3(0, 0, 0));
+      }
+      vec3 half_extent = (bb_max - bb_min) * 0.5f + vec3(max_radius, max_radius, max_radius);
+      return aabb((bb_min + bb_max) * 0.5f, half_extent);
+    }
+
+    void get_wood_mesh(mesh &m) {
+      wood.get_mesh(m);
+      m.set_aabb(get_aabb());
+    }
+
+    void get_leaf_mesh(mesh &m) {
+      leaves.get_mesh(m);
+      m.set_aabb(get_aabb());
+    }
+  };
+}
@@ -14,6 +14,9 @@ namespace octet {
     bool loaded_;
     int num_iterations_; // Initial number of iterations
     float rotation_angle_; // Initial branch angle rotation
+    float initial_width_; // Initial branch width for the 3D turtle
+    vec3 tropism_; // Direction branches bend towards in 3D
+    float elasticity_; // How much branches bend towards tropism_
     string axiom_;
     dynarray<string> productions_; // We store all productions here
     dictionary<string> production_rules_;
@@ -39,9 +42,24 @@ namespace octet {
         this->productions_.push_back(axiom_);
       } else if (!strcmp(elemValue, "rule")) {
         processRule(elem);
+      } else if (!strcmp(elemValue, "initial-width")) {
+        this->initial_width_ = (float)atof(elemText);
+      } else if (!strcmp(elemValue, "tropism")) {
+        processTropism(elem);
       }
     }
 
+    // eg. <tropism x="0" y="-1" z="0" elasticity="0.2" />
+    void processTropism(TiXmlElement *elem) {
+      double x = 0, y = -1, z = 0, e = 0;
+      elem->Attribute("x", &x);
+      elem->Attribute("y", &y);
+      elem->Attribute("z", &z);
+      elem->Attribute("elasticity", &e);
+      tropism_ = vec3((float)x, (float)y, (float)z);
+      elasticity_ = (float)e;
+    }
+
     void processRule(TiXmlElement *elem) {
       if (elem->Attribute("predecessor") &&
           elem->Attribute("succesor")) {
@@ -56,6 +74,9 @@ namespace octet {
     : loaded_(false)
     , num_iterations_(0)
     , rotation_angle_(0.0f)
+    , initial_width_(0.5f)
+    , tropism_(0.0f, -1.0f, 0.0f)
+    , elasticity_(0.0f)
     , axiom_()
     , productions_()
     , production_rules_()
@@ -66,6 +87,9 @@ namespace octet {
     : loaded_(false)
     , num_iterations_(0)
     , rotation_angle_(0.0f)
+    , initial_width_(0.5f)
+    , tropism_(0.0f, -1.0f, 0.0f)
+    , elasticity_(0.0f)
     , axiom_()
     , productions_()
     , production_rules_()
@@ -78,10 +102,15 @@ namespace octet {
       productions_.reset();
       production_rules_.reset();
       axiom_.truncate(0);
+      initial_width_ = 0.5f;
+      tropism_ = vec3(0.0f, -1.0f, 0.0f);
+      elasticity_ = 0.0f;
       loaded_ = false;
     }
 
-    bool readConfigurationFile(const char *xmlFilename) {
+    // set expand to false to skip generating the initial iterations
+    bool readConfigurationFile(const char *xmlFilename, bool expand = true) {
+      allocator_tag_scope tag(allocator::tag_xml);
       TiXmlDocument doc;
       dictionary<TiXmlElement *, allocator> ids;
 
@@ -98,7 +127,7 @@ namespace octet {
       }
       buildSystem(top);
       
-      for (int i = 0; i != num_iterations_; i++) {
+      for (int i = 0; i != num_iterations_ && expand; i++) {
         step();
       }
       
@@ -107,41 +136,63 @@ namespace octet {
       return true;
     }
 
-    // Generate a new iteration step
+    // Generate a new iteration step, null if there is not enough memory
     const string *step() {
+      OCTET_PROFILE_SCOPE("rewrite");
+      allocator_tag_scope tag(allocator::tag_rewrite);
       const char *previous_production = getProduction()->c_str();
-      int len = strlen(previous_production);
-      string result; //get last production
-      
-      printf("Generating step %d.\n", productions_.size());
+      size_t len = strlen(previous_production);
+
+      // successor of each symbol, looked up once per step rather than per symbol.
+      // symbols without a rule are copied as they are.
+      const char *successor[256];
+      unsigned successor_len[256];
+      for (unsigned c = 0; c != 256; ++c) {
+        char key = (char)c;
+        string *rule = c ? production_rules_.find(&key, 1) : 0;
+        if (rule) {
+          successor[c] = rule->c_str();
+          successor_len[c] = (unsigned)strlen(successor[c]);
+        } else {
+          successor[c] = 0;
+          successor_len[c] = 1;
+        }
+      }
 
       // deterministic context-free
       // string replace for each character, not yet context sensitive
-      for (int i = 0; i != len; i++) {
-        char comp[] = { previous_production[i], 0 };
-        
-        //printf("step(): Checking char '%c'.\n", comp[0]);
-        if (production_rules_.contains(comp)) {
-          //printf("step(): Found rule, adding string '%s'.\n", production_rules_[comp].c_str());
-          result += production_rules_[comp];
+      string_builder result(len + len / 2);
+      for (size_t i = 0; i != len && !result.failed(); i++) {
+        unsigned char chr = (unsigned char)previous_production[i];
+        if (successor[chr]) {
+          result.append(successor[chr], successor_len[chr]);
         } else {
-          string comp_str(comp);
-          //printf("step(): Found no rule, adding string '%s'.\n", comp_str);
-          result += comp_str;
+          result.append((char)chr);
         }
-        //printf("step(): Current string '%s'.\n", result.c_str());
       }
 
-      //printf("step(): Final string '%s'.\n", result.c_str());
+      OCTET_PROFILE_COUNT("symbols rewritten", len);
+
+      // the text can also be lost when take() shrinks the block
+      bool ok = !result.failed();
+      if (ok) {
+        productions_.push_back(string());
+        productions_[productions_.size()-1].take(result);
+        ok = !result.failed();
+        if (!ok) productions_.pop_back();
+      }
+      if (!ok) {
+        printf("warning: out of memory at step %d\n", productions_.size());
+        return 0;
+      }
 
-      productions_.push_back(result);
-       
       return &productions_[productions_.size()-1];
     }
 
     // Get a string production by passing the iteration step as a parameter
     // If the parameter is a number greater than the productions already stored
     // the model will produce the intermediate steps until the desired step.
+    // Returns null if memory runs out on the way.
     const string *getProduction(int number = -1) {
       int result = number;
 
@@ -157,7 +208,7 @@ namespace octet {
         //printf("Generating %d productions.\n", difference);
 
         for (int i = 0; i != difference; i++) {
-          step();
+          if (!step()) return 0;
         }
       }
 
@@ -172,10 +223,27 @@ namespace octet {
       return rotation_angle_;
     }
 
+    // override the angle from the file
+    void set_rotation_angle(float value) {
+      rotation_angle_ = value;
+    }
+
     int get_initial_iterations() {
       return num_iterations_;
     }
 
+    float get_initial_width() {
+      return initial_width_;
+    }
+
+    const vec3 &get_tropism() {
+      return tropism_;
+    }
+
+    float get_elasticity() {
+      return elasticity_;
+    }
+
     const char *get_axiom() {
       return axiom_.c_str();
     }
@@ -247,8 +315,10 @@ namespace octet {
     // Step through all the string generated in a step, processing each
     // character at a time
     virtual void render(mat4t &cameraToWorld, mat4t &cameraToProjection, int num_iterations) {
+      OCTET_PROFILE_SCOPE("submit");
       initStack();
-      const char *production = model->getProduction(num_iterations)->c_str();
+      const string *production_string = model->getProduction(num_iterations);
+      const char *production = production_string ? production_string->c_str() : "";
       int production_len = strlen(production);
 
       for (int i = 0; i != production_len; i++) {
@@ -268,18 +338,23 @@ namespace octet {
     float branch_rotate_angle;
     float branch_length;
     float branch_separation;
-    texture_shader *tshader;
-    
-    GLuint leafTex;
-    GLuint woodTex;
+    atlas_shader *tshader;
 
-    Tree2DRenderer(texture_shader *tshader_ = NULL, LSystemsModel *m = NULL)
+    // images in the texture atlas, which is bound by the caller
+    texture_atlas *atlas;
+    unsigned leafImage;
+    unsigned woodImage;
+
+    Tree2DRenderer(atlas_shader *tshader_ = NULL, LSystemsModel *m = NULL)
     : LSystemsRenderer(m)
     , rotation_vector(0.0f, 0.0f, 1.0f)
     , branch_rotate_angle(0.0f)
     , branch_length(5.0f)
     , branch_separation(branch_length)
     , tshader(tshader_)
+    , atlas(NULL)
+    , leafImage(0)
+    , woodImage(0)
     {
     }
 
@@ -314,15 +389,9 @@ namespace octet {
       // model -> world -> camera -> projection
       mat4t modelToProjection = mat4t::build_projection_matrix(topMatrix(), cameraToWorld);
 
-      glActiveTexture(GL_TEXTURE0);
-      glBindTexture(GL_TEXTURE_2D, useLeafTex? leafTex: woodTex);
-      glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-      glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-      glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-      glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-
       // set up the uniforms for the shader
-      tshader->render(modelToProjection, 0);
+      // only the wood image is packed with wrapped padding
+      tshader->render(modelToProjection, 0, atlas->get_uv_rect(useLeafTex ? leafImage : woodImage), !useLeafTex);
 
       float branch_texture_v = branch_length/1.0f;
 
@@ -335,11 +404,127 @@ namespace octet {
 
       glVertexAttribPointer(attribute_pos, 2, GL_FLOAT, GL_FALSE, 4*sizeof(float), (void*)vertices );
       glVertexAttribPointer(attribute_uv, 2, GL_FLOAT, GL_FALSE, 4*sizeof(float), (void*)(vertices + 2) );
-      glEnableVertexAttribArray(attribute_pos);
-      glEnableVertexAttribArray(attribute_uv);
+      gl_state::enable_attrib(attribute_pos, true);
+      gl_state::enable_attrib(attribute_uv, true);
 
       // finally, draw the box (4 vertices)
       glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+      OCTET_PROFILE_COUNT("draw calls", 1);
+    }
+  };
+
+  // Concrete implementation of the LSystemsRenderer, to represent an L-System
+  // as a 3D tree. The 3D turtle builds generalised cylinder meshes which are
+  // only rebuilt when the iteration or the turtle parameters change.
+  class Tree3DRenderer : public LSystemsRenderer {
+    LSystemsTurtle turtle;
+    LSystemsBranchBuilder builder;
+    ref<mesh> wood_mesh;
+    ref<mesh> leaf_mesh;
+
+    // parameters the current meshes were built with, iterations is -1 if none
+    int built_iterations;
+    float built_angle;
+    float built_length;
+
+    void renderMesh(mesh *msh, unsigned image, bool wrap, const mat4t &modelToProjection) {
+      if (msh->get_num_indices() == 0) return;
+
+      tshader->render(modelToProjection, 0, atlas->get_uv_rect(image), wrap);
+      msh->render();
+      OCTET_PROFILE_COUNT("draw calls", 1);
+    }
+
+  public:
+    float branch_rotate_angle;
+    float branch_length;
+
+    // rotation of the tree around its trunk in degrees
+    float yaw;
+
+    atlas_shader *tshader;
+
+    // images in the texture atlas, which is bound by the caller
+    texture_atlas *atlas;
+    unsigned leafImage;
+    unsigned woodImage;
+
+    Tree3DRenderer(atlas_shader *tshader_ = NULL, LSystemsModel *m = NULL)
+    : LSystemsRenderer(m)
+    , wood_mesh(new mesh())
+    , leaf_mesh(new mesh())
+    , built_iterations(-1)
+    , built_angle(0.0f)
+    , built_length(0.0f)
+    , branch_rotate_angle(0.0f)
+    , branch_length(5.0f)
+    , yaw(0.0f)
+    , tshader(tshader_)
+    , atlas(NULL)
+    , leafImage(0)
+    , woodImage(0)
+    {
+    }
+
+    void setModel(LSystemsModel *m) {
+      LSystemsRenderer::setModel(m);
+      built_iterations = -1;
+      if (m) {
+        branch_rotate_angle = m->get_rotation_angle();
+        turtle.initial_width = m->get_initial_width();
+        turtle.tropism = m->get_tropism();
+        turtle.elasticity = m->get_elasticity();
+      }
+    }
+
+    void processChar(mat4t &cameraToWorld, mat4t &cameraToProjection, char c) {
+      turtle.processChar(c);
+    }
+
+    // run the turtle over a production and rebuild the meshes
+    void build(int num_iterations) {
+      OCTET_PROFILE_SCOPE("build 3d");
+      turtle.angle = branch_rotate_angle;
+      turtle.step_length = branch_length;
+      const string *production = model->getProduction(num_iterations);
+      turtle.interpret(production ? production->c_str() : "", builder);
+      builder.get_wood_mesh(*wood_mesh);
+      builder.get_leaf_mesh(*leaf_mesh);
+
+      built_iterations = num_iterations;
+      built_angle = branch_rotate_angle;
+      built_length = branch_length;
+    }
+
+    mesh *get_wood_mesh() {
+      return wood_mesh;
+    }
+
+    mesh *get_leaf_mesh() {
+      return leaf_mesh;
+    }
+
+    void render(mat4t &cameraToWorld, mat4t &cameraToProjection, int num_iterations) {
+      OCTET_PROFILE_SCOPE("submit");
+      if (
+        built_iterations != num_iterations ||
+        built_angle != branch_rotate_angle ||
+        built_length != branch_length
+      ) {
+        build(num_iterations);
+      }
+
+      mat4t modelToWorld;
+      modelToWorld.loadIdentity();
+      modelToWorld.rotateY(yaw);
+
+      // model -> world -> camera -> projection
+      mat4t modelToProjection = mat4t::build_projection_matrix(modelToWorld, cameraToWorld);
+
+      gl_state::enable(GL_DEPTH_TEST, true);
+      renderMesh(wood_mesh, woodImage, true, modelToProjection);
+      renderMesh(leaf_mesh, leafImage, false, modelToProjection);
+      gl_state::enable(GL_DEPTH_TEST, false);
     }
   };
 }
@@ -13,6 +13,16 @@
 
 #if defined(OCTET_OBB)
   #include "obb_test.h"
+#elif defined(OCTET_LSYSTEMS_EXPORT)
+  #include "lsystems_export.h"
+#elif defined(OCTET_LSYSTEMS_BATCH)
+  #include "lsystems_batch.h"
+#elif defined(OCTET_LSYSTEMS_BENCHMARK)
+  #include "lsystems_benchmark.h"
+#elif defined(OCTET_CONTAINERS_BENCHMARK)
+  #include "containers_benchmark.h"
+#elif defined(OCTET_LOAD_BENCHMARK)
+  #include "load_benchmark.h"
 #else
   #include "lsystems.h"
 #endif
@@ -24,14 +34,36 @@
 int main(int argc, char **argv) {
   //octet::unit_test_ray();
 
-  octet::app_utils::prefix("../../");
-  octet::app::init_all(argc, argv);
-  #if defined(OCTET_OBB)
-    octet::obb_test app(argc, argv);
+  #if defined(OCTET_LSYSTEMS_EXPORT)
+    // headless: paths are relative to the current directory
+    octet::app_utils::prefix("");
+    return octet::lsystems_export_main(argc, argv);
+  #elif defined(OCTET_LSYSTEMS_BATCH)
+    // headless: paths are relative to the current directory
+    octet::app_utils::prefix("");
+    return octet::lsystems_batch_main(argc, argv);
+  #elif defined(OCTET_LSYSTEMS_BENCHMARK)
+    // headless: paths are relative to the current directory
+    octet::app_utils::prefix("");
+    return octet::lsystems_benchmark_main(argc, argv);
+  #elif defined(OCTET_CONTAINERS_BENCHMARK)
+    // headless: paths are relative to the current directory
+    octet::app_utils::prefix("");
+    return octet::containers_benchmark_main(argc, argv);
+  #elif defined(OCTET_LOAD_BENCHMARK)
+    // headless: paths are relative to the current directory
+    octet::app_utils::prefix("");
+    return octet::load_benchmark_main(argc, argv);
   #else
-    octet::lsystems app(argc, argv);
+    octet::app_utils::prefix("../../");
+    octet::app::init_all(argc, argv);
+    #if defined(OCTET_OBB)
+      octet::obb_test app(argc, argv);
+    #else
+      octet::lsystems app(argc, argv);
+    #endif
+    app.init();
+    octet::app::run_all_apps();
   #endif
-  app.init();
-  octet::app::run_all_apps();
 }
 
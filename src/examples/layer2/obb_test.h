@@ -72,15 +72,15 @@ namespace octet {
       glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
       // allow Z buffer depth testing (closer objects are always drawn in front of far ones)
-      glEnable(GL_DEPTH_TEST);
+      gl_state::enable(GL_DEPTH_TEST, true);
 
       GLint param;
       glGetIntegerv(GL_SAMPLE_BUFFERS, &param);
       if (param == 0) {
         // if multisampling is disabled, we can't use GL_SAMPLE_COVERAGE (which I think is mean)
         // Instead, allow alpha blend (transparency when alpha channel is 0)
-        glEnable(GL_BLEND);
-        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        gl_state::enable(GL_BLEND, true);
+        gl_state::blend_func(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
       } else {
         // if multisampling is enabled, use GL_SAMPLE_COVERAGE instead
         glEnable(GL_SAMPLE_ALPHA_TO_COVERAGE);
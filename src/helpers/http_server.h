@@ -73,38 +73,27 @@ namespace octet {
       //dynarray<string> id_parts;
       //id.split(id_parts, ".");
 
-      dynarray<string> response;
-      response.reserve(64);
+      string_builder response(0x1000);
       int max_depth = 5;
       http_writer writer(0, max_depth, response);
-      response.resize(response.size()+1);
-      response.back().format("%s([\n", callback.c_str());
+      response.append_format("%s([\n", callback.c_str());
       dict->visit(writer);
-      response.resize(response.size()+1);
-      response.back().format("])\n");
+      response.append("])\n");
 
       // With HTTP 1.1 we can keep the connection open and respond to more
       // feeds without the overhead of a new connection.
-      unsigned num_bytes = 0;
-      for (unsigned i = 0; i != response.size(); ++i) {
-        num_bytes += response[i].size();
-      }
-
-      string response_header;
-      response_header.format(
+      string_builder response_header;
+      response_header.append_format(
         "HTTP/1.1 200 OK\n"
         "Content-Type: application/json; charset=UTF-8\n"
         "Content-Length: %d\n"
         "\n",
-        num_bytes
+        (int)response.size()
       );
 
+      app_utils::log("send: %s", response.c_str());
       send(s.client_socket, response_header.c_str(), response_header.size(), 0);
-
-      for (unsigned i = 0; i != response.size(); ++i) {
-        app_utils::log("send: %s", response[i].c_str());
-        send(s.client_socket, response[i].c_str(), response[i].size(), 0);
-      }
+      send(s.client_socket, response.c_str(), response.size(), 0);
     }
 
   public:
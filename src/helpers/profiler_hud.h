@@ -0,0 +1,81 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Andy Thomason 2012, 2013
+//
+// Modular Framework for OpenGLES2 rendering on multiple platforms.
+//
+//
+// on-screen table of the profiler statistics, drawn with a text_overlay
+
+namespace octet {
+  class profiler_hud {
+    text_overlay overlay;
+    dynarray<profiler::stat_t> stats;
+    string text;
+    unsigned num_frames;
+    unsigned refresh_frame;
+    string line;
+
+    // bitmap_font stops at empty lines and at spaces before a newline
+    void add_line() {
+      int len = (int)strlen(line.c_str());
+      while (len && line[len-1] == ' ') --len;
+      if (len == 0) return;
+      line.truncate(len);
+      text += line.c_str();
+      text += "\n";
+    }
+
+    void build_text() {
+      profiler::get_stats(stats, num_frames);
+      text = "";
+      line.format("%-20s %7s %7s %7s %7s", "ms/frame", "avg", "p50", "p95", "max");
+      add_line();
+      for (unsigned i = 0; i != stats.size(); ++i) {
+        const profiler::stat_t &st = stats[i];
+        if (st.kind != profiler::kind_scope) continue;
+        // indent nested scopes
+        string name;
+        name.format("%.*s%s", st.depth < 5 ? st.depth * 2 : 10, "..........", st.name);
+        line.format("%-20s %7.2f %7.2f %7.2f %7.2f", name.c_str(), st.average, st.p50, st.p95, st.max);
+        add_line();
+      }
+      line.format("%-20s %7s %7s %7s %7s", "count/frame", "avg", "p50", "p95", "max");
+      add_line();
+      for (unsigned i = 0; i != stats.size(); ++i) {
+        const profiler::stat_t &st = stats[i];
+        if (st.kind != profiler::kind_counter) continue;
+        line.format("%-20s %7.0f %7.0f %7.0f %7.0f", st.name, st.average, st.p50, st.p95, st.max);
+        add_line();
+      }
+    }
+
+  public:
+    profiler_hud() {
+      num_frames = 60;
+      refresh_frame = 0;
+    }
+
+    // averages and percentiles over num_frames frames
+    void init(unsigned num_frames = 60) {
+      this->num_frames = num_frames;
+      overlay.init(aabb(vec3(280, -240, 0), vec3(280, 240, 0)), "profiling...");
+    }
+
+    // draw in the top left corner, the table is rebuilt twice a second at 60Hz
+    void render(bump_shader &object_shader, bump_shader &skin_shader, int vx, int vy) {
+      OCTET_PROFILE_SCOPE("hud");
+      unsigned frame = profiler::get_frame();
+      if (frame - refresh_frame >= 30 || frame < refresh_frame) {
+        refresh_frame = frame;
+        build_text();
+        if (text.size()) overlay.set_text(text.c_str());
+      }
+
+      mat4t &nodeToParent = overlay.get_node()->access_nodeToParent();
+      nodeToParent.loadIdentity();
+      nodeToParent.translate(vx * -0.5f + 8, vy * 0.5f - 8, 0);
+      overlay.render(object_shader, skin_shader, vx, vy, 1);
+    }
+  };
+}
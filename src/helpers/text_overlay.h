@@ -16,6 +16,11 @@ namespace octet {
 
   public:
     void init() {
+      init(aabb(vec3(0, 0, 0), vec3(64, 256, 0)), "Hello");
+    }
+
+    // bb is the text box in screen pixels about the node of the text
+    void init(const aabb &bb, const char *initial_text) {
       // Make a scene for the text overlay using an ortho camera
       // that works in screen pixels.
       text_scene = new scene();
@@ -35,8 +40,8 @@ namespace octet {
         "Boatswain: None that I more love than myself. You are counsellor;  if you can command these elements to silence, and work the peace of the present, we will not hand a rope more. Use your authority; if you cannot, give thanks you have liv'd so long, and make yourself ready in your cabin for the mischance of the hour, if it so hap.\n"
       ;*/
 
-      aabb bb(vec3(0, 0, 0), vec3(64, 256, 0));
-      text = new mesh_text(font, "Hello", &bb);
+      aabb text_bb = bb;
+      text = new mesh_text(font, initial_text, &text_bb);
 
       scene_node *msh_node = text_scene->add_scene_node();
       material *mat = new material(page);
@@ -48,6 +53,15 @@ namespace octet {
       cam->get_node()->access_nodeToParent().loadIdentity();
     }
 
+    void set_text(const char *value) {
+      text->set_text(value);
+    }
+
+    // move this to place the text on the screen
+    scene_node *get_node() {
+      return msh_inst->get_node();
+    }
+
     void render(bump_shader &object_shader, bump_shader &skin_shader, int vx, int vy, int frame_number) {
       cam->set_ortho((float)vx, (float)vy, 1, -1, 1);
       camera_instance *cam = text_scene->get_camera_instance(0);
@@ -27,6 +27,39 @@ namespace octet {
     dictionary<TiXmlElement *, allocator> ids;
     dynarray<float> temp_floats;
 
+    enum {
+      // shorter arrays stay in the DOM
+      min_array_bytes = 1024,
+
+      // text parsed by one task
+      chunk_bytes = 0x40000,
+
+      max_pow10 = 400,
+    };
+
+    // the numbers of an element cut out by load_xml(). The element gets
+    // an octet_array attribute with the index of one of these.
+    struct number_array {
+      bool is_float;
+      unsigned count;  // the count attribute, 0 if there is none
+      size_t bytes;    // length of the text
+      dynarray<float> floats;
+      dynarray<int> ints;
+    };
+
+    // a piece of a number_array's text, cut at whitespace so that it parses alone
+    struct number_chunk {
+      unsigned array;
+      const char *begin;
+      const char *end;
+      bool stopped;
+      dynarray<float> floats;
+      dynarray<int> ints;
+    };
+
+    dynarray<number_array> arrays;
+    dynarray<number_chunk> chunks;
+
     // find all the ids in an xml file
     void find_ids(TiXmlElement *parent) {
       for (TiXmlElement *elem = parent->FirstChildElement(); elem; elem = elem->NextSiblingElement()) {
@@ -42,7 +75,8 @@ namespace octet {
     TiXmlElement *find_id(const char *source) {
       if (source) {
         if (source[0] == '#') source++;
-        return ids[source];
+        TiXmlElement **elem = ids.find(source);
+        return elem ? *elem : 0;
       }
       return 0;
     }
@@ -95,52 +129,299 @@ namespace octet {
       return 8;
     }
 
-    // convert a string like "1.2 3.4 43.12" into an array of float values
-    void atofv(dynarray<float> &values, const char *src) {  
-      values.resize(0);
-      if (!src) return;
+    static bool is_space(char c) {
+      return c > 0 && c <= ' ';
+    }
 
-      while (*src > 0 && *src <= ' ') ++src;
-      while(*src != 0) {
-        double whole = 0, msign = 1;
+    static bool is_digit(char c) {
+      return c >= '0' && c <= '9';
+    }
+
+    // powers of ten, made by pow() itself so that the floats come out
+    // exactly as they always have.
+    struct pow10_table {
+      double values[max_pow10 * 2 + 1];
+
+      pow10_table() {
+        for (int i = 0; i != max_pow10 * 2 + 1; ++i) {
+          values[i] = pow(10.0, i - max_pow10);
+        }
+      }
+    };
+
+    // pow(10, exp). C++11 compilers make the table once, whichever threads ask
+    // first. For older ones, load_xml() asks before it starts its workers.
+    static double pow10(int exp) {
+      static pow10_table table;
+      return exp >= -max_pow10 && exp <= max_pow10 ? table.values[exp + max_pow10] : pow(10.0, exp);
+    }
+
+    // the digits at src, as value = value * 10 + digit in doubles would make them.
+    // scale is multiplied by ten for each digit.
+    // Up to fifteen digits are exact, so those are gathered in an integer.
+    static double parse_digits(const char *&src, const char *end, double &scale) {
+      uint64_t value = 0, power = 1;
+      for (unsigned num = 0; num != 15 && src != end && is_digit(*src); ++num) {
+        value = value * 10 + (*src++ - '0');
+        power *= 10;
+      }
+      double result = (double)value;
+      scale *= (double)power;
+      while (src != end && is_digit(*src)) {
+        result = result * 10 + (*src++ - '0');
+        scale *= 10;
+      }
+      return result;
+    }
+
+    // add the numbers in text like "1.2 3.4 43.12" in [src, end) to values.
+    // returns false if it stopped at something that is not a number.
+    static bool parse_floats(dynarray<float> &values, const char *src, const char *end) {
+      while (src != end && is_space(*src)) ++src;
+      while (src != end && *src != 0) {
+        double whole = 0, msign = 1, scale = 1;
         if (*src == '-') { msign = -1; src++; }
-        if( !(*src >= '0' && *src <= '9') && *src != '.' ) break;
-        while (*src >= '0' && *src <= '9') whole = whole * 10 + (*src++ - '0');
-        if (*src == '.') {
+        if (src == end || ( !is_digit(*src) && *src != '.' )) return false;
+        whole = parse_digits(src, end, scale);
+        if (src != end && *src == '.') {
           src++;
-          double frac = 0, v = 1;
-          while (*src >= '0' && *src <= '9') { frac = frac * 10 + (*src++ - '0'); v *= 10; }
+          double v = 1;
+          double frac = parse_digits(src, end, v);
           whole += frac / v;
         }
-        if (*src == 'e' || *src == 'E') {
+        if (src != end && ( *src == 'e' || *src == 'E' )) {
           int esign = 1;
           src++;
-          if (*src == '-') { esign = -1; src++; }
-          else if (*src == '+') src++;
+          if (src != end && *src == '-') { esign = -1; src++; }
+          else if (src != end && *src == '+') src++;
           int exp = 0;
-          while (*src >= '0' && *src <= '9') { exp = exp * 10 + (*src++ - '0'); }
-          whole = whole * pow(10.0, exp * esign);
+          while (src != end && is_digit(*src)) { exp = exp * 10 + (*src++ - '0'); }
+          whole = whole * pow10(exp * esign);
         }
         values.push_back((float)(whole * msign));
-        while (*src > 0 && *src <= ' ') ++src;
+        while (src != end && is_space(*src)) ++src;
+      }
+      return true;
+    }
+
+    // add the integers in text like "1 3 9 12 34" in [src, end) to values.
+    // returns false if it stopped at something that is not a number.
+    static bool parse_ints(dynarray<int> &values, const char *src, const char *end) {
+      while (src != end && is_space(*src)) ++src;
+      while (src != end && *src != 0) {
+        int whole = 0, msign = 1;
+        if (*src != '-' && !is_digit(*src)) return false;
+        if (*src == '-') { msign = -1; src++; }
+        while (src != end && is_digit(*src)) whole = whole * 10 + (*src++ - '0');
+        values.push_back(whole * msign);
+        while (src != end && is_space(*src)) ++src;
       }
+      return true;
+    }
+
+    // how many numbers to reserve for bytes of an array's text: the share of its
+    // count attribute, or a guess without one. A number and its separator take at
+    // least two bytes, so a wrong count can not reserve more than that.
+    static unsigned estimate_count(size_t bytes, unsigned count, size_t total_bytes) {
+      size_t most = bytes / 2 + 1;
+      size_t guess = count && total_bytes ? (size_t)((double)count * bytes / total_bytes) + 1 : bytes / 4 + 1;
+      return (unsigned)(guess < most ? guess : most);
+    }
+
+    // the count="n" attribute in the start tag [src, end), 0 if it has none
+    static unsigned find_count(const char *src, const char *end) {
+      for (; end - src > 8; ++src) {
+        if (is_space(src[0]) && !memcmp(src + 1, "count=", 6) && (src[7] == '"' || src[7] == '\'')) {
+          unsigned count = 0;
+          for (src += 8; src != end && is_digit(*src); ++src) count = count * 10 + (*src - '0');
+          return count;
+        }
+      }
+      return 0;
+    }
+
+    // convert a string like "1.2 3.4 43.12" into an array of float values
+    void atofv(dynarray<float> &values, const char *src, unsigned count = 0) {  
+      values.resize(0);
+      if (!src) return;
+
+      size_t length = strlen(src);
+      values.reserve(estimate_count(length, count, length));
+      parse_floats(values, src, src + length);
     }
 
     // convert an ascii sequence of integers like "1 3 9 12 34" to an array of integers
-    void atoiv(dynarray<int> &values, const char *src) {  
+    void atoiv(dynarray<int> &values, const char *src, unsigned count = 0) {  
       values.resize(0);
       if (!src) return;
 
-      while (*src > 0 && *src <= ' ') ++src;
-      while(*src != 0) {
-        int whole = 0, msign = 1;
-        if (*src == '-') { msign = -1; src++; }
-        while (*src >= '0' && *src <= '9') whole = whole * 10 + (*src++ - '0');
-        values.push_back(whole * msign);
-        while (*src > 0 && *src <= ' ') ++src;
+      size_t length = strlen(src);
+      values.reserve(estimate_count(length, count, length));
+      parse_ints(values, src, src + length);
+    }
+
+    static unsigned get_count(const char *count) {
+      return count ? (unsigned)atoi(count) : 0;
+    }
+
+    // the numbers of an element, from the arrays load_xml() cut out of the
+    // file or from the element's text.
+    void get_floats(dynarray<float> &values, TiXmlElement *elem) {
+      const char *index = attr(elem, "octet_array");
+      if (!index) {
+        atofv(values, text(elem), get_count(attr(elem, "count")));
+      } else if (!arrays[atoi(index)].is_float) {
+        printf("warning: <%s> does not hold floats\n", value(elem));
+        values.resize(0);
+      } else {
+        values = arrays[atoi(index)].floats;
       }
     }
 
+    void get_ints(dynarray<int> &values, TiXmlElement *elem) {
+      const char *index = attr(elem, "octet_array");
+      if (!index) {
+        atoiv(values, text(elem), get_count(attr(elem, "count")));
+      } else if (arrays[atoi(index)].is_float) {
+        printf("warning: <%s> does not hold integers\n", value(elem));
+        values.resize(0);
+      } else {
+        values = arrays[atoi(index)].ints;
+      }
+    }
+
+    // is this an element whose text is a long list of numbers?
+    static bool is_array_element(const char *name, size_t length, bool &is_float) {
+      static const char *const names[] = { "float_array", "int_array", "p", "v", "vcount" };
+      for (unsigned i = 0; i != sizeof(names)/sizeof(names[0]); ++i) {
+        if (strlen(names[i]) == length && !memcmp(name, names[i], length)) {
+          is_float = i == 0;
+          return true;
+        }
+      }
+      return false;
+    }
+
+    // make a copy of the xml in [src, end) for TinyXML with the text of big number
+    // arrays cut out, adding an octet_array="index" attribute in its place.
+    // The cut text is split into chunks at whitespace for parse_chunk().
+    void cut_arrays(dynarray<char> &dest, const char *src, const char *end) {
+      dest.reserve((unsigned)(end - src + 1));
+      const char *copied = src;
+      const char *p = src;
+      while (p != end) {
+        p = (const char *)memchr(p, '<', end - p);
+        if (!p) break;
+
+        // skip comments and CDATA whole, they may have tags in them
+        const char *skip_to = 0;
+        if (end - p >= 4 && !memcmp(p, "<!--", 4)) skip_to = "-->";
+        else if (end - p >= 9 && !memcmp(p, "<![CDATA[", 9)) skip_to = "]]>";
+        if (skip_to) {
+          size_t skip_length = strlen(skip_to);
+          while (p != end && (size_t)(end - p) >= skip_length && memcmp(p, skip_to, skip_length)) ++p;
+          p = (size_t)(end - p) >= skip_length ? p + skip_length : end;
+          continue;
+        }
+
+        // find the end of the start tag, stepping over quoted attributes
+        const char *name = p + 1;
+        const char *name_end = name;
+        while (name_end != end && !is_space(*name_end) && *name_end != '>' && *name_end != '/') ++name_end;
+        const char *tag_end = name_end;
+        char quote = 0;
+        while (tag_end != end && ( quote || *tag_end != '>' )) {
+          if (quote) {
+            if (*tag_end == quote) quote = 0;
+          } else if (*tag_end == '"' || *tag_end == '\'') {
+            quote = *tag_end;
+          }
+          ++tag_end;
+        }
+        if (tag_end == end) break;
+        p = tag_end + 1;
+
+        bool is_float = false;
+        if (tag_end[-1] == '/' || !is_array_element(name, name_end - name, is_float)) continue;
+
+        // only plain text up to the end tag is cut
+        const char *text_begin = tag_end + 1;
+        const char *text_end = (const char *)memchr(text_begin, '<', end - text_begin);
+        if (!text_end || text_end - text_begin < min_array_bytes || text_end + 1 == end || text_end[1] != '/') continue;
+
+        unsigned index = arrays.size();
+        arrays.resize(index + 1);
+        arrays[index].is_float = is_float;
+        arrays[index].count = find_count(name_end, tag_end);
+        arrays[index].bytes = text_end - text_begin;
+
+        char attribute[32];
+        sprintf(attribute, " octet_array=\"%u\">", index);
+        dest.append(copied, (unsigned)(tag_end - copied));
+        dest.append(attribute, (unsigned)strlen(attribute));
+        copied = text_end;
+
+        for (const char *chunk_begin = text_begin; chunk_begin != text_end; ) {
+          const char *chunk_end = text_end - chunk_begin > chunk_bytes ? chunk_begin + chunk_bytes : text_end;
+          while (chunk_end != text_end && !is_space(*chunk_end)) ++chunk_end;
+          chunks.resize(chunks.size() + 1);
+          number_chunk &chunk = chunks.back();
+          chunk.array = index;
+          chunk.begin = chunk_begin;
+          chunk.end = chunk_end;
+          chunk.stopped = false;
+          chunk_begin = chunk_end;
+        }
+        p = text_end;
+      }
+      dest.append(copied, (unsigned)(end - copied));
+      dest.push_back(0);
+    }
+
+    static void parse_chunk(void *context, unsigned index, unsigned thread) {
+      collada_builder *builder = (collada_builder *)context;
+      number_chunk &chunk = builder->chunks[index];
+      const number_array &array = builder->arrays[chunk.array];
+      unsigned num_values = estimate_count(chunk.end - chunk.begin, array.count, array.bytes);
+      if (array.is_float) {
+        chunk.floats.reserve(num_values);
+        chunk.stopped = !parse_floats(chunk.floats, chunk.begin, chunk.end);
+      } else {
+        chunk.ints.reserve(num_values);
+        chunk.stopped = !parse_ints(chunk.ints, chunk.begin, chunk.end);
+      }
+    }
+
+    // join the chunks of each array. As with one long parse, an array ends at
+    // the first chunk that stopped early.
+    void join_chunks() {
+      unsigned c = 0;
+      for (unsigned a = 0; a != arrays.size(); ++a) {
+        number_array &array = arrays[a];
+        unsigned first_chunk = c;
+        unsigned size = 0;
+        bool stopped = false;
+        for (; c != chunks.size() && chunks[c].array == a; ++c) {
+          if (stopped) continue;
+          size += array.is_float ? chunks[c].floats.size() : chunks[c].ints.size();
+          stopped = chunks[c].stopped;
+        }
+        array.floats.resize(array.is_float ? size : 0);
+        array.ints.resize(array.is_float ? 0 : size);
+        unsigned pos = 0;
+        for (unsigned i = first_chunk; i != c && pos != size; ++i) {
+          if (array.is_float) {
+            memcpy(array.floats.data() + pos, chunks[i].floats.data(), chunks[i].floats.size() * sizeof(float));
+            pos += chunks[i].floats.size();
+          } else {
+            memcpy(array.ints.data() + pos, chunks[i].ints.data(), chunks[i].ints.size() * sizeof(int));
+            pos += chunks[i].ints.size();
+          }
+        }
+      }
+      chunks.reset();
+    }
+
     // convert an ascii sequence of integers like "fred bert harry" into an array of strings
     void atonv(dynarray<string> &values, const char *src) {
       values.resize(0);
@@ -294,7 +575,7 @@ namespace octet {
       } else if (state.pass == 2) {
         dynarray<float> accessor_floats;
         if (!strcmp(accessor_source_elem->Value(), "float_array")) {
-          atofv(accessor_floats, accessor_source_elem->GetText());
+          get_floats(accessor_floats, accessor_source_elem);
         }
 
         // attribute building pass
@@ -333,7 +614,7 @@ namespace octet {
           }
         } else if (!strcmp(semantic, "WEIGHT")) {
           dynarray<float> accessor_floats;
-          atofv(accessor_floats, accessor_source_elem->GetText());
+          get_floats(accessor_floats, accessor_source_elem);
           assert(state.skinst->raw_weights.size() >= num_vertices);
           for (unsigned i = 0; i != num_vertices; ++i) {
             unsigned index = state.p[i * state.input_stride + state.input_offset];
@@ -677,7 +958,7 @@ namespace octet {
               }
             } else if (!strcmp(semantic, "INV_BIND_MATRIX")) {
               TiXmlElement *float_array = child(find_id(source_id), "float_array");
-              atofv(skinst.inv_bind_matrices, text(float_array));
+              get_floats(skinst.inv_bind_matrices, float_array);
             }
             input = sibling(input, "input");
           }
@@ -782,10 +1063,10 @@ namespace octet {
               const char *source_id = attr(input, "source");
               if (!strcmp(semantic, "INPUT")) {
                 TiXmlElement *float_array = child(find_id(source_id), "float_array");
-                atofv(times, text(float_array));
+                get_floats(times, float_array);
               } else if (!strcmp(semantic, "OUTPUT")) {
                 TiXmlElement *float_array = child(find_id(source_id), "float_array");
-                atofv(values, text(float_array));
+                get_floats(values, float_array);
               } else if (!strcmp(semantic, "INTERPOLATION")) {
                 /*TiXmlElement *name_array = child(find_id(source_id), "Name_array");
                 if (name_array) {
@@ -966,7 +1247,7 @@ namespace octet {
 
       parse_input_state state;
       state.s = mesh;
-      atoiv(state.p, pelem->GetText());
+      get_ints(state.p, pelem);
       state.input_stride = get_input_stride(mesh_child);
       //unsigned implicit_offset = 0;
       state.slot = 0;
@@ -1056,7 +1337,7 @@ namespace octet {
       if (vcount_elem) {
         // polygons
         dynarray<int> vcount;
-        atoiv(vcount, vcount_elem->GetText());
+        get_ints(vcount, vcount_elem);
         num_indices = convert_polygons_to_triangles(state, vcount);
       } else {
         // just plain triangles
@@ -1120,7 +1401,7 @@ namespace octet {
         printf("warning: no vcount element in skin\n");
       }
 
-      atoiv(skin->vcount, vcount_elem->GetText());
+      get_ints(skin->vcount, vcount_elem);
 
       int num_vertices = 0;
       int num_vcs = skin->vcount.size();
@@ -1133,7 +1414,7 @@ namespace octet {
 
       parse_input_state state;
       state.s = NULL;
-      atoiv(state.p, pelem->GetText());
+      get_ints(state.p, pelem);
       state.input_stride = get_input_stride(mesh_child);
       state.slot = 0;
       state.attr_offset = 0;
@@ -1221,9 +1502,49 @@ namespace octet {
 
     // public function to load a collada file
     bool load_xml(const char *url) {
+      allocator_tag_scope tag(allocator::tag_xml);
       doc_path = url;
       doc_path.truncate(doc_path.filename_pos());
-      doc.LoadFile(app_utils::get_path(url));
+
+      // the numbers, which are most of a file, go straight from the file to
+      // arrays in parallel. TinyXML only sees the structure.
+      dynarray<unsigned char> file;
+      app_utils::get_url(file, url);
+      const char *src = (const char *)file.data();
+      const char *end = src + file.size();
+      const char *nul = (const char *)memchr(src, 0, file.size());
+      if (nul) end = nul;
+
+      // TinyXML's LoadFile() takes a UTF-8 byte order mark to mean UTF-8
+      TiXmlEncoding encoding = TIXML_DEFAULT_ENCODING;
+      if (end - src >= 3 && !memcmp(src, "\xef\xbb\xbf", 3)) {
+        src += 3;
+        encoding = TIXML_ENCODING_UTF8;
+      }
+
+      arrays.reset();
+      chunks.reset();
+      dynarray<char> structure;
+      cut_arrays(structure, src, end);
+
+      pow10(0);
+      thread_pool::get_default().run(chunks.size(), parse_chunk, this);
+      join_chunks();
+
+      // make line ends '\n' as TiXmlDocument::LoadFile() does
+      char *q = structure.data();
+      for (const char *p = structure.data(); *p; ) {
+        if (*p == '\r') {
+          *q++ = '\n';
+          if (*++p == '\n') p++;
+        } else {
+          *q++ = *p++;
+        }
+      }
+      *q = 0;
+
+      doc.Clear();
+      doc.Parse(structure.data(), 0, encoding);
 
       TiXmlElement *top = doc.RootElement();
       if (!top || strcmp(top->Value(), "COLLADA")) {
@@ -1270,6 +1591,7 @@ namespace octet {
 
     // extract resources from the collada file into a collection.
     void get_resources(resources &dict) {
+      allocator_tag_scope tag(allocator::tag_scene);
       add_images(dict);
 
       add_materials(dict);
@@ -7,73 +7,287 @@
 //
 // jpeg file encoder - tiny and fast
 //
+// Baseline JPEG, 4:4:4 YCbCr with the standard Huffman tables.
+//
 // See http://en.wikipedia.org/wiki/JPEG
-// 
+//
 namespace octet {
   class jpeg_encoder {
+    // quality 1..100
+    int quality;
+
+    // quantisation tables in zigzag order
+    uint8_t qtable[2][64];
+
+    // huffman codes and lengths for each symbol: dc0, ac0, dc1, ac1
+    uint16_t codes[4][256];
+    uint8_t lengths[4][256];
+
+    uint32_t bit_buffer;
+    int bit_count;
+
+    static const uint8_t *zigzag() {
+      static const uint8_t table[64] = {
+         0,  1,  8, 16,  9,  2,  3, 10, 17, 24, 32, 25, 18, 11,  4,  5,
+        12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13,  6,  7, 14, 21, 28,
+        35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+        58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63,
+      };
+      return table;
+    }
+
+    // bits[16] then values of the four standard tables (JPEG spec annex K)
+    static const uint8_t *huffman_table(int table) {
+      static const uint8_t dc_luminance[] = {
+        0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0,
+        0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11,
+      };
+      static const uint8_t ac_luminance[] = {
+        0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d,
+        0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+        0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0,
+        0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+        0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+        0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+        0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+        0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+        0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+        0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+        0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+        0xf9, 0xfa,
+      };
+      static const uint8_t dc_chrominance[] = {
+        0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0,
+        0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11,
+      };
+      static const uint8_t ac_chrominance[] = {
+        0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77,
+        0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+        0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91, 0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0,
+        0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34, 0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26,
+        0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+        0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+        0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+        0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5,
+        0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3,
+        0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+        0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+        0xf9, 0xfa,
+      };
+      static const uint8_t *tables[] = { dc_luminance, ac_luminance, dc_chrominance, ac_chrominance };
+      return tables[table];
+    }
+
+    static unsigned huffman_table_size(int table) {
+      const uint8_t *bits = huffman_table(table);
+      unsigned size = 16;
+      for (unsigned i = 0; i != 16; ++i) size += bits[i];
+      return size;
+    }
+
+    void make_tables() {
+      static const uint8_t luminance[64] = {
+        16, 11, 10, 16, 24, 40, 51, 61,  12, 12, 14, 19, 26, 58, 60, 55,
+        14, 13, 16, 24, 40, 57, 69, 56,  14, 17, 22, 29, 51, 87, 80, 62,
+        18, 22, 37, 56, 68, 109, 103, 77,  24, 35, 55, 64, 81, 104, 113, 92,
+        49, 64, 78, 87, 103, 121, 120, 101,  72, 92, 95, 98, 112, 100, 103, 99,
+      };
+      static const uint8_t chrominance[64] = {
+        17, 18, 24, 47, 99, 99, 99, 99,  18, 21, 26, 66, 99, 99, 99, 99,
+        24, 26, 56, 99, 99, 99, 99, 99,  47, 66, 99, 99, 99, 99, 99, 99,
+        99, 99, 99, 99, 99, 99, 99, 99,  99, 99, 99, 99, 99, 99, 99, 99,
+        99, 99, 99, 99, 99, 99, 99, 99,  99, 99, 99, 99, 99, 99, 99, 99,
+      };
+
+      int q = quality < 1 ? 1 : quality > 100 ? 100 : quality;
+      int scale = q < 50 ? 5000 / q : 200 - q * 2;
+      const uint8_t *zz = zigzag();
+      for (unsigned i = 0; i != 64; ++i) {
+        int l = (luminance[zz[i]] * scale + 50) / 100;
+        int c = (chrominance[zz[i]] * scale + 50) / 100;
+        qtable[0][i] = (uint8_t)(l < 1 ? 1 : l > 255 ? 255 : l);
+        qtable[1][i] = (uint8_t)(c < 1 ? 1 : c > 255 ? 255 : c);
+      }
+
+      // canonical huffman codes from the bit counts
+      for (int t = 0; t != 4; ++t) {
+        const uint8_t *bits = huffman_table(t);
+        const uint8_t *values = bits + 16;
+        unsigned code = 0;
+        for (unsigned len = 1; len <= 16; ++len) {
+          for (unsigned i = 0; i != bits[len-1]; ++i) {
+            codes[t][*values] = (uint16_t)code++;
+            lengths[t][*values++] = (uint8_t)len;
+          }
+          code <<= 1;
+        }
+      }
+    }
+
+    void put_bits(dynarray<uint8_t> &data, unsigned code, int length) {
+      bit_buffer = (bit_buffer << length) | code;
+      bit_count += length;
+      while (bit_count >= 8) {
+        uint8_t byte = (uint8_t)(bit_buffer >> (bit_count - 8));
+        data.push_back(byte);
+        if (byte == 0xff) data.push_back(0);
+        bit_count -= 8;
+      }
+    }
+
+    void put_symbol(dynarray<uint8_t> &data, int table, unsigned symbol) {
+      put_bits(data, codes[table][symbol], lengths[table][symbol]);
+    }
+
+    // the category and extra bits of a coefficient
+    void put_value(dynarray<uint8_t> &data, int table, unsigned run, int value) {
+      int magnitude = value < 0 ? -value : value;
+      unsigned size = 0;
+      while (magnitude >> size) size++;
+      put_symbol(data, table, (run << 4) | size);
+      if (size) put_bits(data, value < 0 ? value + (1 << size) - 1 : value, size);
+    }
+
+    static void put_marker(dynarray<uint8_t> &data, unsigned marker, unsigned length) {
+      data.push_back(0xff);
+      data.push_back((uint8_t)marker);
+      data.push_back((uint8_t)(length >> 8));
+      data.push_back((uint8_t)length);
+    }
+
+    // forward DCT, quantise and encode one 8x8 block
+    void encode_block(dynarray<uint8_t> &data, const float *block, int component, int &dc) {
+      static float cosines[8][8];
+      static bool init;
+      if (!init) {
+        for (unsigned u = 0; u != 8; ++u) {
+          for (unsigned x = 0; x != 8; ++x) {
+            cosines[u][x] = (u ? 0.5f : 0.35355339f) * cosf((2 * x + 1) * u * 3.14159265f / 16);
+          }
+        }
+        init = true;
+      }
+
+      float rows[64];
+      for (unsigned y = 0; y != 8; ++y) {
+        for (unsigned u = 0; u != 8; ++u) {
+          float sum = 0;
+          for (unsigned x = 0; x != 8; ++x) sum += block[y * 8 + x] * cosines[u][x];
+          rows[y * 8 + u] = sum;
+        }
+      }
+
+      const uint8_t *zz = zigzag();
+      const uint8_t *q = qtable[component ? 1 : 0];
+      int coefs[64];
+      for (unsigned i = 0; i != 64; ++i) {
+        unsigned u = zz[i] & 7, v = zz[i] >> 3;
+        float sum = 0;
+        for (unsigned y = 0; y != 8; ++y) sum += rows[y * 8 + u] * cosines[v][y];
+        float f = sum / q[i];
+        coefs[i] = (int)(f < 0 ? f - 0.5f : f + 0.5f);
+      }
+
+      int dc_table = component ? 2 : 0, ac_table = dc_table + 1;
+      put_value(data, dc_table, 0, coefs[0] - dc);
+      dc = coefs[0];
+
+      unsigned run = 0;
+      for (unsigned i = 1; i != 64; ++i) {
+        if (coefs[i] == 0) {
+          run++;
+        } else {
+          for (; run > 15; run -= 16) put_symbol(data, ac_table, 0xf0);
+          put_value(data, ac_table, run, coefs[i]);
+          run = 0;
+        }
+      }
+      if (run) put_symbol(data, ac_table, 0x00);
+    }
+
   public:
-    jpeg_encoder() {
+    jpeg_encoder(int quality_ = 90) {
+      quality = quality_;
     }
 
-    bool encode(dynarray<uint8_t> data, uint32_t width, uint32_t height, int stride, const uint8_t *src) {
-      /*if ((height & 7) != 0 || (width & 7) != 0) {
+    // encode RGBA pixels. stride is the bytes from one row to the next
+    // and may be negative to flip the image.
+    bool encode(dynarray<uint8_t> &data, uint32_t width, uint32_t height, int stride, const uint8_t *src) {
+      if (!width || !height || width > 0xffff || height > 0xffff) {
         return false;
       }
 
-      // guess
-      data.reserve(width * height / 2);
-
-      static const uint8_t hdr[] = {
-        0xff, 0xd8, // SOI
-        0xff, 0xe0, 0x00, 0x10, // APP0
-          'J', 'F', 'I', 'F', 0x00, 0x01, 0x01, 0x01, 0x00, 0x48, 0x00, 0x48, 0x00, 0x00,
-
-        0xff, 0xdb, 0x00, 0x43, // DQT
-          0x00,
-          0x03, 0x02, 0x02, 0x03, 0x02, 0x02, 0x03, 0x03,
-          0x03, 0x03, 0x04, 0x03, 0x03, 0x04, 0x05, 0x08,
-          0x05, 0x05, 0x04, 0x04, 0x05, 0x0a, 0x07, 0x07,
-          0x06, 0x08, 0x0c, 0x0a, 0x0c, 0x0c, 0x0b, 0x0a,
-          0x0b, 0x0b, 0x0d, 0x0e, 0x12, 0x10, 0x0d, 0x0e,
-          0x11, 0x0e, 0x0b, 0x0b, 0x10, 0x16, 0x10, 0x11,
-          0x13, 0x14, 0x15, 0x15, 0x15, 0x0c, 0x0f, 0x17,
-          0x18, 0x16, 0x14, 0x18, 0x12, 0x14, 0x15, 0x14,
-        0xff, 0xdb, 0x00, 0x43, // DQT
-          0x01,
-          0x03, 0x04, 0x04, 0x05, 0x04, 0x05, 0x09, 0x05,
-          0x05, 0x09, 0x14, 0x0d, 0x0b, 0x0d, 0x14, 0x14,
-          0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14,
-          0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14,
-          0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14,
-          0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14,
-          0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14,
-          0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14,
-        0xff, 0xc0, 0x00, 0x11, // SOF0
-          0x08, 0x02, 0x00, 0x02, 0x00, 0x03, 0x01, 0x11, 0x00, 0x02, 0x11, 0x01, 0x03, 0x11, 0x01,
-        0xff, 0xc4, 0x00, 0x1e, // DHT
-          0x00, 0x01, 0x00, 0x03, 0x00, 0x02, 0x03, 0x01, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-          0x00, 0x00, 0x01, 0x02, 0x03, 0x04, 0x06, 0x05, 0x07, 0x09, 0x08, 0x0a,
-        0xff, 0xc4, 0x00, 0x55, // DHT
-          0x10, 0x00, 0x02, 0x00, 0x03, 0x04, 0x05, 0x08, 0x06, 0x06, 0x04, 0x0b, 0x05, 0x07, 0x05, 0x00,
-          0x00, 0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x61, 0x07,
-          0x14, 0x53, 0x71, 0x81, 0x92, 0xb1, 0xf0, 0x08, 0x13, 0x34, 0x72, 0x91, 0xa1, 0x09, 0x22, 0x32,
-          0x42, 0xc1, 0xd1, 0x23, 0x52, 0xe1, 0xf1, 0x15, 0x16, 0x17, 0x36, 0x43, 0x62, 0x73, 0x82, 0x94,
-          0xb2, 0xd2, 0x24, 0x55, 0x63, 0xa3, 0xc2, 0x18, 0x33, 0x35, 0x64, 0x74, 0x93, 0xa2, 0x25, 0x44,
-          0x45, 0x54, 0x83,
-        0xff, 0xc4, 0x00, 0x1d, // DHT
-          0x01, 0x01, 0x01, 0x01, 0x00, 0x02, 0x03, 0x01, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-          0x00, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09,
-        0xff, 0xc4, 0x00, 0x43, // DHT
-          0x11, 0x01, 0x00, 0x01, 0x02, 0x03, 0x05, 0x02, 0x0b, 0x06, 0x04, 0x05, 0x04, 0x03, 0x01, 0x00,
-          0x00, 0x00, 0x01, 0x02, 0x11, 0x03, 0x04, 0x31, 0x05, 0x12, 0x21, 0x32, 0x51, 0x06, 0x41, 0x07,
-          0x13, 0x14, 0x22, 0x61, 0x71, 0x81, 0x91, 0xa1, 0xb1, 0xd1, 0x15, 0x34, 0x42, 0x53, 0x72, 0xf0,
-          0x52, 0x62, 0xc1, 0xe1, 0x23, 0x82, 0x92, 0xa2, 0xc2, 0x24, 0x43, 0xb2, 0xd2, 0x33, 0x63, 0x73,
-          0x93,
-        0xff, 0xda, 0x00, 0x0c, // SOS
-          0x03, 0x01, 0x00, 0x02, 0x11, 0x03, 0x11, 0x00, 0x3f, 0x00, 0xfd, 0x7f, 
-      };*/
-      return 0;
+      make_tables();
+      data.resize(0);
+      data.reserve(width * height / 2 + 1024);
+
+      static const uint8_t app0[] = { 'J', 'F', 'I', 'F', 0, 1, 1, 0, 0, 1, 0, 1, 0, 0 };
+      data.push_back(0xff);
+      data.push_back(0xd8); // SOI
+      put_marker(data, 0xe0, 2 + sizeof(app0));
+      for (unsigned i = 0; i != sizeof(app0); ++i) data.push_back(app0[i]);
+
+      put_marker(data, 0xdb, 2 + 2 * 65); // DQT
+      for (unsigned t = 0; t != 2; ++t) {
+        data.push_back((uint8_t)t);
+        for (unsigned i = 0; i != 64; ++i) data.push_back(qtable[t][i]);
+      }
+
+      static const uint8_t sof0[] = { 8, 0, 0, 0, 0, 3, 1, 0x11, 0, 2, 0x11, 1, 3, 0x11, 1 };
+      put_marker(data, 0xc0, 2 + sizeof(sof0));
+      for (unsigned i = 0; i != sizeof(sof0); ++i) {
+        uint8_t byte = sof0[i];
+        if (i == 1) byte = (uint8_t)(height >> 8);
+        if (i == 2) byte = (uint8_t)height;
+        if (i == 3) byte = (uint8_t)(width >> 8);
+        if (i == 4) byte = (uint8_t)width;
+        data.push_back(byte);
+      }
+
+      unsigned dht_length = 2;
+      for (int t = 0; t != 4; ++t) dht_length += 1 + huffman_table_size(t);
+      put_marker(data, 0xc4, dht_length);
+      static const uint8_t table_ids[] = { 0x00, 0x10, 0x01, 0x11 };
+      for (int t = 0; t != 4; ++t) {
+        data.push_back(table_ids[t]);
+        const uint8_t *table = huffman_table(t);
+        for (unsigned i = 0; i != huffman_table_size(t); ++i) data.push_back(table[i]);
+      }
+
+      static const uint8_t sos[] = { 3, 1, 0x00, 2, 0x11, 3, 0x11, 0, 63, 0 };
+      put_marker(data, 0xda, 2 + sizeof(sos));
+      for (unsigned i = 0; i != sizeof(sos); ++i) data.push_back(sos[i]);
+
+      bit_buffer = 0;
+      bit_count = 0;
+      int dc[3] = { 0, 0, 0 };
+      float blocks[3][64];
+      for (uint32_t by = 0; by < height; by += 8) {
+        for (uint32_t bx = 0; bx < width; bx += 8) {
+          // repeat the edge pixels of partial blocks
+          for (unsigned y = 0; y != 8; ++y) {
+            uint32_t sy = by + y < height ? by + y : height - 1;
+            const uint8_t *row = src + (intptr_t)sy * stride;
+            for (unsigned x = 0; x != 8; ++x) {
+              uint32_t sx = bx + x < width ? bx + x : width - 1;
+              const uint8_t *p = row + sx * 4;
+              float r = p[0], g = p[1], b = p[2];
+              blocks[0][y * 8 + x] = 0.299f * r + 0.587f * g + 0.114f * b - 128;
+              blocks[1][y * 8 + x] = -0.168736f * r - 0.331264f * g + 0.5f * b;
+              blocks[2][y * 8 + x] = 0.5f * r - 0.418688f * g - 0.081312f * b;
+            }
+          }
+          for (int c = 0; c != 3; ++c) {
+            encode_block(data, blocks[c], c, dc[c]);
+          }
+        }
+      }
+
+      // pad the last byte with ones
+      put_bits(data, 0x7f, 7);
+      data.push_back(0xff);
+      data.push_back(0xd9); // EOI
+      return true;
     }
   };
 }
-
@@ -0,0 +1,50 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Andy Thomason 2012, 2013
+//
+// Modular Framework for OpenGLES2 rendering on multiple platforms.
+//
+//
+// tga file encoder - uncompressed 32 bit only
+//
+// Used to save frames from glReadPixels. Loads back with tga_decoder.
+// 
+
+namespace octet {
+  class tga_encoder {
+  public:
+    tga_encoder() {
+    }
+
+    // encode RGBA pixels. stride is the bytes from one row to the next
+    // and may be negative to flip the image.
+    bool encode(dynarray<uint8_t> &data, uint32_t width, uint32_t height, int stride, const uint8_t *src) {
+      if (width > 0xffff || height > 0xffff) {
+        return false;
+      }
+
+      data.resize(18 + width * height * 4);
+      uint8_t *dest = &data[0];
+
+      // see tga_decoder for the fields
+      memset(dest, 0, 18);
+      dest[2] = 2;
+      dest[12] = (uint8_t)width; dest[13] = (uint8_t)(width >> 8);
+      dest[14] = (uint8_t)height; dest[15] = (uint8_t)(height >> 8);
+      dest[16] = 32;
+      dest[17] = 0x28; // top left origin, 8 alpha bits
+      dest += 18;
+
+      for (uint32_t y = 0; y != height; ++y) {
+        const uint8_t *s = src + (intptr_t)y * stride;
+        for (uint32_t x = 0; x != width; ++x, s += 4, dest += 4) {
+          dest[0] = s[2];
+          dest[1] = s[1];
+          dest[2] = s[0];
+          dest[3] = s[3];
+        }
+      }
+      return true;
+    }
+  };
+}
@@ -6,318 +6,453 @@
 //
 //
 // zip deflate format decoder
-// 
+//
+// The Huffman codes are decoded with lookup tables indexed by the next bits
+// of the stream, with a second level for the few codes that are too long for
+// the first. Where two short literal codes fit in the first level together,
+// one lookup gives both. The bits are kept in a 64 bit buffer refilled a word
+// at a time, so one refill is enough for a length and distance pair.
+//
+// crc32() checks the data against the crc in the zip directory.
+//
+// note: like the rest of the loaders this expects a little-endian machine.
+//
+
+#if defined(__ARM_FEATURE_CRC32)
+  #include <arm_acle.h>
+#endif
+
 namespace octet {
   class zip_decoder {
-    enum { debug = 1 };
+    enum {
+      lit_bits = 11,
+      dist_bits = 8,
+      code_length_bits = 7,
+
+      // most entries a table can need with its second level
+      lit_table_size = 2342,
+      dist_table_size = 402,
+
+      // a table entry:
+      //   bits 0-4   number of bits to consume
+      //   bits 5-7   kind
+      //   bits 8-15  number of extra bits, or the bits of a second level table
+      //   bits 16-31 literals, a length or distance base or a second level offset
+      kind_literal = 0 << 5,
+      kind_literal2 = 1 << 5,
+      kind_length = 2 << 5,
+      kind_end = 3 << 5,
+      kind_subtable = 4 << 5,
+      kind_invalid = 5 << 5,
+      kind_mask = 7 << 5,
+    };
 
     struct huffman_table {
-      uint8_t min_lit_length;
-      uint8_t max_lit_length;
-      uint8_t min_dist_length;
-      uint8_t max_dist_length;
-
-      //uint8_t lit_lengths[288];
-      uint16_t lit_codes[288];
-      uint16_t lit_limits[18];
-      uint16_t lit_base[18];
-
-      //uint8_t dist_lengths[32];
-      uint16_t dist_codes[32];
-      uint16_t dist_limits[18];
-      uint16_t dist_base[18];
+      uint32_t lit[lit_table_size];
+      uint32_t dist[dist_table_size];
     };
 
     huffman_table fixed_;
     huffman_table var_;
 
-    // on ARM we can do this faster with the "rev" instruction
+    // bits of the compressed stream, least significant first
+    struct bit_stream {
+      const uint8_t *src;
+      const uint8_t *src_max;
+      uint64_t bits;
+      unsigned num_bits;
+      unsigned overrun; // zero bytes added after src_max
+
+      bit_stream(const uint8_t *src, const uint8_t *src_max) {
+        this->src = src;
+        this->src_max = src_max;
+        bits = 0;
+        num_bits = 0;
+        overrun = 0;
+      }
+
+      // make at least 56 bits available
+      void refill() {
+        if (src_max - src >= 8) {
+          uint64_t word;
+          memcpy(&word, src, 8);
+          bits |= word << num_bits;
+          src += ( 63 - num_bits ) >> 3;
+          num_bits |= 56;
+        } else {
+          while (num_bits <= 56) {
+            if (src != src_max) {
+              bits |= (uint64_t)*src++ << num_bits;
+            } else {
+              overrun++;
+            }
+            num_bits += 8;
+          }
+        }
+      }
+
+      unsigned peek(unsigned n) const {
+        return (unsigned)bits & ( ( 1u << n ) - 1 );
+      }
+
+      void consume(unsigned n) {
+        bits >>= n;
+        num_bits -= n;
+      }
+
+      unsigned get(unsigned n) {
+        unsigned value = peek(n);
+        consume(n);
+        return value;
+      }
+
+      // true if bits past the end of the stream have been used
+      bool is_overrun() const {
+        return overrun * 8 > num_bits;
+      }
+
+      // drop the bits up to the next byte and return its address, 0 if past the end
+      const uint8_t *align_to_byte() {
+        consume(num_bits & 7);
+        if (is_overrun()) return 0;
+        const uint8_t *result = src + overrun - num_bits / 8;
+        bits = 0;
+        num_bits = 0;
+        overrun = 0;
+        src = result;
+        return result;
+      }
+    };
+
+    static uint32_t make_entry(unsigned kind, unsigned extra, unsigned value) {
+      return kind | ( extra << 8 ) | ( value << 16 );
+    }
+
+    // bits 0-15 of value, reversed
     inline static uint16_t rev16(uint16_t value) {
-      // small table version.
-      //static const uint8_t r16[] = { 0x0, 0x8, 0x4, 0xc, 0x2, 0xa, 0x6, 0xe, 0x1, 0x9, 0x5, 0xd, 0x3, 0xb, 0x7, 0xf };
-      //return r16[value&0x0f] * 0x1000 | r16[(value>>4)&0x0f] * 0x100 | r16[(value>>8)&0x0f] * 0x10 | r16[value>>12];
-
-      // this table is probably too big to be efficient. L1 cache misses are very expensive.
-      static const uint8_t r256[] = {
-        0x00, 0x80, 0x40, 0xc0, 0x20, 0xa0, 0x60, 0xe0, 
-        0x00+0x10, 0x80+0x10, 0x40+0x10, 0xc0+0x10, 0x20+0x10, 0xa0+0x10, 0x60+0x10, 0xe0+0x10, 
-        0x00+8, 0x80+8, 0x40+8, 0xc0+8, 0x20+8, 0xa0+8, 0x60+8, 0xe0+8, 
-        0x00+0x10+8, 0x80+0x10+8, 0x40+0x10+8, 0xc0+0x10+8, 0x20+0x10+8, 0xa0+0x10+8, 0x60+0x10+8, 0xe0+0x10+8, 
-        0x00+ 4, 0x80+ 4, 0x40+ 4, 0xc0+ 4, 0x20+ 4, 0xa0+ 4, 0x60+ 4, 0xe0+ 4, 
-        0x00+0x10+ 4, 0x80+0x10+ 4, 0x40+0x10+ 4, 0xc0+0x10+ 4, 0x20+0x10+ 4, 0xa0+0x10+ 4, 0x60+0x10+ 4, 0xe0+0x10+ 4, 
-        0x00+8+ 4, 0x80+8+ 4, 0x40+8+ 4, 0xc0+8+ 4, 0x20+8+ 4, 0xa0+8+ 4, 0x60+8+ 4, 0xe0+8+ 4, 
-        0x00+0x10+8+ 4, 0x80+0x10+8+ 4, 0x40+0x10+8+ 4, 0xc0+0x10+8+ 4, 0x20+0x10+8+ 4, 0xa0+0x10+8+ 4, 0x60+0x10+8+ 4, 0xe0+0x10+8+ 4, 
-        0x00+ 2, 0x80+ 2, 0x40+ 2, 0xc0+ 2, 0x20+ 2, 0xa0+ 2, 0x60+ 2, 0xe0+ 2, 
-        0x00+0x10+ 2, 0x80+0x10+ 2, 0x40+0x10+ 2, 0xc0+0x10+ 2, 0x20+0x10+ 2, 0xa0+0x10+ 2, 0x60+0x10+ 2, 0xe0+0x10+ 2, 
-        0x00+8+ 2, 0x80+8+ 2, 0x40+8+ 2, 0xc0+8+ 2, 0x20+8+ 2, 0xa0+8+ 2, 0x60+8+ 2, 0xe0+8+ 2, 
-        0x00+0x10+8+ 2, 0x80+0x10+8+ 2, 0x40+0x10+8+ 2, 0xc0+0x10+8+ 2, 0x20+0x10+8+ 2, 0xa0+0x10+8+ 2, 0x60+0x10+8+ 2, 0xe0+0x10+8+ 2, 
-        0x00+ 4+ 2, 0x80+ 4+ 2, 0x40+ 4+ 2, 0xc0+ 4+ 2, 0x20+ 4+ 2, 0xa0+ 4+ 2, 0x60+ 4+ 2, 0xe0+ 4+ 2, 
-        0x00+0x10+ 4+ 2, 0x80+0x10+ 4+ 2, 0x40+0x10+ 4+ 2, 0xc0+0x10+ 4+ 2, 0x20+0x10+ 4+ 2, 0xa0+0x10+ 4+ 2, 0x60+0x10+ 4+ 2, 0xe0+0x10+ 4+ 2, 
-        0x00+8+ 4+ 2, 0x80+8+ 4+ 2, 0x40+8+ 4+ 2, 0xc0+8+ 4+ 2, 0x20+8+ 4+ 2, 0xa0+8+ 4+ 2, 0x60+8+ 4+ 2, 0xe0+8+ 4+ 2, 
-        0x00+0x10+8+ 4+ 2, 0x80+0x10+8+ 4+ 2, 0x40+0x10+8+ 4+ 2, 0xc0+0x10+8+ 4+ 2, 0x20+0x10+8+ 4+ 2, 0xa0+0x10+8+ 4+ 2, 0x60+0x10+8+ 4+ 2, 0xe0+0x10+8+ 4+ 2, 
-        0x00+ 1, 0x80+ 1, 0x40+ 1, 0xc0+ 1, 0x20+ 1, 0xa0+ 1, 0x60+ 1, 0xe0+ 1, 
-        0x00+0x10+ 1, 0x80+0x10+ 1, 0x40+0x10+ 1, 0xc0+0x10+ 1, 0x20+0x10+ 1, 0xa0+0x10+ 1, 0x60+0x10+ 1, 0xe0+0x10+ 1, 
-        0x00+8+ 1, 0x80+8+ 1, 0x40+8+ 1, 0xc0+8+ 1, 0x20+8+ 1, 0xa0+8+ 1, 0x60+8+ 1, 0xe0+8+ 1, 
-        0x00+0x10+8+ 1, 0x80+0x10+8+ 1, 0x40+0x10+8+ 1, 0xc0+0x10+8+ 1, 0x20+0x10+8+ 1, 0xa0+0x10+8+ 1, 0x60+0x10+8+ 1, 0xe0+0x10+8+ 1, 
-        0x00+ 4+ 1, 0x80+ 4+ 1, 0x40+ 4+ 1, 0xc0+ 4+ 1, 0x20+ 4+ 1, 0xa0+ 4+ 1, 0x60+ 4+ 1, 0xe0+ 4+ 1, 
-        0x00+0x10+ 4+ 1, 0x80+0x10+ 4+ 1, 0x40+0x10+ 4+ 1, 0xc0+0x10+ 4+ 1, 0x20+0x10+ 4+ 1, 0xa0+0x10+ 4+ 1, 0x60+0x10+ 4+ 1, 0xe0+0x10+ 4+ 1, 
-        0x00+8+ 4+ 1, 0x80+8+ 4+ 1, 0x40+8+ 4+ 1, 0xc0+8+ 4+ 1, 0x20+8+ 4+ 1, 0xa0+8+ 4+ 1, 0x60+8+ 4+ 1, 0xe0+8+ 4+ 1, 
-        0x00+0x10+8+ 4+ 1, 0x80+0x10+8+ 4+ 1, 0x40+0x10+8+ 4+ 1, 0xc0+0x10+8+ 4+ 1, 0x20+0x10+8+ 4+ 1, 0xa0+0x10+8+ 4+ 1, 0x60+0x10+8+ 4+ 1, 0xe0+0x10+8+ 4+ 1, 
-        0x00+ 2+ 1, 0x80+ 2+ 1, 0x40+ 2+ 1, 0xc0+ 2+ 1, 0x20+ 2+ 1, 0xa0+ 2+ 1, 0x60+ 2+ 1, 0xe0+ 2+ 1, 
-        0x00+0x10+ 2+ 1, 0x80+0x10+ 2+ 1, 0x40+0x10+ 2+ 1, 0xc0+0x10+ 2+ 1, 0x20+0x10+ 2+ 1, 0xa0+0x10+ 2+ 1, 0x60+0x10+ 2+ 1, 0xe0+0x10+ 2+ 1, 
-        0x00+8+ 2+ 1, 0x80+8+ 2+ 1, 0x40+8+ 2+ 1, 0xc0+8+ 2+ 1, 0x20+8+ 2+ 1, 0xa0+8+ 2+ 1, 0x60+8+ 2+ 1, 0xe0+8+ 2+ 1, 
-        0x00+0x10+8+ 2+ 1, 0x80+0x10+8+ 2+ 1, 0x40+0x10+8+ 2+ 1, 0xc0+0x10+8+ 2+ 1, 0x20+0x10+8+ 2+ 1, 0xa0+0x10+8+ 2+ 1, 0x60+0x10+8+ 2+ 1, 0xe0+0x10+8+ 2+ 1, 
-        0x00+ 4+ 2+ 1, 0x80+ 4+ 2+ 1, 0x40+ 4+ 2+ 1, 0xc0+ 4+ 2+ 1, 0x20+ 4+ 2+ 1, 0xa0+ 4+ 2+ 1, 0x60+ 4+ 2+ 1, 0xe0+ 4+ 2+ 1, 
-        0x00+0x10+ 4+ 2+ 1, 0x80+0x10+ 4+ 2+ 1, 0x40+0x10+ 4+ 2+ 1, 0xc0+0x10+ 4+ 2+ 1, 0x20+0x10+ 4+ 2+ 1, 0xa0+0x10+ 4+ 2+ 1, 0x60+0x10+ 4+ 2+ 1, 0xe0+0x10+ 4+ 2+ 1, 
-        0x00+8+ 4+ 2+ 1, 0x80+8+ 4+ 2+ 1, 0x40+8+ 4+ 2+ 1, 0xc0+8+ 4+ 2+ 1, 0x20+8+ 4+ 2+ 1, 0xa0+8+ 4+ 2+ 1, 0x60+8+ 4+ 2+ 1, 0xe0+8+ 4+ 2+ 1, 
-        0x00+0x10+8+ 4+ 2+ 1, 0x80+0x10+8+ 4+ 2+ 1, 0x40+0x10+8+ 4+ 2+ 1, 0xc0+0x10+8+ 4+ 2+ 1, 0x20+0x10+8+ 4+ 2+ 1, 0xa0+0x10+8+ 4+ 2+ 1, 0x60+0x10+8+ 4+ 2+ 1, 0xe0+0x10+8+ 4+ 2+ 1, 
-      };
-      return r256[value&0xff] << 8 | r256[(value>>8)&0xff];
-
-      //value = ( ( value >> 1 ) & 0x5555 ) | ( ( value & 0x5555 ) << 1 );
-      //value = ( ( value >> 2 ) & 0x3333 ) | ( ( value & 0x3333 ) << 2 );
-      //value = ( ( value >> 4 ) & 0x0f0f ) | ( ( value & 0x0f0f ) << 4 );
-      //value = ( ( value >> 8 ) & 0x00ff ) | ( ( value & 0x00ff ) << 8 );
-      //return value;
+      value = ( ( value >> 1 ) & 0x5555 ) | ( ( value & 0x5555 ) << 1 );
+      value = ( ( value >> 2 ) & 0x3333 ) | ( ( value & 0x3333 ) << 2 );
+      value = ( ( value >> 4 ) & 0x0f0f ) | ( ( value & 0x0f0f ) << 4 );
+      value = ( ( value >> 8 ) & 0x00ff ) | ( ( value & 0x00ff ) << 8 );
+      return value;
     }
 
-    bool build_huffman(uint8_t *lengths, unsigned num_lengths, uint8_t &min_length, uint8_t &max_length, uint16_t *codes, uint16_t *limits, uint16_t *base) {
-      min_length = 16;
-      max_length = 0;
-      for (unsigned i = 0; i != num_lengths; ++i) {
-        if (debug) printf("%d,", lengths[i]);
-        if (lengths[i]) {
-          if (min_length > lengths[i]) min_length = lengths[i];
-          if (max_length < lengths[i]) max_length = lengths[i];
+    // what each literal/length symbol decodes to, without its bit count
+    static const uint32_t *lit_entries() {
+      static uint32_t entries[288];
+      static bool done = false;
+      if (!done) {
+        static const uint8_t extra[] = {
+          0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+        };
+        static const uint16_t base[] = {
+          3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+          35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258,
+        };
+        for (unsigned i = 0; i != 288; ++i) {
+          if (i < 256) {
+            entries[i] = make_entry(kind_literal, 0, i);
+          } else if (i == 256) {
+            entries[i] = make_entry(kind_end, 0, 0);
+          } else if (i < 286) {
+            entries[i] = make_entry(kind_length, extra[i-257], base[i-257]);
+          } else {
+            entries[i] = make_entry(kind_invalid, 0, 0);
+          }
+        }
+        done = true;
+      }
+      return entries;
+    }
+
+    static const uint32_t *dist_entries() {
+      static uint32_t entries[32];
+      static bool done = false;
+      if (!done) {
+        static const uint8_t extra[] = {
+          0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13,
+        };
+        static const uint16_t base[] = {
+          1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+        };
+        for (unsigned i = 0; i != 32; ++i) {
+          entries[i] = i < 30 ? make_entry(kind_length, extra[i], base[i]) : make_entry(kind_invalid, 0, 0);
         }
+        done = true;
       }
-      if (debug) printf("\n");
+      return entries;
+    }
 
-      if (debug) printf("min_length=%d\n", min_length);
-      if (debug) printf("max_length=%d\n", max_length);
+    static const uint32_t *code_length_entries() {
+      static uint32_t entries[19];
+      static bool done = false;
+      if (!done) {
+        for (unsigned i = 0; i != 19; ++i) {
+          entries[i] = make_entry(kind_literal, 0, i);
+        }
+        done = true;
+      }
+      return entries;
+    }
 
-      if ( min_length <= 0 || min_length > max_length || max_length > 16 ) {
-        return false;
+    // build a lookup table for canonical Huffman codes with these lengths.
+    // codes longer than root_bits go in second level tables after the first.
+    // returns false if the lengths do not make a code.
+    static bool build_table(uint32_t *table, unsigned table_size, unsigned root_bits, const uint8_t *lengths, unsigned num_lengths, const uint32_t *entries) {
+      unsigned counts[16] = { 0 };
+      for (unsigned i = 0; i != num_lengths; ++i) {
+        counts[lengths[i]]++;
       }
+      counts[0] = 0;
 
+      // first code of each length
+      unsigned next_code[16];
       unsigned code = 0;
-      unsigned huffcode = 0;
-      for (unsigned length = min_length; length <= max_length; ++length) {
-        base[length-min_length] = huffcode - code;
-        for (unsigned i = 0; i != num_lengths; ++i) {
-          if (lengths[i] == length) {
-            codes[code++] = i;
-            //dump_bits(huffcode << (16-length), 16, "huffcode");
-            huffcode++;
+      for (unsigned length = 1; length != 16; ++length) {
+        code = ( code + counts[length-1] ) << 1;
+        next_code[length] = code;
+        if (code + counts[length] > ( 1u << length )) return false;
+      }
+
+      unsigned root_size = 1 << root_bits;
+      for (unsigned i = 0; i != root_size; ++i) {
+        table[i] = make_entry(kind_invalid, 0, 0);
+      }
+
+      // the bits of the second level table for each first level index
+      uint8_t sub_bits[1 << lit_bits];
+      memset(sub_bits, 0, root_size);
+      unsigned codes[288];
+      for (unsigned i = 0; i != num_lengths; ++i) {
+        unsigned length = lengths[i];
+        if (!length) continue;
+        codes[i] = rev16((uint16_t)next_code[length]++) >> ( 16 - length );
+        if (length > root_bits) {
+          unsigned index = codes[i] & ( root_size - 1 );
+          if (sub_bits[index] < length - root_bits) sub_bits[index] = (uint8_t)( length - root_bits );
+        }
+      }
+
+      unsigned next = root_size;
+      for (unsigned i = 0; i != root_size; ++i) {
+        if (sub_bits[i]) {
+          unsigned size = 1 << sub_bits[i];
+          if (next + size > table_size) return false;
+          table[i] = make_entry(kind_subtable, sub_bits[i], next) | root_bits;
+          for (unsigned j = 0; j != size; ++j) {
+            table[next + j] = make_entry(kind_invalid, 0, 0);
           }
+          next += size;
         }
-        limits[length-min_length] = (uint16_t)( ( huffcode << (16-length) ) - 1 );
-        if (debug) printf("length %d: lim=%04x base=%04x\n", length, ( huffcode << (16-length) ) - 1, base[length-min_length]);
-        if (( huffcode << (16-length) ) - 1 > 0xffff) {
-          if (debug) printf("invalid huffman table\n");
-          return false;
+      }
+
+      for (unsigned i = 0; i != num_lengths; ++i) {
+        unsigned length = lengths[i];
+        if (!length) continue;
+        if (length <= root_bits) {
+          for (unsigned j = codes[i]; j < root_size; j += 1 << length) {
+            table[j] = entries[i] | length;
+          }
+        } else {
+          uint32_t sub = table[codes[i] & ( root_size - 1 )];
+          uint32_t *sub_table = table + ( sub >> 16 );
+          unsigned sub_size = 1 << ( ( sub >> 8 ) & 0xff );
+          unsigned sub_length = length - root_bits;
+          for (unsigned j = codes[i] >> root_bits; j < sub_size; j += 1 << sub_length) {
+            sub_table[j] = entries[i] | sub_length;
+          }
         }
-        huffcode *= 2;
       }
+      return true;
+    }
+
+    // where a literal is followed by another short one, decode both at once
+    static void pair_literals(uint32_t *table) {
+      enum { root_size = 1 << lit_bits };
+      uint32_t single[root_size];
+      memcpy(single, table, sizeof(single));
+      for (unsigned i = 0; i != root_size; ++i) {
+        uint32_t first = single[i];
+        unsigned length = first & 31;
+        if (( first & kind_mask ) != kind_literal || length >= lit_bits) continue;
+        uint32_t second = single[i >> length];
+        unsigned length2 = second & 31;
+        if (( second & kind_mask ) != kind_literal || length + length2 > lit_bits) continue;
+        table[i] = make_entry(kind_literal2, 0, ( first >> 16 ) | ( second >> 16 << 8 )) | ( length + length2 );
+      }
+    }
 
-      // prevent escape from bitstream decoding loop.
-      limits[max_length+1-min_length] = 0xffff;
+    static bool build_tables(huffman_table &table, const uint8_t *lit_lengths, unsigned num_lit, const uint8_t *dist_lengths, unsigned num_dist) {
+      if (!build_table(table.lit, lit_table_size, lit_bits, lit_lengths, num_lit, lit_entries())) return false;
+      if (!build_table(table.dist, dist_table_size, dist_bits, dist_lengths, num_dist, dist_entries())) return false;
+      pair_literals(table.lit);
       return true;
     }
 
-    /// debug function for dumping bit fields
-    void dump_bits(unsigned value, unsigned bits, const char *name) {
-      char tmp[64];
-      assert(bits<63);
-      for (unsigned i = 0; i != bits; ++i) tmp[i] = ( ( value >> (bits-1-i) ) & 1 ) + '0';
-      tmp[bits] = 0;
-      printf("[%s] %s\n", tmp, name);
+    // look up the next code
+    static uint32_t decode_symbol(bit_stream &s, const uint32_t *table, unsigned root_bits) {
+      uint32_t entry = table[s.peek(root_bits)];
+      if (( entry & kind_mask ) == kind_subtable) {
+        s.consume(root_bits);
+        entry = table[( entry >> 16 ) + s.peek(( entry >> 8 ) & 0xff)];
+      }
+      s.consume(entry & 31);
+      return entry;
     }
 
-    /// peek a fixed number of little-endian bits from the bitstream
-    /// note: this will have to be fixed on PPC and other big-endian devices
-    unsigned peek(const uint8_t *src, unsigned bitptr, unsigned bits, const char *name) {
-      unsigned i = bitptr >> 3, j = bitptr & 7;
-      unsigned value = ( (unsigned&)src[i] >> j ) & ( (1u << bits) - 1 );
-      if (name) dump_bits(value, bits, name);
-      return value;
+    // copy length bytes from distance back, eight at a time where they do not overlap
+    static void copy_match(uint8_t *dest, uint8_t *dest_max, unsigned distance, unsigned length) {
+      const uint8_t *from = dest - distance;
+      if (distance >= 8 && (size_t)( dest_max - dest ) >= length + 8) {
+        uint8_t *end = dest + length;
+        do {
+          uint64_t word;
+          memcpy(&word, from, 8);
+          memcpy(dest, &word, 8);
+          dest += 8;
+          from += 8;
+        } while (dest < end);
+      } else if (distance == 1) {
+        memset(dest, *from, length);
+      } else {
+        for (unsigned i = 0; i != length; ++i) {
+          dest[i] = from[i];
+        }
+      }
     }
 
-    unsigned decode_uncompressed(uint8_t *&dest, uint8_t *dest_max, const uint8_t *src, const uint8_t *src_max, unsigned bitptr) {
-      bitptr = ( bitptr + 7 ) & ~7;
-      unsigned bytes_to_copy = peek(src, bitptr, 16, "bytes_to_copy");
-      unsigned clength = peek(src, bitptr + 16, 16, "store length check");
-      bitptr += 32;
+    bool decode_uncompressed(uint8_t *&dest, uint8_t *dest_max, bit_stream &s) {
+      const uint8_t *src = s.align_to_byte();
+      if (!src || s.src_max - src < 4) return false;
+      unsigned bytes_to_copy = src[0] + src[1] * 256;
+      unsigned clength = src[2] + src[3] * 256;
+      src += 4;
 
-      if (bytes_to_copy != (clength^0xffff)) return ~0;
-      if (dest + bytes_to_copy > dest_max) return ~0;
-      if ((src + bitptr/8) + bytes_to_copy > src_max) return ~0;
+      if (bytes_to_copy != (clength^0xffff)) return false;
+      if ((size_t)( dest_max - dest ) < bytes_to_copy) return false;
+      if ((size_t)( s.src_max - src ) < bytes_to_copy) return false;
 
-      memcpy(dest, src + bitptr/8, bytes_to_copy);
+      memcpy(dest, src, bytes_to_copy);
       dest += bytes_to_copy;
-      bitptr += bytes_to_copy * 8;
-      return bitptr;
+      s.src = src + bytes_to_copy;
+      return true;
     }
 
-    unsigned decode_lz77(uint8_t *&dest, uint8_t *dest_max, const uint8_t *src, const uint8_t *src_max, unsigned bitptr, huffman_table *table_) {
+    bool decode_lz77(uint8_t *&dest, uint8_t *dest_begin, uint8_t *dest_max, bit_stream &s, const huffman_table &table) {
+      uint8_t *out = dest;
       for(;;) {
-        if (src + bitptr/8 > src_max) return ~0;
-        unsigned peek16 = peek(src, bitptr, 16, NULL);
-        unsigned value = rev16(peek16);
-        unsigned index = 0;
-        while (value > table_->lit_limits[index]) {
-          index++;
+        // at most 15 + 5 + 15 + 13 bits per loop
+        if (s.num_bits < 48) {
+          s.refill();
+          if (s.is_overrun()) return false;
         }
-        unsigned length = table_->min_lit_length + index;
-        unsigned offset = ( value >> ( 16 - length ) );
-        unsigned code = table_->lit_codes[offset - table_->lit_base[index]];
-        bitptr += length;
-        if (debug) dump_bits(peek16, length, "code");
-
-        if (code < 256) {
-          if (dest+1 > dest_max) return ~0;
-          *dest++ = code;
-          if (debug) printf("%02x\n", code);
-        } else if (code == 256) {
-          return bitptr;
-        } else {
-          unsigned block_length;
-          unsigned distance;
-          {
-            if (debug) printf("[%d]\n", code);
-            static const uint8_t extra[] = {
-              0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
-            };
-            static const uint8_t base[] = {
-              3-3, 4-3, 5-3, 6-3, 7-3, 8-3, 9-3, 10-3,
-              11-3, 13-3, 15-3, 17-3, 19-3, 23-3, 27-3, 31-3,
-              35-3, 43-3, 51-3, 59-3, 67-3, 83-3, 99-3, 115-3,
-              131-3, 163-3, 195-3, 227-3, 258-3,
-            };
-            if (code-257 > sizeof(extra)) return ~0;
-            unsigned extra_length = extra[ code-257 ];
-            block_length = base[ code-257 ] + 3 + peek(src, bitptr, extra_length, "extra");
-            bitptr += extra_length;
-          }
-          {
-            //if (src + (bitptr + table_->max_dist_length)/8 > src_max ) return ~0;
-            unsigned peek16 = peek(src, bitptr, 16, NULL);
-            unsigned value = rev16(peek16);
-            unsigned index = 0;
-            while (value > table_->dist_limits[index]) {
-              index++;
-            }
-            unsigned length = table_->min_dist_length + index;
-            unsigned offset = ( value >> ( 16 - length ) );
-            unsigned code = table_->dist_codes[offset - table_->dist_base[index]];
-            bitptr += length;
-
-            if (debug) printf("{%d}\n", code);
-            static const uint8_t extra[] = {
-              0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13, 0, 0, 0,
-            };
-            static const uint16_t base[] = {
-              1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
-            };
-            if (code > sizeof(extra)) return ~0;
-            unsigned extra_length = extra[ code ];
-            distance = base[ code ] + peek(src, bitptr, extra_length, "extra");
-            bitptr += extra_length;
-          }
-
-          if (debug) printf("length=%d distance=%d\n", block_length, distance);
-
-          if (dest+block_length > dest_max) return ~0;
 
-          for(unsigned i = 0; i != block_length; ++i) {
-            dest[0] = dest[-(int)distance];
-            dest++;
-          }
+        uint32_t entry = decode_symbol(s, table.lit, lit_bits);
+        unsigned kind = entry & kind_mask;
+        if (kind == kind_literal) {
+          if (out == dest_max) return false;
+          *out++ = (uint8_t)( entry >> 16 );
+        } else if (kind == kind_literal2) {
+          if (dest_max - out < 2) return false;
+          out[0] = (uint8_t)( entry >> 16 );
+          out[1] = (uint8_t)( entry >> 24 );
+          out += 2;
+        } else if (kind == kind_length) {
+          unsigned length = ( entry >> 16 ) + s.get(( entry >> 8 ) & 0xff);
+          uint32_t dist_entry = decode_symbol(s, table.dist, dist_bits);
+          if (( dist_entry & kind_mask ) != kind_length) return false;
+          unsigned distance = ( dist_entry >> 16 ) + s.get(( dist_entry >> 8 ) & 0xff);
+          if (distance > (size_t)( out - dest_begin ) || length > (size_t)( dest_max - out )) return false;
+          copy_match(out, dest_max, distance, length);
+          out += length;
+        } else if (kind == kind_end) {
+          dest = out;
+          return !s.is_overrun();
+        } else {
+          return false;
         }
       }
     }
 
-    unsigned decode_fixed(uint8_t *&dest, uint8_t *dest_max, const uint8_t *src, const uint8_t *src_max, unsigned bitptr) {
-      return decode_lz77(dest, dest_max, src, src_max, bitptr, &fixed_);
-    }
-
-    unsigned decode_variable(uint8_t *&dest, uint8_t *dest_max, const uint8_t *src, const uint8_t *src_max, unsigned bitptr) {
-      unsigned num_lit_codes = peek(src, bitptr, 5, "num_lit_codes") + 257;
-      unsigned num_dist_codes = peek(src, bitptr+5, 5, "num_dist_codes") + 1;
-      unsigned num_length_codes = peek(src, bitptr+10, 4, "num_length_codes") + 4;
-      
-      bitptr += 14;
+    bool decode_variable(uint8_t *&dest, uint8_t *dest_begin, uint8_t *dest_max, bit_stream &s) {
+      s.refill();
+      unsigned num_lit_codes = s.get(5) + 257;
+      unsigned num_dist_codes = s.get(5) + 1;
+      unsigned num_length_codes = s.get(4) + 4;
+      if (num_lit_codes > 286 || num_dist_codes > 30) return false;
 
       uint8_t lengths[288 + 32];
-      memset(lengths, 0, 20);
-      if (src + bitptr/8 + num_length_codes > src_max ) return ~0;
+      memset(lengths, 0, 19);
       for (unsigned i = 0; i != num_length_codes; ++i) {
         static const uint8_t order[] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
-        lengths[order[i]] = peek(src, bitptr, 3, "length code lenghs");
-        bitptr += 3;
+        if (s.num_bits < 3) s.refill();
+        lengths[order[i]] = (uint8_t)s.get(3);
       }
-      
-      uint16_t codes[19];
-      uint16_t limits[18];
-      uint16_t base[18];
-      uint8_t min_length;
-      uint8_t max_length;
-      if (!build_huffman(lengths, 19, min_length, max_length, codes, limits, base)) return ~0;
-      
+
+      uint32_t code_table[1 << code_length_bits];
+      if (!build_table(code_table, 1 << code_length_bits, code_length_bits, lengths, 19, code_length_entries())) return false;
+
       unsigned todo = num_lit_codes + num_dist_codes;
       for(unsigned done = 0; done < todo;) {
-        if (src + bitptr/8 + max_length > src_max ) return ~0;
-        unsigned peek16 = peek(src, bitptr, 16, NULL);
-        unsigned value = rev16(peek16);
-        unsigned index = 0;
-        while (value > limits[index]) {
-          index++;
+        if (s.num_bits < 16) {
+          s.refill();
+          if (s.is_overrun()) return false;
         }
-        unsigned length = min_length + index;
-        unsigned offset = ( value >> ( 16 - length ) );
-        unsigned code = codes[offset - base[index]];
-        bitptr += length;
-        if (debug) dump_bits(peek16, length, "length");
-        //fprintf(source_.debug(), "code=%03x\n", code);
+        uint32_t entry = decode_symbol(s, code_table, code_length_bits);
+        if (( entry & kind_mask ) != kind_literal) return false;
+        unsigned code = entry >> 16;
         unsigned copy = 1;
         if (code < 16) {
         } else if(code == 16) {
-          if (src + (bitptr+2)/8 > src_max ) return ~0;
-          copy = peek(src, bitptr, 2, NULL) + 3;
-          bitptr += 2;
-          if (done == 0) return ~0;
+          copy = s.get(2) + 3;
+          if (done == 0) return false;
           code = lengths[ done-1 ];
         } else if(code == 17) {
-          if (src + (bitptr+3)/8 > src_max ) return ~0;
-          copy = peek(src, bitptr, 3, NULL) + 3;
-          bitptr += 3;
-          code = 0;
-        } else if(code == 18) {
-          if (src + (bitptr+7)/8 > src_max ) return ~0;
-          copy = peek(src, bitptr, 7, NULL) + 11;
-          bitptr += 7;
+          copy = s.get(3) + 3;
           code = 0;
         } else {
-          return ~0;
+          copy = s.get(7) + 11;
+          code = 0;
         }
-        if (done + copy > todo) return ~0;
+        if (done + copy > todo) return false;
         do {
-          lengths[done++] = code;
+          lengths[done++] = (uint8_t)code;
         } while( --copy );
       }
 
-      if (debug) printf("lengths done\n");
+      if (lengths[256] == 0) return false;
+      if (!build_tables(var_, lengths, num_lit_codes, lengths + num_lit_codes, num_dist_codes)) return false;
+      return decode_lz77(dest, dest_begin, dest_max, s, var_);
+    }
 
-      if(
-        !build_huffman(lengths, num_lit_codes, var_.min_lit_length, var_.max_lit_length, var_.lit_codes, var_.lit_limits, var_.lit_base) ||
-        !build_huffman(lengths+num_lit_codes, num_dist_codes, var_.min_dist_length, var_.max_dist_length, var_.dist_codes, var_.dist_limits, var_.dist_base)
-      ) {
-        return ~0;
+    // crc tables for eight bytes at a time
+    static const uint32_t *crc_table() {
+      static uint32_t table[8][256];
+      static bool done = false;
+      if (!done) {
+        for (unsigned i = 0; i != 256; ++i) {
+          uint32_t crc = i;
+          for (unsigned j = 0; j != 8; ++j) {
+            crc = ( crc >> 1 ) ^ ( 0xedb88320 & ( 0 - ( crc & 1 ) ) );
+          }
+          table[0][i] = crc;
+        }
+        for (unsigned i = 0; i != 256; ++i) {
+          for (unsigned j = 1; j != 8; ++j) {
+            table[j][i] = ( table[j-1][i] >> 8 ) ^ table[0][table[j-1][i] & 0xff];
+          }
+        }
+        done = true;
       }
-      return decode_lz77(dest, dest_max, src, src_max, bitptr, &var_);
+      return table[0];
     }
+
   public:
     zip_decoder() {
+      // the shared tables are made here, not by decoders running in parallel
+      code_length_entries();
+      crc_table();
+
       uint8_t lit_lengths[288];
       uint8_t dist_lengths[32];
       memset(lit_lengths +   0, 8, 144 - 0);
@@ -325,33 +460,69 @@ namespace octet {
       memset(lit_lengths + 256, 7, 280-256);
       memset(lit_lengths + 280, 8, 288-280);
       memset(dist_lengths, 5, 32);
-      build_huffman(lit_lengths, 288, fixed_.min_lit_length, fixed_.max_lit_length, fixed_.lit_codes, fixed_.lit_limits, fixed_.lit_base);
-      build_huffman(dist_lengths, 32, fixed_.min_dist_length, fixed_.max_dist_length, fixed_.dist_codes, fixed_.dist_limits, fixed_.dist_base);
+      build_tables(fixed_, lit_lengths, 288, dist_lengths, 32);
     }
 
-    void decode(uint8_t *dest, uint8_t *dest_max, const uint8_t *src, const uint8_t *src_max) {
-      unsigned bitptr = 0;
+    // inflate src into dest. returns false if the data is damaged
+    // or does not fit. if dest_end is given, it gets the end of the output,
+    // which may be short of dest_max.
+    bool decode(uint8_t *dest, uint8_t *dest_max, const uint8_t *src, const uint8_t *src_max, uint8_t **dest_end=0) {
+      uint8_t *dest_begin = dest;
+      if (dest_end) *dest_end = dest;
+      bit_stream s(src, src_max);
       unsigned is_last_block;
 
       // for each "deflate" block:
       do {
-        // prevent (bitptr / 8) from overflowing (>512Mib)
-        src += bitptr / 8;
-        bitptr %= 8;
+        if (s.num_bits < 3) s.refill();
 
         // three bits determine kind and exit condition
-        is_last_block = peek(src, bitptr, 1, "deflate last") != 0;
-        unsigned kind = peek(src, bitptr + 1, 2, "deflate kind");
+        is_last_block = s.get(1);
+        unsigned kind = s.get(2);
 
-        bitptr += 3;
+        bool ok = false;
         switch (kind) {
-        case 0: bitptr = decode_uncompressed(dest, dest_max, src, src_max, bitptr); break;
-        case 1: bitptr = decode_fixed(dest, dest_max, src, src_max, bitptr); break;
-        case 2: bitptr = decode_variable(dest, dest_max, src, src_max, bitptr); break;
-        default: return;
+          case 0: ok = decode_uncompressed(dest, dest_max, s); break;
+          case 1: ok = decode_lz77(dest, dest_begin, dest_max, s, fixed_); break;
+          case 2: ok = decode_variable(dest, dest_begin, dest_max, s); break;
+        }
+        if (dest_end) *dest_end = dest;
+        if (!ok) return false;
+      } while( !is_last_block );
+      return true;
+    }
+
+    // zip's crc-32 of size bytes, continuing from crc
+    static uint32_t crc32(uint32_t crc, const uint8_t *src, size_t size) {
+      crc = ~crc;
+      #if defined(__ARM_FEATURE_CRC32)
+        // ARMv8 has instructions for this polynomial
+        for (; size >= 8; size -= 8, src += 8) {
+          uint64_t word;
+          memcpy(&word, src, 8);
+          crc = __crc32d(crc, word);
+        }
+        for (; size; --size) {
+          crc = __crc32b(crc, *src++);
         }
-      } while( !is_last_block && bitptr != ~0);
+      #else
+        // x86's crc32 instruction is for a different polynomial (crc-32c)
+        const uint32_t (*table)[256] = (const uint32_t (*)[256])crc_table();
+        for (; size >= 8; size -= 8, src += 8) {
+          uint32_t lo, hi;
+          memcpy(&lo, src, 4);
+          memcpy(&hi, src + 4, 4);
+          lo ^= crc;
+          crc =
+            table[7][lo & 0xff] ^ table[6][( lo >> 8 ) & 0xff] ^ table[5][( lo >> 16 ) & 0xff] ^ table[4][lo >> 24] ^
+            table[3][hi & 0xff] ^ table[2][( hi >> 8 ) & 0xff] ^ table[1][( hi >> 16 ) & 0xff] ^ table[0][hi >> 24]
+          ;
+        }
+        for (; size; --size) {
+          crc = ( crc >> 8 ) ^ table[0][( crc ^ *src++ ) & 0xff];
+        }
+      #endif
+      return ~crc;
     }
   };
 }
-
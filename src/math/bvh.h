@@ -0,0 +1,469 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Andy Thomason 2012, 2013
+//
+// Modular Framework for OpenGLES2 rendering on multiple platforms.
+//
+// Bounding volume hierarchy
+//
+// A binary tree of boxes over a set of primitives (triangles, mesh instances...)
+// given as one aabb each. build() splits with the surface area heuristic
+// using binned centroids, and refit() moves the boxes when the primitives
+// move but keep their order.
+//
+// Ray casts walk the tree and call a test class for each leaf that the ray
+// reaches. A leaf is a range of get_prims(), so a test class may keep its
+// primitives in the same order to test several at once:
+//
+//   struct my_test {
+//     // return true and lower t_max if get_prims()[first .. first+count-1]
+//     // has a hit before t_max
+//     bool test(unsigned first, unsigned count, float &t_max);
+//
+//     // the same for the rays of a packet in mask, return the mask of hits
+//     unsigned test_packet(unsigned first, unsigned count, unsigned mask, float *t_max);
+//   };
+//
+// The rays are segments: origin + distance * t for 0 <= t <= t_max
+//
+
+namespace octet {
+  class bvh {
+  public:
+    struct node_t {
+      float bb_min[3];
+      unsigned first;   // first child of an inner node, first entry in get_prims() for a leaf
+      float bb_max[3];
+      unsigned count;   // number of primitives in a leaf, zero for an inner node
+    };
+
+    // the biggest packet for cast_packet()
+    enum { max_packet = 32 };
+
+  private:
+    enum { num_bins = 12, max_depth = 64 };
+
+    // nodes in depth first order, children after their parents
+    dynarray<node_t> nodes;
+
+    // primitive indices in leaf order
+    dynarray<unsigned> prims;
+
+    struct bin_t {
+      float bb_min[3];
+      float bb_max[3];
+      unsigned count;
+    };
+
+    static void clear_bounds(float *bb_min, float *bb_max) {
+      for (int i = 0; i != 3; ++i) {
+        bb_min[i] = 1e37f;
+        bb_max[i] = -1e37f;
+      }
+    }
+
+    static void add_bounds(float *bb_min, float *bb_max, const float *rhs_min, const float *rhs_max) {
+      for (int i = 0; i != 3; ++i) {
+        bb_min[i] = rhs_min[i] < bb_min[i] ? rhs_min[i] : bb_min[i];
+        bb_max[i] = rhs_max[i] > bb_max[i] ? rhs_max[i] : bb_max[i];
+      }
+    }
+
+    static void add_box(float *bb_min, float *bb_max, const aabb &box) {
+      vec3 lo = box.get_min(), hi = box.get_max();
+      float box_min[3] = { lo.x(), lo.y(), lo.z() };
+      float box_max[3] = { hi.x(), hi.y(), hi.z() };
+      add_bounds(bb_min, bb_max, box_min, box_max);
+    }
+
+    // half the surface area, enough for comparing costs
+    static float half_area(const float *bb_min, const float *bb_max) {
+      float dx = bb_max[0] - bb_min[0], dy = bb_max[1] - bb_min[1], dz = bb_max[2] - bb_min[2];
+      return dx < 0 ? 0 : dx * dy + dy * dz + dz * dx;
+    }
+
+    // choose a split of prims[first, first+count) and partition them.
+    // returns the size of the left part or 0 for a leaf.
+    unsigned split(const aabb *boxes, const node_t &node, unsigned first, unsigned count, unsigned max_leaf_size) {
+      if (count <= 1) return 0;
+
+      float c_min[3], c_max[3];
+      clear_bounds(c_min, c_max);
+      for (unsigned i = first; i != first + count; ++i) {
+        vec3 c = boxes[prims[i]].get_center();
+        float center[3] = { c.x(), c.y(), c.z() };
+        add_bounds(c_min, c_max, center, center);
+      }
+
+      int axis = 0;
+      for (int i = 1; i != 3; ++i) {
+        if (c_max[i] - c_min[i] > c_max[axis] - c_min[axis]) axis = i;
+      }
+      float extent = c_max[axis] - c_min[axis];
+
+      // all the centers in one place: only split if we have to
+      if (extent <= 0) {
+        return count <= max_leaf_size ? 0 : count / 2;
+      }
+
+      bin_t bins[num_bins];
+      for (int b = 0; b != num_bins; ++b) {
+        clear_bounds(bins[b].bb_min, bins[b].bb_max);
+        bins[b].count = 0;
+      }
+
+      float scale = num_bins / extent * 0.9999f;
+      for (unsigned i = first; i != first + count; ++i) {
+        const aabb &box = boxes[prims[i]];
+        int b = (int)((box.get_center()[axis] - c_min[axis]) * scale);
+        add_box(bins[b].bb_min, bins[b].bb_max, box);
+        bins[b].count++;
+      }
+
+      // sweep from the right to get the cost of each right hand side
+      float right_cost[num_bins];
+      float r_min[3], r_max[3];
+      clear_bounds(r_min, r_max);
+      unsigned right_count = 0;
+      for (int b = num_bins - 1; b > 0; --b) {
+        add_bounds(r_min, r_max, bins[b].bb_min, bins[b].bb_max);
+        right_count += bins[b].count;
+        right_cost[b] = half_area(r_min, r_max) * right_count;
+      }
+
+      // then from the left to find the cheapest split
+      float l_min[3], l_max[3];
+      clear_bounds(l_min, l_max);
+      unsigned left_count = 0;
+      float best_cost = 1e37f;
+      int best_bin = 0;
+      for (int b = 0; b != num_bins - 1; ++b) {
+        add_bounds(l_min, l_max, bins[b].bb_min, bins[b].bb_max);
+        left_count += bins[b].count;
+        float cost = half_area(l_min, l_max) * left_count + right_cost[b+1];
+        if (left_count != 0 && left_count != count && cost < best_cost) {
+          best_cost = cost;
+          best_bin = b + 1;
+        }
+      }
+
+      // a leaf costs one test per primitive, a split one box test plus its children
+      float leaf_cost = half_area(node.bb_min, node.bb_max) * count;
+      if (count <= max_leaf_size && leaf_cost <= best_cost + half_area(node.bb_min, node.bb_max)) {
+        return 0;
+      }
+
+      if (best_cost == 1e37f) {
+        return count / 2;
+      }
+
+      // partition so that the bins below best_bin come first
+      unsigned *p = prims.data();
+      unsigned lo = first, hi = first + count;
+      while (lo < hi) {
+        int b = (int)((boxes[p[lo]].get_center()[axis] - c_min[axis]) * scale);
+        if (b < best_bin) {
+          lo++;
+        } else {
+          unsigned tmp = p[lo]; p[lo] = p[hi-1]; p[hi-1] = tmp;
+          hi--;
+        }
+      }
+      return lo - first;
+    }
+
+    static void set_bounds(node_t &node, const float *bb_min, const float *bb_max) {
+      for (int i = 0; i != 3; ++i) {
+        node.bb_min[i] = bb_min[i];
+        node.bb_max[i] = bb_max[i];
+      }
+    }
+
+    // the rays of a packet, x, y and z in separate arrays for SIMD
+    struct packet_t {
+      float org[3][max_packet];
+      float inv[3][max_packet];
+      float t_max[max_packet];
+    };
+
+    // mask of the rays in mask that reach a node
+    static unsigned packet_intersects(const node_t &node, const packet_t &pk, unsigned mask) {
+      unsigned result = 0;
+      #if OCTET_SSE
+        // four rays at a time
+        for (unsigned g = 0; g != max_packet; g += 4) {
+          if (!((mask >> g) & 15)) continue;
+          __m128 t0 = _mm_setzero_ps();
+          __m128 t1 = _mm_loadu_ps(pk.t_max + g);
+          for (int i = 0; i != 3; ++i) {
+            __m128 org = _mm_loadu_ps(pk.org[i] + g);
+            __m128 inv = _mm_loadu_ps(pk.inv[i] + g);
+            __m128 ta = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.bb_min[i]), org), inv);
+            __m128 tb = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.bb_max[i]), org), inv);
+            t0 = _mm_max_ps(_mm_min_ps(ta, tb), t0);
+            t1 = _mm_min_ps(_mm_max_ps(ta, tb), t1);
+          }
+          result |= (unsigned)_mm_movemask_ps(_mm_cmple_ps(t0, t1)) << g;
+        }
+        return result & mask;
+      #else
+        for (unsigned bits = mask; bits; bits &= bits - 1) {
+          unsigned r = lowest_bit(bits);
+          float org[3] = { pk.org[0][r], pk.org[1][r], pk.org[2][r] };
+          float inv[3] = { pk.inv[0][r], pk.inv[1][r], pk.inv[2][r] };
+          float t_near;
+          if (intersects(node, org, inv, pk.t_max[r], t_near)) result |= 1u << r;
+        }
+        return result;
+      #endif
+    }
+
+  public:
+    bvh() {
+    }
+
+    // build the tree over num_boxes boxes, with up to max_leaf_size in a leaf
+    // where the heuristic allows.
+    void build(const aabb *boxes, unsigned num_boxes, unsigned max_leaf_size = 4) {
+      nodes.resize(0);
+      prims.resize(num_boxes);
+      for (unsigned i = 0; i != num_boxes; ++i) {
+        prims[i] = i;
+      }
+      if (num_boxes == 0) return;
+
+      // a binary tree with n leaves has 2n-1 nodes
+      nodes.reserve(num_boxes * 2);
+
+      struct task_t { unsigned node, first, count, depth; };
+      dynarray<task_t> tasks;
+      nodes.push_back(node_t());
+      task_t root = { 0, 0, num_boxes, 0 };
+      tasks.push_back(root);
+
+      while (!tasks.is_empty()) {
+        task_t task = tasks.back();
+        tasks.pop_back();
+
+        float bb_min[3], bb_max[3];
+        clear_bounds(bb_min, bb_max);
+        for (unsigned i = task.first; i != task.first + task.count; ++i) {
+          add_box(bb_min, bb_max, boxes[prims[i]]);
+        }
+        set_bounds(nodes[task.node], bb_min, bb_max);
+
+        // past max_depth, leaves just get bigger so that casts can use a fixed stack
+        unsigned left = task.depth + 1 >= max_depth ? 0 : split(boxes, nodes[task.node], task.first, task.count, max_leaf_size);
+        node_t &node = nodes[task.node];
+        if (left == 0) {
+          node.first = task.first;
+          node.count = task.count;
+        } else {
+          unsigned child = nodes.size();
+          node.first = child;
+          node.count = 0;
+          nodes.push_back(node_t());
+          nodes.push_back(node_t());
+          task_t rhs = { child + 1, task.first + left, task.count - left, task.depth + 1 };
+          task_t lhs = { child, task.first, left, task.depth + 1 };
+          tasks.push_back(rhs);
+          tasks.push_back(lhs);
+        }
+      }
+    }
+
+    // move the boxes to fit the primitives, keeping the shape of the tree.
+    // boxes are in the same order as they were for build()
+    void refit(const aabb *boxes) {
+      // children come after their parents, so go backwards
+      for (int i = (int)nodes.size() - 1; i >= 0; --i) {
+        node_t &node = nodes[i];
+        float bb_min[3], bb_max[3];
+        clear_bounds(bb_min, bb_max);
+        if (node.count) {
+          for (unsigned j = node.first; j != node.first + node.count; ++j) {
+            add_box(bb_min, bb_max, boxes[prims[j]]);
+          }
+        } else {
+          add_bounds(bb_min, bb_max, nodes[node.first].bb_min, nodes[node.first].bb_max);
+          add_bounds(bb_min, bb_max, nodes[node.first+1].bb_min, nodes[node.first+1].bb_max);
+        }
+        set_bounds(node, bb_min, bb_max);
+      }
+    }
+
+    void reset() {
+      nodes.reset();
+      prims.reset();
+    }
+
+    bool is_empty() const {
+      return nodes.size() == 0;
+    }
+
+    unsigned get_num_nodes() const {
+      return nodes.size();
+    }
+
+    const node_t *get_nodes() const {
+      return nodes.data();
+    }
+
+    // the primitive of each leaf entry
+    const unsigned *get_prims() const {
+      return prims.data();
+    }
+
+    unsigned get_num_prims() const {
+      return prims.size();
+    }
+
+    // slab test of a segment against a node's box. inv_distance is 1/distance.
+    // t_near is where the ray enters the box.
+    static bool intersects(const node_t &node, const float *org, const float *inv_distance, float t_max, float &t_near) {
+      float t0 = 0, t1 = t_max;
+      for (int i = 0; i != 3; ++i) {
+        float ta = (node.bb_min[i] - org[i]) * inv_distance[i];
+        float tb = (node.bb_max[i] - org[i]) * inv_distance[i];
+        if (ta > tb) { float tmp = ta; ta = tb; tb = tmp; }
+        // NaNs (0 * infinity) fail these compares and leave the range as it is
+        t0 = ta > t0 ? ta : t0;
+        t1 = tb < t1 ? tb : t1;
+      }
+      t_near = t0;
+      return t0 <= t1;
+    }
+
+    static void get_inverse(float *inv, const vec3 &distance) {
+      for (int i = 0; i != 3; ++i) {
+        inv[i] = distance[i] != 0 ? 1.0f / distance[i] : 1e37f;
+      }
+    }
+
+    // cast a segment origin + distance * t, 0 <= t <= t_max.
+    // with any_hit it stops at the first hit, otherwise t_max ends up at the closest.
+    template <class test_t> bool cast(const vec3 &origin, const vec3 &distance, float &t_max, test_t &tester, bool any_hit = false) const {
+      if (nodes.size() == 0) return false;
+
+      float org[3] = { origin.x(), origin.y(), origin.z() };
+      float inv[3];
+      get_inverse(inv, distance);
+
+      const node_t *n = nodes.data();
+
+      // nodes to visit and where the ray enters them
+      unsigned stack[max_depth * 2];
+      float stack_t[max_depth * 2];
+      int sp = 0;
+      bool hit = false;
+      float t_near;
+      if (!intersects(n[0], org, inv, t_max, t_near)) return false;
+      stack[sp] = 0;
+      stack_t[sp++] = t_near;
+
+      while (sp) {
+        --sp;
+        // skip nodes beyond the closest hit found since they were pushed
+        if (stack_t[sp] > t_max) continue;
+        const node_t &node = n[stack[sp]];
+        if (node.count) {
+          if (tester.test(node.first, node.count, t_max)) {
+            hit = true;
+            if (any_hit) return true;
+          }
+        } else {
+          // visit the nearer child first
+          float t_left, t_right;
+          bool left = intersects(n[node.first], org, inv, t_max, t_left);
+          bool right = intersects(n[node.first+1], org, inv, t_max, t_right);
+          if (left && right) {
+            bool right_first = t_right < t_left;
+            stack[sp] = node.first + (right_first ? 0 : 1);
+            stack_t[sp++] = right_first ? t_left : t_right;
+            stack[sp] = node.first + (right_first ? 1 : 0);
+            stack_t[sp++] = right_first ? t_right : t_left;
+          } else if (left) {
+            stack[sp] = node.first;
+            stack_t[sp++] = t_left;
+          } else if (right) {
+            stack[sp] = node.first + 1;
+            stack_t[sp++] = t_right;
+          }
+        }
+      }
+      return hit;
+    }
+
+    // cast up to max_packet segments together. The rays share the walk of the
+    // tree, so this is fastest when they start and point in much the same way.
+    // returns a mask of the rays that hit.
+    template <class test_t> unsigned cast_packet(const vec3 *origins, const vec3 *distances, float *t_max, unsigned num_rays, test_t &tester, bool any_hit = false) const {
+      if (nodes.size() == 0 || num_rays == 0) return 0;
+      assert(num_rays <= max_packet);
+
+      // unused rays have t_max < 0 and so miss everything
+      packet_t pk;
+      memset(&pk, 0, sizeof(pk));
+      for (unsigned r = 0; r != max_packet; ++r) {
+        pk.t_max[r] = -1;
+      }
+      for (unsigned r = 0; r != num_rays; ++r) {
+        float inv[3];
+        get_inverse(inv, distances[r]);
+        for (int i = 0; i != 3; ++i) {
+          pk.org[i][r] = origins[r][i];
+          pk.inv[i][r] = inv[i];
+        }
+        pk.t_max[r] = t_max[r];
+      }
+
+      const node_t *n = nodes.data();
+      unsigned stack[max_depth * 2];
+      unsigned stack_mask[max_depth * 2];
+      int sp = 0;
+      unsigned all_rays = num_rays == 32 ? ~0u : (1u << num_rays) - 1;
+      unsigned hits = 0;
+      stack[sp] = 0;
+      stack_mask[sp++] = all_rays;
+
+      while (sp) {
+        --sp;
+        const node_t &node = n[stack[sp]];
+        unsigned mask = stack_mask[sp];
+        if (any_hit) mask &= ~hits;
+
+        // which of the rays reach this node?
+        unsigned active = packet_intersects(node, pk, mask);
+        if (!active) continue;
+
+        if (node.count) {
+          hits |= tester.test_packet(node.first, node.count, active, pk.t_max);
+        } else {
+          // visit the child nearer to the first ray first
+          unsigned r = lowest_bit(active);
+          float org[3] = { pk.org[0][r], pk.org[1][r], pk.org[2][r] };
+          float inv[3] = { pk.inv[0][r], pk.inv[1][r], pk.inv[2][r] };
+          float t_left, t_right;
+          bool left = intersects(n[node.first], org, inv, pk.t_max[r], t_left);
+          bool right = intersects(n[node.first+1], org, inv, pk.t_max[r], t_right);
+          unsigned near_child = right && (!left || t_right < t_left) ? 1 : 0;
+          stack[sp] = node.first + (near_child ^ 1);
+          stack_mask[sp++] = active;
+          stack[sp] = node.first + near_child;
+          stack_mask[sp++] = active;
+        }
+      }
+
+      for (unsigned r = 0; r != num_rays; ++r) {
+        t_max[r] = pk.t_max[r];
+      }
+      return hits;
+    }
+
+    static unsigned lowest_bit(unsigned bits) {
+      unsigned r = 0;
+      while (!(bits & 1)) { bits >>= 1; r++; }
+      return r;
+    }
+  };
+}
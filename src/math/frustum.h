@@ -0,0 +1,51 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Andy Thomason 2012, 2013
+//
+// Modular Framework for OpenGLES2 rendering on multiple platforms.
+//
+// View frustum for culling
+//
+
+namespace octet {
+  // the six planes of the clip volume -w <= x, y, z <= w of a projection matrix.
+  // a point p is inside a plane when dot(p.xyz1(), plane) >= 0
+  class frustum {
+    vec4 planes[6];
+  public:
+    frustum() {
+      for (int i = 0; i != 6; ++i) {
+        planes[i] = vec4(0, 0, 0, 1);
+      }
+    }
+
+    // with worldToProjection, the planes are in world space.
+    // (clip = pos * matrix, so the planes come from the columns)
+    frustum(const mat4t &worldToProjection) {
+      const mat4t &m = worldToProjection;
+      planes[0] = m.colw() + m.colx();
+      planes[1] = m.colw() - m.colx();
+      planes[2] = m.colw() + m.coly();
+      planes[3] = m.colw() - m.coly();
+      planes[4] = m.colw() + m.colz();
+      planes[5] = m.colw() - m.colz();
+    }
+
+    const vec4 &get_plane(int i) const {
+      return planes[i];
+    }
+
+    // false if the box is wholly outside one of the planes.
+    // boxes near the corners may pass when they are outside.
+    bool intersects(const aabb &bb) const {
+      vec4 center = bb.get_center().xyz1();
+      vec4 half = bb.get_half_extent().xyz0();
+      for (int i = 0; i != 6; ++i) {
+        float distance = dot(center, planes[i]);
+        float radius = dot(half, abs(planes[i]));
+        if (distance + radius < 0) return false;
+      }
+      return true;
+    }
+  };
+}
@@ -549,6 +549,11 @@ namespace octet {
     vec4 colw() const { return vec4( v[0][3], v[1][3], v[2][3], v[3][3] ); }
   };
 
+  // four vec4s, so a plain copy is enough
+  template <> struct is_relocatable<mat4t> {
+    enum { value = 1 };
+  };
+
   // vector times a matrix (premultiplication)
   inline vec4 vec4::operator*(const mat4t &r) const
   {
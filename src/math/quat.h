@@ -20,5 +20,9 @@ namespace octet {
     vec4 rotate(const vec4 &r) const { return (*this * r) * conjugate(); }
   };
 
+  template <> struct is_relocatable<quat> {
+    enum { value = 1 };
+  };
+
 }
 
@@ -26,11 +26,15 @@ namespace octet {
     aabb get_aabb() const {
       vec3 min_aabb = min(origin, origin + distance);
       vec3 max_aabb = max(origin, origin + distance);
-      return aabb((min_aabb+max_aabb)*0.5f, (max_aabb-max_aabb)*0.5f);
+      return aabb((min_aabb+max_aabb)*0.5f, (max_aabb-min_aabb)*0.5f);
     }
 
+    // the same ray in another space. a point at distance * t stays at t.
     ray get_transform(const mat4t &mat) const {
-      return ray((origin.xyz1() * mat).xyz(), (distance.xyz0() * mat).xyz());
+      ray result;
+      result.origin = (origin.xyz1() * mat).xyz();
+      result.distance = (distance.xyz0() * mat).xyz();
+      return result;
     }
 
     const char *toString(char *dest, size_t len) const {
@@ -98,7 +102,7 @@ namespace octet {
     }
 
     vec3 get_distance() const {
-      return origin + distance;
+      return distance;
     }
   };
 
@@ -16,11 +16,9 @@ namespace octet {
     // note we have to use a union because of GCC's
     // type based alias analysis interpretation.
     #if OCTET_SSE
-      union { __m128 m; float f; int i; } fur, fua, fub;
-      // negative numbers are 1.......
-      fua.f = a;
-      fub.f = b;
-      fur.m = _mm_cmple_ps(fua.m, fub.m);
+      union { __m128 m; float f; int i; } fur;
+      // all ones (negative) if a > b
+      fur.m = _mm_cmpgt_ss(_mm_set_ss(a), _mm_set_ss(b));
       return fur.i;
     #else
       union { float f; int i; } fu;
@@ -0,0 +1,158 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Andy Thomason 2012, 2013
+//
+// Modular Framework for OpenGLES2 rendering on multiple platforms.
+//
+// Four triangles for ray casting
+//
+// The corners are stored as one vertex and two edges with x, y and z in
+// separate arrays, so that one ray can be tested against all four triangles
+// with SSE. intersect_scalar() does the same sums in the same order and so
+// gives the same answers, for machines without SSE and for testing.
+//
+// A hit has "barycentric" numerators (a, b, c, t) over a denominator:
+//   hit pos = (numer[0] * a + numer[1] * b + numer[2] * c) / denom
+//           = org + dir * numer[3] / denom
+//
+
+namespace octet {
+  class triangle_block {
+  public:
+    enum { width = 4 };
+
+  private:
+    float a[3][width];
+    float e1[3][width];
+    float e2[3][width];
+
+    // choose the closest lane with a hit. Of equal lanes take the last,
+    // as testing them one at a time would.
+    static int closest_lane(unsigned bits, const float *t) {
+      int best = -1;
+      for (int lane = 0; lane != width; ++lane) {
+        if ((bits >> lane) & 1) {
+          if (best < 0 || t[lane] <= t[best]) best = lane;
+        }
+      }
+      return best;
+    }
+
+  public:
+    // all lanes empty. An empty lane has no area and is never hit.
+    void clear() {
+      memset(this, 0, sizeof(*this));
+    }
+
+    void set(unsigned lane, const vec3 &pa, const vec3 &pb, const vec3 &pc) {
+      for (int i = 0; i != 3; ++i) {
+        a[i][lane] = pa[i];
+        e1[i][lane] = pb[i] - pa[i];
+        e2[i][lane] = pc[i] - pa[i];
+      }
+    }
+
+    // test a segment org + dir * t, 0 <= t <= t_max, against the lanes in lane_mask.
+    // returns the lane of the closest hit or -1. On a hit, t_max is lowered to
+    // its distance and numer, denom are set.
+    int intersect_scalar(const vec3 &org, const vec3 &dir, unsigned lane_mask, float &t_max, vec4 &numer, float &denom) const {
+      float dx = dir.x(), dy = dir.y(), dz = dir.z();
+      float hits_t[width];
+      float hits_numer[width][4];
+      float hits_denom[width];
+      unsigned bits = 0;
+      for (int lane = 0; lane != width; ++lane) {
+        if (!((lane_mask >> lane) & 1)) continue;
+
+        // solve org + t * dir = a + u * e1 + v * e2 by Cramer's rule
+        float sx = org.x() - a[0][lane], sy = org.y() - a[1][lane], sz = org.z() - a[2][lane];
+        float e1x = e1[0][lane], e1y = e1[1][lane], e1z = e1[2][lane];
+        float e2x = e2[0][lane], e2y = e2[1][lane], e2z = e2[2][lane];
+        float px = dy * e2z - dz * e2y;
+        float py = dz * e2x - dx * e2z;
+        float pz = dx * e2y - dy * e2x;
+        float det = e1x * px + e1y * py + e1z * pz;
+        float u = sx * px + sy * py + sz * pz;
+        float qx = sy * e1z - sz * e1y;
+        float qy = sz * e1x - sx * e1z;
+        float qz = sx * e1y - sy * e1x;
+        float v = dx * qx + dy * qy + dz * qz;
+        float t = e2x * qx + e2y * qy + e2z * qz;
+        float w = det - u - v;
+
+        // using a multiply lets us check the signs without using a divide.
+        if (det == 0 || !(u * det >= 0 && v * det >= 0 && w * det >= 0 && t * det >= 0)) continue;
+        float tt = t / det;
+        if (!(tt <= t_max)) continue;
+
+        bits |= 1 << lane;
+        hits_t[lane] = tt;
+        hits_numer[lane][0] = w; hits_numer[lane][1] = u; hits_numer[lane][2] = v; hits_numer[lane][3] = t;
+        hits_denom[lane] = det;
+      }
+
+      int lane = closest_lane(bits, hits_t);
+      if (lane >= 0) {
+        t_max = hits_t[lane];
+        numer = vec4(hits_numer[lane][0], hits_numer[lane][1], hits_numer[lane][2], hits_numer[lane][3]);
+        denom = hits_denom[lane];
+      }
+      return lane;
+    }
+
+    int intersect(const vec3 &org, const vec3 &dir, unsigned lane_mask, float &t_max, vec4 &numer, float &denom) const {
+      #if OCTET_SSE
+        __m128 dx = _mm_set1_ps(dir.x()), dy = _mm_set1_ps(dir.y()), dz = _mm_set1_ps(dir.z());
+        __m128 sx = _mm_sub_ps(_mm_set1_ps(org.x()), _mm_loadu_ps(a[0]));
+        __m128 sy = _mm_sub_ps(_mm_set1_ps(org.y()), _mm_loadu_ps(a[1]));
+        __m128 sz = _mm_sub_ps(_mm_set1_ps(org.z()), _mm_loadu_ps(a[2]));
+        __m128 e1x = _mm_loadu_ps(e1[0]), e1y = _mm_loadu_ps(e1[1]), e1z = _mm_loadu_ps(e1[2]);
+        __m128 e2x = _mm_loadu_ps(e2[0]), e2y = _mm_loadu_ps(e2[1]), e2z = _mm_loadu_ps(e2[2]);
+
+        // p = cross(dir, e2), q = cross(s, e1)
+        __m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+        __m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+        __m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+        __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+        __m128 u = _mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)), _mm_mul_ps(sz, pz));
+        __m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+        __m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+        __m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+        __m128 v = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz));
+        __m128 t = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz));
+        __m128 w = _mm_sub_ps(_mm_sub_ps(det, u), v);
+
+        __m128 zero = _mm_setzero_ps();
+        __m128 ok = _mm_cmpneq_ps(det, zero);
+        ok = _mm_and_ps(ok, _mm_cmpge_ps(_mm_mul_ps(u, det), zero));
+        ok = _mm_and_ps(ok, _mm_cmpge_ps(_mm_mul_ps(v, det), zero));
+        ok = _mm_and_ps(ok, _mm_cmpge_ps(_mm_mul_ps(w, det), zero));
+        ok = _mm_and_ps(ok, _mm_cmpge_ps(_mm_mul_ps(t, det), zero));
+        unsigned bits = (unsigned)_mm_movemask_ps(ok) & lane_mask;
+        if (!bits) return -1;
+
+        // only divide when something is hit
+        __m128 tt = _mm_div_ps(t, det);
+        bits &= (unsigned)_mm_movemask_ps(_mm_cmple_ps(tt, _mm_set1_ps(t_max)));
+        if (!bits) return -1;
+
+        float hits_t[width];
+        _mm_storeu_ps(hits_t, tt);
+        int lane = closest_lane(bits, hits_t);
+
+        float lanes[5][width];
+        _mm_storeu_ps(lanes[0], w);
+        _mm_storeu_ps(lanes[1], u);
+        _mm_storeu_ps(lanes[2], v);
+        _mm_storeu_ps(lanes[3], t);
+        _mm_storeu_ps(lanes[4], det);
+        t_max = hits_t[lane];
+        numer = vec4(lanes[0][lane], lanes[1][lane], lanes[2][lane], lanes[3][lane]);
+        denom = lanes[4][lane];
+        return lane;
+      #else
+        return intersect_scalar(org, dir, lane_mask, t_max, numer, denom);
+      #endif
+    }
+  };
+}
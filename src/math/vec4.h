@@ -362,6 +362,11 @@ namespace octet {
     }
   };
 
+  // the copy constructor is written out, but a plain copy is enough
+  template <> struct is_relocatable<vec4> {
+    enum { value = 1 };
+  };
+
   // dot product
   inline float dot(const vec4 &lhs, const vec4 &rhs) {
      return lhs.dot(rhs); 
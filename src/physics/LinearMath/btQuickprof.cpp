@@ -47,7 +47,7 @@ static btClock gProfileClock;
 
 #include <time.h>
 
-#elif defined(SN_TARGET_PSP2) || defined(__GENERIC__)
+#elif defined(SN_TARGET_PSP2) || (defined(__GENERIC__) && defined(_WIN32))
 struct timeval {
   unsigned tv_sec;
   unsigned tv_usec;
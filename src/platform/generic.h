@@ -21,6 +21,8 @@
 
 typedef float float_t;
 
+#include "thread_pool.h"
+#include "profiler.h"
 #include "gl_skeleton.h"
 #include "al_defs.h"
 
@@ -102,6 +104,9 @@ namespace octet {
     // initialiser (it is nice to keep the two separate for aggregate memory allocation)
     void init() {
       set_viewport_size(512, 512);
+      int vx, vy;
+      get_viewport_size(vx, vy);
+      gl_ctxt()->set_framebuffer_size(vx, vy);
       app_init();
     }
 
@@ -132,4 +137,17 @@ namespace octet {
     }
   };
 
+  //////////////////////////////////////
+  //
+  // platform specific intrinsics
+  //
+
+  // return number of 1 bits
+  inline static unsigned pop_count(uint32_t v) {
+    v = (v & 0x55555555) + ((v>>1) & 0x55555555);
+    v = (v & 0x33333333) + ((v>>2) & 0x33333333);
+    v = (v & 0x0f0f0f0f) + ((v>>4) & 0x0f0f0f0f);
+    v = (v & 0x00ff00ff) + ((v>>8) & 0x00ff00ff);
+    return (v + (v>>16)) & 0xff;
+  }
 }
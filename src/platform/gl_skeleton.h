@@ -767,6 +767,8 @@ typedef struct __GLsync *GLsync;
 #define GL_NUM_SAMPLE_COUNTS                             0x9380
 #define GL_TEXTURE_IMMUTABLE_LEVELS                      0x82DF
 
+#include "soft_raster.h"
+
 class gl_container {
   struct variant {
     enum kind_t {
@@ -803,24 +805,180 @@ public:
   }
 
   bool get_unsigned(uint16_t key, unsigned *results, unsigned max_results) {
-    int index = values.get_index(key);
-    if (index < 0) return false;
-    /*variant &i = values.get_value(index);
-    if (i.kind == variant::kind_float) {
-      for (unsigned i = 0; i != max_results; ++i) results[i] = (unsigned)i.f[i];
-    } else if (i.kind == variant::kind_unsigned) {
-      for (unsigned i = 0; i != max_results; ++i) results[i] = (unsigned)i.f[i];
-    }*/
+    const variant *found = values.find(key);
+    if (!found) return false;
+    const variant &v = *found;
+    for (unsigned i = 0; i != max_results && i != 4; ++i) {
+      results[i] = v.kind == variant::kind_float ? (unsigned)v.f[i] : v.u[i];
+    }
+    return true;
+  }
+
+  bool get_float(uint16_t key, float *results, unsigned max_results) {
+    const variant *found = values.find(key);
+    if (!found) return false;
+    const variant &v = *found;
+    for (unsigned i = 0; i != max_results && i != 4; ++i) {
+      results[i] = v.kind == variant::kind_float ? v.f[i] : (float)v.u[i];
+    }
+    return true;
+  }
+
+  unsigned get_unsigned(uint16_t key, unsigned default_value) {
+    unsigned result = default_value;
+    get_unsigned(key, &result, 1);
+    return result;
   }
 };
 
+class gl_shader : public gl_container {
+public:
+  GLenum type;
+  octet::string source;
+};
+
 class gl_program : public gl_container {
+  // true if word is in src and not part of a longer name
+  static bool has_word(const char *src, const char *word) {
+    size_t len = strlen(word);
+    for (const char *p = strstr(src, word); p; p = strstr(p + 1, word)) {
+      bool start = p == src || !(isalnum(p[-1]) || p[-1] == '_');
+      bool end = !(isalnum(p[len]) || p[len] == '_');
+      if (start && end) return true;
+    }
+    return false;
+  }
+
+  struct uniform_t {
+    octet::string name;
+    unsigned offset;
+    unsigned size;
+  };
+
+  octet::dynarray<uniform_t> uniforms;
+  octet::dynarray<float> uniform_values;
+
+public:
+  // uniforms of the stock shaders
+  enum stock_uniform {
+    u_modelToProjection,
+    u_modelToCamera,
+    u_cameraToProjection,
+    u_emissive_color,
+    u_sampler,
+    u_samplers,
+    u_uv_rect,
+    u_uv_wrap,
+    u_light_uniforms,
+    u_num_lights,
+    u_light_direction,
+    u_light_diffuse,
+    u_light_ambient,
+    u_light_specular,
+    u_shininess,
+    u_num,
+  };
+
+  GLuint vertex_shader;
+  GLuint fragment_shader;
+  octet::string vertex_source;
+  octet::string fragment_source;
+  octet::dictionary<unsigned> attrib_locations;
+
+  bool linked;
+  bool skinned;
+  octet::soft_raster::shading_t shading;
+  int stock_uniforms[u_num];
+
+  gl_program() {
+    vertex_shader = fragment_shader = 0;
+    linked = skinned = false;
+    shading = octet::soft_raster::shading_flat;
+  }
+
+  // attribute index bound to a name, or -1
+  int get_attrib_location(const char *name) {
+    int index = attrib_locations.get_index(name);
+    return index < 0 ? -1 : (int)attrib_locations.get_value(index);
+  }
+
+  // uniforms get a location when first asked for, if they are in the source
+  int get_uniform_location(const char *name) {
+    for (unsigned i = 0; i != uniforms.size(); ++i) {
+      if (uniforms[i].name == name) return (int)i;
+    }
+    if (!has_word(vertex_source.c_str(), name) && !has_word(fragment_source.c_str(), name)) {
+      return -1;
+    }
+    uniforms.push_back(uniform_t());
+    uniform_t &u = uniforms.back();
+    u.name = name;
+    u.offset = 0;
+    u.size = 0;
+    return (int)uniforms.size() - 1;
+  }
+
+  void set_uniform(int location, const float *values, unsigned num) {
+    if (location < 0 || location >= (int)uniforms.size()) return;
+    uniform_t &u = uniforms[location];
+    if (num > u.size) {
+      u.offset = uniform_values.size();
+      u.size = num;
+      uniform_values.resize(u.offset + num);
+    }
+    memcpy(&uniform_values[u.offset], values, num * sizeof(float));
+  }
+
+  // values of a stock uniform, or NULL if it has fewer than num values
+  const float *get_uniform(stock_uniform which, unsigned num) {
+    int location = stock_uniforms[which];
+    if (location < 0 || uniforms[location].size < num) return NULL;
+    return &uniform_values[uniforms[location].offset];
+  }
+
+  unsigned get_uniform_size(stock_uniform which) {
+    int location = stock_uniforms[which];
+    return location < 0 ? 0 : uniforms[location].size;
+  }
+
+  // there is no shader compiler, so pick the stock shader that matches the source
+  void link() {
+    const char *vs = vertex_source.c_str();
+    const char *fs = fragment_source.c_str();
+    if (has_word(fs, "light_uniforms")) {
+      shading = octet::soft_raster::shading_bump;
+    } else if (has_word(fs, "light_direction")) {
+      shading = octet::soft_raster::shading_phong;
+    } else if (has_word(fs, "sampler")) {
+      shading = octet::soft_raster::shading_texture;
+    } else {
+      if (!has_word(fs, "emissive_color")) {
+        printf("warning: software GL does not know this fragment shader, using a flat color\n");
+      }
+      shading = octet::soft_raster::shading_flat;
+    }
+    skinned = has_word(vs, "blendindices");
+
+    static const char *const names[] = {
+      "modelToProjection", "modelToCamera", "cameraToProjection", "emissive_color",
+      "sampler", "samplers", "uv_rect", "uv_wrap", "light_uniforms", "num_lights",
+      "light_direction", "light_diffuse", "light_ambient", "light_specular", "shininess",
+    };
+    for (unsigned i = 0; i != u_num; ++i) {
+      stock_uniforms[i] = get_uniform_location(names[i]);
+    }
+    linked = true;
+  }
 };
 
 class gl_buffer : public gl_container {
+public:
+  octet::dynarray<uint8_t> data;
 };
 
 class gl_texture : public gl_container {
+public:
+  octet::soft_raster::texture image;
 };
 
 class gl_renderbuffer : public gl_container {
@@ -830,12 +988,411 @@ class gl_framebuffer : public gl_container {
 };
 
 class gl_context : public gl_container {
+public:
+  enum {
+    max_texture_units = 8,
+    max_attribs = 16,
+  };
+
+  struct attrib_t {
+    bool enabled;
+    GLint size;
+    GLenum type;
+    bool normalized;
+    GLsizei stride;
+    const uint8_t *pointer;
+    GLuint buffer;
+    float current[4];
+  };
 
+private:
   unsigned error;
+
+  octet::dynarray<gl_buffer*> buffers;
+  octet::dynarray<gl_texture*> textures;
+  octet::dynarray<gl_shader*> shaders;
+  octet::dynarray<gl_program*> programs;
+
+  // vertices of the current draw after the vertex shader
+  octet::dynarray<octet::soft_raster::vertex> vertices;
+
+  template <class object_t> static object_t *find(octet::dynarray<object_t*> &objects, GLuint name) {
+    return name && name <= objects.size() ? objects[name-1] : 0;
+  }
+
+  template <class object_t> static GLuint add(octet::dynarray<object_t*> &objects, object_t *object) {
+    objects.push_back(object);
+    return objects.size();
+  }
+
+  template <class object_t> static void remove(octet::dynarray<object_t*> &objects, GLuint name) {
+    if (name && name <= objects.size()) {
+      delete objects[name-1];
+      objects[name-1] = 0;
+    }
+  }
+
+  static unsigned type_size(GLenum type) {
+    switch (type) {
+      case GL_BYTE: case GL_UNSIGNED_BYTE: return 1;
+      case GL_SHORT: case GL_UNSIGNED_SHORT: case GL_HALF_FLOAT: return 2;
+      default: return 4;
+    }
+  }
+
+  // read one attribute of one vertex as four floats
+  void fetch(const attrib_t &a, unsigned index, float *out) {
+    out[0] = a.current[0]; out[1] = a.current[1]; out[2] = a.current[2]; out[3] = a.current[3];
+    if (!a.enabled) return;
+
+    unsigned size = a.size > 0 && a.size <= 4 ? a.size : 4;
+    unsigned stride = a.stride ? a.stride : size * type_size(a.type);
+    const uint8_t *src;
+    if (a.buffer) {
+      gl_buffer *buf = find(buffers, a.buffer);
+      size_t offset = (size_t)a.pointer + (size_t)index * stride;
+      if (!buf || offset + size * type_size(a.type) > buf->data.size()) return;
+      src = buf->data.data() + offset;
+    } else {
+      if (!a.pointer) return;
+      src = a.pointer + (size_t)index * stride;
+    }
+
+    out[1] = out[2] = 0; out[3] = 1;
+    for (unsigned i = 0; i != size; ++i) {
+      switch (a.type) {
+        case GL_FLOAT: out[i] = ((const float*)src)[i]; break;
+        case GL_BYTE: out[i] = a.normalized ? ((const int8_t*)src)[i] * (1.0f/127) : ((const int8_t*)src)[i]; break;
+        case GL_UNSIGNED_BYTE: out[i] = a.normalized ? src[i] * (1.0f/255) : src[i]; break;
+        case GL_SHORT: out[i] = a.normalized ? ((const int16_t*)src)[i] * (1.0f/32767) : ((const int16_t*)src)[i]; break;
+        case GL_UNSIGNED_SHORT: out[i] = a.normalized ? ((const uint16_t*)src)[i] * (1.0f/65535) : ((const uint16_t*)src)[i]; break;
+        case GL_FIXED: out[i] = ((const int32_t*)src)[i] * (1.0f/65536); break;
+        case GL_INT: out[i] = (float)((const int32_t*)src)[i]; break;
+        case GL_UNSIGNED_INT: out[i] = (float)((const uint32_t*)src)[i]; break;
+      }
+    }
+  }
+
+  // column major matrix times a vector
+  static void transform(float *out, const float *m, const float *v) {
+    for (unsigned j = 0; j != 4; ++j) {
+      out[j] = m[j] * v[0] + m[4+j] * v[1] + m[8+j] * v[2] + m[12+j] * v[3];
+    }
+  }
+
+  // copy the GL state into the draw state of the raster
+  void get_draw_state(gl_program *prog, octet::soft_raster::draw_state &ds) {
+    memset(&ds, 0, sizeof(ds));
+    ds.shading = prog->shading;
+    ds.num_varyings = prog->shading == octet::soft_raster::shading_flat ? 0 : prog->shading == octet::soft_raster::shading_texture ? 2 : 5;
+
+    float unit[octet::soft_raster::max_textures] = { 0, 1, 2, 3, 4, 5 };
+    if (const float *sampler = prog->get_uniform(gl_program::u_sampler, 1)) {
+      unit[0] = sampler[0];
+    }
+    if (const float *samplers = prog->get_uniform(gl_program::u_samplers, 1)) {
+      unsigned num = prog->get_uniform_size(gl_program::u_samplers);
+      for (unsigned i = 0; i != num && i != octet::soft_raster::max_textures; ++i) unit[i] = samplers[i];
+    }
+    for (unsigned i = 0; i != octet::soft_raster::max_textures; ++i) {
+      unsigned u = (unsigned)unit[i];
+      gl_texture *tex = u < max_texture_units ? find(textures, texture_units[u]) : 0;
+      ds.textures[i] = tex ? &tex->image : 0;
+    }
+
+    ds.color[0] = ds.color[1] = ds.color[2] = ds.color[3] = 1;
+    if (const float *color = prog->get_uniform(gl_program::u_emissive_color, 4)) {
+      memcpy(ds.color, color, sizeof(ds.color));
+    }
+
+    ds.uv_rect[2] = ds.uv_rect[3] = 1;
+    ds.uv_wrap = -1;
+    if (const float *uv_rect = prog->get_uniform(gl_program::u_uv_rect, 4)) {
+      memcpy(ds.uv_rect, uv_rect, sizeof(ds.uv_rect));
+      const float *uv_wrap = prog->get_uniform(gl_program::u_uv_wrap, 1);
+      ds.uv_wrap = uv_wrap && uv_wrap[0] > 0.5f ? 1 : 0;
+    }
+
+    if (prog->shading == octet::soft_raster::shading_bump) {
+      unsigned num_uniforms = prog->get_uniform_size(gl_program::u_light_uniforms) / 4;
+      const float *lights = prog->get_uniform(gl_program::u_light_uniforms, 4);
+      const float *num_lights = prog->get_uniform(gl_program::u_num_lights, 1);
+      if (lights) {
+        memcpy(ds.ambient, lights, sizeof(ds.ambient));
+        for (unsigned i = 0; num_lights && i != (unsigned)num_lights[0] && i != octet::soft_raster::max_lights && i * 4 + 3 < num_uniforms; ++i) {
+          memcpy(ds.light_direction[i], lights + (i * 4 + 2) * 4, sizeof(ds.light_direction[i]));
+          memcpy(ds.light_color[i], lights + (i * 4 + 3) * 4, sizeof(ds.light_color[i]));
+          ds.num_lights = i + 1;
+        }
+      }
+    } else if (prog->shading == octet::soft_raster::shading_phong) {
+      const float *value;
+      if ((value = prog->get_uniform(gl_program::u_light_direction, 3))) memcpy(ds.light_direction[0], value, 3 * sizeof(float));
+      if ((value = prog->get_uniform(gl_program::u_light_diffuse, 4))) memcpy(ds.light_color[0], value, 4 * sizeof(float));
+      if ((value = prog->get_uniform(gl_program::u_light_ambient, 4))) memcpy(ds.ambient, value, 4 * sizeof(float));
+      if ((value = prog->get_uniform(gl_program::u_light_specular, 4))) memcpy(ds.light_specular, value, 4 * sizeof(float));
+      if ((value = prog->get_uniform(gl_program::u_shininess, 1))) ds.shininess = value[0];
+      ds.num_lights = 1;
+    }
+
+    float viewport[4] = { 0, 0, (float)raster.get_width(), (float)raster.get_height() };
+    get_float(GL_VIEWPORT, viewport, 4);
+    float scissor[4] = { viewport[0], viewport[1], viewport[2], viewport[3] };
+    get_float(GL_SCISSOR_BOX, scissor, 4);
+    for (unsigned i = 0; i != 4; ++i) {
+      ds.viewport[i] = (int)viewport[i];
+      ds.scissor[i] = (int)scissor[i];
+    }
+    ds.depth_range[1] = 1;
+    get_float(GL_DEPTH_RANGE, ds.depth_range, 2);
+
+    ds.cull = get_unsigned(GL_CULL_FACE, 0u) != 0;
+    ds.cull_face = get_unsigned(GL_CULL_FACE_MODE, GL_BACK);
+    ds.front_face = get_unsigned(GL_FRONT_FACE, GL_CCW);
+    ds.scissor_test = get_unsigned(GL_SCISSOR_TEST, 0u) != 0;
+    ds.depth_test = get_unsigned(GL_DEPTH_TEST, 0u) != 0;
+    ds.depth_write = get_unsigned(GL_DEPTH_WRITEMASK, GL_TRUE) != 0;
+    ds.depth_func = get_unsigned(GL_DEPTH_FUNC, GL_LESS);
+    ds.blend = get_unsigned(GL_BLEND, 0u) != 0;
+    ds.blend_equation_rgb = get_unsigned(GL_BLEND_EQUATION, GL_FUNC_ADD);
+    ds.blend_equation_alpha = get_unsigned(GL_BLEND_EQUATION_ALPHA, GL_FUNC_ADD);
+    ds.src_rgb = get_unsigned(GL_BLEND_SRC_RGB, GL_ONE);
+    ds.dst_rgb = get_unsigned(GL_BLEND_DST_RGB, GL_ZERO);
+    ds.src_alpha = get_unsigned(GL_BLEND_SRC_ALPHA, GL_ONE);
+    ds.dst_alpha = get_unsigned(GL_BLEND_DST_ALPHA, GL_ZERO);
+    get_float(GL_BLEND_COLOR, ds.blend_color, 4);
+    ds.color_mask = get_unsigned(GL_COLOR_WRITEMASK, 0xffffffff);
+  }
+
+  // run the vertex shader of a stock program on one vertex
+  void shade_vertex(gl_program *prog, unsigned index, const int *locations, octet::soft_raster::vertex &out) {
+    float pos[4], uv[4], normal[4];
+    static const attrib_t none = { false, 4, GL_FLOAT, false, 0, 0, 0, { 0, 0, 0, 1 } };
+    fetch(locations[0] >= 0 ? attribs[locations[0]] : none, index, pos);
+    fetch(locations[1] >= 0 ? attribs[locations[1]] : none, index, uv);
+    fetch(locations[2] >= 0 ? attribs[locations[2]] : none, index, normal);
+    normal[3] = 0;
+
+    static const float identity[16] = { 1, 0, 0, 0,  0, 1, 0, 0,  0, 0, 1, 0,  0, 0, 0, 1 };
+    const float *modelToCamera = prog->get_uniform(gl_program::u_modelToCamera, 16);
+    if (!modelToCamera) modelToCamera = identity;
+
+    float camera_normal[4];
+    if (prog->skinned) {
+      // blend four of the modelToCamera matrices
+      float weight[4], indices[4], blended[16];
+      fetch(locations[3] >= 0 ? attribs[locations[3]] : none, index, weight);
+      fetch(locations[4] >= 0 ? attribs[locations[4]] : none, index, indices);
+      float w[4] = { 1 - weight[0] - weight[1] - weight[2], weight[0], weight[1], weight[2] };
+      unsigned num_matrices = prog->get_uniform_size(gl_program::u_modelToCamera) / 16;
+      memset(blended, 0, sizeof(blended));
+      for (unsigned i = 0; i != 4; ++i) {
+        unsigned m = (unsigned)indices[i];
+        const float *src = m < num_matrices ? modelToCamera + m * 16 : identity;
+        for (unsigned j = 0; j != 16; ++j) blended[j] += src[j] * w[i];
+      }
+      const float *cameraToProjection = prog->get_uniform(gl_program::u_cameraToProjection, 16);
+      float camera_pos[4];
+      transform(camera_pos, blended, pos);
+      transform(out.pos, cameraToProjection ? cameraToProjection : identity, camera_pos);
+      transform(camera_normal, blended, normal);
+      float len = sqrtf(camera_normal[0] * camera_normal[0] + camera_normal[1] * camera_normal[1] + camera_normal[2] * camera_normal[2]);
+      if (len > 0) { camera_normal[0] /= len; camera_normal[1] /= len; camera_normal[2] /= len; }
+    } else {
+      const float *modelToProjection = prog->get_uniform(gl_program::u_modelToProjection, 16);
+      transform(out.pos, modelToProjection ? modelToProjection : identity, pos);
+      transform(camera_normal, modelToCamera, normal);
+    }
+
+    out.varyings[0] = uv[0];
+    out.varyings[1] = uv[1];
+    out.varyings[2] = camera_normal[0];
+    out.varyings[3] = camera_normal[1];
+    out.varyings[4] = camera_normal[2];
+  }
+
 public:
+  octet::soft_raster raster;
+  GLuint texture_units[max_texture_units];
+  attrib_t attribs[max_attribs];
+
+  gl_context() {
+    error = GL_NO_ERROR;
+    memset(texture_units, 0, sizeof(texture_units));
+    memset(attribs, 0, sizeof(attribs));
+    for (unsigned i = 0; i != max_attribs; ++i) {
+      attribs[i].size = 4;
+      attribs[i].type = GL_FLOAT;
+      attribs[i].current[3] = 1;
+    }
+  }
+
+  ~gl_context() {
+    for (unsigned i = 0; i != buffers.size(); ++i) delete buffers[i];
+    for (unsigned i = 0; i != textures.size(); ++i) delete textures[i];
+    for (unsigned i = 0; i != shaders.size(); ++i) delete shaders[i];
+    for (unsigned i = 0; i != programs.size(); ++i) delete programs[i];
+  }
 
   void set_error(unsigned value) {
-    error = value;
+    if (error == GL_NO_ERROR) error = value;
+  }
+
+  unsigned get_error() {
+    unsigned result = error;
+    error = GL_NO_ERROR;
+    return result;
+  }
+
+  // size of the default framebuffer
+  void set_framebuffer_size(unsigned width, unsigned height) {
+    raster.resize(width, height);
+  }
+
+  GLuint add_buffer() { return add(buffers, new gl_buffer()); }
+  GLuint add_texture() { return add(textures, new gl_texture()); }
+  GLuint add_shader(GLenum type) { gl_shader *s = new gl_shader(); s->type = type; return add(shaders, s); }
+  GLuint add_program() { return add(programs, new gl_program()); }
+
+  // bindings to a deleted buffer revert to zero
+  void remove_buffer(GLuint name) {
+    if (get_unsigned(GL_ARRAY_BUFFER_BINDING, 0u) == name) set(GL_ARRAY_BUFFER_BINDING, 0u);
+    if (get_unsigned(GL_ELEMENT_ARRAY_BUFFER_BINDING, 0u) == name) set(GL_ELEMENT_ARRAY_BUFFER_BINDING, 0u);
+    for (unsigned i = 0; i != max_attribs; ++i) {
+      if (attribs[i].buffer == name) attribs[i].buffer = 0;
+    }
+    remove(buffers, name);
+  }
+
+  void remove_texture(GLuint name) { raster.flush(); remove(textures, name); }
+  void remove_shader(GLuint name) { remove(shaders, name); }
+  void remove_program(GLuint name) { remove(programs, name); }
+
+  gl_buffer *get_buffer(GLuint name) { return find(buffers, name); }
+  gl_texture *get_texture(GLuint name) { return find(textures, name); }
+  gl_shader *get_shader(GLuint name) { return find(shaders, name); }
+  gl_program *get_program(GLuint name) { return find(programs, name); }
+
+  gl_buffer *get_bound_buffer(GLenum target) {
+    return get_buffer(get_unsigned(target + 2, 0u));
+  }
+
+  gl_texture *get_bound_texture() {
+    unsigned unit = get_unsigned(GL_ACTIVE_TEXTURE, GL_TEXTURE0) - GL_TEXTURE0;
+    return unit < max_texture_units ? get_texture(texture_units[unit]) : 0;
+  }
+
+  gl_program *get_current_program() {
+    return get_program(get_unsigned(GL_CURRENT_PROGRAM, 0u));
+  }
+
+  // glTexParameter* on the bound texture
+  void set_texture_parameter(GLenum pname, GLint param) {
+    gl_texture *tex = get_bound_texture();
+    if (!tex) {
+      set_error(GL_INVALID_OPERATION);
+      return;
+    }
+    unsigned *value = 0;
+    switch (pname) {
+      case GL_TEXTURE_WRAP_S: value = &tex->image.wrap_s; break;
+      case GL_TEXTURE_WRAP_T: value = &tex->image.wrap_t; break;
+      case GL_TEXTURE_MIN_FILTER: value = &tex->image.min_filter; break;
+      case GL_TEXTURE_MAG_FILTER: value = &tex->image.mag_filter; break;
+      default: return;
+    }
+    // queued triangles sample with the parameters they were drawn with
+    if (*value != (unsigned)param) {
+      raster.flush();
+      *value = (unsigned)param;
+    }
+  }
+
+  // glVertexAttrib*: the value of an attribute without an array
+  void set_attrib(GLuint index, const GLfloat *values) {
+    if (index >= max_attribs) {
+      set_error(GL_INVALID_VALUE);
+      return;
+    }
+    memcpy(attribs[index].current, values, sizeof(GLfloat) * 4);
+  }
+
+  // glDrawArrays (indices == NULL and no element buffer) and glDrawElements
+  void draw(GLenum mode, GLint first, GLsizei count, GLenum index_type, const GLvoid *indices, bool indexed) {
+    gl_program *prog = get_current_program();
+    if (!prog || !prog->linked || count <= 0 || first < 0) return;
+
+    // points and lines are not drawn
+    if (mode != GL_TRIANGLES && mode != GL_TRIANGLE_STRIP && mode != GL_TRIANGLE_FAN) return;
+
+    const uint8_t *index_data = 0;
+    unsigned index_size = index_type == GL_UNSIGNED_BYTE ? 1 : index_type == GL_UNSIGNED_SHORT ? 2 : 4;
+    if (indexed) {
+      gl_buffer *buf = get_bound_buffer(GL_ELEMENT_ARRAY_BUFFER);
+      if (buf) {
+        if ((size_t)indices + (size_t)count * index_size > buf->data.size()) {
+          set_error(GL_INVALID_OPERATION);
+          return;
+        }
+        index_data = buf->data.data() + (size_t)indices;
+      } else {
+        index_data = (const uint8_t*)indices;
+      }
+      if (!index_data) return;
+    }
+
+    // shade each vertex in the range once
+    unsigned min_index = first, max_index = first + count - 1;
+    if (index_data) {
+      min_index = ~0u;
+      max_index = 0;
+      for (GLsizei i = 0; i != count; ++i) {
+        unsigned index = index_size == 1 ? index_data[i] : index_size == 2 ? ((const uint16_t*)index_data)[i] : ((const uint32_t*)index_data)[i];
+        min_index = index < min_index ? index : min_index;
+        max_index = index > max_index ? index : max_index;
+      }
+    }
+
+    int locations[5] = {
+      prog->get_attrib_location("pos"),
+      prog->get_attrib_location("uv"),
+      prog->get_attrib_location("normal"),
+      prog->get_attrib_location("blendweight"),
+      prog->get_attrib_location("blendindices"),
+    };
+    for (unsigned i = 0; i != 5; ++i) {
+      if (locations[i] >= max_attribs) locations[i] = -1;
+    }
+
+    vertices.resize(max_index - min_index + 1);
+    for (unsigned i = min_index; i <= max_index; ++i) {
+      shade_vertex(prog, i, locations, vertices[i - min_index]);
+    }
+
+    octet::soft_raster::draw_state ds;
+    get_draw_state(prog, ds);
+    raster.begin_draw(ds);
+
+    const octet::soft_raster::vertex *v = vertices.data();
+    #define OCTET_GL_VERTEX(I) (index_data ? v[(index_size == 1 ? index_data[I] : index_size == 2 ? ((const uint16_t*)index_data)[I] : ((const uint32_t*)index_data)[I]) - min_index] : v[I])
+    if (mode == GL_TRIANGLES) {
+      for (GLsizei i = 0; i + 2 < count; i += 3) {
+        raster.add_triangle(OCTET_GL_VERTEX(i), OCTET_GL_VERTEX(i+1), OCTET_GL_VERTEX(i+2));
+      }
+    } else if (mode == GL_TRIANGLE_STRIP) {
+      for (GLsizei i = 0; i + 2 < count; ++i) {
+        if (i & 1) {
+          raster.add_triangle(OCTET_GL_VERTEX(i+1), OCTET_GL_VERTEX(i), OCTET_GL_VERTEX(i+2));
+        } else {
+          raster.add_triangle(OCTET_GL_VERTEX(i), OCTET_GL_VERTEX(i+1), OCTET_GL_VERTEX(i+2));
+        }
+      }
+    } else {
+      for (GLsizei i = 1; i + 1 < count; ++i) {
+        raster.add_triangle(OCTET_GL_VERTEX(0), OCTET_GL_VERTEX(i), OCTET_GL_VERTEX(i+1));
+      }
+    }
+    #undef OCTET_GL_VERTEX
   }
 };
 
@@ -845,6 +1402,23 @@ gl_context *gl_ctxt(gl_context *in = 0) {
   return ctxt;
 }
 
+// store a uniform of the current program
+inline void gl_uniform(GLint location, unsigned components, GLsizei count, const GLfloat *values) {
+  gl_context *ctxt = gl_ctxt();
+  gl_program *prog = ctxt->get_current_program();
+  if (!prog || count < 0) {
+    ctxt->set_error(GL_INVALID_OPERATION);
+    return;
+  }
+  prog->set_uniform(location, values, components * count);
+}
+
+inline void gl_uniform(GLint location, unsigned components, GLsizei count, const GLint *values) {
+  octet::dynarray<float> tmp(count > 0 ? components * count : 0);
+  for (unsigned i = 0; i != tmp.size(); ++i) tmp[i] = (float)values[i];
+  gl_uniform(location, components, count, tmp.data());
+}
+
 /*-------------------------------------------------------------------------
  * Entrypoint definitions
  *-----------------------------------------------------------------------*/
@@ -859,11 +1433,28 @@ GL_APICALL void GL_APIENTRY glActiveTexture (GLenum texture) {
 
 GL_APICALL void GL_APIENTRY glAttachShader (GLuint program, GLuint shader) {
   gl_context *ctxt = gl_ctxt();
+  gl_program *prog = ctxt->get_program(program);
+  gl_shader *s = ctxt->get_shader(shader);
+  if (!prog || !s) {
+    ctxt->set_error(GL_INVALID_VALUE);
+    return;
+  }
+  if (s->type == GL_VERTEX_SHADER) {
+    prog->vertex_shader = shader;
+  } else {
+    prog->fragment_shader = shader;
+  }
 }
 
 
 GL_APICALL void GL_APIENTRY glBindAttribLocation (GLuint program, GLuint index, const GLchar* name) {
   gl_context *ctxt = gl_ctxt();
+  gl_program *prog = ctxt->get_program(program);
+  if (!prog || index >= gl_context::max_attribs) {
+    ctxt->set_error(GL_INVALID_VALUE);
+    return;
+  }
+  prog->attrib_locations[name] = index;
 }
 
 
@@ -889,6 +1480,12 @@ GL_APICALL void GL_APIENTRY glBindRenderbuffer (GLenum target, GLuint renderbuff
 
 GL_APICALL void GL_APIENTRY glBindTexture (GLenum target, GLuint texture) {
   gl_context *ctxt = gl_ctxt();
+  unsigned unit = ctxt->get_unsigned(GL_ACTIVE_TEXTURE, GL_TEXTURE0) - GL_TEXTURE0;
+  if (target != GL_TEXTURE_2D || unit >= gl_context::max_texture_units) {
+    ctxt->set_error(GL_INVALID_ENUM);
+    return;
+  }
+  ctxt->texture_units[unit] = texture;
 }
 
 
@@ -932,11 +1529,25 @@ GL_APICALL void GL_APIENTRY glBlendFuncSeparate (GLenum srcRGB, GLenum dstRGB, G
 
 GL_APICALL void GL_APIENTRY glBufferData (GLenum target, GLsizeiptr size, const GLvoid* data, GLenum usage) {
   gl_context *ctxt = gl_ctxt();
+  gl_buffer *buf = ctxt->get_bound_buffer(target);
+  if (!buf) {
+    ctxt->set_error(GL_INVALID_OPERATION);
+    return;
+  }
+  buf->data.resize((unsigned)size);
+  if (data && size) memcpy(buf->data.data(), data, size);
+  buf->set(GL_BUFFER_USAGE, usage);
 }
 
 
 GL_APICALL void GL_APIENTRY glBufferSubData (GLenum target, GLintptr offset, GLsizeiptr size, const GLvoid* data) {
   gl_context *ctxt = gl_ctxt();
+  gl_buffer *buf = ctxt->get_bound_buffer(target);
+  if (!buf || offset < 0 || offset + size > buf->data.size()) {
+    ctxt->set_error(buf ? GL_INVALID_VALUE : GL_INVALID_OPERATION);
+    return;
+  }
+  if (data && size) memcpy(buf->data.data() + offset, data, size);
 }
 
 
@@ -948,6 +1559,16 @@ GL_APICALL GLenum GL_APIENTRY glCheckFramebufferStatus (GLenum target) {
 
 GL_APICALL void GL_APIENTRY glClear (GLbitfield mask) {
   gl_context *ctxt = gl_ctxt();
+  float color[4] = { 0, 0, 0, 0 };
+  float depth = 1;
+  float scissor[4];
+  int rect[4];
+  ctxt->get_float(GL_COLOR_CLEAR_VALUE, color, 4);
+  ctxt->get_float(GL_DEPTH_CLEAR_VALUE, &depth, 1);
+  bool use_scissor = ctxt->get_unsigned(GL_SCISSOR_TEST, 0u) && ctxt->get_float(GL_SCISSOR_BOX, scissor, 4);
+  for (unsigned i = 0; i != 4 && use_scissor; ++i) rect[i] = (int)scissor[i];
+  bool depth_write = ctxt->get_unsigned(GL_DEPTH_WRITEMASK, GL_TRUE) != 0;
+  ctxt->raster.clear((mask & GL_COLOR_BUFFER_BIT) != 0, (mask & GL_DEPTH_BUFFER_BIT) && depth_write, color, depth, use_scissor ? rect : 0, ctxt->get_unsigned(GL_COLOR_WRITEMASK, 0xffffffff));
 }
 
 
@@ -971,7 +1592,7 @@ GL_APICALL void GL_APIENTRY glClearStencil (GLint s) {
 
 GL_APICALL void GL_APIENTRY glColorMask (GLboolean red, GLboolean green, GLboolean blue, GLboolean alpha) {
   gl_context *ctxt = gl_ctxt();
-  //GL_COLOR_WRITEMASK
+  ctxt->set(GL_COLOR_WRITEMASK, (red ? 0xffu : 0) | (green ? 0xff00u : 0) | (blue ? 0xff0000u : 0) | (alpha ? 0xff000000u : 0));
 }
 
 
@@ -1002,23 +1623,29 @@ GL_APICALL void GL_APIENTRY glCopyTexSubImage2D (GLenum target, GLint level, GLi
 
 GL_APICALL GLuint GL_APIENTRY glCreateProgram (void) {
   gl_context *ctxt = gl_ctxt();
-  return 0;
+  return ctxt->add_program();
 }
 
 
 GL_APICALL GLuint GL_APIENTRY glCreateShader (GLenum type) {
   gl_context *ctxt = gl_ctxt();
-  return 0;
+  if (type != GL_VERTEX_SHADER && type != GL_FRAGMENT_SHADER) {
+    ctxt->set_error(GL_INVALID_ENUM);
+    return 0;
+  }
+  return ctxt->add_shader(type);
 }
 
 
 GL_APICALL void GL_APIENTRY glCullFace (GLenum mode) {
   gl_context *ctxt = gl_ctxt();
+  ctxt->set(GL_CULL_FACE_MODE, mode);
 }
 
 
 GL_APICALL void GL_APIENTRY glDeleteBuffers (GLsizei n, const GLuint* buffers) {
   gl_context *ctxt = gl_ctxt();
+  for (GLsizei i = 0; i < n; ++i) ctxt->remove_buffer(buffers[i]);
 }
 
 
@@ -1029,6 +1656,7 @@ GL_APICALL void GL_APIENTRY glDeleteFramebuffers (GLsizei n, const GLuint* frame
 
 GL_APICALL void GL_APIENTRY glDeleteProgram (GLuint program) {
   gl_context *ctxt = gl_ctxt();
+  ctxt->remove_program(program);
 }
 
 
@@ -1039,26 +1667,36 @@ GL_APICALL void GL_APIENTRY glDeleteRenderbuffers (GLsizei n, const GLuint* rend
 
 GL_APICALL void GL_APIENTRY glDeleteShader (GLuint shader) {
   gl_context *ctxt = gl_ctxt();
+  ctxt->remove_shader(shader);
 }
 
 
 GL_APICALL void GL_APIENTRY glDeleteTextures (GLsizei n, const GLuint* textures) {
   gl_context *ctxt = gl_ctxt();
+  for (GLsizei i = 0; i < n; ++i) {
+    for (unsigned j = 0; j != gl_context::max_texture_units; ++j) {
+      if (ctxt->texture_units[j] == textures[i]) ctxt->texture_units[j] = 0;
+    }
+    ctxt->remove_texture(textures[i]);
+  }
 }
 
 
 GL_APICALL void GL_APIENTRY glDepthFunc (GLenum func) {
   gl_context *ctxt = gl_ctxt();
+  ctxt->set(GL_DEPTH_FUNC, func);
 }
 
 
 GL_APICALL void GL_APIENTRY glDepthMask (GLboolean flag) {
   gl_context *ctxt = gl_ctxt();
+  ctxt->set(GL_DEPTH_WRITEMASK, (unsigned)flag);
 }
 
 
 GL_APICALL void GL_APIENTRY glDepthRangef (GLfloat n, GLfloat f) {
   gl_context *ctxt = gl_ctxt();
+  ctxt->set(GL_DEPTH_RANGE, n, f);
 }
 
 
@@ -1069,41 +1707,57 @@ GL_APICALL void GL_APIENTRY glDetachShader (GLuint program, GLuint shader) {
 
 GL_APICALL void GL_APIENTRY glDisable (GLenum cap) {
   gl_context *ctxt = gl_ctxt();
+  ctxt->set(cap, 0u);
 }
 
 
 GL_APICALL void GL_APIENTRY glDisableVertexAttribArray (GLuint index) {
   gl_context *ctxt = gl_ctxt();
+  if (index >= gl_context::max_attribs) {
+    ctxt->set_error(GL_INVALID_VALUE);
+    return;
+  }
+  ctxt->attribs[index].enabled = false;
 }
 
 
 GL_APICALL void GL_APIENTRY glDrawArrays (GLenum mode, GLint first, GLsizei count) {
   gl_context *ctxt = gl_ctxt();
+  ctxt->draw(mode, first, count, GL_UNSIGNED_SHORT, 0, false);
 }
 
 
 GL_APICALL void GL_APIENTRY glDrawElements (GLenum mode, GLsizei count, GLenum type, const GLvoid* indices) {
   gl_context *ctxt = gl_ctxt();
+  ctxt->draw(mode, 0, count, type, indices, true);
 }
 
 
 GL_APICALL void GL_APIENTRY glEnable (GLenum cap) {
   gl_context *ctxt = gl_ctxt();
+  ctxt->set(cap, 1u);
 }
 
 
 GL_APICALL void GL_APIENTRY glEnableVertexAttribArray (GLuint index) {
   gl_context *ctxt = gl_ctxt();
+  if (index >= gl_context::max_attribs) {
+    ctxt->set_error(GL_INVALID_VALUE);
+    return;
+  }
+  ctxt->attribs[index].enabled = true;
 }
 
 
 GL_APICALL void GL_APIENTRY glFinish (void) {
   gl_context *ctxt = gl_ctxt();
+  ctxt->raster.flush();
 }
 
 
 GL_APICALL void GL_APIENTRY glFlush (void) {
   gl_context *ctxt = gl_ctxt();
+  ctxt->raster.flush();
 }
 
 
@@ -1119,11 +1773,13 @@ GL_APICALL void GL_APIENTRY glFramebufferTexture2D (GLenum target, GLenum attach
 
 GL_APICALL void GL_APIENTRY glFrontFace (GLenum mode) {
   gl_context *ctxt = gl_ctxt();
+  ctxt->set(GL_FRONT_FACE, mode);
 }
 
 
 GL_APICALL void GL_APIENTRY glGenBuffers (GLsizei n, GLuint* buffers) {
   gl_context *ctxt = gl_ctxt();
+  for (GLsizei i = 0; i < n; ++i) buffers[i] = ctxt->add_buffer();
 }
 
 
@@ -1144,6 +1800,7 @@ GL_APICALL void GL_APIENTRY glGenRenderbuffers (GLsizei n, GLuint* renderbuffers
 
 GL_APICALL void GL_APIENTRY glGenTextures (GLsizei n, GLuint* textures) {
   gl_context *ctxt = gl_ctxt();
+  for (GLsizei i = 0; i < n; ++i) textures[i] = ctxt->add_texture();
 }
 
 
@@ -1164,6 +1821,8 @@ GL_APICALL void GL_APIENTRY glGetAttachedShaders (GLuint program, GLsizei maxcou
 
 GL_APICALL GLint GL_APIENTRY glGetAttribLocation (GLuint program, const GLchar* name) {
   gl_context *ctxt = gl_ctxt();
+  gl_program *prog = ctxt->get_program(program);
+  return prog ? prog->get_attrib_location(name) : -1;
 }
 
 
@@ -1179,11 +1838,27 @@ GL_APICALL void GL_APIENTRY glGetBufferParameteriv (GLenum target, GLenum pname,
 
 GL_APICALL GLenum GL_APIENTRY glGetError (void) {
   gl_context *ctxt = gl_ctxt();
+  return ctxt->get_error();
 }
 
 
+// number of values glGet writes for pname
+inline unsigned gl_get_num_values(GLenum pname) {
+  switch (pname) {
+    case GL_VIEWPORT: case GL_SCISSOR_BOX: case GL_COLOR_CLEAR_VALUE:
+    case GL_BLEND_COLOR: case GL_COLOR_WRITEMASK:
+      return 4;
+    case GL_DEPTH_RANGE: case GL_ALIASED_POINT_SIZE_RANGE:
+    case GL_ALIASED_LINE_WIDTH_RANGE: case GL_MAX_VIEWPORT_DIMS:
+      return 2;
+    default:
+      return 1;
+  }
+}
+
 GL_APICALL void GL_APIENTRY glGetFloatv (GLenum pname, GLfloat* params) {
   gl_context *ctxt = gl_ctxt();
+  ctxt->get_float((uint16_t)pname, params, gl_get_num_values(pname));
 }
 
 
@@ -1194,16 +1869,40 @@ GL_APICALL void GL_APIENTRY glGetFramebufferAttachmentParameteriv (GLenum target
 
 GL_APICALL void GL_APIENTRY glGetIntegerv (GLenum pname, GLint* params) {
   gl_context *ctxt = gl_ctxt();
+  unsigned values[4];
+  if (pname == GL_VIEWPORT || pname == GL_SCISSOR_BOX) {
+    float f[4];
+    if (ctxt->get_float((uint16_t)pname, f, 4)) {
+      for (unsigned i = 0; i != 4; ++i) params[i] = (GLint)f[i];
+    }
+  } else if (pname == GL_TEXTURE_BINDING_2D) {
+    unsigned unit = ctxt->get_unsigned(GL_ACTIVE_TEXTURE, GL_TEXTURE0) - GL_TEXTURE0;
+    params[0] = unit < gl_context::max_texture_units ? ctxt->texture_units[unit] : 0;
+  } else if (ctxt->get_unsigned((uint16_t)pname, values, 1)) {
+    params[0] = (GLint)values[0];
+  }
 }
 
 
 GL_APICALL void GL_APIENTRY glGetProgramiv (GLuint program, GLenum pname, GLint* params) {
   gl_context *ctxt = gl_ctxt();
+  gl_program *prog = ctxt->get_program(program);
+  if (!prog) {
+    ctxt->set_error(GL_INVALID_VALUE);
+    return;
+  }
+  if (pname == GL_LINK_STATUS) {
+    params[0] = prog->linked;
+  } else if (pname == GL_INFO_LOG_LENGTH) {
+    params[0] = 0;
+  }
 }
 
 
 GL_APICALL void GL_APIENTRY glGetProgramInfoLog (GLuint program, GLsizei bufsize, GLsizei* length, GLchar* infolog) {
   gl_context *ctxt = gl_ctxt();
+  if (length) *length = 0;
+  if (infolog && bufsize > 0) infolog[0] = 0;
 }
 
 
@@ -1214,11 +1913,25 @@ GL_APICALL void GL_APIENTRY glGetRenderbufferParameteriv (GLenum target, GLenum
 
 GL_APICALL void GL_APIENTRY glGetShaderiv (GLuint shader, GLenum pname, GLint* params) {
   gl_context *ctxt = gl_ctxt();
+  gl_shader *s = ctxt->get_shader(shader);
+  if (!s) {
+    ctxt->set_error(GL_INVALID_VALUE);
+    return;
+  }
+  if (pname == GL_COMPILE_STATUS) {
+    params[0] = GL_TRUE;
+  } else if (pname == GL_SHADER_TYPE) {
+    params[0] = s->type;
+  } else if (pname == GL_INFO_LOG_LENGTH) {
+    params[0] = 0;
+  }
 }
 
 
 GL_APICALL void GL_APIENTRY glGetShaderInfoLog (GLuint shader, GLsizei bufsize, GLsizei* length, GLchar* infolog) {
   gl_context *ctxt = gl_ctxt();
+  if (length) *length = 0;
+  if (infolog && bufsize > 0) infolog[0] = 0;
 }
 
 
@@ -1233,8 +1946,14 @@ GL_APICALL void GL_APIENTRY glGetShaderSource (GLuint shader, GLsizei bufsize, G
 
 
 GL_APICALL const GLubyte* GL_APIENTRY glGetString (GLenum name) {
+  switch (name) {
+    case GL_VENDOR: return (const GLubyte*)"octet";
+    case GL_RENDERER: return (const GLubyte*)"octet software rasteriser";
+    case GL_VERSION: return (const GLubyte*)"OpenGL ES 2.0";
+    case GL_SHADING_LANGUAGE_VERSION: return (const GLubyte*)"OpenGL ES GLSL ES 1.00";
+    case GL_EXTENSIONS: return (const GLubyte*)"";
+  }
   return 0;
-  gl_context *ctxt = gl_ctxt();
 }
 
 
@@ -1259,8 +1978,13 @@ GL_APICALL void GL_APIENTRY glGetUniformiv (GLuint program, GLint location, GLin
 
 
 GL_APICALL GLint GL_APIENTRY glGetUniformLocation (GLuint program, const GLchar* name) {
-  return 0;
   gl_context *ctxt = gl_ctxt();
+  gl_program *prog = ctxt->get_program(program);
+  if (!prog || !prog->linked) {
+    ctxt->set_error(GL_INVALID_OPERATION);
+    return -1;
+  }
+  return prog->get_uniform_location(name);
 }
 
 
@@ -1286,12 +2010,13 @@ GL_APICALL void GL_APIENTRY glHint (GLenum target, GLenum mode) {
 
 GL_APICALL GLboolean GL_APIENTRY glIsBuffer (GLuint buffer) {
   gl_context *ctxt = gl_ctxt();
+  return ctxt->get_buffer(buffer) != 0;
 }
 
 
 GL_APICALL GLboolean GL_APIENTRY glIsEnabled (GLenum cap) {
-  return 0;
   gl_context *ctxt = gl_ctxt();
+  return ctxt->get_unsigned((uint16_t)cap, 0u) != 0;
 }
 
 
@@ -1302,8 +2027,8 @@ GL_APICALL GLboolean GL_APIENTRY glIsFramebuffer (GLuint framebuffer) {
 
 
 GL_APICALL GLboolean GL_APIENTRY glIsProgram (GLuint program) {
-  return 0;
   gl_context *ctxt = gl_ctxt();
+  return ctxt->get_program(program) != 0;
 }
 
 
@@ -1314,14 +2039,14 @@ GL_APICALL GLboolean GL_APIENTRY glIsRenderbuffer (GLuint renderbuffer) {
 
 
 GL_APICALL GLboolean GL_APIENTRY glIsShader (GLuint shader) {
-  return 0;
   gl_context *ctxt = gl_ctxt();
+  return ctxt->get_shader(shader) != 0;
 }
 
 
 GL_APICALL GLboolean GL_APIENTRY glIsTexture (GLuint texture) {
-  return 0;
   gl_context *ctxt = gl_ctxt();
+  return ctxt->get_texture(texture) != 0;
 }
 
 
@@ -1332,11 +2057,22 @@ GL_APICALL void GL_APIENTRY glLineWidth (GLfloat width) {
 
 GL_APICALL void GL_APIENTRY glLinkProgram (GLuint program) {
   gl_context *ctxt = gl_ctxt();
+  gl_program *prog = ctxt->get_program(program);
+  if (!prog) {
+    ctxt->set_error(GL_INVALID_VALUE);
+    return;
+  }
+  gl_shader *vs = ctxt->get_shader(prog->vertex_shader);
+  gl_shader *fs = ctxt->get_shader(prog->fragment_shader);
+  prog->vertex_source = vs ? vs->source.c_str() : "";
+  prog->fragment_source = fs ? fs->source.c_str() : "";
+  prog->link();
 }
 
 
 GL_APICALL void GL_APIENTRY glPixelStorei (GLenum pname, GLint param) {
   gl_context *ctxt = gl_ctxt();
+  ctxt->set(pname, (unsigned)param);
 }
 
 
@@ -1347,6 +2083,11 @@ GL_APICALL void GL_APIENTRY glPolygonOffset (GLfloat factor, GLfloat units) {
 
 GL_APICALL void GL_APIENTRY glReadPixels (GLint x, GLint y, GLsizei width, GLsizei height, GLenum format, GLenum type, GLvoid* pixels) {
   gl_context *ctxt = gl_ctxt();
+  if (format != GL_RGBA || type != GL_UNSIGNED_BYTE) {
+    ctxt->set_error(GL_INVALID_ENUM);
+    return;
+  }
+  ctxt->raster.read_pixels(x, y, width, height, (uint8_t*)pixels);
 }
 
 
@@ -1367,6 +2108,7 @@ GL_APICALL void GL_APIENTRY glSampleCoverage (GLfloat value, GLboolean invert) {
 
 GL_APICALL void GL_APIENTRY glScissor (GLint x, GLint y, GLsizei width, GLsizei height) {
   gl_context *ctxt = gl_ctxt();
+  ctxt->set(GL_SCISSOR_BOX, (float)x, (float)y, (float)width, (float)height);
 }
 
 
@@ -1377,6 +2119,21 @@ GL_APICALL void GL_APIENTRY glShaderBinary (GLsizei n, const GLuint* shaders, GL
 
 GL_APICALL void GL_APIENTRY glShaderSource (GLuint shader, GLsizei count, const GLchar* const* string, const GLint* length) {
   gl_context *ctxt = gl_ctxt();
+  gl_shader *s = ctxt->get_shader(shader);
+  if (!s) {
+    ctxt->set_error(GL_INVALID_VALUE);
+    return;
+  }
+  s->source = "";
+  for (GLsizei i = 0; i < count; ++i) {
+    if (length && length[i] >= 0) {
+      octet::string part;
+      part.set(string[i], length[i]);
+      s->source += part.c_str();
+    } else {
+      s->source += string[i];
+    }
+  }
 }
 
 
@@ -1412,131 +2169,189 @@ GL_APICALL void GL_APIENTRY glStencilOpSeparate (GLenum face, GLenum fail, GLenu
 
 GL_APICALL void GL_APIENTRY glTexImage2D (GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height, GLint border, GLenum format, GLenum type, const GLvoid* pixels) {
   gl_context *ctxt = gl_ctxt();
+  gl_texture *tex = ctxt->get_bound_texture();
+  if (!tex || target != GL_TEXTURE_2D) {
+    ctxt->set_error(GL_INVALID_OPERATION);
+    return;
+  }
+  // only level 0 is kept
+  if (level != 0) return;
+  if (type != GL_UNSIGNED_BYTE) {
+    ctxt->set_error(GL_INVALID_ENUM);
+    return;
+  }
+  ctxt->raster.flush();
+  tex->image.set_size(width, height);
+  if (pixels) {
+    tex->image.set_pixels(0, 0, width, height, format, (const uint8_t*)pixels, ctxt->get_unsigned(GL_UNPACK_ALIGNMENT, 4u));
+  } else {
+    memset(tex->image.pixels.data(), 0, width * height * sizeof(uint32_t));
+  }
 }
 
 
 GL_APICALL void GL_APIENTRY glTexParameterf (GLenum target, GLenum pname, GLfloat param) {
   gl_context *ctxt = gl_ctxt();
+  ctxt->set_texture_parameter(pname, (GLint)param);
 }
 
 
 GL_APICALL void GL_APIENTRY glTexParameterfv (GLenum target, GLenum pname, const GLfloat* params) {
   gl_context *ctxt = gl_ctxt();
+  ctxt->set_texture_parameter(pname, (GLint)params[0]);
 }
 
 
 GL_APICALL void GL_APIENTRY glTexParameteri (GLenum target, GLenum pname, GLint param) {
   gl_context *ctxt = gl_ctxt();
+  ctxt->set_texture_parameter(pname, param);
 }
 
 
 GL_APICALL void GL_APIENTRY glTexParameteriv (GLenum target, GLenum pname, const GLint* params) {
   gl_context *ctxt = gl_ctxt();
+  ctxt->set_texture_parameter(pname, params[0]);
 }
 
 
 GL_APICALL void GL_APIENTRY glTexSubImage2D (GLenum target, GLint level, GLint xoffset, GLint yoffset, GLsizei width, GLsizei height, GLenum format, GLenum type, const GLvoid* pixels) {
   gl_context *ctxt = gl_ctxt();
+  gl_texture *tex = ctxt->get_bound_texture();
+  if (!tex || target != GL_TEXTURE_2D) {
+    ctxt->set_error(GL_INVALID_OPERATION);
+    return;
+  }
+  if (level != 0) return;
+  ctxt->raster.flush();
+  if (type != GL_UNSIGNED_BYTE || !tex->image.set_pixels(xoffset, yoffset, width, height, format, (const uint8_t*)pixels, ctxt->get_unsigned(GL_UNPACK_ALIGNMENT, 4u))) {
+    ctxt->set_error(GL_INVALID_VALUE);
+  }
 }
 
 
 GL_APICALL void GL_APIENTRY glUniform1f (GLint location, GLfloat x) {
   gl_context *ctxt = gl_ctxt();
+  gl_uniform(location, 1, 1, &x);
 }
 
 
 GL_APICALL void GL_APIENTRY glUniform1fv (GLint location, GLsizei count, const GLfloat* v) {
   gl_context *ctxt = gl_ctxt();
+  gl_uniform(location, 1, count, v);
 }
 
 
 GL_APICALL void GL_APIENTRY glUniform1i (GLint location, GLint x) {
   gl_context *ctxt = gl_ctxt();
+  gl_uniform(location, 1, 1, &x);
 }
 
 
 GL_APICALL void GL_APIENTRY glUniform1iv (GLint location, GLsizei count, const GLint* v) {
   gl_context *ctxt = gl_ctxt();
+  gl_uniform(location, 1, count, v);
 }
 
 
 GL_APICALL void GL_APIENTRY glUniform2f (GLint location, GLfloat x, GLfloat y) {
   gl_context *ctxt = gl_ctxt();
+  GLfloat v[] = { x, y };
+  gl_uniform(location, 2, 1, v);
 }
 
 
 GL_APICALL void GL_APIENTRY glUniform2fv (GLint location, GLsizei count, const GLfloat* v) {
   gl_context *ctxt = gl_ctxt();
+  gl_uniform(location, 2, count, v);
 }
 
 
 GL_APICALL void GL_APIENTRY glUniform2i (GLint location, GLint x, GLint y) {
   gl_context *ctxt = gl_ctxt();
+  GLint v[] = { x, y };
+  gl_uniform(location, 2, 1, v);
 }
 
 
 GL_APICALL void GL_APIENTRY glUniform2iv (GLint location, GLsizei count, const GLint* v) {
   gl_context *ctxt = gl_ctxt();
+  gl_uniform(location, 2, count, v);
 }
 
 
 GL_APICALL void GL_APIENTRY glUniform3f (GLint location, GLfloat x, GLfloat y, GLfloat z) {
   gl_context *ctxt = gl_ctxt();
+  GLfloat v[] = { x, y, z };
+  gl_uniform(location, 3, 1, v);
 }
 
 
 GL_APICALL void GL_APIENTRY glUniform3fv (GLint location, GLsizei count, const GLfloat* v) {
   gl_context *ctxt = gl_ctxt();
+  gl_uniform(location, 3, count, v);
 }
 
 
 GL_APICALL void GL_APIENTRY glUniform3i (GLint location, GLint x, GLint y, GLint z) {
   gl_context *ctxt = gl_ctxt();
+  GLint v[] = { x, y, z };
+  gl_uniform(location, 3, 1, v);
 }
 
 
 GL_APICALL void GL_APIENTRY glUniform3iv (GLint location, GLsizei count, const GLint* v) {
   gl_context *ctxt = gl_ctxt();
+  gl_uniform(location, 3, count, v);
 }
 
 
 GL_APICALL void GL_APIENTRY glUniform4f (GLint location, GLfloat x, GLfloat y, GLfloat z, GLfloat w) {
   gl_context *ctxt = gl_ctxt();
+  GLfloat v[] = { x, y, z, w };
+  gl_uniform(location, 4, 1, v);
 }
 
 
 GL_APICALL void GL_APIENTRY glUniform4fv (GLint location, GLsizei count, const GLfloat* v) {
   gl_context *ctxt = gl_ctxt();
+  gl_uniform(location, 4, count, v);
 }
 
 
 GL_APICALL void GL_APIENTRY glUniform4i (GLint location, GLint x, GLint y, GLint z, GLint w) {
   gl_context *ctxt = gl_ctxt();
+  GLint v[] = { x, y, z, w };
+  gl_uniform(location, 4, 1, v);
 }
 
 
 GL_APICALL void GL_APIENTRY glUniform4iv (GLint location, GLsizei count, const GLint* v) {
   gl_context *ctxt = gl_ctxt();
+  gl_uniform(location, 4, count, v);
 }
 
 
 GL_APICALL void GL_APIENTRY glUniformMatrix2fv (GLint location, GLsizei count, GLboolean transpose, const GLfloat* value) {
   gl_context *ctxt = gl_ctxt();
+  gl_uniform(location, 4, count, value);
 }
 
 
 GL_APICALL void GL_APIENTRY glUniformMatrix3fv (GLint location, GLsizei count, GLboolean transpose, const GLfloat* value) {
   gl_context *ctxt = gl_ctxt();
+  gl_uniform(location, 9, count, value);
 }
 
 
 GL_APICALL void GL_APIENTRY glUniformMatrix4fv (GLint location, GLsizei count, GLboolean transpose, const GLfloat* value) {
   gl_context *ctxt = gl_ctxt();
+  gl_uniform(location, 16, count, value);
 }
 
 
 GL_APICALL void GL_APIENTRY glUseProgram (GLuint program) {
   gl_context *ctxt = gl_ctxt();
+  ctxt->set(GL_CURRENT_PROGRAM, program);
 }
 
 
@@ -1546,52 +2361,76 @@ GL_APICALL void GL_APIENTRY glValidateProgram (GLuint program) {
 
 
 GL_APICALL void GL_APIENTRY glVertexAttrib1f (GLuint indx, GLfloat x) {
-  gl_context *ctxt = gl_ctxt();
+  GLfloat v[] = { x, 0, 0, 1 };
+  gl_ctxt()->set_attrib(indx, v);
 }
 
 
 GL_APICALL void GL_APIENTRY glVertexAttrib1fv (GLuint indx, const GLfloat* values) {
-  gl_context *ctxt = gl_ctxt();
+  GLfloat v[] = { values[0], 0, 0, 1 };
+  gl_ctxt()->set_attrib(indx, v);
 }
 
 
 GL_APICALL void GL_APIENTRY glVertexAttrib2f (GLuint indx, GLfloat x, GLfloat y) {
-  gl_context *ctxt = gl_ctxt();
+  GLfloat v[] = { x, y, 0, 1 };
+  gl_ctxt()->set_attrib(indx, v);
 }
 
 
 GL_APICALL void GL_APIENTRY glVertexAttrib2fv (GLuint indx, const GLfloat* values) {
-  gl_context *ctxt = gl_ctxt();
+  GLfloat v[] = { values[0], values[1], 0, 1 };
+  gl_ctxt()->set_attrib(indx, v);
 }
 
 
 GL_APICALL void GL_APIENTRY glVertexAttrib3f (GLuint indx, GLfloat x, GLfloat y, GLfloat z) {
-  gl_context *ctxt = gl_ctxt();
+  GLfloat v[] = { x, y, z, 1 };
+  gl_ctxt()->set_attrib(indx, v);
 }
 
 
 GL_APICALL void GL_APIENTRY glVertexAttrib3fv (GLuint indx, const GLfloat* values) {
-  gl_context *ctxt = gl_ctxt();
+  GLfloat v[] = { values[0], values[1], values[2], 1 };
+  gl_ctxt()->set_attrib(indx, v);
 }
 
 
 GL_APICALL void GL_APIENTRY glVertexAttrib4f (GLuint indx, GLfloat x, GLfloat y, GLfloat z, GLfloat w) {
-  gl_context *ctxt = gl_ctxt();
+  GLfloat v[] = { x, y, z, w };
+  gl_ctxt()->set_attrib(indx, v);
 }
 
 
 GL_APICALL void GL_APIENTRY glVertexAttrib4fv (GLuint indx, const GLfloat* values) {
   gl_context *ctxt = gl_ctxt();
+  ctxt->set_attrib(indx, values);
 }
 
 
 GL_APICALL void GL_APIENTRY glVertexAttribPointer (GLuint indx, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const GLvoid* ptr) {
   gl_context *ctxt = gl_ctxt();
+  if (indx >= gl_context::max_attribs || size < 1 || size > 4 || stride < 0) {
+    ctxt->set_error(GL_INVALID_VALUE);
+    return;
+  }
+  gl_context::attrib_t &a = ctxt->attribs[indx];
+  a.size = size;
+  a.type = type;
+  a.normalized = normalized != 0;
+  a.stride = stride;
+  a.pointer = (const uint8_t*)ptr;
+  a.buffer = ctxt->get_unsigned(GL_ARRAY_BUFFER_BINDING, 0u);
 }
 
 
 GL_APICALL void GL_APIENTRY glViewport (GLint x, GLint y, GLsizei width, GLsizei height) {
   gl_context *ctxt = gl_ctxt();
+  // size the default framebuffer if the platform has not
+  if (!ctxt->raster.get_width()) {
+    ctxt->set_framebuffer_size(x + width, y + height);
+  }
+  ctxt->set(GL_VIEWPORT, (float)x, (float)y, (float)width, (float)height);
 }
 
 
@@ -1605,6 +2444,7 @@ GL_APICALL void GL_APIENTRY glReadBuffer (GLenum mode) {
 
 GL_APICALL void GL_APIENTRY glDrawRangeElements (GLenum mode, GLuint start, GLuint end, GLsizei count, GLenum type, const GLvoid* indices) {
   gl_context *ctxt = gl_ctxt();
+  ctxt->draw(mode, 0, count, type, indices, true);
 }
 
 
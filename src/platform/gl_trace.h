@@ -0,0 +1,571 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Andy Thomason 2012, 2013
+//
+// Modular Framework for OpenGLES2 rendering on multiple platforms.
+//
+// GL call tracer.
+//
+// With OCTET_GL_TRACE set to 1 the GL entry points the framework uses go
+// through counting wrappers. gl_trace counts the calls of each frame by
+// function and the calls that set state to the value it already had: the
+// same program, texture, sampler parameter, capability, blend or depth
+// state, attribute array or uniform value. Draws also count the vertices
+// and the client-side vertex and index bytes they read.
+//
+// Call gl_trace::end_frame() once a frame. The last max_frames frames can be
+// printed or written as JSON.
+//
+// Only calls compiled after this header are seen. Call invalidate() if
+// other code changes the GL state.
+//
+
+#ifndef OCTET_GL_TRACE
+  #define OCTET_GL_TRACE 0
+#endif
+
+#define OCTET_GL_TRACE_FUNCS(X) \
+  X(glActiveTexture) X(glBindTexture) X(glTexParameterf) X(glTexParameteri) \
+  X(glTexImage2D) X(glTexSubImage2D) X(glDeleteTextures) \
+  X(glUseProgram) X(glBindBuffer) X(glBufferData) X(glBufferSubData) X(glDeleteBuffers) \
+  X(glEnable) X(glDisable) X(glBlendFunc) X(glDepthFunc) X(glDepthMask) X(glCullFace) X(glFrontFace) \
+  X(glEnableVertexAttribArray) X(glDisableVertexAttribArray) X(glVertexAttribPointer) \
+  X(glUniform1i) X(glUniform1f) X(glUniform1iv) X(glUniform1fv) X(glUniform2fv) \
+  X(glUniform3fv) X(glUniform4fv) X(glUniformMatrix4fv) \
+  X(glViewport) X(glClear) X(glDrawArrays) X(glDrawElements)
+
+namespace octet {
+  class gl_trace {
+  public:
+    enum func_t {
+      #define OCTET_GL_TRACE_ENUM(NAME) func_##NAME,
+      OCTET_GL_TRACE_FUNCS(OCTET_GL_TRACE_ENUM)
+      #undef OCTET_GL_TRACE_ENUM
+      num_funcs
+    };
+
+    enum {
+      max_frames = 256,
+      max_units = 16,
+      max_attribs = 16,
+    };
+
+    struct frame_t {
+      unsigned frame;
+      unsigned calls[num_funcs];
+      unsigned redundant[num_funcs];
+      unsigned vertices;      // vertices or indices drawn
+      unsigned client_bytes;  // client-side vertex and index data read by draws
+      unsigned upload_bytes;  // buffer and texture data sent
+
+      unsigned get_num_calls() const {
+        unsigned total = 0;
+        for (unsigned i = 0; i != num_funcs; ++i) total += calls[i];
+        return total;
+      }
+
+      unsigned get_num_redundant() const {
+        unsigned total = 0;
+        for (unsigned i = 0; i != num_funcs; ++i) total += redundant[i];
+        return total;
+      }
+
+      unsigned get_draw_calls() const {
+        return calls[func_glDrawArrays] + calls[func_glDrawElements];
+      }
+
+      unsigned get_uniform_uploads() const {
+        unsigned total = 0;
+        for (unsigned i = func_glUniform1i; i <= func_glUniformMatrix4fv; ++i) total += calls[i];
+        return total;
+      }
+    };
+
+  private:
+    enum { unknown = 0xffffffff };
+
+    // the sampler parameters we shadow
+    struct tex_params_t {
+      unsigned known;  // bit per parameter
+      float values[4];
+    };
+
+    struct attrib_t {
+      unsigned enabled;
+      unsigned buffer;
+      GLint size;
+      GLenum type;
+      GLboolean normalized;
+      GLsizei stride;
+      const void *ptr;
+    };
+
+    struct uniform_t {
+      unsigned hash;
+      unsigned size;  // 0 if not set yet
+    };
+
+    frame_t current;
+    dynarray<frame_t> history;
+    unsigned num_frames;
+
+    // shadow of the state set through the tracer
+    unsigned active_unit;
+    unsigned textures[max_units][2];  // GL_TEXTURE_2D, GL_TEXTURE_CUBE_MAP
+    hash_map<unsigned, tex_params_t> tex_params;
+    unsigned program;
+    unsigned array_buffer;
+    unsigned element_buffer;
+    hash_map<unsigned, unsigned> caps;
+    unsigned blend_src, blend_dst;
+    unsigned depth_func, depth_mask;
+    unsigned cull_face, front_face;
+    attrib_t attribs[max_attribs];
+    hash_map<uint64_t, uniform_t> uniforms;
+
+    static const char *get_func_name(unsigned func) {
+      static const char *names[] = {
+        #define OCTET_GL_TRACE_NAME(NAME) #NAME,
+        OCTET_GL_TRACE_FUNCS(OCTET_GL_TRACE_NAME)
+        #undef OCTET_GL_TRACE_NAME
+      };
+      return func < num_funcs ? names[func] : "";
+    }
+
+    static unsigned get_type_size(GLenum type) {
+      switch (type) {
+        case GL_BYTE: case GL_UNSIGNED_BYTE: return 1;
+        case GL_SHORT: case GL_UNSIGNED_SHORT: return 2;
+        default: return 4;
+      }
+    }
+
+    static int get_param_index(GLenum pname) {
+      switch (pname) {
+        case GL_TEXTURE_MIN_FILTER: return 0;
+        case GL_TEXTURE_MAG_FILTER: return 1;
+        case GL_TEXTURE_WRAP_S: return 2;
+        case GL_TEXTURE_WRAP_T: return 3;
+        default: return -1;
+      }
+    }
+
+    // count a call that sets shadow to value
+    void set(func_t func, unsigned &shadow, unsigned value) {
+      current.calls[func]++;
+      if (shadow == value) current.redundant[func]++;
+      shadow = value;
+    }
+
+    unsigned &bound_texture(GLenum target) {
+      return textures[active_unit][target == GL_TEXTURE_CUBE_MAP ? 1 : 0];
+    }
+
+    void set_cap(func_t func, GLenum cap, unsigned value) {
+      unsigned *old_value = caps.find(cap);
+      if (old_value) {
+        set(func, *old_value, value);
+      } else {
+        current.calls[func]++;
+        caps[cap] = value;
+      }
+    }
+
+    void set_attrib_enabled(func_t func, GLuint index, unsigned value) {
+      if (index < max_attribs) {
+        set(func, attribs[index].enabled, value);
+      } else {
+        current.calls[func]++;
+      }
+    }
+
+    void set_uniform(func_t func, GLint location, const void *data, unsigned size) {
+      current.calls[func]++;
+      if (location < 0 || program == unknown) return;
+      unsigned hash = 0x811c9dc5;
+      for (unsigned i = 0; i != size; ++i) {
+        hash = (hash ^ ((const uint8_t*)data)[i]) * 0x01000193;
+      }
+      uniform_t &u = uniforms[((uint64_t)program << 32) | (unsigned)(location + 1)];
+      if (u.size == size && u.hash == hash) current.redundant[func]++;
+      u.size = size;
+      u.hash = hash;
+    }
+
+    // client-side vertex bytes read for vertices [0, num_vertices)
+    void add_client_vertices(unsigned num_vertices) {
+      for (unsigned i = 0; i != max_attribs; ++i) {
+        const attrib_t &a = attribs[i];
+        if (a.enabled == 1 && a.buffer == 0 && a.ptr) {
+          unsigned stride = a.stride ? a.stride : a.size * get_type_size(a.type);
+          current.client_bytes += stride * num_vertices;
+        }
+      }
+    }
+
+    void clear_frame() {
+      memset(&current, 0, sizeof(current));
+      current.frame = num_frames;
+    }
+
+    static void write_counts(FILE *file, const unsigned *counts) {
+      const char *sep = "";
+      fprintf(file, "{");
+      for (unsigned i = 0; i != num_funcs; ++i) {
+        if (counts[i]) {
+          fprintf(file, "%s\"%s\":%u", sep, get_func_name(i), counts[i]);
+          sep = ",";
+        }
+      }
+      fprintf(file, "}");
+    }
+
+  public:
+    gl_trace() {
+      num_frames = 0;
+      clear_frame();
+      invalidate();
+    }
+
+    static gl_trace &get() {
+      static gl_trace *trace;
+      if (!trace) trace = new gl_trace();
+      return *trace;
+    }
+
+    // forget the shadowed state, the next set of anything is not redundant
+    void invalidate() {
+      active_unit = 0;
+      memset(textures, 0xff, sizeof(textures));
+      tex_params.clear();
+      program = unknown;
+      array_buffer = element_buffer = unknown;
+      caps.clear();
+      blend_src = blend_dst = unknown;
+      depth_func = depth_mask = unknown;
+      cull_face = front_face = unknown;
+      memset(attribs, 0, sizeof(attribs));
+      for (unsigned i = 0; i != max_attribs; ++i) {
+        attribs[i].enabled = unknown;
+        attribs[i].buffer = unknown;
+      }
+      uniforms.clear();
+    }
+
+    // finish the counts for this frame and start the next
+    void end_frame() {
+      if (history.size() < max_frames) {
+        history.push_back(current);
+      } else {
+        history[num_frames % max_frames] = current;
+      }
+      num_frames++;
+      clear_frame();
+    }
+
+    // counts so far in this frame
+    const frame_t &get_current() const {
+      return current;
+    }
+
+    // number of frames kept
+    unsigned get_num_frames() const {
+      return history.size();
+    }
+
+    // a kept frame, 0 is the oldest
+    const frame_t &get_frame(unsigned index) const {
+      unsigned size = history.size();
+      unsigned first = num_frames > size ? num_frames % size : 0;
+      return history[(first + index) % size];
+    }
+
+    void print_frame(const frame_t &f) const {
+      printf("frame %u: %u calls, %u redundant, %u draws, %u vertices, %u client bytes, %u upload bytes\n",
+        f.frame, f.get_num_calls(), f.get_num_redundant(), f.get_draw_calls(), f.vertices, f.client_bytes, f.upload_bytes
+      );
+      for (unsigned i = 0; i != num_funcs; ++i) {
+        if (f.calls[i]) printf("  %-28s %8u %8u\n", get_func_name(i), f.calls[i], f.redundant[i]);
+      }
+    }
+
+    // the kept frames as a JSON array with one frame per line
+    bool write_json(const char *url) const {
+      FILE *file = fopen(url, "wb");
+      if (!file) {
+        printf("warning: could not write %s\n", url);
+        return false;
+      }
+      fprintf(file, "[\n");
+      for (unsigned i = 0; i != get_num_frames(); ++i) {
+        const frame_t &f = get_frame(i);
+        fprintf(file, "{\"frame\":%u,\"draw_calls\":%u,\"vertices\":%u,\"client_bytes\":%u,\"upload_bytes\":%u,\"uniform_uploads\":%u,\"calls\":",
+          f.frame, f.get_draw_calls(), f.vertices, f.client_bytes, f.upload_bytes, f.get_uniform_uploads()
+        );
+        write_counts(file, f.calls);
+        fprintf(file, ",\"redundant\":");
+        write_counts(file, f.redundant);
+        fprintf(file, "}%s\n", i + 1 == get_num_frames() ? "" : ",");
+      }
+      fprintf(file, "]\n");
+      fclose(file);
+      return true;
+    }
+
+    // called by the wrappers below
+    void active_texture(GLenum texture) {
+      unsigned unit = texture - GL_TEXTURE0;
+      if (unit >= max_units) unit = 0;
+      set(func_glActiveTexture, active_unit, unit);
+    }
+
+    void bind_texture(GLenum target, GLuint texture) {
+      set(func_glBindTexture, bound_texture(target), texture);
+    }
+
+    void tex_parameter(func_t func, GLenum target, GLenum pname, float value) {
+      current.calls[func]++;
+      unsigned texture = bound_texture(target);
+      int index = get_param_index(pname);
+      if (texture == 0 || texture == unknown || index < 0) return;
+      tex_params_t &p = tex_params[texture];
+      unsigned bit = 1 << index;
+      if ((p.known & bit) && p.values[index] == value) current.redundant[func]++;
+      p.known |= bit;
+      p.values[index] = value;
+    }
+
+    void tex_image(func_t func, GLsizei width, GLsizei height, GLenum format, GLenum type) {
+      current.calls[func]++;
+      unsigned components = format == GL_RGBA ? 4 : format == GL_RGB ? 3 : format == GL_LUMINANCE_ALPHA ? 2 : 1;
+      unsigned texel = type == GL_UNSIGNED_BYTE ? components : 2;
+      current.upload_bytes += width * height * texel;
+    }
+
+    void delete_textures(GLsizei n, const GLuint *ids) {
+      current.calls[func_glDeleteTextures]++;
+      for (GLsizei i = 0; i != n; ++i) {
+        if (ids[i] && tex_params.contains(ids[i])) tex_params[ids[i]].known = 0;
+        for (unsigned u = 0; u != max_units; ++u) {
+          if (textures[u][0] == ids[i]) textures[u][0] = 0;
+          if (textures[u][1] == ids[i]) textures[u][1] = 0;
+        }
+      }
+    }
+
+    void use_program(GLuint value) {
+      set(func_glUseProgram, program, value);
+    }
+
+    void bind_buffer(GLenum target, GLuint buffer) {
+      set(func_glBindBuffer, target == GL_ELEMENT_ARRAY_BUFFER ? element_buffer : array_buffer, buffer);
+    }
+
+    void buffer_data(func_t func, GLsizeiptr size) {
+      current.calls[func]++;
+      current.upload_bytes += (unsigned)size;
+    }
+
+    void delete_buffers(GLsizei n, const GLuint *ids) {
+      current.calls[func_glDeleteBuffers]++;
+      for (GLsizei i = 0; i != n; ++i) {
+        // deleting a bound buffer unbinds it
+        if (array_buffer == ids[i]) array_buffer = 0;
+        if (element_buffer == ids[i]) element_buffer = 0;
+      }
+    }
+
+    void enable(GLenum cap, bool value) {
+      set_cap(value ? func_glEnable : func_glDisable, cap, value ? 1 : 0);
+    }
+
+    void blend_func(GLenum src, GLenum dst) {
+      current.calls[func_glBlendFunc]++;
+      if (blend_src == src && blend_dst == dst) current.redundant[func_glBlendFunc]++;
+      blend_src = src;
+      blend_dst = dst;
+    }
+
+    void set_depth_func(GLenum value) { set(func_glDepthFunc, depth_func, value); }
+    void set_depth_mask(GLboolean value) { set(func_glDepthMask, depth_mask, value); }
+    void set_cull_face(GLenum value) { set(func_glCullFace, cull_face, value); }
+    void set_front_face(GLenum value) { set(func_glFrontFace, front_face, value); }
+
+    void enable_attrib(GLuint index, bool value) {
+      set_attrib_enabled(value ? func_glEnableVertexAttribArray : func_glDisableVertexAttribArray, index, value ? 1 : 0);
+    }
+
+    void attrib_pointer(GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const void *ptr) {
+      current.calls[func_glVertexAttribPointer]++;
+      if (index >= max_attribs) return;
+      attrib_t &a = attribs[index];
+      if (
+        a.buffer == array_buffer && a.size == size && a.type == type &&
+        a.normalized == normalized && a.stride == stride && a.ptr == ptr
+      ) {
+        current.redundant[func_glVertexAttribPointer]++;
+      }
+      a.buffer = array_buffer;
+      a.size = size;
+      a.type = type;
+      a.normalized = normalized;
+      a.stride = stride;
+      a.ptr = ptr;
+    }
+
+    void uniform(func_t func, GLint location, const void *data, unsigned size) {
+      set_uniform(func, location, data, size);
+    }
+
+    void other(func_t func) {
+      current.calls[func]++;
+    }
+
+    void draw_arrays(GLint first, GLsizei count) {
+      current.calls[func_glDrawArrays]++;
+      current.vertices += count;
+      add_client_vertices(first + count);
+    }
+
+    void draw_elements(GLsizei count, GLenum type, const void *indices) {
+      current.calls[func_glDrawElements]++;
+      current.vertices += count;
+      unsigned num_vertices = count;
+      if (element_buffer == 0 && indices) {
+        // client-side indices, the highest one says how many vertices are read
+        unsigned max_index = 0;
+        for (GLsizei i = 0; i != count; ++i) {
+          unsigned index =
+            type == GL_UNSIGNED_BYTE ? ((const uint8_t*)indices)[i] :
+            type == GL_UNSIGNED_SHORT ? ((const uint16_t*)indices)[i] :
+            ((const uint32_t*)indices)[i]
+          ;
+          if (index > max_index) max_index = index;
+        }
+        num_vertices = count ? max_index + 1 : 0;
+        current.client_bytes += count * get_type_size(type);
+      }
+      add_client_vertices(num_vertices);
+    }
+  };
+}
+
+#if OCTET_GL_TRACE
+  // each wrapper records the call then makes it
+  inline void octet_trace_glActiveTexture(GLenum texture) { octet::gl_trace::get().active_texture(texture); glActiveTexture(texture); }
+  inline void octet_trace_glBindTexture(GLenum target, GLuint texture) { octet::gl_trace::get().bind_texture(target, texture); glBindTexture(target, texture); }
+  inline void octet_trace_glTexParameterf(GLenum target, GLenum pname, GLfloat param) { octet::gl_trace::get().tex_parameter(octet::gl_trace::func_glTexParameterf, target, pname, (float)param); glTexParameterf(target, pname, param); }
+  inline void octet_trace_glTexParameteri(GLenum target, GLenum pname, GLint param) { octet::gl_trace::get().tex_parameter(octet::gl_trace::func_glTexParameteri, target, pname, (float)param); glTexParameteri(target, pname, param); }
+  inline void octet_trace_glTexImage2D(GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height, GLint border, GLenum format, GLenum type, const GLvoid *pixels) {
+    octet::gl_trace::get().tex_image(octet::gl_trace::func_glTexImage2D, width, height, format, type);
+    glTexImage2D(target, level, internalformat, width, height, border, format, type, pixels);
+  }
+  inline void octet_trace_glTexSubImage2D(GLenum target, GLint level, GLint xoffset, GLint yoffset, GLsizei width, GLsizei height, GLenum format, GLenum type, const GLvoid *pixels) {
+    octet::gl_trace::get().tex_image(octet::gl_trace::func_glTexSubImage2D, width, height, format, type);
+    glTexSubImage2D(target, level, xoffset, yoffset, width, height, format, type, pixels);
+  }
+  inline void octet_trace_glDeleteTextures(GLsizei n, const GLuint *textures) { octet::gl_trace::get().delete_textures(n, textures); glDeleteTextures(n, textures); }
+  inline void octet_trace_glUseProgram(GLuint program) { octet::gl_trace::get().use_program(program); glUseProgram(program); }
+  inline void octet_trace_glBindBuffer(GLenum target, GLuint buffer) { octet::gl_trace::get().bind_buffer(target, buffer); glBindBuffer(target, buffer); }
+  inline void octet_trace_glBufferData(GLenum target, GLsizeiptr size, const GLvoid *data, GLenum usage) { octet::gl_trace::get().buffer_data(octet::gl_trace::func_glBufferData, size); glBufferData(target, size, data, usage); }
+  inline void octet_trace_glBufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const GLvoid *data) { octet::gl_trace::get().buffer_data(octet::gl_trace::func_glBufferSubData, size); glBufferSubData(target, offset, size, data); }
+  inline void octet_trace_glDeleteBuffers(GLsizei n, const GLuint *buffers) { octet::gl_trace::get().delete_buffers(n, buffers); glDeleteBuffers(n, buffers); }
+  inline void octet_trace_glEnable(GLenum cap) { octet::gl_trace::get().enable(cap, true); glEnable(cap); }
+  inline void octet_trace_glDisable(GLenum cap) { octet::gl_trace::get().enable(cap, false); glDisable(cap); }
+  inline void octet_trace_glBlendFunc(GLenum sfactor, GLenum dfactor) { octet::gl_trace::get().blend_func(sfactor, dfactor); glBlendFunc(sfactor, dfactor); }
+  inline void octet_trace_glDepthFunc(GLenum func) { octet::gl_trace::get().set_depth_func(func); glDepthFunc(func); }
+  inline void octet_trace_glDepthMask(GLboolean flag) { octet::gl_trace::get().set_depth_mask(flag); glDepthMask(flag); }
+  inline void octet_trace_glCullFace(GLenum mode) { octet::gl_trace::get().set_cull_face(mode); glCullFace(mode); }
+  inline void octet_trace_glFrontFace(GLenum mode) { octet::gl_trace::get().set_front_face(mode); glFrontFace(mode); }
+  inline void octet_trace_glEnableVertexAttribArray(GLuint index) { octet::gl_trace::get().enable_attrib(index, true); glEnableVertexAttribArray(index); }
+  inline void octet_trace_glDisableVertexAttribArray(GLuint index) { octet::gl_trace::get().enable_attrib(index, false); glDisableVertexAttribArray(index); }
+  inline void octet_trace_glVertexAttribPointer(GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const GLvoid *ptr) {
+    octet::gl_trace::get().attrib_pointer(index, size, type, normalized, stride, ptr);
+    glVertexAttribPointer(index, size, type, normalized, stride, ptr);
+  }
+  inline void octet_trace_glUniform1i(GLint location, GLint x) { octet::gl_trace::get().uniform(octet::gl_trace::func_glUniform1i, location, &x, sizeof(x)); glUniform1i(location, x); }
+  inline void octet_trace_glUniform1f(GLint location, GLfloat x) { octet::gl_trace::get().uniform(octet::gl_trace::func_glUniform1f, location, &x, sizeof(x)); glUniform1f(location, x); }
+  inline void octet_trace_glUniform1iv(GLint location, GLsizei count, const GLint *v) { octet::gl_trace::get().uniform(octet::gl_trace::func_glUniform1iv, location, v, count * sizeof(GLint)); glUniform1iv(location, count, v); }
+  inline void octet_trace_glUniform1fv(GLint location, GLsizei count, const GLfloat *v) { octet::gl_trace::get().uniform(octet::gl_trace::func_glUniform1fv, location, v, count * sizeof(GLfloat)); glUniform1fv(location, count, v); }
+  inline void octet_trace_glUniform2fv(GLint location, GLsizei count, const GLfloat *v) { octet::gl_trace::get().uniform(octet::gl_trace::func_glUniform2fv, location, v, count * 2 * sizeof(GLfloat)); glUniform2fv(location, count, v); }
+  inline void octet_trace_glUniform3fv(GLint location, GLsizei count, const GLfloat *v) { octet::gl_trace::get().uniform(octet::gl_trace::func_glUniform3fv, location, v, count * 3 * sizeof(GLfloat)); glUniform3fv(location, count, v); }
+  inline void octet_trace_glUniform4fv(GLint location, GLsizei count, const GLfloat *v) { octet::gl_trace::get().uniform(octet::gl_trace::func_glUniform4fv, location, v, count * 4 * sizeof(GLfloat)); glUniform4fv(location, count, v); }
+  inline void octet_trace_glUniformMatrix4fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat *value) {
+    octet::gl_trace::get().uniform(octet::gl_trace::func_glUniformMatrix4fv, location, value, count * 16 * sizeof(GLfloat));
+    glUniformMatrix4fv(location, count, transpose, value);
+  }
+  inline void octet_trace_glViewport(GLint x, GLint y, GLsizei width, GLsizei height) { octet::gl_trace::get().other(octet::gl_trace::func_glViewport); glViewport(x, y, width, height); }
+  inline void octet_trace_glClear(GLbitfield mask) { octet::gl_trace::get().other(octet::gl_trace::func_glClear); glClear(mask); }
+  inline void octet_trace_glDrawArrays(GLenum mode, GLint first, GLsizei count) { octet::gl_trace::get().draw_arrays(first, count); glDrawArrays(mode, first, count); }
+  inline void octet_trace_glDrawElements(GLenum mode, GLsizei count, GLenum type, const GLvoid *indices) { octet::gl_trace::get().draw_elements(count, type, indices); glDrawElements(mode, count, type, indices); }
+
+  // from here on, GL calls go through the wrappers
+  #undef glActiveTexture
+  #define glActiveTexture octet_trace_glActiveTexture
+  #undef glBindTexture
+  #define glBindTexture octet_trace_glBindTexture
+  #undef glTexParameterf
+  #define glTexParameterf octet_trace_glTexParameterf
+  #undef glTexParameteri
+  #define glTexParameteri octet_trace_glTexParameteri
+  #undef glTexImage2D
+  #define glTexImage2D octet_trace_glTexImage2D
+  #undef glTexSubImage2D
+  #define glTexSubImage2D octet_trace_glTexSubImage2D
+  #undef glDeleteTextures
+  #define glDeleteTextures octet_trace_glDeleteTextures
+  #undef glUseProgram
+  #define glUseProgram octet_trace_glUseProgram
+  #undef glBindBuffer
+  #define glBindBuffer octet_trace_glBindBuffer
+  #undef glBufferData
+  #define glBufferData octet_trace_glBufferData
+  #undef glBufferSubData
+  #define glBufferSubData octet_trace_glBufferSubData
+  #undef glDeleteBuffers
+  #define glDeleteBuffers octet_trace_glDeleteBuffers
+  #undef glEnable
+  #define glEnable octet_trace_glEnable
+  #undef glDisable
+  #define glDisable octet_trace_glDisable
+  #undef glBlendFunc
+  #define glBlendFunc octet_trace_glBlendFunc
+  #undef glDepthFunc
+  #define glDepthFunc octet_trace_glDepthFunc
+  #undef glDepthMask
+  #define glDepthMask octet_trace_glDepthMask
+  #undef glCullFace
+  #define glCullFace octet_trace_glCullFace
+  #undef glFrontFace
+  #define glFrontFace octet_trace_glFrontFace
+  #undef glEnableVertexAttribArray
+  #define glEnableVertexAttribArray octet_trace_glEnableVertexAttribArray
+  #undef glDisableVertexAttribArray
+  #define glDisableVertexAttribArray octet_trace_glDisableVertexAttribArray
+  #undef glVertexAttribPointer
+  #define glVertexAttribPointer octet_trace_glVertexAttribPointer
+  #undef glUniform1i
+  #define glUniform1i octet_trace_glUniform1i
+  #undef glUniform1f
+  #define glUniform1f octet_trace_glUniform1f
+  #undef glUniform1iv
+  #define glUniform1iv octet_trace_glUniform1iv
+  #undef glUniform1fv
+  #define glUniform1fv octet_trace_glUniform1fv
+  #undef glUniform2fv
+  #define glUniform2fv octet_trace_glUniform2fv
+  #undef glUniform3fv
+  #define glUniform3fv octet_trace_glUniform3fv
+  #undef glUniform4fv
+  #define glUniform4fv octet_trace_glUniform4fv
+  #undef glUniformMatrix4fv
+  #define glUniformMatrix4fv octet_trace_glUniformMatrix4fv
+  #undef glViewport
+  #define glViewport octet_trace_glViewport
+  #undef glClear
+  #define glClear octet_trace_glClear
+  #undef glDrawArrays
+  #define glDrawArrays octet_trace_glDrawArrays
+  #undef glDrawElements
+  #define glDrawElements octet_trace_glDrawElements
+#endif
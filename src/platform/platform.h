@@ -36,6 +36,11 @@
 #include <stdarg.h>
 #include <math.h>
 #include <assert.h>
+#include <time.h>
+#if !defined(_WIN32) && !defined(SN_TARGET_PSP2)
+  #include <sys/time.h>
+  #include <sys/resource.h>
+#endif
 
 // xml library
 #include "../tinyxml/tinystr.cpp"
@@ -53,10 +58,12 @@ void *operator new(size_t size, void *place, dynarray_dummy_t x) { return place;
 void operator delete(void *ptr, void *place, dynarray_dummy_t x) {}
 
 #include "../containers/allocator.h"
+#include "../containers/arena.h"
 #include "../containers/dictionary.h"
 #include "../containers/hash_map.h"
 #include "../containers/double_list.h"
 #include "../containers/dynarray.h"
+#include "../containers/string_builder.h"
 #include "../containers/string.h"
 #include "../containers/ptr.h"
 #include "../containers/ref.h"
@@ -90,6 +97,15 @@ static char *get_sprintf_buffer() {
   #include "glut_specific.h"
 #endif
 
+#if !defined(__GENERIC__)
+  // generic.h includes these before its software GL
+  #include "thread_pool.h"
+  #include "profiler.h"
+#endif
+
+// optional counting of GL calls, see gl_trace.h
+#include "gl_trace.h"
+
 #include "../math/scalar.h"
 #include "../math/rational.h"
 #include "../math/vec2.h"
@@ -103,6 +119,9 @@ static char *get_sprintf_buffer() {
 #include "../math/bvec4.h"
 #include "../math/aabb.h"
 #include "../math/ray.h"
+#include "../math/frustum.h"
+#include "../math/bvh.h"
+#include "../math/triangle_block.h"
 #include "../math/random.h"
 
 // CG, GLSL, C++ compiler
@@ -122,11 +141,14 @@ static char *get_sprintf_buffer() {
 #include "../loaders/gif_decoder.h"
 #include "../loaders/jpeg_decoder.h"
 #include "../loaders/jpeg_encoder.h"
+#include "../loaders/tga_encoder.h"
 #include "../loaders/tga_decoder.h"
 #include "../loaders/dds_decoder.h"
 
 // resources
+#include "../resources/mapped_file.h"
 #include "../resources/zip_file.h"
+#include "../resources/gl_state.h"
 #include "../resources/app_utils.h"
 #include "../resources/visitor.h"
 #include "../resources/binary_writer.h"
@@ -138,11 +160,13 @@ static char *get_sprintf_buffer() {
 #include "../resources/gl_resource.h"
 #include "../resources/bitmap_font.h"
 #include "../resources/mesh_builder.h"
+#include "../resources/texture_atlas.h"
 
 // shaders
 #include "../shaders/shader.h"
 #include "../shaders/color_shader.h"
 #include "../shaders/texture_shader.h"
+#include "../shaders/atlas_shader.h"
 #include "../shaders/phong_shader.h"
 #include "../shaders/bump_shader.h"
 
@@ -175,6 +199,7 @@ static char *get_sprintf_buffer() {
 #include "../helpers/mouse_ball.h"
 #include "../helpers/http_server.h"
 #include "../helpers/text_overlay.h"
+#include "../helpers/profiler_hud.h"
 #include "../helpers/object_picker.h"
 
 // asset loaders
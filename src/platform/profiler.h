@@ -0,0 +1,433 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Andy Thomason 2012, 2013
+//
+// Modular Framework for OpenGLES2 rendering on multiple platforms.
+//
+// Frame profiler.
+//
+// OCTET_PROFILE_SCOPE("name") times the rest of a block and
+// OCTET_PROFILE_COUNT("name", n) adds to a per-frame counter. Each thread
+// writes to its own ring buffer, so recording takes no locks. Call
+// profiler::end_frame() once a frame from the main thread.
+//
+// Recording is off until profiler::set_enabled(true); a disabled scope costs
+// one test. Build with OCTET_PROFILE 0 to remove the macros altogether.
+//
+// get_stats() may run while other threads record. It copies events and then
+// checks that their slots were not reused in the meantime, like a seqlock.
+//
+// Only the pointer of a name is kept, so use string literals.
+//
+
+#ifndef OCTET_PROFILE
+  #define OCTET_PROFILE 1
+#endif
+
+#ifndef OCTET_THREAD_LOCAL
+  #if defined(_MSC_VER)
+    #define OCTET_THREAD_LOCAL __declspec(thread)
+  #else
+    #define OCTET_THREAD_LOCAL __thread
+  #endif
+#endif
+
+namespace octet {
+  class profiler {
+  public:
+    enum {
+      max_threads = 64,
+      max_events = 1 << 15, // per thread, must be a power of two
+      max_frames = 128,     // frames of history, must be a power of two
+      max_names = 256,      // distinct names reported by get_stats()
+      max_counters = 32,    // distinct counters per thread per frame
+      read_batch = 64,      // events copied by get_stats() between checks
+    };
+
+    enum kind_t { kind_scope, kind_counter };
+
+    struct event_t {
+      const char *name;
+      double start;
+      float value;   // seconds for a scope, the amount for a counter
+      uint16_t kind;
+      uint16_t depth;
+      unsigned frame;
+    };
+
+    // one name over the recent frames. times are in ms per frame.
+    struct stat_t {
+      const char *name;
+      unsigned kind;
+      unsigned depth;
+      float average;
+      float p50;
+      float p95;
+      float max;
+    };
+
+  private:
+    struct counter_t {
+      const char *name;
+      float value;
+    };
+
+    struct thread_t {
+      event_t events[max_events];
+      volatile int num_written;  // events ever written, the newest is at num_written-1
+      unsigned depth;
+
+      // counters are summed over a frame and written as one event each
+      counter_t counters[max_counters];
+      unsigned num_counters;
+      unsigned counter_frame;
+    };
+
+    struct state_t {
+      bool enabled;
+      volatile int num_threads;
+      thread_t *threads[max_threads];
+      volatile unsigned frame;  // number of the frame being recorded
+      double frame_start;
+    };
+
+    static state_t &state() {
+      static state_t s;
+      return s;
+    }
+
+    // the ring of this thread, made on first use. NULL if there are too many threads.
+    static thread_t *get_thread() {
+      static OCTET_THREAD_LOCAL thread_t *thread;
+      static OCTET_THREAD_LOCAL bool refused;
+      if (!thread && !refused) {
+        state_t &s = state();
+        int index = thread_pool::atomic_add(&s.num_threads, 1);
+        if (index >= max_threads) {
+          thread_pool::atomic_add(&s.num_threads, -1);
+          refused = true;
+          return NULL;
+        }
+        thread = (thread_t*)calloc(1, sizeof(thread_t));
+        s.threads[index] = thread;
+      }
+      return thread;
+    }
+
+    static void write_event(thread_t *thread, const char *name, double start, float value, unsigned kind, unsigned depth, unsigned frame) {
+      event_t &e = thread->events[thread->num_written & (max_events-1)];
+      e.name = name;
+      e.start = start;
+      e.value = value;
+      e.kind = (uint16_t)kind;
+      e.depth = (uint16_t)depth;
+      e.frame = frame;
+      // publishes the event to readers on other threads
+      thread_pool::atomic_add(&thread->num_written, 1);
+    }
+
+    static void flush_counters(thread_t *thread) {
+      double now = get_time();
+      for (unsigned i = 0; i != thread->num_counters; ++i) {
+        const counter_t &c = thread->counters[i];
+        write_event(thread, c.name, now, c.value, kind_counter, 0, thread->counter_frame);
+      }
+      thread->num_counters = 0;
+    }
+
+    // events written by a thread, with a full barrier so that events read
+    // before this call were read before it
+    static unsigned get_num_written(thread_t *thread) {
+      return (unsigned)thread_pool::atomic_add(&thread->num_written, 0);
+    }
+
+    // the recorded part of a ring, oldest first
+    static void get_range(thread_t *thread, unsigned &first, unsigned &last) {
+      last = get_num_written(thread);
+      first = last > max_events ? last - max_events : 0;
+    }
+
+    static int compare_float(const void *a, const void *b) {
+      float fa = *(const float*)a, fb = *(const float*)b;
+      return fa < fb ? -1 : fa > fb ? 1 : 0;
+    }
+
+    static int compare_stat(const void *a, const void *b) {
+      const stat_t *sa = (const stat_t*)a, *sb = (const stat_t*)b;
+      if (sa->kind != sb->kind) return sa->kind < sb->kind ? -1 : 1;
+      return sa->average > sb->average ? -1 : sa->average < sb->average ? 1 : 0;
+    }
+
+    static void write_name(FILE *file, const char *name) {
+      putc('"', file);
+      for (const char *p = name; *p; ++p) {
+        if (*p == '"' || *p == '\\') putc('\\', file);
+        if ((unsigned char)*p >= 0x20) putc(*p, file);
+      }
+      putc('"', file);
+    }
+
+  public:
+    // seconds from an arbitrary start
+    static double get_time() {
+      #if defined(_WIN32) && !defined(__GENERIC__)
+        LARGE_INTEGER count, freq;
+        QueryPerformanceCounter(&count);
+        QueryPerformanceFrequency(&freq);
+        return (double)count.QuadPart / (double)freq.QuadPart;
+      #elif defined(_WIN32) || defined(SN_TARGET_PSP2)
+        return (double)clock() / CLOCKS_PER_SEC;
+      #else
+        timespec t;
+        clock_gettime(CLOCK_MONOTONIC, &t);
+        return t.tv_sec + t.tv_nsec * 1e-9;
+      #endif
+    }
+
+    static bool is_enabled() {
+      return state().enabled;
+    }
+
+    static void set_enabled(bool value) {
+      state_t &s = state();
+      if (value && !s.enabled) s.frame_start = get_time();
+      s.enabled = value;
+    }
+
+    // number of the frame being recorded
+    static unsigned get_frame() {
+      return state().frame;
+    }
+
+    // start a scope, returns the start time
+    static double begin_scope() {
+      thread_t *thread = get_thread();
+      if (thread) thread->depth++;
+      return get_time();
+    }
+
+    static void end_scope(const char *name, double start) {
+      double end = get_time();
+      thread_t *thread = get_thread();
+      if (!thread) return;
+      thread->depth--;
+      write_event(thread, name, start, (float)(end - start), kind_scope, thread->depth, state().frame);
+    }
+
+    static void add_count(const char *name, float value) {
+      state_t &s = state();
+      if (!s.enabled) return;
+      thread_t *thread = get_thread();
+      if (!thread) return;
+      if (thread->counter_frame != s.frame) {
+        // a thread's counters for a frame go out on its first count of a later frame
+        flush_counters(thread);
+        thread->counter_frame = s.frame;
+      }
+      for (unsigned i = 0; i != thread->num_counters; ++i) {
+        if (thread->counters[i].name == name) {
+          thread->counters[i].value += value;
+          return;
+        }
+      }
+      if (thread->num_counters == max_counters) {
+        write_event(thread, name, get_time(), value, kind_counter, 0, s.frame);
+      } else {
+        counter_t &c = thread->counters[thread->num_counters++];
+        c.name = name;
+        c.value = value;
+      }
+    }
+
+    // close the current frame as a "frame" scope and start the next
+    static void end_frame() {
+      state_t &s = state();
+      if (!s.enabled) return;
+      double now = get_time();
+      thread_t *thread = get_thread();
+      if (thread) {
+        if (thread->counter_frame == s.frame) flush_counters(thread);
+        write_event(thread, "frame", s.frame_start, (float)(now - s.frame_start), kind_scope, 0, s.frame);
+      }
+      s.frame_start = now;
+      s.frame++;
+    }
+
+    // averages and percentiles over the last num_frames finished frames.
+    // frames whose events have left a thread's ring are not counted, so fewer
+    // frames may be used.
+    static void get_stats(dynarray<stat_t> &result, unsigned num_frames = 60) {
+      state_t &s = state();
+      result.resize(0);
+      unsigned end_frame = s.frame;
+      if (num_frames > max_frames) num_frames = max_frames;
+      if (num_frames > end_frame) num_frames = end_frame;
+      if (num_frames == 0) return;
+      unsigned first_frame = end_frame - num_frames;
+
+      // frames before this one are missing events of some thread
+      unsigned complete_frame = first_frame;
+
+      // per frame totals of each name
+      hash_map<void *, unsigned> names;
+      dynarray<float> totals;
+      event_t batch[read_batch];
+      for (int t = 0; t != s.num_threads; ++t) {
+        thread_t *thread = s.threads[t];
+        if (!thread) continue;
+        unsigned first, last;
+        get_range(thread, first, last);
+        unsigned i = last;
+        unsigned oldest_frame = end_frame;
+        bool done = false;
+        bool lost = false;
+        while (i != first && !done) {
+          // copy newest first, then check that the writer has not started on
+          // any of the slots since
+          unsigned n = i - first < read_batch ? i - first : read_batch;
+          for (unsigned j = 0; j != n; ++j) {
+            batch[j] = thread->events[(i-1-j) & (max_events-1)];
+          }
+          unsigned written = get_num_written(thread);
+          for (unsigned j = 0; j != n && !done; ++j, --i) {
+            if (written - (i-1) >= max_events) {
+              lost = done = true;
+              break;
+            }
+            const event_t &e = batch[j];
+            if (e.frame < first_frame) {
+              done = true;
+              break;
+            }
+            oldest_frame = e.frame;
+            if (e.frame >= end_frame) continue;
+            unsigned *found = names.find((void*)e.name);
+            unsigned slot;
+            if (found) {
+              slot = *found;
+            } else {
+              if (result.size() == max_names) continue;
+              slot = result.size();
+              names[(void*)e.name] = slot;
+              stat_t st = { e.name, e.kind, e.depth, 0, 0, 0, 0 };
+              result.push_back(st);
+              totals.resize((slot + 1) * num_frames);
+              memset(&totals[slot * num_frames], 0, sizeof(float) * num_frames);
+            }
+            if (e.depth < result[slot].depth) result[slot].depth = e.depth;
+            float value = e.kind == kind_scope ? e.value * 1000.0f : e.value;
+            totals[slot * num_frames + e.frame - first_frame] += value;
+          }
+        }
+
+        // the ring ran out before first_frame, the oldest frame seen may be partial
+        bool ran_out = lost || (i == first && first != 0 && !done);
+        if (ran_out && oldest_frame + 1 > complete_frame) {
+          complete_frame = oldest_frame + 1;
+        }
+      }
+
+      if (complete_frame >= end_frame) {
+        result.resize(0);
+        return;
+      }
+      unsigned skip = complete_frame - first_frame;
+      unsigned num_used = num_frames - skip;
+      for (unsigned i = 0; i != result.size(); ++i) {
+        float *values = &totals[i * num_frames + skip];
+        float sum = 0;
+        for (unsigned j = 0; j != num_used; ++j) sum += values[j];
+        qsort(values, num_used, sizeof(float), compare_float);
+        stat_t &st = result[i];
+        st.average = sum / num_used;
+        st.p50 = values[num_used / 2];
+        st.p95 = values[(num_used * 95) / 100 < num_used ? (num_used * 95) / 100 : num_used - 1];
+        st.max = values[num_used - 1];
+      }
+      if (result.size()) qsort(&result[0], result.size(), sizeof(stat_t), compare_stat);
+    }
+
+    // write the history as Chrome trace events (chrome://tracing, ui.perfetto.dev).
+    // other threads should be idle, e.g. between frames.
+    static bool write_chrome_trace(const char *url) {
+      FILE *file = fopen(url, "wb");
+      if (!file) {
+        printf("warning: could not write %s\n", url);
+        return false;
+      }
+      state_t &s = state();
+
+      // times are relative to the oldest event
+      double base = 1e30;
+      for (int t = 0; t != s.num_threads; ++t) {
+        thread_t *thread = s.threads[t];
+        if (!thread) continue;
+        unsigned first, last;
+        get_range(thread, first, last);
+        for (unsigned i = first; i != last; ++i) {
+          double start = thread->events[i & (max_events-1)].start;
+          if (start < base) base = start;
+        }
+      }
+
+      fprintf(file, "{\"traceEvents\":[\n");
+      const char *sep = "";
+      for (int t = 0; t != s.num_threads; ++t) {
+        thread_t *thread = s.threads[t];
+        if (!thread) continue;
+        fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"thread %d\"}}", sep, t, t);
+        sep = ",\n";
+        unsigned first, last;
+        get_range(thread, first, last);
+        for (unsigned i = first; i != last; ++i) {
+          const event_t &e = thread->events[i & (max_events-1)];
+          double ts = (e.start - base) * 1e6;
+          fprintf(file, "%s{\"name\":", sep);
+          write_name(file, e.name);
+          if (e.kind == kind_scope) {
+            fprintf(file, ",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"frame\":%u}}", t, ts, e.value * 1e6, e.frame);
+          } else {
+            fprintf(file, ",\"ph\":\"C\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"args\":{\"value\":%g}}", t, ts, e.value);
+          }
+        }
+      }
+      fprintf(file, "\n]}\n");
+      fclose(file);
+      return true;
+    }
+
+    // forget the history
+    static void reset() {
+      state_t &s = state();
+      for (int t = 0; t != s.num_threads; ++t) {
+        if (s.threads[t]) s.threads[t]->num_written = 0;
+      }
+      s.frame_start = get_time();
+    }
+  };
+
+  // times its lifetime if the profiler was enabled when it started
+  class profile_scope {
+    const char *name;
+    double start;
+  public:
+    profile_scope(const char *name) {
+      this->name = profiler::is_enabled() ? name : 0;
+      if (this->name) start = profiler::begin_scope();
+    }
+
+    ~profile_scope() {
+      if (name) profiler::end_scope(name, start);
+    }
+  };
+}
+
+#if OCTET_PROFILE
+  #define OCTET_PROFILE_CONCAT2(A, B) A##B
+  #define OCTET_PROFILE_CONCAT(A, B) OCTET_PROFILE_CONCAT2(A, B)
+  #define OCTET_PROFILE_SCOPE(NAME) octet::profile_scope OCTET_PROFILE_CONCAT(profile_scope_, __LINE__)(NAME)
+  #define OCTET_PROFILE_COUNT(NAME, VALUE) (octet::profiler::is_enabled() ? octet::profiler::add_count(NAME, (float)(VALUE)) : (void)0)
+#else
+  #define OCTET_PROFILE_SCOPE(NAME) ((void)0)
+  #define OCTET_PROFILE_COUNT(NAME, VALUE) ((void)0)
+#endif
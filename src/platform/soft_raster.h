@@ -0,0 +1,722 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Andy Thomason 2012, 2013
+//
+// Modular Framework for OpenGLES2 rendering on multiple platforms.
+//
+// Tile based software rasteriser used by gl_skeleton.h
+//
+// Triangles arrive in clip space with their varyings and the state of the
+// draw they belong to. They are clipped, set up in 1/16 pixel fixed point
+// and binned into 64x64 pixel tiles. flush() shades the tiles on all threads
+// of the default thread_pool; each tile keeps the order of submission, so
+// depth test and blending give the same result as drawing serially.
+//
+// There is no shader compiler. Each draw carries one of the shading models
+// of octet's stock shaders, chosen by gl_skeleton when a program is linked.
+//
+// The framebuffer is RGBA8 with a float depth buffer, row 0 at the bottom.
+//
+
+namespace octet {
+  class soft_raster {
+  public:
+    enum {
+      tile_shift = 6,
+      tile_size = 1 << tile_shift,
+      subpixel_bits = 4,
+      max_varyings = 8,
+      max_textures = 6,
+      max_lights = 4,
+
+      // flush when this many triangles are waiting
+      max_queued_triangles = 1 << 20,
+    };
+
+    enum shading_t {
+      shading_flat,     // one color, as color_shader
+      shading_texture,  // one texture, as texture_shader and atlas_shader
+      shading_bump,     // material textures lit by light_uniforms, as bump_shader
+      shading_phong,    // material textures lit by one light, as phong_shader
+    };
+
+    // level 0 of a 2D texture as RGBA8
+    struct texture {
+      unsigned width;
+      unsigned height;
+      dynarray<uint32_t> pixels;
+      unsigned wrap_s;
+      unsigned wrap_t;
+      unsigned min_filter;
+      unsigned mag_filter;
+
+      texture() {
+        width = height = 0;
+        wrap_s = wrap_t = GL_REPEAT;
+        min_filter = GL_NEAREST_MIPMAP_LINEAR;
+        mag_filter = GL_LINEAR;
+      }
+
+      // copy a rectangle of unsigned byte pixels in a GL format
+      bool set_pixels(unsigned x, unsigned y, unsigned w, unsigned h, unsigned format, const uint8_t *src, unsigned alignment) {
+        unsigned bpp = 0;
+        switch (format) {
+          case GL_RGBA: bpp = 4; break;
+          case GL_RGB: bpp = 3; break;
+          case GL_LUMINANCE_ALPHA: bpp = 2; break;
+          case GL_LUMINANCE: case GL_ALPHA: bpp = 1; break;
+          default: return false;
+        }
+        if (!src || x + w > width || y + h > height) return false;
+
+        unsigned stride = (w * bpp + alignment - 1) & ~(alignment - 1);
+        for (unsigned j = 0; j != h; ++j) {
+          const uint8_t *s = src + j * stride;
+          uint32_t *d = &pixels[(y + j) * width + x];
+          for (unsigned i = 0; i != w; ++i, s += bpp) {
+            switch (format) {
+              case GL_RGBA: d[i] = s[0] | (s[1] << 8) | (s[2] << 16) | (s[3] << 24); break;
+              case GL_RGB: d[i] = s[0] | (s[1] << 8) | (s[2] << 16) | 0xff000000; break;
+              case GL_LUMINANCE_ALPHA: d[i] = s[0] * 0x010101 | (s[1] << 24); break;
+              case GL_LUMINANCE: d[i] = s[0] * 0x010101 | 0xff000000; break;
+              case GL_ALPHA: d[i] = s[0] << 24; break;
+            }
+          }
+        }
+        return true;
+      }
+
+      void set_size(unsigned w, unsigned h) {
+        width = w;
+        height = h;
+        pixels.resize(w * h);
+      }
+
+      static int wrap(int i, int size, unsigned mode) {
+        if (mode == GL_CLAMP_TO_EDGE) {
+          return i < 0 ? 0 : i >= size ? size - 1 : i;
+        } else if (mode == GL_MIRRORED_REPEAT) {
+          int period = size * 2;
+          i %= period;
+          if (i < 0) i += period;
+          return i < size ? i : period - 1 - i;
+        } else {
+          i %= size;
+          return i < 0 ? i + size : i;
+        }
+      }
+
+      static void unpack(uint32_t texel, float *rgba) {
+        static const float scale = 1.0f / 255;
+        rgba[0] = (texel & 0xff) * scale;
+        rgba[1] = ((texel >> 8) & 0xff) * scale;
+        rgba[2] = ((texel >> 16) & 0xff) * scale;
+        rgba[3] = (texel >> 24) * scale;
+      }
+
+      // sample at (u, v). There are no mip levels, so minification uses the
+      // magnification filter.
+      void sample(float u, float v, float *rgba) const {
+        if (!width || !height) {
+          rgba[0] = rgba[1] = rgba[2] = 0; rgba[3] = 1;
+          return;
+        }
+
+        // keep the integer conversions in range
+        u = u < -1e6f ? -1e6f : u > 1e6f ? 1e6f : u;
+        v = v < -1e6f ? -1e6f : v > 1e6f ? 1e6f : v;
+
+        if (mag_filter == GL_NEAREST) {
+          int x = wrap((int)floorf(u * width), width, wrap_s);
+          int y = wrap((int)floorf(v * height), height, wrap_t);
+          unpack(pixels[y * width + x], rgba);
+          return;
+        }
+
+        float fx = u * width - 0.5f, fy = v * height - 0.5f;
+        float flx = floorf(fx), fly = floorf(fy);
+        fx -= flx;
+        fy -= fly;
+        int x0 = wrap((int)flx, width, wrap_s), x1 = wrap((int)flx + 1, width, wrap_s);
+        int y0 = wrap((int)fly, height, wrap_t), y1 = wrap((int)fly + 1, height, wrap_t);
+
+        float c00[4], c10[4], c01[4], c11[4];
+        unpack(pixels[y0 * width + x0], c00);
+        unpack(pixels[y0 * width + x1], c10);
+        unpack(pixels[y1 * width + x0], c01);
+        unpack(pixels[y1 * width + x1], c11);
+        for (unsigned i = 0; i != 4; ++i) {
+          float top = c00[i] + (c10[i] - c00[i]) * fx;
+          float bottom = c01[i] + (c11[i] - c01[i]) * fx;
+          rgba[i] = top + (bottom - top) * fy;
+        }
+      }
+    };
+
+    // everything a draw needs, copied when the draw is made
+    struct draw_state {
+      shading_t shading;
+      unsigned num_varyings;
+      const texture *textures[max_textures];
+
+      // shading_flat
+      float color[4];
+
+      // shading_texture: uv_wrap < 0 uses the texture's wrap modes,
+      // otherwise uvs are clamped (0) or repeated (1) inside uv_rect
+      float uv_rect[4];
+      int uv_wrap;
+
+      // shading_bump and shading_phong, camera space
+      float ambient[4];
+      unsigned num_lights;
+      float light_direction[max_lights][4];
+      float light_color[max_lights][4];
+      float light_specular[4];
+      float shininess;
+
+      // triangle setup
+      int viewport[4];
+      float depth_range[2];
+      bool cull;
+      unsigned cull_face;
+      unsigned front_face;
+
+      // per fragment
+      bool scissor_test;
+      int scissor[4];
+      bool depth_test;
+      bool depth_write;
+      unsigned depth_func;
+      bool blend;
+      unsigned blend_equation_rgb;
+      unsigned blend_equation_alpha;
+      unsigned src_rgb;
+      unsigned dst_rgb;
+      unsigned src_alpha;
+      unsigned dst_alpha;
+      float blend_color[4];
+      uint32_t color_mask;
+    };
+
+    // a vertex in clip space
+    struct vertex {
+      float pos[4];
+      float varyings[max_varyings];
+    };
+
+  private:
+    // a triangle after setup
+    struct triangle {
+      int x[3];
+      int y[3];
+      float z[3];
+      float inv_w[3];
+
+      // varyings divided by w
+      float varyings[3][max_varyings];
+
+      int min_x, min_y, max_x, max_y;
+      float inv_area;
+      unsigned draw;
+    };
+
+    struct tile_t {
+      dynarray<unsigned> triangles;
+    };
+
+    unsigned width;
+    unsigned height;
+    dynarray<uint32_t> color_buffer;
+    dynarray<float> depth_buffer;
+
+    unsigned tiles_x;
+    unsigned tiles_y;
+    tile_t *tiles;
+
+    dynarray<draw_state> draws;
+    dynarray<triangle> triangles;
+
+    unsigned num_triangles_drawn;
+
+    static bool depth_pass(unsigned func, float z, float d) {
+      switch (func) {
+        case GL_NEVER: return false;
+        case GL_LESS: return z < d;
+        case GL_EQUAL: return z == d;
+        case GL_LEQUAL: return z <= d;
+        case GL_GREATER: return z > d;
+        case GL_NOTEQUAL: return z != d;
+        case GL_GEQUAL: return z >= d;
+        default: return true;
+      }
+    }
+
+    static float blend_factor(unsigned factor, const float *src, const float *dst, const float *constant, unsigned c) {
+      switch (factor) {
+        case GL_ZERO: return 0;
+        case GL_ONE: return 1;
+        case GL_SRC_COLOR: return src[c];
+        case GL_ONE_MINUS_SRC_COLOR: return 1 - src[c];
+        case GL_DST_COLOR: return dst[c];
+        case GL_ONE_MINUS_DST_COLOR: return 1 - dst[c];
+        case GL_SRC_ALPHA: return src[3];
+        case GL_ONE_MINUS_SRC_ALPHA: return 1 - src[3];
+        case GL_DST_ALPHA: return dst[3];
+        case GL_ONE_MINUS_DST_ALPHA: return 1 - dst[3];
+        case GL_CONSTANT_COLOR: return constant[c];
+        case GL_ONE_MINUS_CONSTANT_COLOR: return 1 - constant[c];
+        case GL_CONSTANT_ALPHA: return constant[3];
+        case GL_ONE_MINUS_CONSTANT_ALPHA: return 1 - constant[3];
+        case GL_SRC_ALPHA_SATURATE: {
+          if (c == 3) return 1;
+          float f = 1 - dst[3];
+          return src[3] < f ? src[3] : f;
+        }
+        default: return 1;
+      }
+    }
+
+    static float blend_equation(unsigned equation, float s, float d) {
+      switch (equation) {
+        case GL_FUNC_SUBTRACT: return s - d;
+        case GL_FUNC_REVERSE_SUBTRACT: return d - s;
+        default: return s + d;
+      }
+    }
+
+    static void sample(const texture *tex, float u, float v, float *rgba) {
+      if (tex) {
+        tex->sample(u, v, rgba);
+      } else {
+        rgba[0] = rgba[1] = rgba[2] = 0; rgba[3] = 1;
+      }
+    }
+
+    // the fragment shaders
+    static void shade(const draw_state &ds, const float *v, float *out) {
+      switch (ds.shading) {
+        case shading_flat: {
+          out[0] = ds.color[0]; out[1] = ds.color[1]; out[2] = ds.color[2]; out[3] = ds.color[3];
+        } break;
+        case shading_texture: {
+          float u = v[0], w = v[1];
+          if (ds.uv_wrap > 0) {
+            u -= floorf(u);
+            w -= floorf(w);
+          } else if (ds.uv_wrap == 0) {
+            u = u < 0 ? 0 : u > 1 ? 1 : u;
+            w = w < 0 ? 0 : w > 1 ? 1 : w;
+          }
+          sample(ds.textures[0], ds.uv_rect[0] + u * ds.uv_rect[2], ds.uv_rect[1] + w * ds.uv_rect[3], out);
+        } break;
+        case shading_bump: {
+          const float *n = v + 2;
+          float tex[4];
+          sample(ds.textures[5], v[0], v[1], tex);
+          float shininess = tex[0] * 255.0f;
+
+          float diffuse_light[3] = { 0.3f, 0.3f, 0.3f };
+          float specular_light[3] = { 0, 0, 0 };
+          for (unsigned i = 0; i != ds.num_lights; ++i) {
+            const float *dir = ds.light_direction[i];
+            const float *col = ds.light_color[i];
+            float h[3] = { dir[0], dir[1], dir[2] + 1 };
+            float hlen = sqrtf(h[0] * h[0] + h[1] * h[1] + h[2] * h[2]);
+            float hdotn = hlen > 0 ? (h[0] * n[0] + h[1] * n[1] + h[2] * n[2]) / hlen : 0;
+            float diffuse_factor = dir[0] * n[0] + dir[1] * n[1] + dir[2] * n[2];
+            diffuse_factor = diffuse_factor > 0 ? diffuse_factor : 0;
+            float specular_factor = powf(hdotn > 0 ? hdotn : 0, shininess) * diffuse_factor;
+            for (unsigned c = 0; c != 3; ++c) {
+              diffuse_light[c] += diffuse_factor * col[c];
+              specular_light[c] += specular_factor * col[c];
+            }
+          }
+
+          float diffuse[4], ambient[4], emission[4], specular[4];
+          sample(ds.textures[0], v[0], v[1], diffuse);
+          sample(ds.textures[1], v[0], v[1], ambient);
+          sample(ds.textures[2], v[0], v[1], emission);
+          sample(ds.textures[3], v[0], v[1], specular);
+          for (unsigned c = 0; c != 3; ++c) {
+            out[c] = ds.ambient[c] * ambient[c] + diffuse_light[c] * diffuse[c] + emission[c] + specular_light[c] * specular[c];
+          }
+          out[3] = diffuse[3];
+        } break;
+        case shading_phong: {
+          float n[3] = { v[2], v[3], v[4] };
+          float len = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+          if (len > 0) { n[0] /= len; n[1] /= len; n[2] /= len; }
+
+          const float *dir = ds.light_direction[0];
+          float h[3] = { dir[0], dir[1], dir[2] + 1 };
+          float hlen = sqrtf(h[0] * h[0] + h[1] * h[1] + h[2] * h[2]);
+          float hdotn = hlen > 0 ? (h[0] * n[0] + h[1] * n[1] + h[2] * n[2]) / hlen : 0;
+          float diffuse_factor = dir[0] * n[0] + dir[1] * n[1] + dir[2] * n[2];
+          diffuse_factor = diffuse_factor > 0 ? diffuse_factor : 0;
+          float specular_factor = powf(hdotn > 0 ? hdotn : 0, ds.shininess);
+
+          float diffuse[4], ambient[4], emission[4], specular[4];
+          sample(ds.textures[0], v[0], v[1], diffuse);
+          sample(ds.textures[1], v[0], v[1], ambient);
+          sample(ds.textures[2], v[0], v[1], emission);
+          sample(ds.textures[3], v[0], v[1], specular);
+          for (unsigned c = 0; c != 4; ++c) {
+            out[c] =
+              ambient[c] * ds.ambient[c] +
+              diffuse[c] * ds.light_color[0][c] * diffuse_factor +
+              emission[c] +
+              specular[c] * ds.light_specular[c] * specular_factor
+            ;
+          }
+        } break;
+      }
+    }
+
+    // rasterise the binned triangles of one tile in order
+    void shade_tile(unsigned index) {
+      tile_t &tile = tiles[index];
+      int tile_x0 = (index % tiles_x) << tile_shift;
+      int tile_y0 = (index / tiles_x) << tile_shift;
+      int tile_x1 = tile_x0 + tile_size - 1;
+      int tile_y1 = tile_y0 + tile_size - 1;
+      if (tile_x1 >= (int)width) tile_x1 = width - 1;
+      if (tile_y1 >= (int)height) tile_y1 = height - 1;
+
+      for (unsigned t = 0; t != tile.triangles.size(); ++t) {
+        const triangle &tri = triangles[tile.triangles[t]];
+        const draw_state &ds = draws[tri.draw];
+
+        int x0 = tri.min_x > tile_x0 ? tri.min_x : tile_x0;
+        int y0 = tri.min_y > tile_y0 ? tri.min_y : tile_y0;
+        int x1 = tri.max_x < tile_x1 ? tri.max_x : tile_x1;
+        int y1 = tri.max_y < tile_y1 ? tri.max_y : tile_y1;
+        if (x0 > x1 || y0 > y1) continue;
+
+        // edge k is opposite vertex k and is positive inside the triangle
+        int64_t row[3], step_x[3], step_y[3];
+        int64_t px = ((int64_t)x0 << subpixel_bits) + (1 << (subpixel_bits - 1));
+        int64_t py = ((int64_t)y0 << subpixel_bits) + (1 << (subpixel_bits - 1));
+        for (unsigned k = 0; k != 3; ++k) {
+          unsigned a = k == 2 ? 0 : k + 1, b = a == 2 ? 0 : a + 1;
+          int64_t dx = tri.x[b] - tri.x[a], dy = tri.y[b] - tri.y[a];
+          row[k] = dx * (py - tri.y[a]) - dy * (px - tri.x[a]);
+          // top-left rule: pixel centres exactly on other edges belong to the neighbour
+          if (!(dy < 0 || (dy == 0 && dx < 0))) row[k]--;
+          step_x[k] = -dy << subpixel_bits;
+          step_y[k] = dx << subpixel_bits;
+        }
+
+        for (int y = y0; y <= y1; ++y) {
+          int64_t e0 = row[0], e1 = row[1], e2 = row[2];
+          uint32_t *color = &color_buffer[y * width];
+          float *depth = &depth_buffer[y * width];
+          for (int x = x0; x <= x1; ++x, e0 += step_x[0], e1 += step_x[1], e2 += step_x[2]) {
+            if ((e0 | e1 | e2) < 0) continue;
+
+            float b0 = (float)e0 * tri.inv_area;
+            float b1 = (float)e1 * tri.inv_area;
+            float b2 = 1.0f - b0 - b1;
+
+            float z = tri.z[0] * b0 + tri.z[1] * b1 + tri.z[2] * b2;
+            if (ds.depth_test) {
+              if (!depth_pass(ds.depth_func, z, depth[x])) continue;
+              if (ds.depth_write) depth[x] = z;
+            }
+
+            // perspective correct varyings
+            float w = 1.0f / (tri.inv_w[0] * b0 + tri.inv_w[1] * b1 + tri.inv_w[2] * b2);
+            float v[max_varyings];
+            for (unsigned i = 0; i != ds.num_varyings; ++i) {
+              v[i] = (tri.varyings[0][i] * b0 + tri.varyings[1][i] * b1 + tri.varyings[2][i] * b2) * w;
+            }
+
+            float src[4];
+            shade(ds, v, src);
+            for (unsigned c = 0; c != 4; ++c) {
+              src[c] = src[c] < 0 ? 0 : src[c] > 1 ? 1 : src[c];
+            }
+
+            if (ds.blend) {
+              float dst[4];
+              texture::unpack(color[x], dst);
+              float result[4];
+              for (unsigned c = 0; c != 4; ++c) {
+                unsigned sf = c == 3 ? ds.src_alpha : ds.src_rgb;
+                unsigned df = c == 3 ? ds.dst_alpha : ds.dst_rgb;
+                unsigned eq = c == 3 ? ds.blend_equation_alpha : ds.blend_equation_rgb;
+                float r = blend_equation(eq, src[c] * blend_factor(sf, src, dst, ds.blend_color, c), dst[c] * blend_factor(df, src, dst, ds.blend_color, c));
+                result[c] = r < 0 ? 0 : r > 1 ? 1 : r;
+              }
+              memcpy(src, result, sizeof(src));
+            }
+
+            uint32_t packed =
+              (uint32_t)(src[0] * 255.0f + 0.5f) |
+              ((uint32_t)(src[1] * 255.0f + 0.5f) << 8) |
+              ((uint32_t)(src[2] * 255.0f + 0.5f) << 16) |
+              ((uint32_t)(src[3] * 255.0f + 0.5f) << 24)
+            ;
+            color[x] = (packed & ds.color_mask) | (color[x] & ~ds.color_mask);
+          }
+          row[0] += step_y[0];
+          row[1] += step_y[1];
+          row[2] += step_y[2];
+        }
+      }
+      tile.triangles.resize(0);
+    }
+
+    static void shade_tile_task(void *context, unsigned index, unsigned thread) {
+      OCTET_PROFILE_SCOPE("raster tile");
+      ((soft_raster*)context)->shade_tile(index);
+    }
+
+    // clip against one plane of the frustum, dist = w + sign * pos[axis]
+    static unsigned clip_polygon(vertex *dest, const vertex *src, unsigned num, unsigned axis, float sign, unsigned num_varyings) {
+      unsigned num_out = 0;
+      for (unsigned i = 0; i != num; ++i) {
+        const vertex &a = src[i];
+        const vertex &b = src[i + 1 == num ? 0 : i + 1];
+        float da = a.pos[3] + sign * a.pos[axis];
+        float db = b.pos[3] + sign * b.pos[axis];
+        if (da >= 0) dest[num_out++] = a;
+        if ((da >= 0) != (db >= 0)) {
+          float t = da / (da - db);
+          vertex &v = dest[num_out++];
+          for (unsigned j = 0; j != 4; ++j) v.pos[j] = a.pos[j] + (b.pos[j] - a.pos[j]) * t;
+          for (unsigned j = 0; j != num_varyings; ++j) v.varyings[j] = a.varyings[j] + (b.varyings[j] - a.varyings[j]) * t;
+        }
+      }
+      return num_out;
+    }
+
+    static unsigned outcode(const vertex &v) {
+      unsigned code = 0;
+      for (unsigned axis = 0; axis != 3; ++axis) {
+        if (v.pos[3] + v.pos[axis] < 0) code |= 1 << (axis * 2);
+        if (v.pos[3] - v.pos[axis] < 0) code |= 2 << (axis * 2);
+      }
+      return code;
+    }
+
+    // project, cull and bin a triangle that is inside the frustum
+    void setup(const vertex *v0, const vertex *v1, const vertex *v2) {
+      const draw_state &ds = draws.back();
+      const vertex *v[3] = { v0, v1, v2 };
+      float sx[3], sy[3], sz[3], inv_w[3];
+      int ix[3], iy[3];
+      for (unsigned i = 0; i != 3; ++i) {
+        inv_w[i] = 1.0f / v[i]->pos[3];
+        sx[i] = ds.viewport[0] + (v[i]->pos[0] * inv_w[i] + 1) * 0.5f * ds.viewport[2];
+        sy[i] = ds.viewport[1] + (v[i]->pos[1] * inv_w[i] + 1) * 0.5f * ds.viewport[3];
+        sz[i] = ds.depth_range[0] + (v[i]->pos[2] * inv_w[i] + 1) * 0.5f * (ds.depth_range[1] - ds.depth_range[0]);
+        ix[i] = (int)floorf(sx[i] * (1 << subpixel_bits) + 0.5f);
+        iy[i] = (int)floorf(sy[i] * (1 << subpixel_bits) + 0.5f);
+      }
+
+      int64_t area = (int64_t)(ix[1] - ix[0]) * (iy[2] - iy[0]) - (int64_t)(ix[2] - ix[0]) * (iy[1] - iy[0]);
+      if (area == 0) return;
+
+      bool is_front = (area > 0) == (ds.front_face != GL_CW);
+      if (ds.cull) {
+        if (ds.cull_face == GL_FRONT_AND_BACK) return;
+        if (ds.cull_face == GL_FRONT ? is_front : !is_front) return;
+      }
+
+      // make the triangle anticlockwise
+      unsigned order[3] = { 0, 1, 2 };
+      if (area < 0) {
+        order[1] = 2;
+        order[2] = 1;
+        area = -area;
+      }
+
+      // pixel centres inside the bounding box, the viewport, the framebuffer and the scissor
+      int min_sx = ix[0] < ix[1] ? ix[0] : ix[1]; min_sx = min_sx < ix[2] ? min_sx : ix[2];
+      int max_sx = ix[0] > ix[1] ? ix[0] : ix[1]; max_sx = max_sx > ix[2] ? max_sx : ix[2];
+      int min_sy = iy[0] < iy[1] ? iy[0] : iy[1]; min_sy = min_sy < iy[2] ? min_sy : iy[2];
+      int max_sy = iy[0] > iy[1] ? iy[0] : iy[1]; max_sy = max_sy > iy[2] ? max_sy : iy[2];
+      int half = 1 << (subpixel_bits - 1);
+      int min_x = (min_sx - half + (1 << subpixel_bits) - 1) >> subpixel_bits;
+      int min_y = (min_sy - half + (1 << subpixel_bits) - 1) >> subpixel_bits;
+      int max_x = (max_sx - half) >> subpixel_bits;
+      int max_y = (max_sy - half) >> subpixel_bits;
+
+      int clip[4] = { ds.viewport[0], ds.viewport[1], ds.viewport[0] + ds.viewport[2] - 1, ds.viewport[1] + ds.viewport[3] - 1 };
+      if (clip[0] < 0) clip[0] = 0;
+      if (clip[1] < 0) clip[1] = 0;
+      if (clip[2] >= (int)width) clip[2] = width - 1;
+      if (clip[3] >= (int)height) clip[3] = height - 1;
+      if (ds.scissor_test) {
+        if (clip[0] < ds.scissor[0]) clip[0] = ds.scissor[0];
+        if (clip[1] < ds.scissor[1]) clip[1] = ds.scissor[1];
+        if (clip[2] > ds.scissor[0] + ds.scissor[2] - 1) clip[2] = ds.scissor[0] + ds.scissor[2] - 1;
+        if (clip[3] > ds.scissor[1] + ds.scissor[3] - 1) clip[3] = ds.scissor[1] + ds.scissor[3] - 1;
+      }
+      if (min_x < clip[0]) min_x = clip[0];
+      if (min_y < clip[1]) min_y = clip[1];
+      if (max_x > clip[2]) max_x = clip[2];
+      if (max_y > clip[3]) max_y = clip[3];
+      if (min_x > max_x || min_y > max_y) return;
+
+      unsigned index = triangles.size();
+      triangles.resize(index + 1);
+      triangle &tri = triangles[index];
+      for (unsigned i = 0; i != 3; ++i) {
+        unsigned j = order[i];
+        tri.x[i] = ix[j];
+        tri.y[i] = iy[j];
+        tri.z[i] = sz[j];
+        tri.inv_w[i] = inv_w[j];
+        for (unsigned k = 0; k != ds.num_varyings; ++k) {
+          tri.varyings[i][k] = v[j]->varyings[k] * inv_w[j];
+        }
+      }
+      tri.min_x = min_x;
+      tri.min_y = min_y;
+      tri.max_x = max_x;
+      tri.max_y = max_y;
+      tri.inv_area = 1.0f / (float)area;
+      tri.draw = draws.size() - 1;
+      num_triangles_drawn++;
+
+      for (int ty = min_y >> tile_shift; ty <= (max_y >> tile_shift); ++ty) {
+        for (int tx = min_x >> tile_shift; tx <= (max_x >> tile_shift); ++tx) {
+          tiles[ty * tiles_x + tx].triangles.push_back(index);
+        }
+      }
+    }
+
+  public:
+    soft_raster() {
+      width = height = 0;
+      tiles_x = tiles_y = 0;
+      tiles = 0;
+      num_triangles_drawn = 0;
+    }
+
+    ~soft_raster() {
+      delete [] tiles;
+    }
+
+    void resize(unsigned w, unsigned h) {
+      flush();
+      width = w;
+      height = h;
+      color_buffer.resize(w * h);
+      depth_buffer.resize(w * h);
+      memset(color_buffer.data(), 0, w * h * sizeof(uint32_t));
+      for (unsigned i = 0; i != w * h; ++i) depth_buffer[i] = 1.0f;
+
+      delete [] tiles;
+      tiles_x = (w + tile_size - 1) >> tile_shift;
+      tiles_y = (h + tile_size - 1) >> tile_shift;
+      tiles = new tile_t[tiles_x * tiles_y];
+    }
+
+    unsigned get_width() const {
+      return width;
+    }
+
+    unsigned get_height() const {
+      return height;
+    }
+
+    // start a draw. Triangles added until the next begin_draw use this state.
+    void begin_draw(const draw_state &state) {
+      if (triangles.size() >= max_queued_triangles) {
+        flush();
+      }
+      draws.push_back(state);
+    }
+
+    // add a triangle in clip space to the current draw
+    void add_triangle(const vertex &a, const vertex &b, const vertex &c) {
+      if (!draws.size() || !tiles) return;
+
+      unsigned ca = outcode(a), cb = outcode(b), cc = outcode(c);
+      if (ca & cb & cc) return;
+      if ((ca | cb | cc) == 0) {
+        setup(&a, &b, &c);
+        return;
+      }
+
+      // clip to the frustum and fan out the polygon
+      vertex poly[2][9];
+      poly[0][0] = a;
+      poly[0][1] = b;
+      poly[0][2] = c;
+      unsigned num = 3, cur = 0;
+      unsigned num_varyings = draws.back().num_varyings;
+      for (unsigned plane = 0; plane != 6 && num >= 3; ++plane) {
+        if (((ca | cb | cc) >> plane) & 1) {
+          num = clip_polygon(poly[cur ^ 1], poly[cur], num, plane >> 1, plane & 1 ? -1.0f : 1.0f, num_varyings);
+          cur ^= 1;
+        }
+      }
+      for (unsigned i = 2; i < num; ++i) {
+        setup(&poly[cur][0], &poly[cur][i-1], &poly[cur][i]);
+      }
+    }
+
+    // shade all the waiting triangles
+    void flush() {
+      if (triangles.size()) {
+        OCTET_PROFILE_SCOPE("raster");
+        thread_pool::get_default().run(tiles_x * tiles_y, shade_tile_task, this);
+      }
+      triangles.resize(0);
+      draws.resize(0);
+    }
+
+    // clear the color and depth buffers inside a rectangle
+    void clear(bool clear_color, bool clear_depth, const float *rgba, float depth, const int *rect, uint32_t color_mask) {
+      flush();
+      int x0 = rect ? rect[0] : 0, y0 = rect ? rect[1] : 0;
+      int x1 = rect ? rect[0] + rect[2] : (int)width, y1 = rect ? rect[1] + rect[3] : (int)height;
+      if (x0 < 0) x0 = 0;
+      if (y0 < 0) y0 = 0;
+      if (x1 > (int)width) x1 = width;
+      if (y1 > (int)height) y1 = height;
+
+      uint32_t packed = 0;
+      for (unsigned c = 0; c != 4; ++c) {
+        float f = rgba[c] < 0 ? 0 : rgba[c] > 1 ? 1 : rgba[c];
+        packed |= (uint32_t)(f * 255.0f + 0.5f) << (c * 8);
+      }
+
+      for (int y = y0; y < y1; ++y) {
+        if (clear_color) {
+          uint32_t *color = &color_buffer[y * width];
+          for (int x = x0; x < x1; ++x) color[x] = (packed & color_mask) | (color[x] & ~color_mask);
+        }
+        if (clear_depth) {
+          float *d = &depth_buffer[y * width];
+          for (int x = x0; x < x1; ++x) d[x] = depth;
+        }
+      }
+    }
+
+    // copy RGBA8 pixels out of the color buffer, bottom row first
+    void read_pixels(int x, int y, int w, int h, uint8_t *dest) {
+      flush();
+      for (int j = 0; j != h; ++j) {
+        uint8_t *d = dest + j * w * 4;
+        for (int i = 0; i != w; ++i, d += 4) {
+          int px = x + i, py = y + j;
+          uint32_t c = px >= 0 && py >= 0 && px < (int)width && py < (int)height ? color_buffer[py * width + px] : 0;
+          d[0] = (uint8_t)c;
+          d[1] = (uint8_t)(c >> 8);
+          d[2] = (uint8_t)(c >> 16);
+          d[3] = (uint8_t)(c >> 24);
+        }
+      }
+    }
+
+    // triangles binned since the raster was made
+    unsigned get_num_triangles_drawn() const {
+      return num_triangles_drawn;
+    }
+  };
+}
@@ -0,0 +1,262 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Andy Thomason 2012, 2013
+//
+// Modular Framework for OpenGLES2 rendering on multiple platforms.
+//
+// Fixed pool of worker threads for data parallel batches.
+//
+// run() hands out the indices of a batch to the workers and to the calling
+// thread and returns when every index has been done. Batches do not nest:
+// a run() from inside a task is done serially on the calling thread.
+//
+// Set OCTET_THREADS to 0 to build without threads. The environment variable
+// OCTET_NUM_THREADS overrides the size of the default pool.
+//
+
+#ifndef OCTET_THREADS
+  #if (defined(_MSC_VER) && defined(__GENERIC__)) || defined(SN_TARGET_PSP2)
+    // the generic build blocks windows.h and the Vita has no pthreads
+    #define OCTET_THREADS 0
+  #else
+    #define OCTET_THREADS 1
+  #endif
+#endif
+
+#if OCTET_THREADS && !defined(_WIN32)
+  #include <pthread.h>
+  #include <unistd.h>
+#endif
+
+namespace octet {
+  class thread_pool {
+  public:
+    // called once for each index of a batch. thread is 0 for the calling thread.
+    typedef void (*task_t)(void *context, unsigned index, unsigned thread);
+
+  private:
+    struct worker_t {
+      thread_pool *pool;
+      unsigned index;
+      #if OCTET_THREADS && defined(_WIN32)
+        HANDLE handle;
+      #elif OCTET_THREADS
+        pthread_t handle;
+      #endif
+    };
+
+    #if OCTET_THREADS && defined(_WIN32)
+      CRITICAL_SECTION mutex;
+      CONDITION_VARIABLE wake;
+      CONDITION_VARIABLE done;
+
+      void lock() { EnterCriticalSection(&mutex); }
+      void unlock() { LeaveCriticalSection(&mutex); }
+      void wait(CONDITION_VARIABLE *cond) { SleepConditionVariableCS(cond, &mutex, INFINITE); }
+      void signal_all(CONDITION_VARIABLE *cond) { WakeAllConditionVariable(cond); }
+
+      static DWORD WINAPI thread_main(void *param) {
+        worker_t *worker = (worker_t*)param;
+        worker->pool->worker_loop(worker->index);
+        return 0;
+      }
+    #elif OCTET_THREADS
+      pthread_mutex_t mutex;
+      pthread_cond_t wake;
+      pthread_cond_t done;
+
+      void lock() { pthread_mutex_lock(&mutex); }
+      void unlock() { pthread_mutex_unlock(&mutex); }
+      void wait(pthread_cond_t *cond) { pthread_cond_wait(cond, &mutex); }
+      void signal_all(pthread_cond_t *cond) { pthread_cond_broadcast(cond); }
+
+      static void *thread_main(void *param) {
+        worker_t *worker = (worker_t*)param;
+        worker->pool->worker_loop(worker->index);
+        return 0;
+      }
+    #else
+      void lock() {}
+      void unlock() {}
+    #endif
+
+    dynarray<worker_t> workers;
+
+    // the current batch
+    task_t task;
+    void *context;
+    unsigned num_tasks;
+    volatile int next_task;
+
+    unsigned generation;
+    unsigned num_finished;
+    bool busy;
+    bool quit;
+
+    // take indices until the batch is empty
+    void work(unsigned thread) {
+      for (;;) {
+        int index = atomic_add(&next_task, 1);
+        if (index >= (int)num_tasks) break;
+        task(context, (unsigned)index, thread);
+      }
+    }
+
+    void worker_loop(unsigned index) {
+      #if OCTET_THREADS
+        unsigned seen = 0;
+        lock();
+        for (;;) {
+          while (generation == seen && !quit) wait(&wake);
+          if (quit) break;
+          seen = generation;
+          unlock();
+          work(index);
+          lock();
+          if (++num_finished == workers.size()) signal_all(&done);
+        }
+        unlock();
+        allocator::flush_thread();
+      #endif
+    }
+
+  public:
+    // num_threads includes the calling thread. 0 uses one thread per core.
+    thread_pool(unsigned num_threads = 0) {
+      task = 0;
+      context = 0;
+      num_tasks = 0;
+      next_task = 0;
+      generation = 0;
+      num_finished = 0;
+      busy = false;
+      quit = false;
+
+      if (num_threads == 0) num_threads = get_num_cores();
+
+      #if OCTET_THREADS
+        #if defined(_WIN32)
+          InitializeCriticalSection(&mutex);
+          InitializeConditionVariable(&wake);
+          InitializeConditionVariable(&done);
+        #else
+          pthread_mutex_init(&mutex, NULL);
+          pthread_cond_init(&wake, NULL);
+          pthread_cond_init(&done, NULL);
+        #endif
+
+        // the workers must not move once started
+        workers.resize(num_threads - 1);
+        for (unsigned i = 0; i != workers.size(); ++i) {
+          worker_t &worker = workers[i];
+          worker.pool = this;
+          worker.index = i + 1;
+          #if defined(_WIN32)
+            worker.handle = CreateThread(NULL, 0, thread_main, &worker, 0, NULL);
+          #else
+            pthread_create(&worker.handle, NULL, thread_main, &worker);
+          #endif
+        }
+      #endif
+    }
+
+    ~thread_pool() {
+      #if OCTET_THREADS
+        lock();
+        quit = true;
+        signal_all(&wake);
+        unlock();
+        for (unsigned i = 0; i != workers.size(); ++i) {
+          #if defined(_WIN32)
+            WaitForSingleObject(workers[i].handle, INFINITE);
+            CloseHandle(workers[i].handle);
+          #else
+            pthread_join(workers[i].handle, NULL);
+          #endif
+        }
+        #if defined(_WIN32)
+          DeleteCriticalSection(&mutex);
+        #else
+          pthread_cond_destroy(&done);
+          pthread_cond_destroy(&wake);
+          pthread_mutex_destroy(&mutex);
+        #endif
+      #endif
+    }
+
+    // call fn(context, i, thread) for i in [0, num) and wait for all of them
+    void run(unsigned num, task_t fn, void *ctx) {
+      lock();
+      if (busy || workers.size() == 0 || num <= 1) {
+        unlock();
+        for (unsigned i = 0; i != num; ++i) {
+          fn(ctx, i, 0);
+        }
+        return;
+      }
+
+      task = fn;
+      context = ctx;
+      num_tasks = num;
+      next_task = 0;
+      num_finished = 0;
+      busy = true;
+      generation++;
+      #if OCTET_THREADS
+        signal_all(&wake);
+      #endif
+      unlock();
+
+      work(0);
+
+      lock();
+      #if OCTET_THREADS
+        while (num_finished != workers.size()) wait(&done);
+      #endif
+      busy = false;
+      unlock();
+    }
+
+    // number of threads that can run tasks, including the calling thread
+    unsigned get_num_threads() const {
+      return workers.size() + 1;
+    }
+
+    // add delta to value and return the old value
+    static int atomic_add(volatile int *value, int delta) {
+      #if OCTET_THREADS && defined(_WIN32)
+        return (int)InterlockedExchangeAdd((volatile LONG*)value, delta);
+      #elif OCTET_THREADS
+        return __sync_fetch_and_add(value, delta);
+      #else
+        int old = *value;
+        *value += delta;
+        return old;
+      #endif
+    }
+
+    static unsigned get_num_cores() {
+      const char *env = getenv("OCTET_NUM_THREADS");
+      if (env && atoi(env) > 0) {
+        return (unsigned)atoi(env);
+      }
+      #if OCTET_THREADS && defined(_WIN32)
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        return info.dwNumberOfProcessors ? info.dwNumberOfProcessors : 1;
+      #elif OCTET_THREADS
+        long num = sysconf(_SC_NPROCESSORS_ONLN);
+        return num > 0 ? (unsigned)num : 1;
+      #else
+        return 1;
+      #endif
+    }
+
+    // pool shared by the engine, made on first use and stopped at exit.
+    // C++11 compilers make it once, whichever threads ask first.
+    static thread_pool &get_default() {
+      static thread_pool pool;
+      return pool;
+    }
+  };
+}
@@ -243,7 +243,7 @@ public:
     clFinish(queue);
 
 
-    glBindTexture(GL_TEXTURE_2D, ctxt.texture_handle);
+    gl_state::bind_texture(0, GL_TEXTURE_2D, ctxt.texture_handle);
     glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, ctxt.width, ctxt.height, GL_RGB, GL_UNSIGNED_BYTE, &image[0]);
 
     clReleaseMemObject(image_mem);
@@ -41,6 +41,15 @@ namespace octet {
       }
     }
   
+    // map a file to read in place. Arrays read from a mapped file may borrow
+    // its memory, so it stays mapped while they use it. A file that has
+    // changed since is mapped again. Safe to call from any thread.
+    static ref<mapped_file> get_mapped_file(const char *url) {
+      string path;
+      get_path(path, url);
+      return mapped_file::open(path);
+    }
+
     static void setrgb(dynarray<unsigned char> &buffer, int size, int x, int y, unsigned rgb, unsigned a = 0xff) {
       buffer[(y*size+x)*4+0] = rgb >> 16;
       buffer[(y*size+x)*4+1] = rgb >> 8;
@@ -51,10 +60,20 @@ namespace octet {
     // turn a url into a file path
     static const char *get_path(const char *url) {
       if (url == NULL) return "";
+      static string path;
+      get_path(path, url);
+      return path;
+    }
+
+    // turn a url into a file path in a string of the caller's, for other threads
+    static void get_path(string &path, const char *url) {
+      if (url == NULL) {
+        path = "";
+        return;
+      }
 
       string url_str;
       url_str.urldecode(url);
-      static string path;
 
       if (url[0] == '/' || (url[0] >= 'A' && url[0] <= 'Z' && url[1] == ':')) {
         path = url_str;
@@ -62,18 +81,26 @@ namespace octet {
         // relative path
         path.format("%s%s", prefix(), url_str.c_str());
       }
-      return path;
+    }
+
+    // for zip://path.zip/file urls, the zip url and the file in it
+    static bool split_zip_url(string &zip_url, const char *&file, const char *url) {
+      if (strncmp(url, "zip://", 6)) return false;
+      const char *zip = strstr(url + 6, ".zip");
+      if (!zip) return false;
+      int path_len = zip - (url + 6) + 4;
+      zip_url.set(url + 6, path_len);
+      file = (url + 6) + path_len;
+      file += file[0] == '/';
+      return true;
     }
 
     static void get_url(dynarray<unsigned char> &buffer, const char *url) {
+      allocator_tag_scope tag(allocator::tag_load);
+      string zip_url;
+      const char *file = 0;
       if (!strncmp(url, "zip://", 6)) {
-        const char *zip = strstr(url + 6, ".zip");
-        if (zip) {
-          int path_len = zip - (url + 6) + 4;
-          string zip_url;
-          zip_url.set(url + 6, path_len);
-          const char *file = (url + 6) + path_len;
-          file += file[0] == '/';
+        if (split_zip_url(zip_url, file, url)) {
           zip_file *zip = get_zip_file(zip_url.c_str());
           zip->get_file(buffer, file);
         }
@@ -93,6 +120,55 @@ namespace octet {
       }
     }
 
+    // load num_urls urls, buffers[i] gets urls[i].
+    // neighbouring urls in the same zip file are extracted in parallel.
+    static void get_urls(dynarray<unsigned char> *buffers, const char **urls, unsigned num_urls) {
+      allocator_tag_scope tag(allocator::tag_load);
+      dynarray<const char *> files;
+      for (unsigned i = 0; i != num_urls;) {
+        string zip_url, next_url;
+        const char *file = 0;
+        if (!split_zip_url(zip_url, file, urls[i])) {
+          get_url(buffers[i], urls[i]);
+          ++i;
+          continue;
+        }
+        files.resize(0);
+        unsigned first = i;
+        files.push_back(file);
+        while (++i != num_urls && split_zip_url(next_url, file, urls[i]) && next_url == zip_url) {
+          files.push_back(file);
+        }
+        get_zip_file(zip_url.c_str())->get_files(buffers + first, files.data(), files.size());
+      }
+    }
+
+    // load and decode a gif, jpeg or tga image.
+    // format is GL_RGB or GL_RGBA, returns false if the format is not known.
+    static bool decode_image(dynarray<uint8_t> &image, uint16_t &format, uint16_t &width, uint16_t &height, const char *url) {
+      dynarray<uint8_t> buffer;
+      get_url(buffer, url);
+      format = 0;
+      width = 0;
+      height = 0;
+      const unsigned char *src = buffer.data();
+      const unsigned char *src_max = src + buffer.size();
+      if (buffer.size() >= 6 && !memcmp(&buffer[0], "GIF89a", 6)) {
+        gif_decoder dec;
+        dec.get_image(image, format, width, height, src, src_max);
+      } else if (buffer.size() >= 6 && buffer[0] == 0xff && buffer[1] == 0xd8) {
+        jpeg_decoder dec;
+        dec.get_image(image, format, width, height, src, src_max);
+      } else if (buffer.size() >= 6 && buffer[0] == 0 && buffer[1] == 0 && buffer[2] == 2) {
+        tga_decoder dec;
+        dec.get_image(image, format, width, height, src, src_max);
+      } else {
+        printf("warning: unknown texture format\n");
+        return false;
+      }
+      return true;
+    }
+
     static GLuint get_stock_texture(unsigned gl_kind, const char *name) {
       //stock_texture_generator stock;
       if (!strcmp(name, "bricks")) {
@@ -163,17 +239,64 @@ namespace octet {
       // make a new texture handle
       GLuint handle = 0;
       glGenTextures(1, &handle);
-      glActiveTexture(GL_TEXTURE0);
-      glBindTexture(GL_TEXTURE_2D, handle);
+      gl_state::bind_texture(0, GL_TEXTURE_2D, handle);
 
       glTexImage2D(GL_TEXTURE_2D, 0, gl_kind, width, height, 0, in_format, GL_UNSIGNED_BYTE, (void*)image);
 
       glGenerateMipmap(GL_TEXTURE_2D);
-      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+      gl_state::tex_parameter(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+      gl_state::tex_parameter(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
       return handle;
     }
 
+    // read a rectangle of the framebuffer and write it as a .jpg or .tga file
+    static bool save_frame(const char *url, int x, int y, int width, int height) {
+      dynarray<uint8_t> pixels(width * height * 4);
+      glReadPixels(x, y, width, height, GL_RGBA, GL_UNSIGNED_BYTE, (void*)&pixels[0]);
+
+      // GL rows are bottom up, so start at the top row and step back
+      const uint8_t *top = &pixels[(height - 1) * width * 4];
+      dynarray<uint8_t> file_data;
+      const char *ext = strrchr(url, '.');
+      bool ok;
+      if (ext && (!strcmp(ext, ".jpg") || !strcmp(ext, ".jpeg"))) {
+        jpeg_encoder encoder;
+        ok = encoder.encode(file_data, width, height, -width * 4, top);
+      } else {
+        tga_encoder encoder;
+        ok = encoder.encode(file_data, width, height, -width * 4, top);
+      }
+
+      FILE *file = ok ? fopen(get_path(url), "wb") : NULL;
+      if (!file) {
+        printf("warning: could not write %s\n", url);
+        return false;
+      }
+      fwrite(&file_data[0], 1, file_data.size(), file);
+      fclose(file);
+      return true;
+    }
+
+    // seconds from an arbitrary start, for timing
+    static double get_time() {
+      return profiler::get_time();
+    }
+
+    // largest resident set of this process so far in KB, 0 if not known
+    static unsigned get_peak_memory() {
+      #if defined(_WIN32) || defined(SN_TARGET_PSP2)
+        return 0;
+      #else
+        rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        #if defined(__APPLE__)
+          return (unsigned)(usage.ru_maxrss / 1024);
+        #else
+          return (unsigned)usage.ru_maxrss;
+        #endif
+      #endif
+    }
+
     static ALuint make_sound_buffer(unsigned kind, unsigned rate, dynarray<unsigned char> &buffer, unsigned offset, unsigned size) {
       ALuint id = 0;
       alGenBuffers(1, &id);
@@ -215,13 +338,13 @@ namespace octet {
           (*dict)[predefined_atom(num_atoms)] = (atom_t)num_atoms;
         }
       }
-      if (dict->contains(name)) {
-        //app_utils::log("old atom %s %d\n", name, (*dict)[name]);
-        return (*dict)[name];
-      } else {
+      bool added;
+      atom_t &atom = dict->find_or_insert(name, added);
+      if (added) {
         //app_utils::log("new atom %s %d\n", name, num_atoms);
-        return (*dict)[name] = (atom_t)num_atoms++;
+        atom = (atom_t)num_atoms++;
       }
+      return atom;
     }
 
     static const char *predefined_atom(unsigned i) {
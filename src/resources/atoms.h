@@ -114,3 +114,5 @@ OCTET_ATOM(vscale)
 OCTET_ATOM(flags)
 OCTET_ATOM(size)
 
+OCTET_ATOM(weld_epsilon)
+OCTET_ATOM(blended)
@@ -4,20 +4,46 @@
 //
 // Modular Framework for OpenGLES2 rendering on multiple platforms.
 //
-// visitor for writing xml files.
+// visitor for reading binary (.oct) files.
+//
+// The file is read from memory. Given a url, the file is mapped and the bytes
+// of dynarrays in version 2 files are borrowed from the mapping, not copied.
+// A mesh's vertices then stay in the file until they are used.
 //
 
 namespace octet {
   class binary_reader : public visitor {
-    enum { debug = true };
+    enum { debug = false };
     hash_map<void *, int> refs;
     dynarray<void *> id_to_ref;
-    FILE *file;
     char tmp[256];
 
+    // the mapped file, if any. borrowed dynarrays hold references of their own
+    ref<mapped_file> file;
+    dynarray<uint8_t> buffer;
+    uint8_t *begin;
+    uint8_t *pos;
+    uint8_t *end;
+    unsigned version;
+    bool can_borrow;
+
     void read(uint8_t *src, unsigned bytes) {
       //if (debug) app_utils::log("read %08x bytes\n", bytes);
-      fread(src, 1, bytes, file);
+      if (bytes > (unsigned)(end - pos)) {
+        if (!get_error()) app_utils::log("error: unexpected end of file\n");
+        set_error(true);
+        memset(src, 0, bytes);
+        pos = end;
+        return;
+      }
+      memcpy(src, pos, bytes);
+      pos += bytes;
+    }
+
+    void align(unsigned alignment) {
+      unsigned offset = (unsigned)(pos - begin);
+      unsigned pad = ( alignment - offset ) & ( alignment - 1 );
+      pos = pad <= (unsigned)(end - pos) ? pos + pad : end;
     }
 
     int read_int() {
@@ -39,7 +65,7 @@ namespace octet {
     const char *read_string() {
       int nchars = 0;
       for(;;) {
-        int c = fgetc(file);
+        int c = pos != end ? *pos++ : 0;
         tmp[nchars] = c;
         if (c == 0) break;
         nchars += nchars != sizeof(tmp)-1;
@@ -51,7 +77,7 @@ namespace octet {
     bool check_atom(atom_t sid) {
       if (!get_error()) {
         atom_t test = read_atom();
-        app_utils::log("%*scheck_atom %s\n", get_depth()*2, "", app_utils::get_atom_name(sid));
+        if (debug) app_utils::log("%*scheck_atom %s\n", get_depth()*2, "", app_utils::get_atom_name(sid));
         if (test != sid) {
           app_utils::log("error: expected %s\n", app_utils::get_atom_name(sid));
           set_error(true);
@@ -63,7 +89,7 @@ namespace octet {
     bool check_size(unsigned size) {
       if (!get_error()) {
         int test = read_int();
-        app_utils::log("%*scheck_size %d\n", get_depth()*2, "", size);
+        if (debug) app_utils::log("%*scheck_size %d\n", get_depth()*2, "", size);
         if (test != (int)size) {
           app_utils::log("error: expected %d bytes\n", size);
           set_error(true);
@@ -73,7 +99,7 @@ namespace octet {
     }
 
     void *get_ref(int id) {
-      app_utils::log("%*sget_ref %d/%d\n", get_depth()*2, "", id, id_to_ref.size());
+      if (debug) app_utils::log("%*sget_ref %d/%d\n", get_depth()*2, "", id, id_to_ref.size());
       if (id == (int)id_to_ref.size()) {
         return NULL;
       } else if (id > (int)id_to_ref.size()) {
@@ -85,20 +111,63 @@ namespace octet {
       }
     }
 
-  public:
-    binary_reader(FILE *file) {
+    // check the header and find the version
+    void init(uint8_t *data, size_t size) {
       if (debug) app_utils::log("binary_reader\n");
       id_to_ref.reserve(256);
       id_to_ref.push_back(NULL);
 
-      this->file = file;
-      char tmp[8];
-      fread(tmp, 1, sizeof(tmp), file);
-      if (memcmp(tmp, "octet", 5)) {
+      begin = pos = data;
+      end = data + size;
+      version = 1;
+
+      if (size < 8 || memcmp(data, "octet", 5)) {
+        set_error(true);
+        return;
+      }
+      pos += 8;
+
+      if (end - pos >= 4) {
+        unsigned word = pos[0] + (pos[1] << 8) + (pos[2] << 16) + (pos[3] << 24);
+        if (word & binary_writer::version_flag) {
+          version = word & ~binary_writer::version_flag;
+          pos += 4;
+        }
+      }
+
+      if (version > binary_writer::version) {
+        app_utils::log("error: .oct version %d is newer than this reader\n", version);
         set_error(true);
       }
     }
 
+  public:
+    // read the rest of a file, copying everything
+    binary_reader(FILE *file) {
+      if (file) {
+        long start = ftell(file);
+        fseek(file, 0, SEEK_END);
+        buffer.resize((unsigned)(ftell(file) - start));
+        fseek(file, start, SEEK_SET);
+        buffer.resize((unsigned)fread(buffer.data(), 1, buffer.size(), file));
+      }
+      can_borrow = false;
+      init(buffer.data(), buffer.size());
+    }
+
+    // read a mapped file, borrowing the bytes of dynarrays where the file allows
+    binary_reader(const char *url) {
+      file = app_utils::get_mapped_file(url);
+      can_borrow = true;
+      init(file->data(), file->size());
+      can_borrow = version >= 2;
+    }
+
+    // the version of the file, 1 for files without a version word
+    unsigned get_version() const {
+      return version;
+    }
+
     ~binary_reader() {
     }
 
@@ -168,7 +237,14 @@ namespace octet {
     // begin reading a dynarray
     unsigned begin_read_dynarray(unsigned elem_size, atom_t &sid) {
       if (!check_atom(atom_dynarray) && !check_atom(sid)) {
-        return (unsigned)read_int() / elem_size;
+        unsigned bytes = (unsigned)read_int();
+        if (version >= 2) align(binary_writer::dynarray_alignment);
+        if (bytes > (unsigned)(end - pos)) {
+          app_utils::log("error: dynarray overflows the file\n");
+          set_error(true);
+          return 0;
+        }
+        return bytes / elem_size;
       }
       return 0;
     }
@@ -178,6 +254,18 @@ namespace octet {
       read((uint8_t*)ptr, bytes);
     }
 
+    // use the bytes of a dynarray in place
+    void *borrow_dynarray(unsigned bytes) {
+      bool ok = can_borrow && !get_error() && bytes <= (unsigned)(end - pos);
+      if (!ok || ((size_t)pos & (binary_writer::dynarray_alignment - 1))) {
+        return 0;
+      }
+      void *result = pos;
+      pos += bytes;
+      file->add_ref();  // released by the dynarray through dynarray_borrow
+      return result;
+    }
+
     // called after visiting a new object
     void end_ref() {
       if (debug) app_utils::log("%*send_ref\n", get_depth()*2, "");
@@ -200,8 +288,8 @@ namespace octet {
       //check_atom(atom_end_refs);
     }
 
-    void visit_bin(void *value, unsigned size, atom_t sid, atom_t type) {
-      if (debug) app_utils::log("%*svisit_bin %s %d\n", get_depth()*2, "", app_utils::get_atom_name(sid), size);
+    void visit_bin(void *value, size_t size, atom_t sid, atom_t type) {
+      if (debug) app_utils::log("%*svisit_bin %s %d\n", get_depth()*2, "", app_utils::get_atom_name(sid), (int)size);
       if (!check_atom(type) && !check_atom(sid) && !check_size(size)) {
         read((uint8_t*)value, size);
       }
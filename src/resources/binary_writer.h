@@ -4,19 +4,41 @@
 //
 // Modular Framework for OpenGLES2 rendering on multiple platforms.
 //
-// visitor for writing xml files.
+// visitor for writing binary (.oct) files.
+//
+// The file starts with "octet\r\n\x1a" and a version word. Files from before
+// the version word are version 1. From version 2 the bytes of each dynarray
+// start on a 16 byte boundary, so that a reader of a mapped file can use them
+// in place. Version 3 adds the blended flag of materials, version 4 the weld
+// epsilon of indexers.
 //
 
 namespace octet {
   class binary_writer : public visitor {
-    enum { debug = true };
+  public:
+    enum {
+      version = 4,
+      // old files start with an atom, which is never this big
+      version_flag = 0x40000000,
+      dynarray_alignment = 16,
+    };
+
+  private:
+    enum { debug = false };
     hash_map<void *, int> refs;
     int next_id;
     FILE *file;
+    unsigned offset; // from the start of the file
 
     void write(const uint8_t *src, unsigned bytes) {
       //if (debug) app_utils::log("%*swrite %08x bytes\n", get_depth()*2, "", bytes);
       fwrite(src, 1, bytes, file);
+      offset += bytes;
+    }
+
+    void align(unsigned alignment) {
+      static const uint8_t zeros[16] = { 0 };
+      write(zeros, ( alignment - offset ) & ( alignment - 1 ));
     }
 
     void write_int(int value) {
@@ -41,8 +63,10 @@ namespace octet {
       if (debug) app_utils::log("%*sbinary_writer\n", get_depth()*2, "");
       next_id = 1;
       this->file = file;
+      offset = 0;
 
-      fwrite("octet\r\n\x1a", 1, 8, file);
+      write((const uint8_t*)"octet\r\n\x1a", 8);
+      write_int((int)(version_flag | version));
     }
 
     ~binary_writer() {
@@ -144,10 +168,13 @@ namespace octet {
       //write_atom(atom_end_refs);
     }
 
-    void visit_bin(void *value, unsigned size, atom_t sid, atom_t type) {
+    void visit_bin(void *value, size_t size, atom_t sid, atom_t type) {
       write_atom(type);
       write_atom(sid);
       write_int(size);
+      if (type == atom_dynarray) {
+        align(dynarray_alignment);
+      }
       write((const uint8_t*)value, size);
     }
 
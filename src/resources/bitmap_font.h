@@ -179,7 +179,9 @@ private:
         } else if (*ptr == 4) {
           const char_info *chars = (const char_info*)(ptr + 5);
           for (unsigned i = 0; i < size; i += sizeof(char_info)) {
-            char_map[u4(chars->id)] = chars++;
+            // the order of evaluation of a[x] = y++ is unspecified
+            char_map[u4(chars->id)] = chars;
+            chars++;
           }
           /*for (unsigned i = 0; i != char_map.size(); ++i) {
             app_utils::log("%d %08x %p %d\n", i, char_map.key(i), char_map.value(i), char_map.get_index(char_map.key(i)));
@@ -18,6 +18,15 @@ namespace octet {
     // GL_ARRAY_BUFFER etc.
     GLuint target;
 
+    // changes whenever the bytes may have changed, so that data derived
+    // from them (eg. a mesh's ray cast tree) knows when to update.
+    mutable unsigned version;
+
+    static unsigned next_version() {
+      static unsigned counter = 0;
+      return ++counter;
+    }
+
   public:
     // helper classes so that we remember to unlock!
 
@@ -51,6 +60,7 @@ namespace octet {
 
     gl_resource(unsigned target=0, unsigned size=0) {
       buffer = 0;
+      version = next_version();
       this->target = target;
       if (size) {
         allocate(target, size);
@@ -61,16 +71,19 @@ namespace octet {
     void visit(visitor &v) {
       v.visit(bytes, atom_bytes);
       v.visit(target, atom_target);
+      version = next_version();
     }
 
     // 
     void allocate(GLuint target, unsigned size) {
+      allocator_tag_scope tag(allocator::tag_geometry);
       reset();
       glGenBuffers(1, &buffer);
       glBindBuffer(target, buffer);
       glBufferData(target, size, NULL, GL_STATIC_DRAW);
       bytes.resize(size);
       this->target = target;
+      version = next_version();
     }
 
     void reset() {
@@ -93,6 +106,11 @@ namespace octet {
       return bytes.size();
     }
 
+    // a different number after every allocate() or unlock()
+    unsigned get_version() const {
+      return version;
+    }
+
     const void *lock_read_only() const {
       return (const void*)&bytes[0];
       glBindBuffer(target, buffer);
@@ -114,9 +132,16 @@ namespace octet {
       glBindBuffer(target, buffer);
       glBufferSubData(target, 0, bytes.size(), &bytes[0]);
       //glUnmapBuffer(target);
+      version = next_version();
     }
 
-    void bind() const {
+    // resources read from a file have bytes but no buffer until first use.
+    void bind() {
+      if (buffer == 0 && bytes.size() != 0) {
+        glGenBuffers(1, &buffer);
+        glBindBuffer(target, buffer);
+        glBufferData(target, bytes.size(), &bytes[0], GL_STATIC_DRAW);
+      }
       glBindBuffer(target, buffer);
     }
 
@@ -0,0 +1,258 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Andy Thomason 2012, 2013
+//
+// Modular Framework for OpenGLES2 rendering on multiple platforms.
+//
+// Shadow of the GL state, to skip calls that would not change anything.
+//
+// The shaders, materials, meshes and renderers set the program, texture
+// bindings, sampler parameters, blend and depth state and vertex attribute
+// arrays through here. Code that sets any of these with GL calls directly
+// must call gl_state::invalidate() afterwards, as must anything that makes
+// a new GL context. Textures are deleted with gl_state::delete_textures(),
+// as GL may give a deleted texture's name to the next new texture.
+//
+
+namespace octet {
+  class gl_state {
+  public:
+    enum kind_t {
+      kind_program,
+      kind_texture,
+      kind_sampler,
+      kind_capability,
+      kind_blend,
+      kind_depth,
+      kind_attrib,
+      num_kinds,
+    };
+
+    enum {
+      max_units = 16,
+      max_attribs = 16,
+      num_params = 4,
+    };
+
+  private:
+    enum { unknown = 0xffffffff };
+
+    struct sampler_t {
+      unsigned values[num_params];
+    };
+
+    struct state_t {
+      unsigned program;
+      unsigned active_unit;
+      unsigned textures[max_units][2];  // GL_TEXTURE_2D, GL_TEXTURE_CUBE_MAP
+      hash_map<unsigned, sampler_t> samplers;
+      unsigned blend, depth_test, cull_face;
+      unsigned blend_src, blend_dst;
+      unsigned depth_func, depth_mask;
+      unsigned attribs[max_attribs];
+
+      unsigned hits[num_kinds];
+      unsigned misses[num_kinds];
+
+      state_t() {
+        memset(hits, 0, sizeof(hits));
+        memset(misses, 0, sizeof(misses));
+        reset();
+      }
+
+      void reset() {
+        program = unknown;
+        active_unit = unknown;
+        memset(textures, 0xff, sizeof(textures));
+        samplers.clear();
+        blend = depth_test = cull_face = unknown;
+        blend_src = blend_dst = unknown;
+        depth_func = depth_mask = unknown;
+        memset(attribs, 0xff, sizeof(attribs));
+      }
+    };
+
+    static state_t &state() {
+      static state_t s;
+      return s;
+    }
+
+    // true if the GL call is needed
+    static bool update(kind_t kind, unsigned &shadow, unsigned value) {
+      state_t &s = state();
+      if (shadow == value) {
+        s.hits[kind]++;
+        return false;
+      }
+      s.misses[kind]++;
+      shadow = value;
+      return true;
+    }
+
+    static int get_param_index(GLenum pname) {
+      switch (pname) {
+        case GL_TEXTURE_MIN_FILTER: return 0;
+        case GL_TEXTURE_MAG_FILTER: return 1;
+        case GL_TEXTURE_WRAP_S: return 2;
+        case GL_TEXTURE_WRAP_T: return 3;
+        default: return -1;
+      }
+    }
+
+    static unsigned *get_capability(GLenum cap) {
+      state_t &s = state();
+      switch (cap) {
+        case GL_BLEND: return &s.blend;
+        case GL_DEPTH_TEST: return &s.depth_test;
+        case GL_CULL_FACE: return &s.cull_face;
+        default: return NULL;
+      }
+    }
+
+    static unsigned &bound_texture(GLenum target) {
+      state_t &s = state();
+      if (s.active_unit >= max_units) {
+        // not shadowed
+        static unsigned none;
+        none = unknown;
+        return none;
+      }
+      return s.textures[s.active_unit][target == GL_TEXTURE_CUBE_MAP ? 1 : 0];
+    }
+
+  public:
+    // forget everything, the next set of anything makes a GL call
+    static void invalidate() {
+      state().reset();
+    }
+
+    static void use_program(GLuint program) {
+      if (update(kind_program, state().program, program)) {
+        glUseProgram(program);
+      }
+    }
+
+    // delete textures and forget their bindings and parameters.
+    // GL binds 0 in place of a deleted texture that is bound.
+    static void delete_textures(GLsizei n, const GLuint *textures) {
+      state_t &s = state();
+      for (GLsizei i = 0; i != n; ++i) {
+        if (!textures[i]) continue;
+        for (unsigned unit = 0; unit != max_units; ++unit) {
+          for (unsigned target = 0; target != 2; ++target) {
+            if (s.textures[unit][target] == textures[i]) s.textures[unit][target] = 0;
+          }
+        }
+        s.samplers.erase(textures[i]);
+      }
+      glDeleteTextures(n, textures);
+    }
+
+    static void active_texture(unsigned unit) {
+      if (update(kind_texture, state().active_unit, unit)) {
+        glActiveTexture(GL_TEXTURE0 + unit);
+      }
+    }
+
+    // bind a texture to a unit, leaving that unit active
+    static void bind_texture(unsigned unit, GLenum target, GLuint texture) {
+      active_texture(unit);
+      if (unit >= max_units) {
+        glBindTexture(target, texture);
+      } else if (update(kind_texture, bound_texture(target), texture)) {
+        glBindTexture(target, texture);
+      }
+    }
+
+    // set a parameter of the texture bound to target on the active unit
+    static void tex_parameter(GLenum target, GLenum pname, GLint value) {
+      unsigned texture = bound_texture(target);
+      int index = get_param_index(pname);
+      if (texture != unknown && texture != 0 && index >= 0) {
+        state_t &s = state();
+        if (!s.samplers.contains(texture)) {
+          sampler_t &smp = s.samplers[texture];
+          memset(smp.values, 0xff, sizeof(smp.values));
+        }
+        if (!update(kind_sampler, s.samplers[texture].values[index], (unsigned)value)) {
+          return;
+        }
+      } else {
+        state().misses[kind_sampler]++;
+      }
+      glTexParameteri(target, pname, value);
+    }
+
+    // GL_BLEND, GL_DEPTH_TEST and GL_CULL_FACE are shadowed, other caps go straight to GL
+    static void enable(GLenum cap, bool value) {
+      unsigned *shadow = get_capability(cap);
+      if (!shadow || update(kind_capability, *shadow, value ? 1 : 0)) {
+        if (value) glEnable(cap); else glDisable(cap);
+      }
+    }
+
+    static void blend_func(GLenum src, GLenum dst) {
+      state_t &s = state();
+      if (s.blend_src == src && s.blend_dst == dst) {
+        s.hits[kind_blend]++;
+      } else {
+        s.misses[kind_blend]++;
+        s.blend_src = src;
+        s.blend_dst = dst;
+        glBlendFunc(src, dst);
+      }
+    }
+
+    static void depth_func(GLenum func) {
+      if (update(kind_depth, state().depth_func, func)) {
+        glDepthFunc(func);
+      }
+    }
+
+    static void depth_mask(bool value) {
+      if (update(kind_depth, state().depth_mask, value ? 1 : 0)) {
+        glDepthMask(value ? GL_TRUE : GL_FALSE);
+      }
+    }
+
+    static void enable_attrib(unsigned index, bool value) {
+      if (index >= max_attribs || update(kind_attrib, state().attribs[index], value ? 1 : 0)) {
+        if (value) glEnableVertexAttribArray(index); else glDisableVertexAttribArray(index);
+      }
+    }
+
+    // calls skipped and made since the start or reset_counters()
+    static unsigned get_hits(kind_t kind) { return state().hits[kind]; }
+    static unsigned get_misses(kind_t kind) { return state().misses[kind]; }
+
+    static unsigned get_hits() {
+      unsigned total = 0;
+      for (unsigned i = 0; i != num_kinds; ++i) total += state().hits[i];
+      return total;
+    }
+
+    static unsigned get_misses() {
+      unsigned total = 0;
+      for (unsigned i = 0; i != num_kinds; ++i) total += state().misses[i];
+      return total;
+    }
+
+    static void reset_counters() {
+      state_t &s = state();
+      memset(s.hits, 0, sizeof(s.hits));
+      memset(s.misses, 0, sizeof(s.misses));
+    }
+
+    static const char *get_kind_name(unsigned kind) {
+      static const char *names[] = { "program", "texture", "sampler", "capability", "blend", "depth", "attrib" };
+      return kind < num_kinds ? names[kind] : "";
+    }
+
+    static void print_stats() {
+      printf("gl_state: %u calls skipped, %u made\n", get_hits(), get_misses());
+      for (unsigned i = 0; i != num_kinds; ++i) {
+        printf("  %-12s %8u %8u\n", get_kind_name(i), state().hits[i], state().misses[i]);
+      }
+    }
+  };
+}
@@ -27,27 +27,23 @@ namespace octet {
       return tmp;
     }
 
-    dynarray<string> &response;
+    // all the JSON goes into one buffer that grows geometrically
+    string_builder &response;
     int depth;
     int max_depth;
 
-    string &next() {
-      response.resize(response.size()+1);
-      return response.back();
-    }
   public:
-    http_writer(int depth_, int max_depth_, dynarray<string> &response_) : response(response_) {
+    http_writer(int depth_, int max_depth_, string_builder &response_) : response(response_) {
       depth = depth_;
       max_depth = max_depth_;
-      response.resize(0);
     }
 
     bool begin_ref(void *ref, const char *sid, atom_t type) {
       if (depth == max_depth) {
-        next().format("%*s{ \"data\": \"%s\" },\n", depth*2, "", sid);
+        response.append_format("%*s{ \"data\": \"%s\" },\n", depth*2, "", sid);
         return false;
       } else {
-        next().format("%*s{ \"data\": \"%s\", children: [\n", depth*2, "", sid);
+        response.append_format("%*s{ \"data\": \"%s\", children: [\n", depth*2, "", sid);
         depth++;
         return true;
       }
@@ -59,10 +55,10 @@ namespace octet {
 
     bool begin_ref(void *ref, int index, atom_t type) {
       if (depth == max_depth) {
-        next().format("%*s{ \"data\": \"%d\",\n", depth*2, "", index);
+        response.append_format("%*s{ \"data\": \"%d\",\n", depth*2, "", index);
         return false;
       } else {
-        next().format("%*s{ \"data\": \"%d\", children: [\n", depth*2, "", index);
+        response.append_format("%*s{ \"data\": \"%d\", children: [\n", depth*2, "", index);
         depth++;
         return true;
       }
@@ -70,15 +66,15 @@ namespace octet {
 
     void end_ref() {
       depth--;
-      next().format("%*s]},\n", depth*2, "");
+      response.append_format("%*s]},\n", depth*2, "");
     }
 
     bool begin_refs(atom_t sid, int &size, bool is_dict) {
       if (depth == max_depth) {
-        next().format("%*s{ \"data\": \"%s\" },\n", depth*2, "", app_utils::get_atom_name(sid));
+        response.append_format("%*s{ \"data\": \"%s\" },\n", depth*2, "", app_utils::get_atom_name(sid));
         return false;
       } else {
-        next().format("%*s{ \"data\": \"%s\", children: [\n", depth*2, "", app_utils::get_atom_name(sid));
+        response.append_format("%*s{ \"data\": \"%s\", children: [\n", depth*2, "", app_utils::get_atom_name(sid));
         depth++;
         return true;
       }
@@ -86,7 +82,7 @@ namespace octet {
 
     void end_refs(bool is_dict) {
       depth--;
-      next().format("%*s]},\n", depth*2, "");
+      response.append_format("%*s]},\n", depth*2, "");
     }
 
     void visit_bin(void *value, size_t size, atom_t sid, atom_t type) {
@@ -110,7 +106,7 @@ namespace octet {
           }
         } break;
       }
-      next().format("%*s{ \"data\": \"%s\", children: [\"%s\"] },\n", depth*2, "", app_utils::get_atom_name(sid), data.c_str());
+      response.append_format("%*s{ \"data\": \"%s\", children: [\"%s\"] },\n", depth*2, "", app_utils::get_atom_name(sid), data.c_str());
     }
   };
 }
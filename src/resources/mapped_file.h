@@ -0,0 +1,266 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Andy Thomason 2012, 2013
+//
+// Modular Framework for OpenGLES2 rendering on multiple platforms.
+//
+// Read only file mapped into memory.
+//
+// The pages are mapped copy-on-write, so the memory may be written without
+// changing the file: the first write to a page gives this process its own copy.
+// Where files can not be mapped, the file is read into memory instead.
+//
+// open() shares a file between readers while it is unchanged. Each dynarray
+// that borrows from a file holds a reference to it, and the file is unmapped
+// when the last reader and the last of these arrays are gone. The list of
+// open files and the reference counts are guarded by a lock, so files can be
+// opened and released on any thread.
+//
+// Set OCTET_MMAP to 0 to always read the file.
+//
+
+#ifndef OCTET_MMAP
+  #if (defined(_MSC_VER) && defined(__GENERIC__)) || defined(SN_TARGET_PSP2)
+    // the generic build blocks windows.h and the Vita has no mmap
+    #define OCTET_MMAP 0
+  #else
+    #define OCTET_MMAP 1
+  #endif
+#endif
+
+#include <sys/stat.h>
+#if OCTET_MMAP && !defined(_WIN32)
+  #include <sys/mman.h>
+  #include <fcntl.h>
+  #include <unistd.h>
+#endif
+
+namespace octet {
+  class mapped_file {
+    int ref_cnt;
+    string path_;
+    uint8_t *data_;
+    size_t size_;
+    time_t mtime;
+    unsigned inode;
+    bool is_mapped_;
+    #if OCTET_MMAP && defined(_WIN32)
+      HANDLE mapping;
+    #endif
+
+    // files with references, guarded by lock()
+    static dynarray<mapped_file*> &get_open_files() {
+      static dynarray<mapped_file*> files;
+      return files;
+    }
+
+    static volatile long &get_lock() {
+      static volatile long value;
+      return value;
+    }
+
+    static void lock() {
+      #if defined(_MSC_VER)
+        while (_InterlockedExchange(&get_lock(), 1)) {}
+      #else
+        while (__sync_lock_test_and_set(&get_lock(), 1)) {}
+      #endif
+    }
+
+    static void unlock() {
+      #if defined(_MSC_VER)
+        _InterlockedExchange(&get_lock(), 0);
+      #else
+        __sync_lock_release(&get_lock());
+      #endif
+    }
+
+    // a dynarray has stopped using memory borrowed from a file
+    static void release_borrowed(const void *ptr) {
+      const uint8_t *bytes = (const uint8_t*)ptr;
+      mapped_file *owner = 0;
+      lock();
+      dynarray<mapped_file*> &files = get_open_files();
+      for (unsigned i = 0; i != files.size(); ++i) {
+        mapped_file *f = files[i];
+        if (bytes >= f->data_ && bytes < f->data_ + f->size_) {
+          owner = f;
+          break;
+        }
+      }
+      unlock();
+      // the borrow's own reference keeps owner alive until here
+      if (owner) owner->release();
+    }
+
+    // returns false if the file is not there
+    static bool get_stat(const char *path, size_t &size, time_t &mtime, unsigned &inode) {
+      struct stat st;
+      if (stat(path, &st)) return false;
+      size = (size_t)st.st_size;
+      mtime = st.st_mtime;
+      inode = (unsigned)st.st_ino;
+      return true;
+    }
+
+    bool map(const char *path) {
+      #if OCTET_MMAP && defined(_WIN32)
+        HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (file == INVALID_HANDLE_VALUE) return false;
+        mapping = CreateFileMappingA(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+        CloseHandle(file);
+        if (!mapping) return false;
+        data_ = (uint8_t*)MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+        if (!data_) {
+          CloseHandle(mapping);
+          mapping = NULL;
+          return false;
+        }
+        return true;
+      #elif OCTET_MMAP
+        int fd = ::open(path, O_RDONLY);
+        if (fd < 0) return false;
+        void *ptr = mmap(NULL, size_, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (ptr == MAP_FAILED) return false;
+        data_ = (uint8_t*)ptr;
+        return true;
+      #else
+        return false;
+      #endif
+    }
+
+    bool read(const char *path) {
+      FILE *file = fopen(path, "rb");
+      if (!file) return false;
+      data_ = (uint8_t*)allocator::malloc(size_);
+      size_t bytes = fread(data_, 1, size_, file);
+      fclose(file);
+      if (bytes != size_) {
+        allocator::free(data_, size_);
+        data_ = 0;
+        return false;
+      }
+      return true;
+    }
+
+  public:
+    mapped_file(const char *path) {
+      ref_cnt = 0;
+      data_ = 0;
+      size_ = 0;
+      mtime = 0;
+      inode = 0;
+      is_mapped_ = false;
+      path_ = path;
+      #if OCTET_MMAP && defined(_WIN32)
+        mapping = NULL;
+      #endif
+      dynarray_borrow::on_release() = release_borrowed;
+
+      if (!get_stat(path, size_, mtime, inode)) {
+        printf("file %s not found\n", path);
+      } else if (size_ != 0) {
+        is_mapped_ = map(path);
+        if (!is_mapped_ && !read(path)) {
+          printf("warning: could not read %s\n", path);
+          size_ = 0;
+        }
+      }
+    }
+
+    ~mapped_file() {
+      if (is_mapped_) {
+        #if OCTET_MMAP && defined(_WIN32)
+          UnmapViewOfFile(data_);
+          CloseHandle(mapping);
+        #elif OCTET_MMAP
+          munmap(data_, size_);
+        #endif
+      } else if (data_) {
+        allocator::free(data_, size_);
+      }
+    }
+
+    // map the file at path or share a mapping of it that is still current
+    static ref<mapped_file> open(const char *path) {
+      mapped_file *found = 0;
+      lock();
+      dynarray<mapped_file*> &files = get_open_files();
+      for (unsigned i = 0; i != files.size(); ++i) {
+        if (files[i]->path_ == path) {
+          found = files[i];
+          found->ref_cnt++;
+          break;
+        }
+      }
+      unlock();
+
+      // the file may have been saved again since it was mapped
+      ref<mapped_file> result = found && found->is_current(path) ? found : new mapped_file(path);
+      if (found) found->release();
+      return result;
+    }
+
+    // true if a mapping of path is still used by a reader or a dynarray
+    static bool is_open(const char *path) {
+      bool res = false;
+      lock();
+      dynarray<mapped_file*> &files = get_open_files();
+      for (unsigned i = 0; i != files.size(); ++i) {
+        res = res || files[i]->path_ == path;
+      }
+      unlock();
+      return res;
+    }
+
+    void add_ref() {
+      lock();
+      if (ref_cnt++ == 0) {
+        get_open_files().push_back(this);
+      }
+      unlock();
+    }
+
+    void release() {
+      lock();
+      bool is_last = --ref_cnt == 0;
+      if (is_last) {
+        dynarray<mapped_file*> &files = get_open_files();
+        for (unsigned i = 0; i != files.size(); ++i) {
+          if (files[i] == this) {
+            files[i] = files[files.size() - 1];
+            files.pop_back();
+            break;
+          }
+        }
+      }
+      unlock();
+      if (is_last) {
+        delete this;
+      }
+    }
+
+    // the bytes of the file, 0 if it could not be read
+    uint8_t *data() const {
+      return data_;
+    }
+
+    size_t size() const {
+      return size_;
+    }
+
+    // false if the file was read into memory
+    bool is_mapped() const {
+      return is_mapped_;
+    }
+
+    // false if the file at path has changed since it was mapped
+    bool is_current(const char *path) const {
+      size_t new_size = 0;
+      time_t new_mtime = 0;
+      unsigned new_inode = 0;
+      return get_stat(path, new_size, new_mtime, new_inode) && new_size == size_ && new_mtime == mtime && new_inode == inode;
+    }
+  };
+}
@@ -12,8 +12,8 @@
 namespace octet {
   class mesh_builder {
     struct vertex { float pos[3]; float normal[3]; float uv[2]; };
-    dynarray<vertex, allocator> vertices;
-    dynarray<unsigned short, allocator> indices;
+    dynarray<vertex, tagged_allocator<allocator::tag_geometry> > vertices;
+    dynarray<uint32_t, tagged_allocator<allocator::tag_geometry> > indices;
 
     struct sphere {
       vec4 center;
@@ -31,7 +31,7 @@ namespace octet {
 
     // For a cube, add the front face. Matrix transforms are used to add the others.
     void add_front_face(float size) {
-      unsigned short cur_vertex = (unsigned short)vertices.size();
+      unsigned cur_vertex = vertices.size();
       add_vertex(vec4(-size, -size, size, 1), vec4(0, 0, 1, 0), 0, 0);
       add_vertex(vec4(-size,  size, size, 1), vec4(0, 0, 1, 0), 0, 1);
       add_vertex(vec4( size,  size, size, 1), vec4(0, 0, 1, 0), 1, 1);
@@ -44,23 +44,6 @@ namespace octet {
       indices.push_back(cur_vertex+3);
     }
 
-    // add a ring in the x-y plane. Return index of first index
-    unsigned add_ring(float radius, const vec4 &normal, unsigned num_vertices, float v, float uvscale) {
-      float rnv = 1.0f / num_vertices;
-      float angle = 3.1415926536f * 2 * rnv;
-      float delta_c = cosf(angle), delta_s = sinf(angle);
-      mat4t save_matrix = matrix;
-      unsigned first_index = (unsigned)vertices.size();
-      float u = 0;
-      for (unsigned i = 0; i <= num_vertices; ++i) {
-        add_vertex(vec4(radius, 0, 0, 1), normal, u, v);
-        matrix.rotateSpecial(delta_c, delta_s, 0, 1);
-        u += rnv * uvscale;
-      }
-      matrix = save_matrix;
-      return first_index;
-    }
-
     void add_cone_or_sphere(float radius, float height, unsigned slices, unsigned stacks, float uvscale, bool is_sphere) {
       float rstacks = 1.0f / stacks;
 
@@ -95,14 +78,7 @@ namespace octet {
         //printf("%d/%d z=%f r=%f\n", i, stacks, z, ring_radius);
         v += rstacks * radius * uvscale;
         if (i != 0) {
-          for (unsigned j = 0; j != slices; ++j) {
-            indices.push_back(prev_ring + j);
-            indices.push_back(cur_ring + j);
-            indices.push_back(cur_ring + j + 1);
-            indices.push_back(prev_ring + j);
-            indices.push_back(cur_ring + j + 1);
-            indices.push_back(prev_ring + j + 1);
-          }
+          add_ring_strip(prev_ring, cur_ring, slices);
         }
         prev_ring = cur_ring;
       }
@@ -137,6 +113,37 @@ namespace octet {
       indices.push_back(index);
     }
 
+    // add a ring in the x-y plane. Return index of first index
+    // the normal is rotated with the ring, so (1, 0, 0) gives a radial normal.
+    unsigned add_ring(float radius, const vec4 &normal, unsigned num_vertices, float v, float uvscale) {
+      float rnv = 1.0f / num_vertices;
+      float angle = 3.1415926536f * 2 * rnv;
+      float delta_c = cosf(angle), delta_s = sinf(angle);
+      mat4t save_matrix = matrix;
+      unsigned first_index = (unsigned)vertices.size();
+      float u = 0;
+      for (unsigned i = 0; i <= num_vertices; ++i) {
+        add_vertex(vec4(radius, 0, 0, 1), normal, u, v);
+        matrix.rotateSpecial(delta_c, delta_s, 0, 1);
+        u += rnv * uvscale;
+      }
+      matrix = save_matrix;
+      return first_index;
+    }
+
+    // join two rings made by add_ring with a strip of triangles.
+    // rings can be shared between strips, as in a generalised cylinder.
+    void add_ring_strip(unsigned ring_a, unsigned ring_b, unsigned slices) {
+      for (unsigned j = 0; j != slices; ++j) {
+        indices.push_back(ring_a + j);
+        indices.push_back(ring_b + j);
+        indices.push_back(ring_b + j + 1);
+        indices.push_back(ring_a + j);
+        indices.push_back(ring_b + j + 1);
+        indices.push_back(ring_a + j + 1);
+      }
+    }
+
     // add a cube to the model at the current matrix location
     // as in glutSolidCube
     void add_cube(float size) {
@@ -163,7 +170,7 @@ namespace octet {
       float sizeBy2 = size * 0.5f;
       for (unsigned i = 0; i != nx; ++i) {
         for (unsigned j = 0; j != ny; ++j) {
-          unsigned short cur_vertex = (unsigned short)vertices.size();
+          unsigned cur_vertex = vertices.size();
           add_vertex(vec4( i*xsize+sizeBy2, j*ysize+sizeBy2, 0, 1), vec4(0, 0, 1, 0), 0, 0);
           add_vertex(vec4( i*xsize+sizeBy2, (j+1)*ysize+sizeBy2, 0, 1), vec4(0, 0, 1, 0), 0, 1);
           add_vertex(vec4( (i+1)*xsize+sizeBy2, (j+1)*ysize+sizeBy2, 0, 1), vec4(0, 0, 1, 0), 1, 1);
@@ -201,6 +208,23 @@ namespace octet {
     void translate(float x, float y, float z) {
       matrix.translate(x, y, z);
     }
+
+    // set the current orientation and position of components
+    void set_matrix(const mat4t &value) {
+      matrix = value;
+    }
+
+    const mat4t &get_matrix() const {
+      return matrix;
+    }
+
+    unsigned get_num_vertices() const {
+      return vertices.size();
+    }
+
+    unsigned get_num_indices() const {
+      return indices.size();
+    }
   };
 }
 
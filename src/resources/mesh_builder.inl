@@ -11,15 +11,41 @@
 // get a mesh mesh from the builder either as VBOs or allocated memory.
 namespace octet {
   inline void mesh_builder::get_mesh(mesh &s) {
-    unsigned isize = indices.size() * sizeof(indices[0]);
     unsigned vsize = vertices.size() * sizeof(vertices[0]);
     s.init();
-    s.allocate(vsize, isize);
-    s.assign(vsize, isize, (unsigned char*)&vertices[0], (unsigned char*)&indices[0]);
-    s.set_params(sizeof(vertex), indices.size(), vertices.size(), GL_TRIANGLES, GL_UNSIGNED_SHORT);
+
+    // use 16 bit indices where we can as GLES2 does not guarantee 32 bit indices.
+    if (vertices.size() <= 0x10000) {
+      arena_scope scope(arena::get_thread_scratch());
+      dynarray<uint16_t, arena_allocator> short_indices(indices.size());
+      for (unsigned i = 0; i != indices.size(); ++i) {
+        short_indices[i] = (uint16_t)indices[i];
+      }
+      unsigned isize = short_indices.size() * sizeof(short_indices[0]);
+      s.allocate(vsize, isize);
+      s.assign(vsize, isize, (unsigned char*)vertices.data(), (unsigned char*)short_indices.data());
+      s.set_params(sizeof(vertex), indices.size(), vertices.size(), GL_TRIANGLES, GL_UNSIGNED_SHORT);
+    } else {
+      unsigned isize = indices.size() * sizeof(indices[0]);
+      s.allocate(vsize, isize);
+      s.assign(vsize, isize, (unsigned char*)vertices.data(), (unsigned char*)indices.data());
+      s.set_params(sizeof(vertex), indices.size(), vertices.size(), GL_TRIANGLES, GL_UNSIGNED_INT);
+    }
 
     s.add_attribute(attribute_pos, 3, GL_FLOAT, 0);
     s.add_attribute(attribute_normal, 3, GL_FLOAT, 12);
     s.add_attribute(attribute_uv, 2, GL_FLOAT, 24);
+
+    // bounding box of the untransformed mesh
+    if (vertices.size()) {
+      vec3 min(vertices[0].pos[0], vertices[0].pos[1], vertices[0].pos[2]);
+      vec3 max = min;
+      for (unsigned i = 1; i != vertices.size(); ++i) {
+        vec3 pos(vertices[i].pos[0], vertices[i].pos[1], vertices[i].pos[2]);
+        min = min.min(pos);
+        max = max.max(pos);
+      }
+      s.set_aabb(aabb((min + max) * 0.5f, (max - min) * 0.5f));
+    }
   }
 }
@@ -82,11 +82,8 @@ namespace octet {
       }
       if (name[0] == '#') name++;
 
-      if (!dict.contains(name)) {
-        return NULL;
-      } else {
-        return dict[name];
-      }
+      ref<resource> *res = dict.find(name);
+      return res ? (resource*)*res : NULL;
     }
 
     scene *get_active_scene() const {
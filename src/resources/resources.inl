@@ -15,25 +15,11 @@ namespace octet {
     } else if (url[0] == '#') {
       return app_utils::get_solid_texture(gl_kind, url+1);
     } else {
-      dynarray<uint8_t> buffer;
       dynarray<uint8_t> image;
-      app_utils::get_url(buffer, url);
       uint16_t format = 0;
       uint16_t width = 0;
       uint16_t height = 0;
-      const unsigned char *src = &buffer[0];
-      const unsigned char *src_max = src + buffer.size();
-      if (buffer.size() >= 6 && !memcmp(&buffer[0], "GIF89a", 6)) {
-        gif_decoder dec;
-        dec.get_image(image, format, width, height, src, src_max);
-      } else if (buffer.size() >= 6 && buffer[0] == 0xff && buffer[1] == 0xd8) {
-        jpeg_decoder dec;
-        dec.get_image(image, format, width, height, src, src_max);
-      } else if (buffer.size() >= 6 && buffer[0] == 0 && buffer[1] == 0 && buffer[2] == 2) {
-        tga_decoder dec;
-        dec.get_image(image, format, width, height, src, src_max);
-      } else {
-        printf("warning: unknown texture format\n");
+      if (!app_utils::decode_image(image, format, width, height, url)) {
         return 0;
       }
 
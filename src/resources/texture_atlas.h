@@ -0,0 +1,324 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Andy Thomason 2012, 2013
+//
+// Modular Framework for OpenGLES2 rendering on multiple platforms.
+//
+// Texture atlas: packs several images into one RGBA texture.
+//
+// Images are added by url and packed onto shelves, tallest first, with a border
+// of padding texels around each one so that linear filtering does not bleed
+// between neighbours. Each image gets a handle which maps to a uv rectangle
+// in the atlas.
+//
+// The packed atlas can be written to a cache file next to the source images
+// and is reloaded from there while the source files keep the same contents.
+//
+
+namespace octet {
+  class texture_atlas {
+    enum {
+      cache_magic = 0x4154434f, // "OCTA"
+      cache_version = 2,
+      flag_wrap = 1,
+    };
+
+    struct image_t {
+      string url;
+      unsigned flags;
+      unsigned source_size;
+      unsigned source_hash;
+
+      // position of the image in the atlas, excluding padding
+      unsigned x, y, width, height;
+    };
+
+    dynarray<image_t> images;
+    dynarray<uint8_t> pixels;
+    unsigned width;
+    unsigned height;
+    unsigned padding;
+    GLuint texture;
+
+    static unsigned next_pow2(unsigned x) {
+      unsigned r = 1;
+      while (r < x) r *= 2;
+      return r;
+    }
+
+    // size and FNV-1a hash of a file's contents, so that edits which keep
+    // the size still invalidate the cache. false if the file is missing.
+    static bool get_file_info(const char *url, unsigned &size, unsigned &hash) {
+      size = 0;
+      hash = 2166136261u;
+      FILE *file = fopen(app_utils::get_path(url), "rb");
+      if (!file) return false;
+      uint8_t buffer[4096];
+      size_t bytes;
+      while ((bytes = fread(buffer, 1, sizeof(buffer), file)) != 0) {
+        for (size_t i = 0; i != bytes; ++i) {
+          hash = (hash ^ buffer[i]) * 16777619u;
+        }
+        size += (unsigned)bytes;
+      }
+      fclose(file);
+      return true;
+    }
+
+    // sort key for packing: tallest first, then widest
+    static bool packs_before(const image_t &a, const image_t &b) {
+      return a.height != b.height ? a.height > b.height : a.width > b.width;
+    }
+
+    // decode an image to RGBA, appending it to rgba
+    static bool load_rgba(dynarray<uint8_t> &rgba, unsigned &w, unsigned &h, const char *url) {
+      dynarray<uint8_t> image;
+      uint16_t format = 0, width = 0, height = 0;
+      if (!app_utils::decode_image(image, format, width, height, url) || !width || !height) {
+        printf("warning: texture_atlas could not load %s\n", url);
+        return false;
+      }
+
+      w = width;
+      h = height;
+      unsigned offset = rgba.size();
+      rgba.resize(offset + w * h * 4);
+      if (format == GL_RGBA) {
+        memcpy(&rgba[offset], image.data(), w * h * 4);
+      } else {
+        const uint8_t *src = image.data();
+        uint8_t *dest = &rgba[offset];
+        for (unsigned i = 0; i != w * h; ++i, src += 3, dest += 4) {
+          dest[0] = src[0]; dest[1] = src[1]; dest[2] = src[2]; dest[3] = 0xff;
+        }
+      }
+      return true;
+    }
+
+    // copy an image and its padding into the atlas.
+    // wrapped images pad with texels from the opposite edge, others repeat the edge.
+    void blit(const image_t &img, const uint8_t *rgba) {
+      int p = (int)padding;
+      int w = (int)img.width, h = (int)img.height;
+      bool wrap = (img.flags & flag_wrap) != 0;
+      for (int y = -p; y < h + p; ++y) {
+        int sy = wrap ? (y + h * p) % h : (y < 0 ? 0 : y >= h ? h - 1 : y);
+        uint32_t *dest = (uint32_t*)&pixels[((img.y + y) * width + img.x) * 4];
+        const uint32_t *src = (const uint32_t*)&rgba[sy * w * 4];
+        for (int x = -p; x < w + p; ++x) {
+          int sx = wrap ? (x + w * p) % w : (x < 0 ? 0 : x >= w ? w - 1 : x);
+          dest[x] = src[sx];
+        }
+      }
+    }
+
+    // shelf pack the images into the smallest power of two square-ish texture
+    void pack(const dynarray<uint8_t> &decoded, const dynarray<unsigned> &offsets) {
+      unsigned num_images = images.size();
+      dynarray<unsigned> order;
+      unsigned area = 0, max_width = 0;
+      for (unsigned i = 0; i != num_images; ++i) {
+        unsigned pw = images[i].width + padding * 2;
+        unsigned ph = images[i].height + padding * 2;
+        area += pw * ph;
+        if (pw > max_width) max_width = pw;
+
+        // insertion sort, there are only a few images
+        unsigned j = order.size();
+        order.push_back(i);
+        while (j > 0 && packs_before(images[i], images[order[j-1]])) {
+          order[j] = order[j-1];
+          j--;
+        }
+        order[j] = i;
+      }
+
+      width = next_pow2(max_width);
+      while (width * width < area) width *= 2;
+
+      unsigned shelf_x = 0, shelf_y = 0, shelf_height = 0;
+      for (unsigned i = 0; i != num_images; ++i) {
+        image_t &img = images[order[i]];
+        unsigned pw = img.width + padding * 2;
+        unsigned ph = img.height + padding * 2;
+        if (shelf_x + pw > width) {
+          shelf_y += shelf_height;
+          shelf_x = shelf_height = 0;
+        }
+        img.x = shelf_x + padding;
+        img.y = shelf_y + padding;
+        shelf_x += pw;
+        if (ph > shelf_height) shelf_height = ph;
+      }
+      height = next_pow2(shelf_y + shelf_height);
+
+      pixels.resize(width * height * 4);
+      memset(pixels.data(), 0, pixels.size());
+      for (unsigned i = 0; i != num_images; ++i) {
+        blit(images[i], &decoded[offsets[i]]);
+      }
+    }
+
+    // try to use the cached atlas, fails if any source has changed
+    bool read_cache(const char *cache_url) {
+      FILE *file = fopen(app_utils::get_path(cache_url), "rb");
+      if (!file) return false;
+      fclose(file);
+
+      dynarray<uint8_t> buffer;
+      app_utils::get_url(buffer, cache_url);
+      const uint8_t *src = buffer.data();
+      const uint8_t *src_max = src + buffer.size();
+
+      struct reader {
+        const uint8_t *&src, *src_max;
+        reader(const uint8_t *&src_, const uint8_t *src_max_) : src(src_), src_max(src_max_) {}
+        bool get(unsigned &value) {
+          if (src + 4 > src_max) return false;
+          value = src[0] | (src[1] << 8) | (src[2] << 16) | (src[3] << 24);
+          src += 4;
+          return true;
+        }
+      } r(src, src_max);
+
+      unsigned magic, version, num_images, cached_padding;
+      if (!r.get(magic) || magic != cache_magic) return false;
+      if (!r.get(version) || version != cache_version) return false;
+      if (!r.get(num_images) || num_images != images.size()) return false;
+      if (!r.get(cached_padding) || cached_padding != padding) return false;
+      if (!r.get(width) || !r.get(height)) return false;
+
+      for (unsigned i = 0; i != num_images; ++i) {
+        image_t &img = images[i];
+        unsigned len, flags, size, hash;
+        if (!r.get(len) || src + len > src_max) return false;
+        if (len != strlen(img.url.c_str()) || memcmp(src, img.url.c_str(), len)) return false;
+        src += len;
+        if (!r.get(flags) || flags != img.flags) return false;
+        if (!r.get(size) || size != img.source_size) return false;
+        if (!r.get(hash) || hash != img.source_hash) return false;
+        if (!r.get(img.x) || !r.get(img.y) || !r.get(img.width) || !r.get(img.height)) return false;
+      }
+
+      unsigned bytes = width * height * 4;
+      if (src + bytes != src_max) return false;
+      pixels.resize(bytes);
+      memcpy(pixels.data(), src, bytes);
+      return true;
+    }
+
+    void write_cache(const char *cache_url) {
+      FILE *file = fopen(app_utils::get_path(cache_url), "wb");
+      if (!file) {
+        printf("warning: could not write texture atlas cache %s\n", cache_url);
+        return;
+      }
+
+      struct writer {
+        FILE *file;
+        writer(FILE *file_) : file(file_) {}
+        void put(unsigned value) {
+          uint8_t bytes[4] = { (uint8_t)value, (uint8_t)(value >> 8), (uint8_t)(value >> 16), (uint8_t)(value >> 24) };
+          fwrite(bytes, 1, 4, file);
+        }
+      } w(file);
+
+      w.put(cache_magic);
+      w.put(cache_version);
+      w.put(images.size());
+      w.put(padding);
+      w.put(width);
+      w.put(height);
+      for (unsigned i = 0; i != images.size(); ++i) {
+        image_t &img = images[i];
+        unsigned len = strlen(img.url.c_str());
+        w.put(len);
+        fwrite(img.url.c_str(), 1, len, file);
+        w.put(img.flags);
+        w.put(img.source_size);
+        w.put(img.source_hash);
+        w.put(img.x);
+        w.put(img.y);
+        w.put(img.width);
+        w.put(img.height);
+      }
+      fwrite(pixels.data(), 1, pixels.size(), file);
+      fclose(file);
+    }
+
+  public:
+    texture_atlas(unsigned padding_ = 2)
+    : width(0)
+    , height(0)
+    , padding(padding_)
+    , texture(0)
+    {
+    }
+
+    // queue an image for the atlas and return its handle.
+    // wrap is for images that are repeated with uvs outside 0..1.
+    unsigned add_image(const char *url, bool wrap = false) {
+      images.push_back(image_t());
+      image_t &img = images.back();
+      img.url = url;
+      img.flags = wrap ? flag_wrap : 0;
+      img.source_size = img.source_hash = 0;
+      img.x = img.y = img.width = img.height = 0;
+      return images.size() - 1;
+    }
+
+    // pack the images and make the texture.
+    // if cache_url is given, the packed atlas is loaded from or saved to it.
+    bool build(const char *cache_url = NULL) {
+      for (unsigned i = 0; i != images.size(); ++i) {
+        get_file_info(images[i].url.c_str(), images[i].source_size, images[i].source_hash);
+      }
+
+      if (!cache_url || !read_cache(cache_url)) {
+        dynarray<uint8_t> decoded;
+        dynarray<unsigned> offsets;
+        for (unsigned i = 0; i != images.size(); ++i) {
+          offsets.push_back(decoded.size());
+          if (!load_rgba(decoded, images[i].width, images[i].height, images[i].url.c_str())) {
+            return false;
+          }
+        }
+        pack(decoded, offsets);
+        if (cache_url) write_cache(cache_url);
+      }
+
+      texture = app_utils::make_texture(GL_RGBA, pixels.data(), pixels.size(), GL_RGBA, width, height);
+      return texture != 0;
+    }
+
+    // the texture to bind for every image in the atlas
+    GLuint get_texture() const {
+      return texture;
+    }
+
+    unsigned get_width() const {
+      return width;
+    }
+
+    unsigned get_height() const {
+      return height;
+    }
+
+    unsigned get_num_images() const {
+      return images.size();
+    }
+
+    // uv rectangle of an image as (u offset, v offset, u scale, v scale)
+    vec4 get_uv_rect(unsigned handle) const {
+      const image_t &img = images[handle];
+      float rw = 1.0f / width, rh = 1.0f / height;
+      return vec4(img.x * rw, img.y * rh, img.width * rw, img.height * rh);
+    }
+
+    // map a 0..1 uv in an image to a uv in the atlas
+    vec2 remap(unsigned handle, const vec2 &uv) const {
+      vec4 r = get_uv_rect(handle);
+      return vec2(r.x() + uv.x() * r.z(), r.y() + uv.y() * r.w());
+    }
+  };
+}
@@ -20,7 +20,7 @@ namespace octet {
   };
 
   class visitor {
-    enum { debug = true };
+    enum { debug = false };
     unsigned depth;
     bool error;
 
@@ -74,11 +74,15 @@ namespace octet {
 
     // when loading, we use these functions as well
     virtual bool is_reader() { return false; }
+    // the format version of the file being read. writers write the newest.
+    virtual unsigned get_version() const { return ~0u; }
     virtual bool begin_read_ref(void *&ref, atom_t &sid, atom_t &type) { return false; }
     virtual bool begin_read_ref(void *&ref, int index, atom_t &type) { return false; }
     virtual bool begin_read_ref(void *&ref, const char *&sid, atom_t &type) { return false; }
     virtual unsigned begin_read_dynarray(unsigned elem_size, atom_t &sid) { return 0; }
     virtual void end_read_dynarray(void *ptr, unsigned bytes) {}
+    // readers of mapped files may lend the bytes of a dynarray instead of copying them
+    virtual void *borrow_dynarray(unsigned bytes) { return 0; }
     virtual void add_new_ref(void *ref) {}
     virtual bool begin_agg(void *ref, atom_t sid, atom_t type) { return true; }
     virtual void end_agg() {}
@@ -272,8 +276,13 @@ namespace octet {
       if (error) return;
       if (is_reader()) {
         unsigned size = begin_read_dynarray(sizeof(value[0]), sid);
-        value.resize(size);
-        end_read_dynarray((void*)&value[0], sizeof(type) * value.size());
+        void *bytes = size ? borrow_dynarray(sizeof(type) * size) : 0;
+        if (bytes) {
+          value.borrow((type*)bytes, size);
+        } else {
+          value.resize(size);
+          end_read_dynarray((void*)&value[0], sizeof(type) * value.size());
+        }
       } else {
         if (value.size()) {
           visit_bin((void*)&value[0], sizeof(type) * value.size(), sid, atom_dynarray);
@@ -80,7 +80,7 @@ namespace octet {
       stack.pop_back();
     }
 
-    void visit_bin(void *value, unsigned size, atom_t sid, atom_t type) {
+    void visit_bin(void *value, size_t size, atom_t sid, atom_t type) {
       if (size <= 16) {
         stack.back()->SetAttribute(app_utils::get_atom_name(sid), to_hex(value, size));
       } else {
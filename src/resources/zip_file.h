@@ -5,23 +5,37 @@
 // Modular Framework for OpenGLES2 rendering on multiple platforms.
 //
 // Zip file reader, uses zip_decoder to inflate compressed files.
+//
+// The zip file is mapped, so the directory and the files are read straight
+// from memory. get_files() extracts many files at once on the thread_pool.
 
 namespace octet {
   class zip_file {
     int ref_cnt;
-    FILE *the_file;
+    ref<mapped_file> the_file;
 
     struct dir_entry {
       uint32_t offset;
       uint32_t csize;
       uint32_t usize;
       uint32_t compression;
+      uint32_t crc;
     };
 
     dictionary<dir_entry> directory;
 
     zip_decoder decoder;
 
+    // work shared by the get_files() tasks
+    struct batch_t {
+      zip_file *zip;
+      const char **files;
+      dynarray<uint8_t> *buffers;
+      zip_decoder **decoders; // one for each pool thread, made on first use
+      bool verify_crc;
+      int num_ok;
+    };
+
     // read little endian bytes on any machine
     static unsigned u4(const uint8_t *src) {
       return src[0] + src[1] * 256 + src[2] * 65536 + src[3] * 0x1000000;
@@ -39,73 +53,49 @@ namespace octet {
       return (int16_t)(src[0] + src[1] * 256);
     }
 
-  public:
-    zip_file(const char *filename) {
-      ref_cnt = 0;
-      the_file = fopen(filename, "rb");
-      if (!the_file) {
-        printf("file %s not found\n", filename);
-      } else {
-        uint8_t tmp[256];
-        unsigned tmp_size = (unsigned)sizeof(tmp);
-        fseek(the_file, 0, SEEK_END);
-        long file_size = ftell(the_file);
-        long search_offset = file_size - (long)tmp_size;
-        search_offset = search_offset < 0 ? 0 : search_offset;
-        fseek(the_file, search_offset, SEEK_SET);
-        fread(&tmp, 1, tmp_size, the_file);
-        for( unsigned i = 0; i != tmp_size; ++i) {
-          if (u4(tmp + i) == 0x06054b50) {
-            dynarray<uint8_t> dir;
-            dir.resize(u4(tmp + i + 12));
-            fseek(the_file, (long)u4(tmp + i + 16), SEEK_SET);
-            fread(&dir[0], 1, dir.size(), the_file);
-            for (unsigned i = 0; i + 4 < dir.size();) {
-              uint8_t *p = &dir[i];
-              if (u4(p) != 0x02014b50) break;
-              struct dir_entry d;
-              d.compression = u2(p + 10);
-              d.csize = u4(p + 20);
-              d.usize = u4(p + 24);
-              unsigned file_name_len = u2(p + 28);
-              unsigned extra_len = u2(p + 30);
-              string file;
-              file.set((const char*)(p + 46), file_name_len);
-              i += 46 + file_name_len + extra_len;
-              d.offset = u4(p + 42);// + (46 + file_name_len + extra_len);
-              for (unsigned i = 0; file[i]; ++i) {
-                if (file[i] == '\\') file[i] = '/';
-              }
-              //printf("%s\n", file.c_str());
-              directory[file] = d;
-            }
-            break;
-          }
-        }
-      }
-    }
+    // read the central directory, found from the record at the end of the file
+    void read_directory() {
+      const uint8_t *data = the_file->data();
+      size_t size = the_file->size();
+      if (size < 22) return;
 
-    ~zip_file() {
-      if (the_file) fclose(the_file);
-    }
-
-    void add_ref() {
-      ref_cnt++;
-    }
+      // the end record is followed by a comment of up to 64k
+      size_t min_pos = size > 22 + 0xffff ? size - 22 - 0xffff : 0;
+      for (size_t pos = size - 22; pos + 1 > min_pos; --pos) {
+        const uint8_t *end = data + pos;
+        if (u4(end) != 0x06054b50) continue;
+        size_t dir_size = u4(end + 12);
+        size_t dir_offset = u4(end + 16);
+        if (dir_offset > size || dir_size > size - dir_offset) break;
 
-    void release() {
-      if (--ref_cnt) {
-        delete this;
+        const uint8_t *dir = data + dir_offset;
+        for (size_t i = 0; i + 46 <= dir_size;) {
+          const uint8_t *p = dir + i;
+          if (u4(p) != 0x02014b50) break;
+          struct dir_entry d;
+          d.compression = u2(p + 10);
+          d.crc = u4(p + 16);
+          d.csize = u4(p + 20);
+          d.usize = u4(p + 24);
+          unsigned file_name_len = u2(p + 28);
+          unsigned extra_len = u2(p + 30);
+          unsigned comment_len = u2(p + 32);
+          d.offset = u4(p + 42);
+          if (i + 46 + file_name_len > dir_size) break;
+          string file;
+          file.set((const char*)(p + 46), file_name_len);
+          i += 46 + file_name_len + extra_len + comment_len;
+          for (unsigned j = 0; file[j]; ++j) {
+            if (file[j] == '\\') file[j] = '/';
+          }
+          directory[file] = d;
+        }
+        break;
       }
     }
 
-    void get_file(dynarray<uint8_t> &buffer, const char *file) {
-      int index = directory.get_index(file);
-      if (index < 0) return;
-      if (!the_file) return;
-      const dir_entry &d = directory.get_value(index);
-      buffer.resize(d.usize);
-      fseek(the_file, d.offset, SEEK_SET);
+    // the compressed bytes of a file, 0 if they are not in the zip file
+    const uint8_t *get_data(const dir_entry &d) {
       /*local file header signature     4 bytes  (0x04034b50) 0
       version needed to extract       2 bytes 4
       general purpose bit flag        2 bytes 6
@@ -117,18 +107,112 @@ namespace octet {
       uncompressed size               4 bytes 22
       file name length                2 bytes 26
       extra field length              2 bytes 28 / 30*/
+      const uint8_t *data = the_file->data();
+      size_t size = the_file->size();
+      if (d.offset > size || size - d.offset < 30) return 0;
+      const uint8_t *header = data + d.offset;
+      if (u4(header) != 0x04034b50) return 0;
+      size_t start = (size_t)d.offset + 30 + u2(header + 26) + u2(header + 28);
+      if (start > size || size - start < d.csize) return 0;
+      return data + start;
+    }
 
-      uint8_t tmp[30];
-      fread(tmp, 1, sizeof(tmp), the_file);
-      if (u4(tmp) != 0x04034b50) return;
-      unsigned extra = u2(tmp + 26) + u2(tmp + 28);
-      fseek(the_file, d.offset + 30 + extra, SEEK_SET);
+    bool extract(zip_decoder &dec, dynarray<uint8_t> &buffer, const char *file, bool verify_crc) {
+      int index = directory.get_index(file);
+      if (index < 0) return false;
+      const dir_entry &d = directory.get_value(index);
+      const uint8_t *src = get_data(d);
+      if (!src) return false;
+
+      buffer.resize_uninitialized(d.usize);
+      bool ok = false;
       if (d.compression == 0) {
-        fread(buffer.data(), 1, d.usize, the_file);
+        ok = d.csize == d.usize;
+        if (ok) memcpy(buffer.data(), src, d.usize);
       } else if (d.compression == 8) {
-        dynarray<uint8_t> uncomp(d.csize + 4); // note: + 4 bytes prevents decode() overflowing
-        fread(uncomp.data(), 1, d.csize, the_file);
-        decoder.decode(buffer.data(), buffer.data() + d.usize, uncomp.data(), uncomp.data() + d.csize);
+        // a stream that ends early would leave the end of the buffer undefined
+        uint8_t *end = 0;
+        ok = dec.decode(buffer.data(), buffer.data() + d.usize, src, src + d.csize, &end);
+        ok = ok && end == buffer.data() + d.usize;
+      }
+      if (ok && verify_crc) {
+        ok = zip_decoder::crc32(0, buffer.data(), buffer.size()) == d.crc;
+      }
+      if (!ok) {
+        printf("warning: %s is damaged in the zip file\n", file);
+      }
+      return ok;
+    }
+
+    static void extract_task(void *context, unsigned index, unsigned thread) {
+      batch_t &b = *(batch_t*)context;
+      // the caller may be using the member decoder, so thread 0 gets its own too.
+      // the shared tables were made by the member decoder, so this is safe on any thread
+      zip_decoder *&dec = b.decoders[thread];
+      if (!dec) dec = new zip_decoder();
+      if (b.zip->extract(*dec, b.buffers[index], b.files[index], b.verify_crc)) {
+        thread_pool::atomic_add(&b.num_ok, 1);
+      }
+    }
+
+  public:
+    zip_file(const char *filename) {
+      ref_cnt = 0;
+      the_file = new mapped_file(filename);
+      read_directory();
+    }
+
+    ~zip_file() {
+    }
+
+    void add_ref() {
+      ref_cnt++;
+    }
+
+    void release() {
+      if (--ref_cnt == 0) {
+        delete this;
+      }
+    }
+
+    // returns false if the file is not there or is damaged.
+    // with verify_crc, the file is also checked against its crc.
+    bool get_file(dynarray<uint8_t> &buffer, const char *file, bool verify_crc=false) {
+      return extract(decoder, buffer, file, verify_crc);
+    }
+
+    // extract num_files files in parallel, buffers[i] gets files[i].
+    // returns the number extracted without error.
+    unsigned get_files(dynarray<uint8_t> *buffers, const char **files, unsigned num_files, bool verify_crc=false) {
+      thread_pool &pool = thread_pool::get_default();
+      batch_t b;
+      b.zip = this;
+      b.files = files;
+      b.buffers = buffers;
+      b.verify_crc = verify_crc;
+      b.num_ok = 0;
+
+      dynarray<zip_decoder*> decoders;
+      decoders.resize(pool.get_num_threads());
+      for (unsigned i = 0; i != decoders.size(); ++i) {
+        decoders[i] = 0;
+      }
+      b.decoders = decoders.data();
+
+      pool.run(num_files, extract_task, &b);
+
+      for (unsigned i = 0; i != decoders.size(); ++i) {
+        delete decoders[i];
+      }
+      return (unsigned)b.num_ok;
+    }
+
+    // names of the files in the zip, in no particular order
+    void get_file_names(dynarray<string> &names) {
+      names.resize(0);
+      for (unsigned i = 0; i != directory.get_num_indices(); ++i) {
+        const char *key = directory.get_key(i);
+        if (key) names.push_back(string(key));
       }
     }
   };
@@ -237,6 +237,7 @@ namespace octet {
 
     // load the image from a file
     void load() {
+      allocator_tag_scope tag(allocator::tag_texture);
       dynarray<uint8_t> buffer;
       app_utils::get_url(buffer, url);
       const unsigned char *src = &buffer[0];
@@ -270,8 +271,7 @@ namespace octet {
 
         // make a new texture handle
         glGenTextures(1, &gl_texture);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, gl_texture);
+        gl_state::bind_texture(0, GL_TEXTURE_2D, gl_texture);
 
         // todo: handle compressed textures
         if (format == GL_RGB || format == GL_RGBA) {
@@ -311,8 +311,8 @@ namespace octet {
           //printf("%d %d\n", src - image_, size);
         }
 
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        gl_state::tex_parameter(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        gl_state::tex_parameter(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
       }
       return gl_texture;
     }
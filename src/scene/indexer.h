@@ -6,101 +6,327 @@
 //
 // Index modifier. Reduce vertices to the minimum set
 //
+// Welding is done in parallel on the default thread_pool:
+//   1. hash the vertices in chunks
+//   2. share the indices out to partitions by hash
+//   3. weld each partition with its own hash_map
+//   4. number the new vertices and remap the indices in chunks
+//
+// Each index remembers the first index with an equal vertex, so the
+// vertices come out in the order they are first used, whatever the
+// number of threads, just as welding them one at a time would.
+//
+// With a weld epsilon, float positions are snapped to the nearest multiple
+// of it before comparing, so vertices in the same cell whose other attributes
+// match become one. The first one used keeps its exact position. Vertices
+// closer than epsilon but in neighbouring cells are not welded. Positions too
+// far out for a cell number are compared exactly.
+//
 
 namespace octet {
   class indexer : public mesh {
     struct vertex {
       const uint8_t *bytes;
       unsigned size;
+      unsigned hash;
+      bool exact;  // the position was not snapped
 
       bool is_empty() const { return bytes == 0; }
 
       bool operator ==(const vertex &rhs) const {
-        //printf("%p %p %d\n", this, &rhs, size == rhs.size && memcmp(bytes, rhs.bytes, size) == 0);
-        return size == rhs.size && memcmp(bytes, rhs.bytes, size) == 0;
+        return size == rhs.size && exact == rhs.exact && memcmp(bytes, rhs.bytes, size) == 0;
       }
 
-      unsigned get_hash() const {
+      static unsigned calc_hash(const uint8_t *bytes, unsigned size) {
         unsigned hash = 0;
-        for (unsigned i = 0; i != size; ++i) {
-          hash = ( hash * 7 ) + ( hash >> 13 ) + bytes[i];
-          //printf("%02x ", bytes[i]);
+        unsigned i = 0;
+        for (; i + 4 <= size; i += 4) {
+          uint32_t word;
+          memcpy(&word, bytes + i, 4);
+          hash = ( hash * 0x01000193 ) ^ word;
         }
-        //printf("%d hash=%08x\n", size, hash_map_cmp::fuzz_hash(hash));
-        return hash;
+        for (; i != size; ++i) {
+          hash = ( hash * 0x01000193 ) ^ bytes[i];
+        }
+        return hash_map_cmp::fuzz_hash(hash);
       }
     };
 
     class vertex_cmp : public hash_map_cmp {
     public:
-      static unsigned get_hash(const vertex &key) { return fuzz_hash(key.get_hash()); }
+      static unsigned get_hash(const vertex &key) { return key.hash; }
       static bool is_empty(const vertex &key) { return key.is_empty(); }
     };
 
+    enum {
+      chunk_size = 0x10000,
+      max_partition_bits = 6,
+    };
+
+    // work shared by the weld tasks
+    struct weld_t {
+      const uint32_t *src_indices;
+      const uint8_t *src_vertices;
+      unsigned num_indices;
+      unsigned num_vertices;
+      unsigned stride;
+
+      // what is compared: the vertices, or a copy with the positions snapped
+      const uint8_t *keys;
+      dynarray<uint8_t> snapped;
+      dynarray<uint8_t> exact;      // for each source vertex, 1 if too far out to snap
+      unsigned pos_offset;
+      unsigned pos_size;
+      float epsilon;
+
+      unsigned num_chunks;
+      unsigned partition_bits;
+
+      dynarray<unsigned> hashes;    // for each source vertex
+      dynarray<unsigned> offsets;   // for each chunk and partition, where its indices go in order
+      dynarray<unsigned> order;     // index positions, grouped by partition
+      dynarray<unsigned> first;     // for each index, the first index with an equal vertex
+      dynarray<unsigned> new_base;  // for each chunk, the number of the first new vertex
+
+      uint32_t *dest_indices;
+      uint8_t *dest_vertices;
+
+      unsigned get_partition(unsigned idx) const {
+        return partition_bits ? ( hashes[idx] * 0x9e3779b1 ) >> ( 32 - partition_bits ) : 0;
+      }
+
+      unsigned get_chunk_end(unsigned chunk, unsigned num) const {
+        unsigned end = ( chunk + 1 ) * chunk_size;
+        return end < num ? end : num;
+      }
+    };
+
     // source mesh. Provides underlying geometry.
     ref<mesh> src;
 
+    // positions closer than this may be welded. 0 welds only equal vertices.
+    float weld_epsilon;
+
+    static void hash_task(void *context, unsigned chunk, unsigned thread) {
+      weld_t &w = *(weld_t*)context;
+      unsigned end = w.get_chunk_end(chunk, w.num_vertices);
+      for (unsigned v = chunk * chunk_size; v < end; ++v) {
+        if (w.epsilon > 0) {
+          float *pos = (float*)(&w.snapped[v * w.stride] + w.pos_offset);
+          float cells[4];
+          bool in_range = true;
+          for (unsigned i = 0; i != w.pos_size; ++i) {
+            cells[i] = floorf(pos[i] / w.epsilon + 0.5f);
+            // also false for nan
+            in_range = in_range && cells[i] >= -2147483648.0f && cells[i] < 2147483648.0f;
+          }
+          if (in_range) {
+            for (unsigned i = 0; i != w.pos_size; ++i) {
+              int32_t cell = (int32_t)cells[i];
+              memcpy(pos + i, &cell, 4);
+            }
+          }
+          w.exact[v] = !in_range;
+        }
+        w.hashes[v] = vertex::calc_hash(w.keys + v * w.stride, w.stride) ^ ( w.epsilon > 0 && w.exact[v] );
+      }
+    }
+
+    static void count_task(void *context, unsigned chunk, unsigned thread) {
+      weld_t &w = *(weld_t*)context;
+      unsigned *counts = &w.offsets[chunk << w.partition_bits];
+      unsigned end = w.get_chunk_end(chunk, w.num_indices);
+      for (unsigned i = chunk * chunk_size; i < end; ++i) {
+        counts[w.get_partition(w.src_indices[i])]++;
+      }
+    }
+
+    static void scatter_task(void *context, unsigned chunk, unsigned thread) {
+      weld_t &w = *(weld_t*)context;
+      unsigned *offsets = &w.offsets[chunk << w.partition_bits];
+      unsigned end = w.get_chunk_end(chunk, w.num_indices);
+      for (unsigned i = chunk * chunk_size; i < end; ++i) {
+        w.order[offsets[w.get_partition(w.src_indices[i])]++] = i;
+      }
+    }
+
+    // the indices of a partition are in order, so the first of
+    // each vertex found is the first used.
+    static void weld_task(void *context, unsigned partition, unsigned thread) {
+      weld_t &w = *(weld_t*)context;
+      unsigned num_partitions = 1 << w.partition_bits;
+      unsigned begin = partition == 0 ? 0 : w.offsets[( w.num_chunks - 1 ) * num_partitions + partition - 1];
+      unsigned end = w.offsets[( w.num_chunks - 1 ) * num_partitions + partition];
+
+      hash_map<vertex, unsigned, vertex_cmp> vertex_to_index;
+      vertex_to_index.reserve(end - begin);
+      for (unsigned k = begin; k != end; ++k) {
+        unsigned i = w.order[k];
+        uint32_t idx = w.src_indices[i];
+        vertex v = { w.keys + idx * w.stride, w.stride, w.hashes[idx], w.epsilon > 0 && w.exact[idx] };
+        unsigned &e = vertex_to_index[v];
+        if (e == 0) { // hash_map inits to zero
+          e = i + 1;
+        }
+        w.first[i] = e - 1;
+      }
+    }
+
+    static void count_new_task(void *context, unsigned chunk, unsigned thread) {
+      weld_t &w = *(weld_t*)context;
+      unsigned end = w.get_chunk_end(chunk, w.num_indices);
+      unsigned num_new = 0;
+      for (unsigned i = chunk * chunk_size; i < end; ++i) {
+        num_new += w.first[i] == i;
+      }
+      w.new_base[chunk] = num_new;
+    }
+
+    static void copy_task(void *context, unsigned chunk, unsigned thread) {
+      weld_t &w = *(weld_t*)context;
+      unsigned end = w.get_chunk_end(chunk, w.num_indices);
+      unsigned e = w.new_base[chunk];
+      for (unsigned i = chunk * chunk_size; i < end; ++i) {
+        if (w.first[i] == i) {
+          memcpy(w.dest_vertices + e * w.stride, w.src_vertices + w.src_indices[i] * w.stride, w.stride);
+          w.dest_indices[i] = e++;
+        }
+      }
+    }
+
+    // the first use of a vertex is always numbered by copy_task
+    static void remap_task(void *context, unsigned chunk, unsigned thread) {
+      weld_t &w = *(weld_t*)context;
+      unsigned end = w.get_chunk_end(chunk, w.num_indices);
+      for (unsigned i = chunk * chunk_size; i < end; ++i) {
+        if (w.first[i] != i) {
+          w.dest_indices[i] = w.dest_indices[w.first[i]];
+        }
+      }
+    }
+
   public:
     RESOURCE_META(indexer)
 
-    indexer(mesh *src=0) {
+    indexer(mesh *src=0, float weld_epsilon=0) {
       this->src = src;
+      this->weld_epsilon = weld_epsilon;
       update();
     }
 
+    // weld positions closer than about epsilon. Call update() after.
+    void set_weld_epsilon(float epsilon) {
+      weld_epsilon = epsilon;
+    }
+
+    float get_weld_epsilon() const {
+      return weld_epsilon;
+    }
+
     void update() {
       if (!src) return;
 
       *(mesh*)this = *(mesh*)src;
 
-      if (get_index_type() != GL_UNSIGNED_INT) return;
-
-      hash_map<vertex, unsigned, vertex_cmp> vertex_to_index;
+      if (get_index_type() != GL_UNSIGNED_INT || get_num_indices() == 0) return;
 
-      dynarray<uint8_t> dest_vertices;
-      dynarray<uint32_t> dest_indices;
-      dest_indices.reserve(get_num_indices());
+      OCTET_PROFILE_SCOPE("weld");
 
       gl_resource::rolock idx_lock(get_indices());
       gl_resource::rolock vtx_lock(get_vertices());
-      const uint32_t *ip = idx_lock.u32();
-      const uint8_t *vp = vtx_lock.u8();
 
-      unsigned stride = get_stride();
-      unsigned num_vertices = 0;
-      for (unsigned i = 0; i != get_num_indices(); ++i) {
-        uint32_t idx = ip[i];
-        vertex v = { vp + idx * stride, stride };
-        unsigned &e = vertex_to_index[v];
-        //printf("i=%d idx=%d e=%d\n", i, idx, e);
-        if (e == 0) { // hash_map inits to zero
-          e = ++num_vertices;
-          unsigned old_size = dest_vertices.size();
-          dest_vertices.resize(old_size + stride);
-          memcpy(&dest_vertices[old_size], vp + idx * stride, stride);
+      weld_t w;
+      w.src_indices = idx_lock.u32();
+      w.src_vertices = vtx_lock.u8();
+      w.num_indices = get_num_indices();
+      w.num_vertices = get_num_vertices();
+      w.stride = get_stride();
+      w.keys = w.src_vertices;
+      w.pos_offset = 0;
+      w.pos_size = 0;
+      w.epsilon = 0;
+
+      unsigned pos_slot = get_slot(attribute_pos);
+      if (weld_epsilon > 0 && pos_slot != ~0u && get_kind(pos_slot) == GL_FLOAT) {
+        w.snapped.resize(w.num_vertices * w.stride);
+        memcpy(w.snapped.data(), w.src_vertices, w.num_vertices * w.stride);
+        w.keys = w.snapped.data();
+        w.exact.resize(w.num_vertices);
+        w.pos_offset = get_offset(pos_slot);
+        w.pos_size = get_size(pos_slot) < 4 ? get_size(pos_slot) : 4;
+        w.epsilon = weld_epsilon;
+      } else if (weld_epsilon > 0) {
+        printf("warning: indexer can only weld float positions\n");
+      }
+
+      // the partitions are fixed by the size of the mesh, not the number of threads
+      w.num_chunks = ( w.num_indices + chunk_size - 1 ) / chunk_size;
+      w.partition_bits = 0;
+      while (w.partition_bits != max_partition_bits && ( chunk_size << w.partition_bits ) < w.num_indices) {
+        w.partition_bits++;
+      }
+      unsigned num_partitions = 1 << w.partition_bits;
+
+      thread_pool &pool = thread_pool::get_default();
+      w.hashes.resize(w.num_vertices);
+      pool.run(( w.num_vertices + chunk_size - 1 ) / chunk_size, hash_task, &w);
+
+      w.offsets.resize(w.num_chunks * num_partitions);
+      memset(w.offsets.data(), 0, w.offsets.size() * sizeof(unsigned));
+      pool.run(w.num_chunks, count_task, &w);
+
+      // partition by partition, chunk by chunk, so each partition is in index order
+      unsigned total = 0;
+      for (unsigned p = 0; p != num_partitions; ++p) {
+        for (unsigned c = 0; c != w.num_chunks; ++c) {
+          unsigned count = w.offsets[c * num_partitions + p];
+          w.offsets[c * num_partitions + p] = total;
+          total += count;
         }
-        dest_indices.push_back(e - 1);
-        //printf("di=%d\n", e-1);
       }
-      //printf("%d/%d\n", get_num_vertices(), num_vertices);
 
-      unsigned isize = dest_indices.size() * sizeof(dest_indices[0]);
-      unsigned vsize = dest_vertices.size() * sizeof(dest_vertices[0]);
+      // afterwards, the last chunk's offsets are the ends of the partitions
+      w.order.resize(w.num_indices);
+      pool.run(w.num_chunks, scatter_task, &w);
+
+      w.first.resize(w.num_indices);
+      pool.run(num_partitions, weld_task, &w);
+
+      w.new_base.resize(w.num_chunks);
+      pool.run(w.num_chunks, count_new_task, &w);
+      unsigned num_vertices = 0;
+      for (unsigned c = 0; c != w.num_chunks; ++c) {
+        unsigned count = w.new_base[c];
+        w.new_base[c] = num_vertices;
+        num_vertices += count;
+      }
+
+      unsigned isize = w.num_indices * sizeof(uint32_t);
+      unsigned vsize = num_vertices * w.stride;
       gl_resource *indices = new gl_resource(GL_ELEMENT_ARRAY_BUFFER, isize);
       gl_resource *vertices = new gl_resource(GL_ARRAY_BUFFER, vsize);
-      indices->assign(&dest_indices[0], 0, isize);
-      vertices->assign(&dest_vertices[0], 0, vsize);
+      {
+        gl_resource::rwlock dest_idx_lock(indices);
+        gl_resource::rwlock dest_vtx_lock(vertices);
+        w.dest_indices = dest_idx_lock.u32();
+        w.dest_vertices = dest_vtx_lock.u8();
+        pool.run(w.num_chunks, copy_task, &w);
+        pool.run(w.num_chunks, remap_task, &w);
+      }
 
       set_indices(indices);
       set_vertices(vertices);
       set_num_vertices(num_vertices);
-
-      //this->dump(app_utils::log("dump\n"));
     }
 
+    // the mesh is saved already welded. weld_epsilon is saved from version 4,
+    // so that update() welds a loaded indexer the same way again.
     void visit(visitor &v) {
       mesh::visit(v);
       v.visit(src, atom_src);
+      if (v.get_version() >= 4) {
+        v.visit(weld_epsilon, atom_weld_epsilon);
+      }
     }
   };
 }
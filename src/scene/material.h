@@ -21,6 +21,9 @@ namespace octet {
     ref<param> bump;
     ref<param> shininess;
 
+    // drawn after the opaque materials, back to front
+    uint32_t blended;
+
     void bind_textures() const {
       // set textures 0, 1, 2, 3 to their respective values
       diffuse->render(0, GL_TEXTURE_2D);
@@ -29,7 +32,7 @@ namespace octet {
       specular->render(3, GL_TEXTURE_2D);
       bump->render(4, GL_TEXTURE_2D);
       shininess->render(5, GL_TEXTURE_2D);
-      glActiveTexture(GL_TEXTURE0);
+      gl_state::active_texture(0);
     }
 
     void init(param *param_) {
@@ -37,6 +40,7 @@ namespace octet {
       emission = new param(vec4(0, 0, 0, 0));
       bump = new param(vec4(0, 0, 0, 0));
       shininess = new param(vec4(30.0f/255, 0, 0, 0));
+      blended = 0;
     }
 
   public:
@@ -50,6 +54,7 @@ namespace octet {
       specular = 0;
       bump = 0;
       shininess = 0;
+      blended = 0;
     }
 
     // don't use this too much, it creates a new image every time.
@@ -73,6 +78,9 @@ namespace octet {
       v.visit(specular, atom_specular);
       v.visit(bump, atom_bump);
       v.visit(shininess, atom_shininess);
+      if (v.get_version() >= 3) {
+        v.visit(blended, atom_blended);
+      }
     }
 
     void init(param *diffuse, param *ambient, param *emission, param *specular, param *bump, param *shininess) {
@@ -84,6 +92,16 @@ namespace octet {
       this->shininess = shininess;
     }
 
+    // set for alpha blended materials, such as leaves, so the scene draws
+    // them after the opaque ones and from back to front
+    void set_blended(bool value) {
+      blended = value;
+    }
+
+    bool is_blended() const {
+      return blended != 0;
+    }
+
     // make a solid color with a specular highlight
     void make_color(const vec4 &color, bool bumpy, bool shiny) {
       diffuse = ambient = new param(color);
@@ -93,14 +111,15 @@ namespace octet {
       shininess = new param(vec4(30.0f/255, 0, 0, 0));
     }
 
-    void render(bump_shader &shader, const mat4t &modelToProjection, const mat4t &modelToCamera, vec4 *light_uniforms, int num_light_uniforms, int num_lights) const {
+    // same_material skips the texture binds when the last draw used this material
+    void render(bump_shader &shader, const mat4t &modelToProjection, const mat4t &modelToCamera, vec4 *light_uniforms, int num_light_uniforms, int num_lights, bool same_material = false) const {
       shader.render(modelToProjection, modelToCamera, light_uniforms, num_light_uniforms, num_lights);
-      bind_textures();
+      if (!same_material) bind_textures();
     }
 
-    void render_skinned(bump_shader &shader, const mat4t &cameraToProjection, const mat4t *modelToCamera, int num_nodes, vec4 *light_uniforms, int num_light_uniforms, int num_lights) const {
+    void render_skinned(bump_shader &shader, const mat4t &cameraToProjection, const mat4t *modelToCamera, int num_nodes, vec4 *light_uniforms, int num_light_uniforms, int num_lights, bool same_material = false) const {
       shader.render_skinned(cameraToProjection, modelToCamera, num_nodes, light_uniforms, num_light_uniforms, num_lights);
-      bind_textures();
+      if (!same_material) bind_textures();
     }
   };
 }
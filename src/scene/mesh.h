@@ -31,9 +31,31 @@ namespace octet {
     // bounding box
     aabb mesh_aabb;
 
+    // bumped when any mesh gets a new aabb
+    static unsigned &aabb_version() {
+      static unsigned value;
+      return value;
+    }
+
+    // triangle tree for ray casts, built on first use and refitted
+    // when the vertices change. see update_bvh()
+    bvh tri_bvh;
+
+    // the triangles' positions in tree order, for the ray cast kernel
+    dynarray<triangle_block> tri_blocks;
+
+    // what tri_bvh and tri_blocks were made from
+    unsigned bvh_indices_version;
+    unsigned bvh_vertices_version;
+    unsigned bvh_num_indices;
+    unsigned bvh_pos_format;
+    unsigned short bvh_mode;
+    unsigned short bvh_index_type;
+    unsigned short bvh_stride;
+
     // add a new edge to a hash map. (index, index) -> (triangle+1, triangle+1)
     static void add_edge(hash_map<uint64_t, uint64_t> &edges, unsigned tri_idx, unsigned i0, unsigned i1) {
-      if (i0 == i1) return; // note: (0, 0) means empty
+      if (i0 == i1) return; // degenerate edge
 
       if (i0 > i1) { swap(i0, i1); }
       uint64_t key = ((uint64_t)i1 << 32) | i0;
@@ -88,6 +110,7 @@ namespace octet {
       v.visit(num_slots, atom_num_slots);
       v.visit(mesh_skin, atom_mesh_skin);
       v.visit(mesh_aabb, atom_aabb);
+      aabb_version()++;
     }
 
     ~mesh() {
@@ -111,6 +134,16 @@ namespace octet {
       mode = GL_TRIANGLES;
 
       mesh_skin = _skin;
+
+      tri_bvh.reset();
+      tri_blocks.reset();
+      bvh_indices_version = 0;
+      bvh_vertices_version = 0;
+      bvh_num_indices = 0;
+      bvh_pos_format = 0;
+      bvh_mode = 0;
+      bvh_index_type = 0;
+      bvh_stride = 0;
     }
 
     void clear_attributes() {
@@ -196,6 +229,7 @@ namespace octet {
     // set the axis aligned bounding box of the untransformed mesh
     void set_aabb(const aabb &value) {
       mesh_aabb = value;
+      aabb_version()++;
     }
 
     // get the axis aligned bounding box of the untransformed mesh
@@ -203,6 +237,11 @@ namespace octet {
       return mesh_aabb;
     }
 
+    // changes whenever any mesh has been given a new aabb
+    static unsigned get_aabb_version() {
+      return aabb_version();
+    }
+
     // return true if this mesh has a particular attribute
     bool has_attribute(unsigned attr) {
       for (unsigned i = 0; i != num_slots; ++i) {
@@ -345,7 +384,7 @@ namespace octet {
         unsigned attr = get_attr(slot);
         unsigned offset = get_offset(slot);
         glVertexAttribPointer(attr, size, kind, n & 1, get_stride(), (void*)(offset));
-        glEnableVertexAttribArray(attr);
+        gl_state::enable_attrib(attr, true);
         n >>= 1;
       }
     }
@@ -358,7 +397,7 @@ namespace octet {
     void disable_attributes() {
       for (unsigned slot = 0; slot != get_num_slots(); ++slot) {
         unsigned attr = get_attr(slot);
-        glDisableVertexAttribArray(attr);
+        gl_state::enable_attrib(attr, false);
       }
     }
 
@@ -544,89 +583,332 @@ namespace octet {
       }
     }
 
-    // *very* slow ray cast.
-    // returns "barycentric" coordinates.
-    // eg. hit pos = bary[0] * pos0 + bary[1] * pos1 + bary[2] * pos2 (or ray.start + ray.distance * bary[3])
+    // result of a ray cast. bary = bary_numer / bary_denom are "barycentric" coordinates.
+    // eg. hit pos = bary[0] * pos0 + bary[1] * pos1 + bary[2] * pos2 (or ray.start + ray.distance * t)
     // eg. hit uv = bary[0] * uv0 + bary[1] * uv1 + bary[2] * uv2
-    bool ray_cast(const ray &the_ray, int indices[], vec4 &bary_numer, float &bary_denom) {
-      unsigned pos_slot = get_slot(attribute_pos);
-      if (get_index_type() != GL_UNSIGNED_INT) return false;
-      if (get_size(pos_slot) < 3) return false;
-      if (get_kind(pos_slot) != GL_FLOAT) return false;
+    // a miss has bary_denom == 0.
+    struct ray_hit {
+      int indices[3];
+      vec4 bary_numer;
+      float bary_denom;
+      float t;
+      unsigned triangle;
+    };
+
+  private:
+    // ray tests for the leaves of tri_bvh, four triangles at a time
+    class triangle_tester {
+      const triangle_block *blocks;
+      const unsigned *prims;
+      const ray *rays;
+      ray_hit *hits;
+      bool any_hit;
+
+    public:
+      triangle_tester(const mesh *msh, const ray *rays, ray_hit *hits, bool any_hit) {
+        this->blocks = msh->tri_blocks.data();
+        this->prims = msh->tri_bvh.get_prims();
+        this->rays = rays;
+        this->hits = hits;
+        this->any_hit = any_hit;
+      }
 
-      vec3 org = the_ray.get_start();
-      vec3 dir = the_ray.get_distance();
-      //app_utils::log("ray_cast: org=%s dir=%s\n", org.toString(), dir.toString());
+      // test the triangles in tree order [first, first+count) against one ray,
+      // lowering t_max if one is hit.
+      bool test_ray(unsigned first, unsigned count, const ray &the_ray, float &t_max, ray_hit &hit) const {
+        vec3 org = the_ray.get_start();
+        vec3 dir = the_ray.get_distance();
+        unsigned end = first + count;
+        bool result = false;
+        for (unsigned block = first / triangle_block::width; block * triangle_block::width < end; ++block) {
+          unsigned base = block * triangle_block::width;
+          unsigned lanes = 0;
+          for (unsigned lane = 0; lane != triangle_block::width; ++lane) {
+            if (base + lane >= first && base + lane < end) lanes |= 1 << lane;
+          }
+          vec4 numer;
+          float denom;
+          int lane = blocks[block].intersect(org, dir, lanes, t_max, numer, denom);
+          if (lane >= 0) {
+            hit.triangle = prims[base + lane];
+            hit.bary_numer = numer;
+            hit.bary_denom = denom;
+            hit.t = t_max;
+            result = true;
+            if (any_hit) break;
+          }
+        }
+        return result;
+      }
 
-      unsigned pos_offset = get_offset(pos_slot);
+      bool test(unsigned first, unsigned count, float &t_max) const {
+        return test_ray(first, count, rays[0], t_max, hits[0]);
+      }
+
+      unsigned test_packet(unsigned first, unsigned count, unsigned mask, float *t_max) const {
+        unsigned result = 0;
+        for (; mask; mask &= mask - 1) {
+          unsigned r = bvh::lowest_bit(mask);
+          if (test_ray(first, count, rays[r], t_max[r], hits[r])) result |= 1u << r;
+        }
+        return result;
+      }
+    };
+
+    static void clear_hit(ray_hit &hit) {
+      hit.indices[0] = hit.indices[1] = hit.indices[2] = 0;
+      hit.bary_numer = vec4(0, 0, 0, 0);
+      hit.bary_denom = 0;
+      hit.t = 0;
+      hit.triangle = 0;
+    }
+
+    // look up the vertex indices of a hit triangle
+    void set_hit_indices(ray_hit &hit) const {
+      unsigned idx[3];
+      get_triangle(hit.triangle, idx);
+      hit.indices[0] = (int)idx[0];
+      hit.indices[1] = (int)idx[1];
+      hit.indices[2] = (int)idx[2];
+    }
+
+    // index i of a locked index buffer
+    unsigned fetch_index(const uint8_t *idx, unsigned i) const {
+      switch (index_type) {
+        case GL_UNSIGNED_BYTE: return idx[i];
+        case GL_UNSIGNED_SHORT: return ((const uint16_t*)idx)[i];
+        default: return ((const uint32_t*)idx)[i];
+      }
+    }
+
+    // position of a vertex in a locked vertex buffer, in any of the GL formats.
+    // normalized integers are scaled to [0, 1] or [-1, 1] as in GLES2.
+    vec3 fetch_position(const uint8_t *vtx, unsigned slot, unsigned vertex) const {
+      const uint8_t *src = vtx + stride * vertex + get_offset(slot);
+      unsigned size = get_size(slot);
+      bool norm = ( normalized >> slot ) & 1;
+      float xyz[3] = { 0, 0, 0 };
+      for (unsigned i = 0; i != size && i != 3; ++i) {
+        switch (get_kind(slot)) {
+          case GL_BYTE: xyz[i] = norm ? max(((const int8_t*)src)[i] * (1.0f/127), -1.0f) : ((const int8_t*)src)[i]; break;
+          case GL_UNSIGNED_BYTE: xyz[i] = ((const uint8_t*)src)[i] * (norm ? 1.0f/255 : 1.0f); break;
+          case GL_SHORT: xyz[i] = norm ? max(((const int16_t*)src)[i] * (1.0f/32767), -1.0f) : ((const int16_t*)src)[i]; break;
+          case GL_UNSIGNED_SHORT: xyz[i] = ((const uint16_t*)src)[i] * (norm ? 1.0f/65535 : 1.0f); break;
+          case GL_INT: xyz[i] = (float)((const int32_t*)src)[i]; break;
+          case GL_UNSIGNED_INT: xyz[i] = (float)((const uint32_t*)src)[i]; break;
+          default: xyz[i] = ((const float*)src)[i]; break;
+        }
+      }
+      return vec3(xyz[0], xyz[1], xyz[2]);
+    }
+
+  public:
+    // how many triangles get_mode() makes of the indices.
+    // zero for points and lines.
+    unsigned get_num_triangles() const {
+      switch (mode) {
+        case GL_TRIANGLES: return num_indices / 3;
+        case GL_TRIANGLE_STRIP: case GL_TRIANGLE_FAN: return num_indices >= 3 ? num_indices - 2 : 0;
+        default: return 0;
+      }
+    }
+
+    // the vertex indices of a triangle, with the winding of a GL_TRIANGLES mesh.
+    void get_triangle(unsigned tri, unsigned result[3]) const {
       gl_resource::rolock idx_lock(get_indices());
+      const uint8_t *idx = idx_lock.u8();
+      if (mode == GL_TRIANGLE_STRIP) {
+        // every other triangle of a strip is wound the other way
+        result[0] = fetch_index(idx, tri + (tri & 1));
+        result[1] = fetch_index(idx, tri + 1 - (tri & 1));
+        result[2] = fetch_index(idx, tri + 2);
+      } else if (mode == GL_TRIANGLE_FAN) {
+        result[0] = fetch_index(idx, 0);
+        result[1] = fetch_index(idx, tri + 1);
+        result[2] = fetch_index(idx, tri + 2);
+      } else {
+        result[0] = fetch_index(idx, tri * 3 + 0);
+        result[1] = fetch_index(idx, tri * 3 + 1);
+        result[2] = fetch_index(idx, tri * 3 + 2);
+      }
+    }
+
+    // true if ray casts work on this mesh: triangles with 8, 16 or 32 bit indices
+    // and positions.
+    bool can_ray_cast() const {
+      if (get_slot(attribute_pos) == ~0u || get_num_triangles() == 0) return false;
+      return index_type == GL_UNSIGNED_BYTE || index_type == GL_UNSIGNED_SHORT || index_type == GL_UNSIGNED_INT;
+    }
+
+    // build the triangle tree and cache for ray casts, or refit them if only
+    // the vertices have changed since the last time. ray_cast() calls this,
+    // so it is only needed to choose when the work gets done.
+    bool update_bvh() {
+      if (!can_ray_cast()) return false;
+
+      unsigned pos_slot = get_slot(attribute_pos);
+      unsigned indices_version = indices->get_version();
+      unsigned vertices_version = vertices->get_version();
+      bool same_indices =
+        indices_version == bvh_indices_version && num_indices == bvh_num_indices &&
+        mode == bvh_mode && index_type == bvh_index_type
+      ;
+      bool same_vertices =
+        vertices_version == bvh_vertices_version &&
+        format[pos_slot] == bvh_pos_format && stride == bvh_stride
+      ;
+      if (same_indices && same_vertices) return true;
+
+      unsigned num_tris = get_num_triangles();
+      dynarray<aabb> boxes(num_tris);
+      for (unsigned i = 0; i != num_tris; ++i) {
+        vec3 a, b, c;
+        get_triangle_corners(i, pos_slot, a, b, c);
+        vec3 lo = min(a, min(b, c));
+        vec3 hi = max(a, max(b, c));
+        boxes[i] = aabb((lo + hi) * 0.5f, (hi - lo) * 0.5f);
+      }
+
+      if (same_indices && !tri_bvh.is_empty()) {
+        tri_bvh.refit(boxes.data());
+      } else {
+        tri_bvh.build(boxes.data(), num_tris);
+      }
+
+      // copy the corners in tree order so that each leaf is a few blocks
+      const unsigned *prims = tri_bvh.get_prims();
+      unsigned num_blocks = (num_tris + triangle_block::width - 1) / triangle_block::width;
+      tri_blocks.resize(num_blocks);
+      for (unsigned i = 0; i != num_blocks; ++i) {
+        tri_blocks[i].clear();
+      }
+      for (unsigned i = 0; i != num_tris; ++i) {
+        vec3 a, b, c;
+        get_triangle_corners(prims[i], pos_slot, a, b, c);
+        tri_blocks[i / triangle_block::width].set(i % triangle_block::width, a, b, c);
+      }
+
+      bvh_indices_version = indices_version;
+      bvh_vertices_version = vertices_version;
+      bvh_num_indices = num_indices;
+      bvh_mode = mode;
+      bvh_index_type = index_type;
+      bvh_pos_format = format[pos_slot];
+      bvh_stride = stride;
+      return true;
+    }
+
+    // the three positions of a triangle
+    void get_triangle_corners(unsigned tri, unsigned pos_slot, vec3 &a, vec3 &b, vec3 &c) const {
+      unsigned idx[3];
+      get_triangle(tri, idx);
       gl_resource::rolock vtx_lock(get_vertices());
-      const uint32_t *idx = idx_lock.u32();
-      const uint8_t *vtx = vtx_lock.u8();
-
-      float best_denom = 0;
-      vec4 best_numer(0, 0, 0, 0);
-      for (unsigned i = 0; i != get_num_indices(); i += 3) {
-        vec3 a = *(const vec3*)(vtx + pos_offset + stride * idx[i+0]) - org;
-        vec3 b = *(const vec3*)(vtx + pos_offset + stride * idx[i+1]) - org;
-        vec3 c = *(const vec3*)(vtx + pos_offset + stride * idx[i+2]) - org;
-        vec3 d = dir;
-
-        // solve [ba, bb, bc, bd] * [[ax, ay, az, 1], [bx, by, bz, 1], [cx, cy, cz, 1], [-dx, -dy, -dz, 0]] = [0, 0, 0, 1]
-        //
-        // ie. ba + bb + bc = 1  and  ba * a + bb * b + bc * c = bd * d
-        //
-        // [ba, bb, bc] are barycentric coordinates, bd is the distance along the vector
-
-        // The last line of the inverse matrix is the solution (vector triple products)
-
-        // numerator
-        vec4 numer(
-          dot(cross(b, c), d),
-          dot(cross(c, a), d),
-          dot(cross(a, b), d),
-          dot(cross(a, b), c)
-        );
-
-        // denominator
-        float denom = numer[0] + numer[1] + numer[2];
-
-        //app_utils::log("a=%s b=%s c=%s d=%s denom=%f\n", a.toString(), b.toString(), c.toString(), d.toString(), denom);
-        //app_utils::log("numer=%s\n", numer.toString());
-        //app_utils::log("res=%s\n", (numer / denom).toString());
-
-        // using a multiply lets us check the sign without using a divide.
-        vec4 bary2 = numer * denom;
-
-        if (all(bary2 >= vec4(0, 0, 0, 0))) {
-          rational best_distance(best_numer[3], best_denom);
-          rational new_distance(numer[3], denom);
-          /*printf(
-            "t%d %9.3f %d %d %d  %s %s %s\n",
-            i, numer[3]/denom, idx[i+0], idx[i+1], idx[i+2],
-            (numer/denom).toString(), best_distance.toString(), new_distance.toString()
-          );*/
-
-          unsigned further = new_distance > best_distance;
-          if (!further) {
-            indices[0] = idx[i+0];
-            indices[1] = idx[i+1];
-            indices[2] = idx[i+2];
-            best_numer = numer;
-            best_denom = denom;
-          }
+      a = fetch_position(vtx_lock.u8(), pos_slot, idx[0]);
+      b = fetch_position(vtx_lock.u8(), pos_slot, idx[1]);
+      c = fetch_position(vtx_lock.u8(), pos_slot, idx[2]);
+    }
+
+    // cast a ray (a segment from start to end) at the triangles.
+    // finds the closest hit, or with any_hit the first one found, which is
+    // quicker when only "is anything there?" matters.
+    // only hits at t <= t_max, so a caller can pass the closest hit so far.
+    bool ray_cast(const ray &the_ray, ray_hit &hit, bool any_hit = false, float t_max = 1.0f) {
+      clear_hit(hit);
+      if (!update_bvh()) return false;
+
+      triangle_tester tester(this, &the_ray, &hit, any_hit);
+      if (!tri_bvh.cast(the_ray.get_start(), the_ray.get_distance(), t_max, tester, any_hit)) return false;
+      set_hit_indices(hit);
+      return true;
+    }
+
+    // cast many rays. Rays that start close together and point the same way,
+    // such as those from one camera, share the walk of the tree.
+    // t_max may be null for whole segments.
+    // returns the number of hits.
+    unsigned ray_cast(const ray *rays, ray_hit *hits, unsigned num_rays, bool any_hit = false, const float *t_max = 0) {
+      for (unsigned i = 0; i != num_rays; ++i) {
+        clear_hit(hits[i]);
+      }
+      if (!update_bvh()) return 0;
+
+      unsigned num_hits = 0;
+      for (unsigned first = 0; first < num_rays; first += bvh::max_packet) {
+        unsigned n = num_rays - first < bvh::max_packet ? num_rays - first : bvh::max_packet;
+        vec3 origins[bvh::max_packet];
+        vec3 distances[bvh::max_packet];
+        float packet_t[bvh::max_packet];
+        for (unsigned r = 0; r != n; ++r) {
+          origins[r] = rays[first + r].get_start();
+          distances[r] = rays[first + r].get_distance();
+          packet_t[r] = t_max ? t_max[first + r] : 1.0f;
+        }
+        triangle_tester tester(this, rays + first, hits + first, any_hit);
+        unsigned mask = tri_bvh.cast_packet(origins, distances, packet_t, n, tester, any_hit);
+        for (; mask; mask &= mask - 1) {
+          set_hit_indices(hits[first + bvh::lowest_bit(mask)]);
+          num_hits++;
         }
       }
+      return num_hits;
+    }
 
-      if (fabsf(best_denom) < 1e-6f) {
-        bary_numer = vec4(0, 0, 0, 0);
-        bary_denom = 0;
-        return false;
-      } else {
-        bary_numer = best_numer;
-        bary_denom = best_denom;
-        return true;
+    // the same as ray_cast() without the tree or the SIMD kernel: every triangle,
+    // one at a time. Very slow, but simple enough to test the fast path against.
+    bool ray_cast_reference(const ray &the_ray, ray_hit &hit, float t_max = 1.0f) {
+      clear_hit(hit);
+      if (!can_ray_cast()) return false;
+
+      unsigned pos_slot = get_slot(attribute_pos);
+      vec3 org = the_ray.get_start();
+      vec3 d = the_ray.get_distance();
+      bool result = false;
+      for (unsigned tri = 0; tri != get_num_triangles(); ++tri) {
+        vec3 a, b, c;
+        get_triangle_corners(tri, pos_slot, a, b, c);
+
+        // solve org + t * d = a + u * (b - a) + v * (c - a) by Cramer's rule.
+        // working from a rather than the ray origin keeps the small triangle
+        // edges out of the cancellation when the ray starts far away.
+        vec3 e1 = b - a;
+        vec3 e2 = c - a;
+        vec3 s = org - a;
+        vec3 p = cross(d, e2);
+        vec3 q = cross(s, e1);
+        float denom = dot(e1, p);
+        float u = dot(s, p);
+        float v = dot(d, q);
+
+        // barycentric numerators and distance, all over denom
+        vec4 numer(denom - u - v, u, v, dot(e2, q));
+
+        // using a multiply lets us check the signs without using a divide.
+        if (denom == 0 || !all(numer * denom >= vec4(0, 0, 0, 0))) continue;
+
+        float t = numer[3] / denom;
+        if (t > t_max) continue;
+
+        t_max = t;
+        hit.triangle = tri;
+        hit.bary_numer = numer;
+        hit.bary_denom = denom;
+        hit.t = t;
+        result = true;
       }
+      if (result) set_hit_indices(hit);
+      return result;
+    }
+
+    // returns "barycentric" coordinates of the closest hit, as in ray_hit.
+    bool ray_cast(const ray &the_ray, int indices[], vec4 &bary_numer, float &bary_denom) {
+      ray_hit hit;
+      bool result = ray_cast(the_ray, hit);
+      indices[0] = hit.indices[0];
+      indices[1] = hit.indices[1];
+      indices[2] = hit.indices[2];
+      bary_numer = hit.bary_numer;
+      bary_denom = hit.bary_denom;
+      return result;
     }
 
     // access the vbo or memory buffer
@@ -687,7 +969,7 @@ namespace octet {
       unsigned stride = get_stride();
       
       for (unsigned i = 0; i != edges.size(); ++i) {
-        if (edges.key(i)) {
+        if (edges.is_used(i)) {
           uint64_t tris = edges.value(i);
           uint32_t tri_a = (uint32_t)(tris) - 1;
           uint32_t tri_b = (uint32_t)(tris >> 32) - 1;
@@ -93,6 +93,7 @@ namespace octet {
     mesh_box &set_size(const aabb &size) {
       init(size);
       update();
+      return *this;
     }
 
     virtual void update() {
@@ -110,7 +111,7 @@ namespace octet {
         vtx++;
         fs += 8;
       }
-      assert((int)fs - (int)box_vertices() == get_vertices()->get_size());
+      assert((char*)fs - (char*)box_vertices() == get_vertices()->get_size());
 
       memcpy(idx, box_indices(), sizeof(uint32_t)*6*6);
 
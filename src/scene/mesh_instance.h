@@ -28,6 +28,12 @@ namespace octet {
     // assorted mesh instance booleans (see flag_*)
     unsigned flags;
 
+    // bumped when any instance gets a new node or mesh
+    static unsigned &placement_version() {
+      static unsigned value;
+      return value;
+    }
+
   public:
     RESOURCE_META(mesh_instance)
 
@@ -37,6 +43,7 @@ namespace octet {
       this->mat = mat;
       this->skel = skel;
       flags = 0;
+      placement_version()++;
     }
 
     // metadata visitor. Used for serialisation and script interface.
@@ -46,6 +53,7 @@ namespace octet {
       v.visit(mat, atom_mat);
       v.visit(skel, atom_skel);
       v.visit(flags, atom_flags);
+      placement_version()++;
     }
 
     //////////////////////////////
@@ -105,8 +113,11 @@ namespace octet {
     skeleton *get_skeleton() const { return skel; }
     unsigned get_flags() const { return flags; }
 
-    void set_node(scene_node *value) { node = value; }
-    void set_mesh(mesh *value) { msh = value; }
+    // changes whenever any instance has been given a new node or mesh
+    static unsigned get_placement_version() { return placement_version(); }
+
+    void set_node(scene_node *value) { node = value; placement_version()++; }
+    void set_mesh(mesh *value) { msh = value; placement_version()++; }
     void set_material(material *value) { mat = value; }
     void set_skeleton(skeleton *value) { skel = value; }
     void set_flags(unsigned value) { flags = value; }
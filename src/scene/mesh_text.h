@@ -57,6 +57,12 @@ namespace octet {
       set_num_vertices(num_quads * 4);
     }
 
+    // replace the text and rebuild the quads
+    void set_text(const char *value) {
+      text = value;
+      update();
+    }
+
     void visit(visitor &v) {
       mesh::visit(v);
       v.visit(font, atom_font);
@@ -14,30 +14,30 @@ namespace octet {
       for (unsigned j = 0; j != dim; ++j) {
         for (unsigned i = 0; i != dim; ++i) {
           uint32_t p00 = opaque[j*dim+i];
-          add_lefts( ~(p00 >> 1) & p00, i, j );
-          add_rights( p00 & ~(p00 << 1), i, j );
+          this->add_lefts( ~(p00 >> 1) & p00, i, j );
+          this->add_rights( p00 & ~(p00 << 1), i, j );
         }
       }
 
       for (unsigned j = 0; j != dim; ++j) {
-        add_bottoms( opaque[j*dim+0], j, 0 );
-        add_tops( opaque[j*dim+(dim-1)], j, dim-1 );
+        this->add_bottoms( opaque[j*dim+0], j, 0 );
+        this->add_tops( opaque[j*dim+(dim-1)], j, dim-1 );
         for (unsigned i = 0; i != dim-1; ++i) {
           uint32_t p00 = opaque[j*dim+i];
           uint32_t p01 = opaque[j*dim+(i+1)];
-          add_bottoms( p00 & ~p01, i, j );
-          add_tops( p01 & ~p00, i, j );
+          this->add_bottoms( p00 & ~p01, i, j );
+          this->add_tops( p01 & ~p00, i, j );
         }
       }
 
       for (unsigned i = 0; i != dim-1; ++i) {
-        add_fronts( opaque[0*dim+i], 0, i );
-        add_backs( opaque[(dim-1)*dim+i], dim-1, i );
+        this->add_fronts( opaque[0*dim+i], 0, i );
+        this->add_backs( opaque[(dim-1)*dim+i], dim-1, i );
         for (unsigned j = 0; j != dim-1; ++j) {
           uint32_t p00 = opaque[j*dim+i];
           uint32_t p10 = opaque[(j+1)*dim+i];
-          add_fronts( p00 & ~p10, i, j );
-          add_backs( p10 & ~p00, i, j );
+          this->add_fronts( p00 & ~p10, i, j );
+          this->add_backs( p10 & ~p00, i, j );
         }
       }
     }
@@ -87,8 +87,7 @@ namespace octet {
     }
 
     void render(unsigned slot, unsigned target) {
-      glActiveTexture(GL_TEXTURE0 + slot);
-      glBindTexture(target, get_gl_texture());
+      gl_state::bind_texture(slot, target, get_gl_texture());
       if (smpl) {
         smpl->render(target);
       }
@@ -42,6 +42,110 @@ namespace octet {
 
     int frame_number;
 
+    // every node under the scene, parents before children, for update_world_transforms()
+    dynarray<scene_node*> flat_nodes;
+    dynarray<int> flat_parents;
+    unsigned flat_version;
+    unsigned flat_transform_version;
+
+    // the mesh instances to draw this frame, by sort key then by index
+    struct draw_item_t {
+      uint64_t key;
+      unsigned index;
+    };
+    dynarray<draw_item_t> draw_list;
+
+    // small ids for the materials and meshes seen this frame, for the sort keys
+    hash_map<void *, unsigned> state_ids;
+
+    bool frustum_culling;
+    int num_drawn;
+    int num_culled;
+
+    // tree of the mesh instances' world boxes for ray casts
+    bvh instance_bvh;
+    dynarray<aabb> instance_boxes;
+    unsigned instance_bvh_version;
+    unsigned instance_transform_version;
+    unsigned instance_placement_version;
+    unsigned instance_aabb_version;
+
+    static int compare_draw_items(const void *a, const void *b) {
+      const draw_item_t &da = *(const draw_item_t*)a, &db = *(const draw_item_t*)b;
+      if (da.key != db.key) return da.key < db.key ? -1 : 1;
+      return da.index < db.index ? -1 : da.index > db.index;
+    }
+
+    unsigned get_state_id(void *state) {
+      unsigned &id = state_ids[state];
+      if (id == 0) id = state_ids.get_size();
+      return id;
+    }
+
+    // cull the mesh instances against the camera and sort the opaque ones to
+    // change shader, then material, then mesh as little as possible, front to
+    // back. blended materials come after them, back to front.
+    // meshes with no aabb and skinned meshes, which move away from theirs, are
+    // always drawn.
+    void build_draw_list(const mat4t &worldToCamera, const mat4t &worldToProjection) {
+      OCTET_PROFILE_SCOPE("cull and sort");
+      frustum view(worldToProjection);
+      draw_list.resize(0);
+      state_ids.clear();
+      num_culled = 0;
+
+      for (unsigned mesh_index = 0; mesh_index != mesh_instances.size(); ++mesh_index) {
+        mesh_instance *mi = mesh_instances[mesh_index];
+        mesh *msh = mi->get_mesh();
+        bool skinned = mi->get_skeleton() && msh->get_skin();
+        const mat4t &modelToWorld = mi->get_node()->calcModelToWorld();
+
+        aabb bb = msh->get_aabb();
+        vec3 half = bb.get_half_extent();
+        vec3 center = modelToWorld.w().xyz();
+        if (!skinned && (half.x() != 0 || half.y() != 0 || half.z() != 0)) {
+          bb = bb.get_transform(modelToWorld);
+          if (frustum_culling && !view.intersects(bb)) {
+            num_culled++;
+            continue;
+          }
+          center = bb.get_center();
+        }
+
+        // positive floats sort in the same order as their bits
+        float depth = -(center.xyz1() * worldToCamera).z();
+        uint32_t depth_bits = 0;
+        if (depth > 0) memcpy(&depth_bits, &depth, sizeof(depth_bits));
+
+        draw_item_t item;
+        unsigned material_id = get_state_id(mi->get_material()) & 0x3fff;
+        unsigned mesh_id = get_state_id(msh) & 0xffff;
+        if (mi->get_material()->is_blended()) {
+          // depth above the state so that the farthest is drawn first
+          item.key =
+            ((uint64_t)1 << 63) |
+            ((uint64_t)~depth_bits << 31) |
+            ((uint64_t)skinned << 30) |
+            (material_id << 16) |
+            mesh_id
+          ;
+        } else {
+          item.key =
+            ((uint64_t)skinned << 62) |
+            ((uint64_t)material_id << 48) |
+            ((uint64_t)mesh_id << 32) |
+            depth_bits
+          ;
+        }
+        item.index = mesh_index;
+        draw_list.push_back(item);
+      }
+
+      qsort(draw_list.data(), draw_list.size(), sizeof(draw_item_t), compare_draw_items);
+      num_drawn = (int)draw_list.size();
+      OCTET_PROFILE_COUNT("culled", num_culled);
+    }
+
     void draw_aabb(const aabb &bb) {
       vec3 pos[8];
       for (int i = 0; i != 8; ++i) {
@@ -63,11 +167,11 @@ namespace octet {
       // render immediate data (this is inefficient!)
       glBindBuffer(GL_ARRAY_BUFFER, 0);
       glVertexAttribPointer(attribute_pos, 3, GL_FLOAT, GL_FALSE, 0, (void*)pos );
-      glEnableVertexAttribArray(attribute_pos);
+      gl_state::enable_attrib(attribute_pos, true);
     
       glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
       glDrawElements(GL_LINES, 24, GL_UNSIGNED_SHORT, indices);
-      glDisableVertexAttribArray(attribute_pos);
+      gl_state::enable_attrib(attribute_pos, false);
     }
 
     void calc_lighting(const mat4t &worldToCamera) {
@@ -104,17 +208,17 @@ namespace octet {
     void render_debug_line_buffer() {
       glBindBuffer(GL_ARRAY_BUFFER, 0);
       glVertexAttribPointer(attribute_pos, 3, GL_FLOAT, GL_FALSE, 0, (void*)debug_line_buffer.data() );
-      glEnableVertexAttribArray(attribute_pos);
+      gl_state::enable_attrib(attribute_pos, true);
     
       glDrawArrays(GL_LINES, 0, debug_line_buffer.size());
-      glDisableVertexAttribArray(attribute_pos);
+      gl_state::enable_attrib(attribute_pos, false);
     }
 
     void dump_mesh_vertices(camera_instance &cam) {
       for (unsigned mesh_index = 0; mesh_index != mesh_instances.size(); ++mesh_index) {
         mesh_instance *mi = mesh_instances[mesh_index];
         mesh *msh = mi->get_mesh();
-        mat4t modelToWorld = mi->get_node()->calcModelToWorld();
+        const mat4t &modelToWorld = mi->get_node()->calcModelToWorld();
         mat4t modelToCamera;
         mat4t modelToProjection;
         cam.get_matrices(modelToProjection, modelToCamera, modelToWorld);
@@ -170,6 +274,10 @@ namespace octet {
     }
 
     void render_impl(bump_shader &object_shader, bump_shader &skin_shader, camera_instance &cam, float aspect_ratio) {
+      OCTET_PROFILE_SCOPE("scene render");
+      update_world_transforms();
+
+      // the camera may not be in this scene
       mat4t cameraToWorld = cam.get_node()->calcModelToWorld();
 
       mat4t worldToCamera;
@@ -182,14 +290,19 @@ namespace octet {
 
       draw_debug_data(object_shader, cam);
 
-      for (unsigned mesh_index = 0; mesh_index != mesh_instances.size(); ++mesh_index) {
-        mesh_instance *mi = mesh_instances[mesh_index];
+      build_draw_list(worldToCamera, worldToCamera * cameraToProjection);
+
+      // the attributes of prev_mesh stay enabled between draws of the same mesh
+      mesh *prev_mesh = 0;
+      material *prev_mat = 0;
+      for (unsigned i = 0; i != draw_list.size(); ++i) {
+        mesh_instance *mi = mesh_instances[draw_list[i].index];
         mesh *msh = mi->get_mesh();
         skin *skn = msh->get_skin();
         skeleton *skel = mi->get_skeleton();
         material *mat = mi->get_material();
 
-        mat4t modelToWorld = mi->get_node()->calcModelToWorld();
+        const mat4t &modelToWorld = mi->get_node()->calcModelToWorld();
         mat4t modelToCamera;
         mat4t modelToProjection;
         cam.get_matrices(modelToProjection, modelToCamera, modelToWorld);
@@ -198,7 +311,7 @@ namespace octet {
           // normal rendering for single matrix objects
           // build a projection matrix: model -> world -> camera_instance -> projection
           // the projection space is the cube -1 <= x/w, y/w, z/w <= 1
-          mat->render(object_shader, modelToProjection, modelToCamera, light_uniforms, num_light_uniforms, num_lights);
+          mat->render(object_shader, modelToProjection, modelToCamera, light_uniforms, num_light_uniforms, num_lights, mat == prev_mat);
         } else {
           // multi-matrix rendering
           mat4t *transforms = skel->calc_transforms(modelToCamera, skn);
@@ -208,20 +321,29 @@ namespace octet {
             //glGetIntegerv(GL_MAX_VERTEX_UNIFORM_VECTORS, &mvuv);
             printf("warning: too many bones (%d/%d)\n", num_bones, mvuv/4);
           } else {
-            mat->render_skinned(skin_shader, cameraToProjection, transforms, num_bones, light_uniforms, num_light_uniforms, num_lights);
+            mat->render_skinned(skin_shader, cameraToProjection, transforms, num_bones, light_uniforms, num_light_uniforms, num_lights, mat == prev_mat);
           }
         }
+        prev_mat = mat;
 
-        msh->enable_attributes();
+        if (msh != prev_mesh) {
+          if (prev_mesh) prev_mesh->disable_attributes();
+          msh->enable_attributes();
+          prev_mesh = msh;
+        }
         msh->draw();
-        msh->disable_attributes();
+        OCTET_PROFILE_COUNT("draw calls", 1);
 
         if (mi->get_flags() & mesh_instance::flag_selected) {
+          // draw_aabb uses its own vertex attributes
+          msh->disable_attributes();
+          prev_mesh = 0;
           aabb bb = mi->get_mesh()->get_aabb();
-          bb = bb.get_transform(mi->get_node()->calcModelToWorld());
+          bb = bb.get_transform(modelToWorld);
           draw_aabb(bb);
         }
       }
+      if (prev_mesh) prev_mesh->disable_attributes();
       frame_number++;
     }
   public:
@@ -240,6 +362,15 @@ namespace octet {
       assert(is_power_of_two(debug_line_buffer.size()));
       memset(&debug_line_buffer[0], 0, debug_line_buffer.size() * sizeof(debug_line_buffer[0]));
       debug_in_ptr = 0;
+      flat_version = ~0u;
+      flat_transform_version = ~0u;
+      frustum_culling = true;
+      num_drawn = 0;
+      num_culled = 0;
+      instance_bvh_version = ~0u;
+      instance_transform_version = ~0u;
+      instance_placement_version = ~0u;
+      instance_aabb_version = ~0u;
     }
 
     void visit(visitor &v) {
@@ -357,6 +488,21 @@ namespace octet {
       dump_vertices = value;
     }
 
+    // skip mesh instances outside the camera's view (on by default)
+    void set_frustum_culling(bool value) {
+      frustum_culling = value;
+    }
+
+    // mesh instances drawn in the last render()
+    int get_num_drawn() const {
+      return num_drawn;
+    }
+
+    // mesh instances found to be out of view in the last render()
+    int get_num_culled() const {
+      return num_culled;
+    }
+
     // access camera_instance information
     camera_instance *get_camera_instance(int index) {
       return camera_instances[index];
@@ -384,6 +530,38 @@ namespace octet {
         mesh_instance *inst = mesh_instances[idx];
         inst->update(delta_time);
       }
+
+      update_world_transforms();
+    }
+
+    // bring the cached nodeToWorld matrices of the dirty nodes up to date
+    // in one pass over the flattened tree, parents first.
+    // render() does this too, so it is only needed to read the matrices
+    // of many nodes in between.
+    void update_world_transforms() {
+      OCTET_PROFILE_SCOPE("world transforms");
+
+      // nothing has moved since the last pass, so every node is clean
+      if (flat_version == get_hierarchy_version() && flat_transform_version == get_transform_version()) {
+        return;
+      }
+
+      if (flat_version != get_hierarchy_version()) {
+        flat_nodes.resize(0);
+        flat_parents.resize(0);
+        get_all_child_nodes(flat_nodes, flat_parents);
+        flat_version = get_hierarchy_version();
+      }
+
+      // the scene itself comes first and may have a parent of its own
+      calcModelToWorld();
+
+      scene_node **nodes = flat_nodes.data();
+      const int *parents = flat_parents.data();
+      for (unsigned i = 1; i < flat_nodes.size(); ++i) {
+        nodes[i]->update_world_transform(nodes[parents[i]]);
+      }
+      flat_transform_version = get_transform_version();
     }
 
     // call OpenGL to draw all the mesh instances (scene_node + mesh + material)
@@ -421,7 +599,7 @@ namespace octet {
       for (int i = 0; i != mesh_instances.size(); ++i) {
         mesh_instance *mi = mesh_instances[i];
         if (mi && mi->get_node()) {
-          mat4t nodeToWorld = mi->get_node()->calcModelToWorld();
+          const mat4t &nodeToWorld = mi->get_node()->calcModelToWorld();
           aabb bb = mi->get_mesh()->get_aabb();
           bb = bb.get_transform(nodeToWorld);
           if (first) {
@@ -438,38 +616,199 @@ namespace octet {
     struct cast_result {
       mesh_instance *mi;
       rational depth;
+      mesh::ray_hit hit;
     };
 
-    // brute force & ignorance ray cast.
-    // return the mesh instance and location of hits.
-    // todo: build a kd tree for mesh instance bbs & mesh triangles
-    void cast_ray(cast_result &result, const ray &the_ray) {
+  private:
+    // ray tests for the mesh instances in the leaves of instance_bvh.
+    // each instance's mesh has its own triangle tree in model space.
+    class instance_tester {
+      scene *scn;
+      const unsigned *prims;
+      const ray *rays;
+      cast_result *results;
+      bool any_hit;
+
+      bool get_instance(unsigned index, mesh *&msh, mat4t &worldToNode) const {
+        mesh_instance *mi = scn->mesh_instances[index];
+        if (!mi || !mi->get_node() || !mi->get_mesh()) return false;
+        msh = mi->get_mesh();
+        worldToNode = mi->get_node()->calcModelToWorld().inverse3x4();
+        return true;
+      }
+
+      void set_result(cast_result &result, unsigned index, const mesh::ray_hit &hit) const {
+        result.mi = scn->mesh_instances[index];
+        result.depth = rational(hit.bary_numer.w(), hit.bary_denom);
+        result.hit = hit;
+      }
+
+    public:
+      instance_tester(scene *scn, const ray *rays, cast_result *results, bool any_hit) {
+        this->scn = scn;
+        this->prims = scn->instance_bvh.get_prims();
+        this->rays = rays;
+        this->results = results;
+        this->any_hit = any_hit;
+      }
+
+      bool test_instance(unsigned index, float &t_max) const {
+        mesh *msh;
+        mat4t worldToNode;
+        if (!get_instance(index, msh, worldToNode)) return false;
+
+        // t is the same in model space as in world space
+        mesh::ray_hit hit;
+        if (!msh->ray_cast(rays[0].get_transform(worldToNode), hit, any_hit, t_max)) return false;
+        t_max = hit.t;
+        set_result(results[0], index, hit);
+        return true;
+      }
+
+      unsigned test_instance_packet(unsigned index, unsigned mask, float *t_max) const {
+        mesh *msh;
+        mat4t worldToNode;
+        if (!get_instance(index, msh, worldToNode)) return 0;
+
+        ray model_rays[bvh::max_packet];
+        mesh::ray_hit hits[bvh::max_packet];
+        float model_t[bvh::max_packet];
+        unsigned ray_index[bvh::max_packet];
+        unsigned n = 0;
+        for (; mask; mask &= mask - 1) {
+          unsigned r = bvh::lowest_bit(mask);
+          model_rays[n] = rays[r].get_transform(worldToNode);
+          model_t[n] = t_max[r];
+          ray_index[n++] = r;
+        }
+
+        unsigned result = 0;
+        msh->ray_cast(model_rays, hits, n, any_hit, model_t);
+        for (unsigned i = 0; i != n; ++i) {
+          if (hits[i].bary_denom != 0) {
+            unsigned r = ray_index[i];
+            t_max[r] = hits[i].t;
+            set_result(results[r], index, hits[i]);
+            result |= 1u << r;
+          }
+        }
+        return result;
+      }
+
+      bool test(unsigned first, unsigned count, float &t_max) const {
+        bool hit = false;
+        for (unsigned i = first; i != first + count; ++i) {
+          if (test_instance(prims[i], t_max)) {
+            hit = true;
+            if (any_hit) break;
+          }
+        }
+        return hit;
+      }
+
+      unsigned test_packet(unsigned first, unsigned count, unsigned mask, float *t_max) const {
+        unsigned hits = 0;
+        for (unsigned i = first; i != first + count && mask; ++i) {
+          hits |= test_instance_packet(prims[i], mask, t_max);
+          if (any_hit) mask &= ~hits;
+        }
+        return hits;
+      }
+    };
+
+    static void clear_result(cast_result &result) {
       result.mi = 0;
       result.depth = rational(0, 0);
-
-      for (int i = 0; i != mesh_instances.size(); ++i) {
+      memset(&result.hit, 0, sizeof(result.hit));
+    }
+
+    // fit the instance tree to where the mesh instances are now.
+    // the tree is only rebuilt when instances or nodes are added and
+    // only refitted when a node, an instance's mesh or a mesh's aabb has changed.
+    void update_instance_bvh() {
+      unsigned num_instances = mesh_instances.size();
+      bool rebuild = instance_bvh.get_num_prims() != num_instances || instance_bvh_version != get_hierarchy_version();
+      bool moved =
+        instance_transform_version != get_transform_version() ||
+        instance_placement_version != mesh_instance::get_placement_version() ||
+        instance_aabb_version != mesh::get_aabb_version()
+      ;
+      if (!rebuild && !moved) return;
+
+      instance_boxes.resize(num_instances);
+      for (unsigned i = 0; i != num_instances; ++i) {
         mesh_instance *mi = mesh_instances[i];
-        if (mi && mi->get_node()) {
-          mat4t nodeToWorld = mi->get_node()->calcModelToWorld();
-          mesh *mesh = mi->get_mesh();
-          aabb bb = mesh->get_aabb();
-          bb = bb.get_transform(nodeToWorld);
-          if (the_ray.intersects(bb)) {
-            mat4t worldToNode = nodeToWorld.inverse3x4();
-            //ray model_ray = ray(vec3(0, 0, -1), vec3(0, 0, 2)); //the_ray.get_transform(worldToNode);
-            ray model_ray = the_ray.get_transform(worldToNode);
-            int indices[3] = {0};
-            vec4 bary_numer(0, 0, 0, 0);
-            float bary_denom;
-            bool hit = mesh->ray_cast(model_ray, indices, bary_numer, bary_denom);
-            if (hit) {
-              rational depth(bary_numer.w() / bary_denom);
-              result.depth = min(depth, result.depth);
-            }
-            //printf("hit=%d %s %f\n", hit, (bary_numer/bary_denom).toString(tmp, sizeof(tmp)), (float)result.depth);
-          }
+        if (mi && mi->get_node() && mi->get_mesh()) {
+          instance_boxes[i] = mi->get_mesh()->get_aabb().get_transform(mi->get_node()->calcModelToWorld());
+        } else {
+          // somewhere no ray will go
+          instance_boxes[i] = aabb(vec3(1e30f, 1e30f, 1e30f), vec3(0, 0, 0));
+        }
+      }
+
+      if (rebuild) {
+        instance_bvh.build(instance_boxes.data(), num_instances, 1);
+      } else {
+        instance_bvh.refit(instance_boxes.data());
+      }
+      instance_bvh_version = get_hierarchy_version();
+      instance_transform_version = get_transform_version();
+      instance_placement_version = mesh_instance::get_placement_version();
+      instance_aabb_version = mesh::get_aabb_version();
+    }
+
+  public:
+    // find the closest hit of a ray (a segment from start to end) on the mesh instances.
+    // return the mesh instance, the depth along the ray and the triangle hit.
+    // mi is null if nothing is hit.
+    void cast_ray(cast_result &result, const ray &the_ray) {
+      clear_result(result);
+      update_world_transforms();
+      update_instance_bvh();
+
+      float t_max = 1.0f;
+      instance_tester tester(this, &the_ray, &result, false);
+      instance_bvh.cast(the_ray.get_start(), the_ray.get_distance(), t_max, tester, false);
+    }
+
+    // true if anything at all is on the ray, eg. for shadow or line of sight tests.
+    bool cast_ray_any(const ray &the_ray) {
+      update_world_transforms();
+      update_instance_bvh();
+
+      cast_result result;
+      clear_result(result);
+      float t_max = 1.0f;
+      instance_tester tester(this, &the_ray, &result, true);
+      return instance_bvh.cast(the_ray.get_start(), the_ray.get_distance(), t_max, tester, true);
+    }
+
+    // cast many rays, eg. for a tool sampling the scene.
+    // rays close together in the array should be close together in space.
+    // returns the number of rays that hit something.
+    unsigned cast_rays(cast_result *results, const ray *rays, unsigned num_rays) {
+      update_world_transforms();
+      update_instance_bvh();
+
+      unsigned num_hits = 0;
+      for (unsigned first = 0; first < num_rays; first += bvh::max_packet) {
+        unsigned n = num_rays - first < bvh::max_packet ? num_rays - first : bvh::max_packet;
+        vec3 origins[bvh::max_packet];
+        vec3 distances[bvh::max_packet];
+        float t_max[bvh::max_packet];
+        for (unsigned r = 0; r != n; ++r) {
+          clear_result(results[first + r]);
+          origins[r] = rays[first + r].get_start();
+          distances[r] = rays[first + r].get_distance();
+          t_max[r] = 1.0f;
+        }
+        instance_tester tester(this, rays + first, results + first, false);
+        unsigned mask = instance_bvh.cast_packet(origins, distances, t_max, n, tester, false);
+        for (; mask; mask &= mask - 1) {
+          num_hits++;
         }
       }
+      return num_hits;
     }
 
     // add a new line in world space (old ones will be lost)
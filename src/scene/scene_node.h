@@ -6,6 +6,12 @@
 //
 // Scene Node
 //
+// Each node caches its nodeToWorld matrix. Writes through access_nodeToParent()
+// or an animation mark the node and everything below it dirty, and the matrix
+// is worked out again the next time it is asked for, or by a scene's
+// update_world_transforms() pass. Take the access_nodeToParent() reference
+// when you write, rather than keeping it, so the node knows it has moved.
+//
 
 namespace octet {
   class scene_node : public resource {
@@ -19,18 +25,53 @@ namespace octet {
     // array of relative transforms (indexed by scene_node index)
     mat4t nodeToParent;
 
+    // nodeToParent * parent's nodeToWorld, good when world_dirty is false
+    mat4t nodeToWorld;
+
+    // if a node is dirty, so are all the nodes below it
+    bool world_dirty;
+
     // sid used to target animations
     atom_t sid;
+
+    // bumped by add_child so that flattened copies of the tree know to rebuild
+    static unsigned &hierarchy_version() {
+      static unsigned value;
+      return value;
+    }
+
+    // bumped when a node moves, so that caches of world positions know to update
+    static unsigned &transform_version() {
+      static unsigned value;
+      return value;
+    }
+
+    // a node that is already dirty has a dirty subtree, so stop there
+    void mark_dirty() {
+      if (!world_dirty) {
+        set_dirty();
+      }
+    }
+
+    void set_dirty() {
+      world_dirty = true;
+      transform_version()++;
+      for (int i = 0; i != children.size(); ++i) {
+        children[i]->mark_dirty();
+      }
+    }
   public:
     RESOURCE_META(scene_node)
 
     scene_node() {
       nodeToParent.loadIdentity();
+      world_dirty = true;
       sid = atom_;
     }
 
     scene_node(const mat4t &nodeToParent, atom_t sid) {
       this->nodeToParent = nodeToParent;
+      world_dirty = true;
       this->sid = sid;
     }
 
@@ -48,6 +89,7 @@ namespace octet {
     void set_value(atom_t sid, atom_t sub_target, atom_t component, float *value) {
       if (sub_target == atom_transform) {
         nodeToParent.init_transpose(value);
+        mark_dirty();
       }
     }
 
@@ -62,11 +104,14 @@ namespace octet {
       app_utils::log("visit scene_node nodeToParent\n");
       v.visit(nodeToParent, atom_nodeToParent);
       v.visit(sid, atom_sid);
+      set_dirty();
     }
 
     void add_child(scene_node *new_node) {
       new_node->parent = this;
       children.push_back(new_node);
+      new_node->set_dirty();
+      hierarchy_version()++;
     }
 
     scene_node *get_parent() {
@@ -81,20 +126,49 @@ namespace octet {
       return children[index];
     }
 
-    // compute the scene_node to world matrix for an individual scene_node;
-    mat4t calcModelToWorld() {
-      mat4t result = nodeToParent;
-      for (scene_node *p = parent; p != NULL; p = p->parent) {
-        result = result * p->nodeToParent;
+    // the scene_node to world matrix for an individual scene_node.
+    // only the dirty nodes on the way up to the root are worked out.
+    const mat4t &calcModelToWorld() {
+      if (world_dirty) {
+        if (parent) {
+          nodeToWorld = nodeToParent * parent->calcModelToWorld();
+        } else {
+          nodeToWorld = nodeToParent;
+        }
+        world_dirty = false;
+      }
+      return nodeToWorld;
+    }
+
+    // parent_node is this node's parent, already up to date.
+    // for passes over a flattened tree that visit parents first.
+    void update_world_transform(scene_node *parent_node) {
+      if (world_dirty) {
+        nodeToWorld = nodeToParent * parent_node->nodeToWorld;
+        world_dirty = false;
       }
-      return result;
+    }
+
+    bool is_world_dirty() const {
+      return world_dirty;
+    }
+
+    static unsigned get_hierarchy_version() {
+      return hierarchy_version();
+    }
+
+    // changes whenever any node has been moved
+    static unsigned get_transform_version() {
+      return transform_version();
     }
 
     const mat4t &get_nodeToParent() const {
       return nodeToParent;
     }
 
+    // marks this node and the ones below it as moved
     mat4t &access_nodeToParent() {
+      mark_dirty();
       return nodeToParent;
     }
 
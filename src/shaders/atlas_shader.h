@@ -0,0 +1,71 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Andy Thomason 2012, 2013
+//
+// Modular Framework for OpenGLES2 rendering on multiple platforms.
+//
+// Single texture shader for images in a texture_atlas.
+//
+// uvs are in 0..1 over the image and are mapped into its rectangle in the atlas.
+// Wrapped images repeat by taking the fraction of the uv, others are clamped.
+
+namespace octet {
+  class atlas_shader : public shader {
+    // indices to use with glUniform*()
+
+    // index for model space to projection space matrix
+    GLuint modelToProjectionIndex_;
+
+    // index for texture sampler
+    GLuint samplerIndex_;
+
+    // index for the image rectangle in the atlas
+    GLuint uvRectIndex_;
+
+    // index for the wrap flag
+    GLuint uvWrapIndex_;
+  public:
+    void init() {
+      const char vertex_shader[] = SHADER_STR(
+        varying vec2 uv_;
+
+        attribute vec4 pos;
+        attribute vec2 uv;
+
+        uniform mat4 modelToProjection;
+
+        void main() { gl_Position = modelToProjection * pos; uv_ = uv; }
+      );
+
+      const char fragment_shader[] = SHADER_STR(
+        varying vec2 uv_;
+        uniform sampler2D sampler;
+        uniform vec4 uv_rect;
+        uniform float uv_wrap;
+        void main() {
+          vec2 uv = mix(clamp(uv_, 0.0, 1.0), fract(uv_), uv_wrap);
+          gl_FragColor = texture2D(sampler, uv_rect.xy + uv * uv_rect.zw);
+        }
+      );
+
+      shader::init(vertex_shader, fragment_shader);
+
+      modelToProjectionIndex_ = glGetUniformLocation(program(), "modelToProjection");
+      samplerIndex_ = glGetUniformLocation(program(), "sampler");
+      uvRectIndex_ = glGetUniformLocation(program(), "uv_rect");
+      uvWrapIndex_ = glGetUniformLocation(program(), "uv_wrap");
+    }
+
+    // uv_rect is from texture_atlas::get_uv_rect()
+    void render(const mat4t &modelToProjection, int sampler, const vec4 &uv_rect, bool wrap) {
+      // tell openGL to use the program
+      shader::render();
+
+      // customize the program with uniforms
+      glUniform1i(samplerIndex_, sampler);
+      glUniformMatrix4fv(modelToProjectionIndex_, 1, GL_FALSE, modelToProjection.get());
+      glUniform4fv(uvRectIndex_, 1, uv_rect.get());
+      glUniform1f(uvWrapIndex_, wrap ? 1.0f : 0.0f);
+    }
+  };
+}
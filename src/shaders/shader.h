@@ -60,7 +60,7 @@ namespace octet {
   
     // use the program we have compiled in init()
     void render() {
-      glUseProgram(program_);
+      gl_state::use_program(program_);
     }
   };
 